@@ -0,0 +1,149 @@
+#include "./AsyncDispatch.h"
+
+#include <algorithm>
+#include <chrono>
+
+inline int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::ostream& operator<<(std::ostream& os, const DispatchStats& s) {  // NOLINT
+  return os << "queued=" << s.queued << " delivered=" << s.delivered << " dropped=" << s.dropped
+            << " blocked=" << s.blocked << " maxQueued=" << s.maxQueued
+            << " latency(mean/max us)=" << s.meanLatencyMicros() << "/" << s.latencyMaxNs * 1.0E-3;
+}
+
+void SharedFrame::deliver(KinectOneListener* listener) const {
+  switch (kind) {
+    case Kind_Skeleton:
+      listener->onSkeleton(&skeleton);
+      break;
+    case Kind_Color:
+      listener->onColor(time, static_cast<UINT>(color.size()), reinterpret_cast<const RGBQUAD*>(color.data()));
+      break;
+    case Kind_DepthAndBodyIndex:
+      listener->onDepthAndBodyIndex(time, static_cast<UINT>(depth.size()), depth.data(),
+                                    static_cast<UINT>(bodyIndex.size()), bodyIndex.data());
+      break;
+  }
+}
+
+SharedFrame* SharedFramePool::acquire() {
+  SharedFrame* frame;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_free.empty()) {
+      m_frames.emplace_back(new SharedFrame());
+      frame = m_frames.back().get();
+      frame->m_pPool = this;
+    } else {
+      frame = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  frame->m_refs.store(1, std::memory_order_relaxed);
+  return frame;
+}
+
+void SharedFramePool::release(SharedFrame* frame) {
+  // The last holder returns the frame; acq_rel orders every holder's reads before its reuse
+  if (frame->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+  SharedFramePool* pool = frame->m_pPool;
+  std::lock_guard<std::mutex> lock(pool->m_mutex);
+  pool->m_free.push_back(frame);
+}
+
+size_t SharedFramePool::numAllocated() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frames.size();
+}
+
+AsyncListener::AsyncListener(KinectOneListener* listener, const DispatchOptions& opts)
+  : m_pListener(listener)
+  , m_opts(std::max<size_t>(opts.queueSize, 1), opts.overflow)
+  , m_ring(m_opts.queueSize)
+  , m_head(0)
+  , m_count(0)
+  , m_busy(false)
+  , m_stopping(false) {
+  m_worker = std::thread(&AsyncListener::workLoop, this);
+}
+
+AsyncListener::~AsyncListener() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_notEmpty.notify_one();
+  m_notFull.notify_all();
+  if (m_worker.joinable()) { m_worker.join(); }
+}
+
+bool AsyncListener::push(SharedFrame* frame) {
+  SharedFrame* evicted = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_count == m_ring.size()) {
+      if (m_opts.overflow == Overflow_DropNewest) {
+        ++m_stats.dropped;
+        return false;
+      } else if (m_opts.overflow == Overflow_DropOldest) {
+        evicted = m_ring[m_head].frame;
+        m_head = (m_head + 1) % m_ring.size();
+        --m_count;
+        ++m_stats.dropped;
+      } else {
+        ++m_stats.blocked;
+        m_notFull.wait(lock, [this] { return m_count < m_ring.size() || m_stopping; });
+        if (m_stopping) { return false; }
+      }
+    }
+    SharedFramePool::addRef(frame);
+    Entry& e = m_ring[(m_head + m_count) % m_ring.size()];
+    e.frame = frame;
+    e.queuedNs = nowNs();
+    ++m_count;
+    ++m_stats.queued;
+    m_stats.maxQueued = std::max<uint64_t>(m_stats.maxQueued, m_count);
+  }
+  m_notEmpty.notify_one();
+  if (evicted != nullptr) { SharedFramePool::release(evicted); }
+  return true;
+}
+
+void AsyncListener::drain() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_count == 0 && !m_busy; });
+}
+
+DispatchStats AsyncListener::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void AsyncListener::workLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_notEmpty.wait(lock, [this] { return m_count > 0 || m_stopping; });
+    if (m_count == 0) { break; }  // Stopping with nothing left to deliver
+    const Entry e = m_ring[m_head];
+    m_head = (m_head + 1) % m_ring.size();
+    --m_count;
+    m_busy = true;
+    const uint64_t latency = std::max<int64_t>(0, nowNs() - e.queuedNs);
+    m_stats.latencySumNs += latency;
+    m_stats.latencyMaxNs = std::max(m_stats.latencyMaxNs, latency);
+    lock.unlock();
+    m_notFull.notify_one();
+
+    e.frame->deliver(m_pListener);
+    SharedFramePool::release(e.frame);
+
+    lock.lock();
+    m_busy = false;
+    ++m_stats.delivered;
+    if (m_count == 0) { m_idle.notify_all(); }
+  }
+  m_idle.notify_all();
+}
@@ -0,0 +1,151 @@
+#ifndef KINECTONETRACKER_ASYNCDISPATCH_H_
+#define KINECTONETRACKER_ASYNCDISPATCH_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./KinectTypes.h"
+#include "./Recording.h"
+
+// Asynchronous delivery of frames to KinectOneListeners (see KinectOneTracker::setAsyncDispatch()). The tracker
+// thread copies each frame once into a pooled, reference counted SharedFrame and queues a reference with every
+// asynchronous listener of its stream. Each listener has its own bounded queue and worker thread calling it, so a
+// slow listener only delays (or drops) its own frames.
+
+//! What an asynchronous listener's queue does with a new frame when it is full
+enum OverflowPolicy {
+  Overflow_Block,       // The tracker thread waits for room, as with synchronous dispatch
+  Overflow_DropNewest,  // The new frame is dropped
+  Overflow_DropOldest   // The oldest queued frame is dropped to make room
+};
+
+//! Queue settings of an asynchronous listener
+struct DispatchOptions {
+  size_t queueSize;
+  OverflowPolicy overflow;
+
+  explicit DispatchOptions(const size_t size = 8, const OverflowPolicy policy = Overflow_DropOldest)
+    : queueSize(size), overflow(policy) { }
+};
+
+//! Counters of an asynchronous listener's queue
+struct DispatchStats {
+  uint64_t queued;         // Frames queued
+  uint64_t delivered;      // Frames delivered to the listener
+  uint64_t dropped;        // Frames dropped because the queue was full
+  uint64_t blocked;        // Times the tracker thread waited for room (Overflow_Block)
+  uint64_t maxQueued;      // Largest number of frames waiting in the queue
+  uint64_t latencySumNs;   // Sum of delays from queueing to delivery
+  uint64_t latencyMaxNs;   // Maximum delay from queueing to delivery
+
+  DispatchStats() : queued(0), delivered(0), dropped(0), blocked(0), maxQueued(0), latencySumNs(0),
+                    latencyMaxNs(0) { }
+  double meanLatencyMicros() const { return delivered ? latencySumNs * 1.0E-3 / delivered : 0.0; }
+};
+
+std::ostream& operator<<(std::ostream& os, const DispatchStats& s);  // NOLINT
+
+class SharedFramePool;
+
+//! Frame copied once from the source and shared by reference between listener queues. Returned to its pool when
+//! the last reference is released
+struct SharedFrame {
+  enum Kind {
+    Kind_Skeleton,
+    Kind_Color,
+    Kind_DepthAndBodyIndex
+  };
+
+  Kind kind;
+  INT64 time;
+  Skeleton skeleton;
+  std::vector<BYTE> color;
+  std::vector<UINT16> depth;
+  std::vector<BYTE> bodyIndex;
+
+  //! Calls the listener method for this frame's kind
+  void deliver(KinectOneListener* listener) const;
+
+ private:
+  friend class SharedFramePool;
+  std::atomic<int> m_refs;
+  SharedFramePool* m_pPool;
+};
+
+//! Recycles SharedFrames, so that once enough frames are in flight nothing is allocated. Frames keep their buffers
+//! between uses. Must outlive all references to its frames
+class SharedFramePool {
+ public:
+  SharedFramePool() { }
+
+  //! Returns a free frame holding one reference, allocating one if none is free
+  SharedFrame* acquire();
+
+  static void addRef(SharedFrame* frame) { frame->m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+  //! Drops a reference, returning the frame to its pool with the last one
+  static void release(SharedFrame* frame);
+
+  //! Number of frames allocated so far
+  size_t numAllocated() const;
+
+ private:
+  SharedFramePool(const SharedFramePool&);
+  SharedFramePool& operator=(const SharedFramePool&);
+
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<SharedFrame>> m_frames;
+  std::vector<SharedFrame*> m_free;
+};
+
+//! Delivers SharedFrames to a listener on its own worker thread through a bounded FIFO queue
+class AsyncListener {
+ public:
+  AsyncListener(KinectOneListener* listener, const DispatchOptions& opts);
+  //! Delivers frames still queued, then stops the worker
+  ~AsyncListener();
+
+  //! Queues a reference to frame, applying the overflow policy if the queue is full. Returns false if the frame
+  //! was dropped
+  bool push(SharedFrame* frame);
+
+  //! Waits until all queued frames have been delivered
+  void drain();
+
+  KinectOneListener* listener() const { return m_pListener; }
+  const DispatchOptions& options() const { return m_opts; }
+  //! Snapshot of counters
+  DispatchStats stats() const;
+
+ private:
+  AsyncListener(const AsyncListener&);
+  AsyncListener& operator=(const AsyncListener&);
+
+  struct Entry {
+    SharedFrame* frame;
+    int64_t queuedNs;
+  };
+
+  void workLoop();
+
+  KinectOneListener* const m_pListener;
+  const DispatchOptions m_opts;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_notEmpty, m_notFull, m_idle;
+  // Ring buffer of queued frames
+  std::vector<Entry> m_ring;
+  size_t m_head, m_count;
+  bool m_busy;
+  bool m_stopping;
+  DispatchStats m_stats;
+  std::thread m_worker;
+};
+
+#endif  // KINECTONETRACKER_ASYNCDISPATCH_H_
@@ -0,0 +1,40 @@
+#ifndef KINECTONETRACKER_BENCHMARK_H_
+#define KINECTONETRACKER_BENCHMARK_H_
+
+#include <chrono>
+#include <streambuf>
+
+//! Wall-clock stopwatch for benchmarks
+class Stopwatch {
+ public:
+  Stopwatch() : m_start(std::chrono::steady_clock::now()) { }
+  void restart() { m_start = std::chrono::steady_clock::now(); }
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point m_start;
+};
+
+//! Runs f at least minIters times and for at least minSeconds. Returns mean seconds per run
+template <typename F>
+double timeIt(F f, const int minIters = 3, const double minSeconds = 0.5) {
+  f();  // Warm up
+  Stopwatch sw;
+  int iters = 0;
+  while (iters < minIters || sw.seconds() < minSeconds) {
+    f();
+    ++iters;
+  }
+  return sw.seconds() / iters;
+}
+
+//! Stream buffer that discards everything written to it, for measuring serialization without I/O
+class NullStreamBuf : public std::streambuf {
+ protected:
+  int overflow(int c) { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+#endif  // KINECTONETRACKER_BENCHMARK_H_
@@ -0,0 +1,111 @@
+#ifndef KINECTONETRACKER_BITSTREAM_H_
+#define KINECTONETRACKER_BITSTREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bit-level I/O and integer mappings shared by the entropy coders (DepthCodec.h, SkeletonCodec.h)
+
+//! Index of lowest set bit of a nonzero x
+inline int lowestSetBit(const uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward64(&i, x);
+  return static_cast<int>(i);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+//! LSB-first bit writer into a buffer large enough for everything written
+class BitWriter {
+ public:
+  explicit BitWriter(uint8_t* out) : m_out(out), m_p(out), m_acc(0), m_numBits(0) { }
+  //! Writes the low n <= 32 bits of v
+  void put(const uint32_t v, const int n) {
+    m_acc |= static_cast<uint64_t>(v) << m_numBits;
+    m_numBits += n;
+    if (m_numBits >= 32) {
+      const uint32_t w = static_cast<uint32_t>(m_acc);
+      memcpy(m_p, &w, 4);
+      m_p += 4;
+      m_acc >>= 32;
+      m_numBits -= 32;
+    }
+  }
+  //! Writes pending bits, padding the last byte with zeros. Returns number of bytes written
+  size_t finish() {
+    while (m_numBits > 0) {
+      *m_p++ = static_cast<uint8_t>(m_acc);
+      m_acc >>= 8;
+      m_numBits -= 8;
+    }
+    m_numBits = 0;
+    return m_p - m_out;
+  }
+
+ private:
+  uint8_t* m_out;
+  uint8_t* m_p;
+  uint64_t m_acc;
+  int m_numBits;
+};
+
+//! LSB-first bit reader. Reading past the end yields zero bits and sets overrun()
+class BitReader {
+ public:
+  BitReader(const uint8_t* in, const size_t size) : m_p(in), m_end(in + size), m_acc(0), m_numBits(0), m_pad(0) {
+    refill();
+  }
+  //! Returns at least 32 upcoming bits without consuming them
+  uint64_t peek() const { return m_acc; }
+  void skip(const int n) {
+    m_acc >>= n;
+    m_numBits -= n;
+    if (m_numBits < 32) { refill(); }
+  }
+  uint32_t get(const int n) {
+    const uint32_t v = static_cast<uint32_t>(m_acc & ((1ull << n) - 1));
+    skip(n);
+    return v;
+  }
+  bool overrun() const { return m_numBits < 8 * m_pad; }
+
+ private:
+  void refill() {
+    if (m_end - m_p >= 8) {
+      // Load 8 bytes (little-endian) and keep the whole bytes that fit
+      uint64_t w;
+      memcpy(&w, m_p, 8);
+      m_acc |= w << m_numBits;
+      m_p += (63 - m_numBits) >> 3;
+      m_numBits |= 56;
+      return;
+    }
+    while (m_numBits <= 56) {
+      if (m_p < m_end) {
+        m_acc |= static_cast<uint64_t>(*m_p++) << m_numBits;
+      } else {
+        ++m_pad;
+      }
+      m_numBits += 8;
+    }
+  }
+
+  const uint8_t* m_p;
+  const uint8_t* m_end;
+  uint64_t m_acc;
+  int m_numBits;
+  int m_pad;  // Zero bytes appended past the end
+};
+
+//! Maps signed e to unsigned 0, -1, 1, -2, ... -> 0, 1, 2, 3, ... so that small magnitudes get small codes
+inline uint32_t zigzag(const int e) { return (static_cast<uint32_t>(e) << 1) ^ static_cast<uint32_t>(e >> 31); }
+inline int unzigzag(const uint32_t v) { return static_cast<int>(v >> 1) ^ -static_cast<int>(v & 1); }
+
+#endif  // KINECTONETRACKER_BITSTREAM_H_
@@ -0,0 +1,325 @@
+#include "./ColorConvert.h"
+#include "./Simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+// BT.601 limited-range coefficients in 14-bit fixed point. The kernels work on sums over 2x2 blocks: Ysum is the
+// sum of 4 Y samples and U', V' are the sums of 2 chroma samples minus 256, so the Y coefficient is divided by 4
+// and the chroma ones by 2. With kBias folding in rounding and the Y offset of 16:
+//   B = (Ysum * kCY + U' * kCUB + kBias) >> 14
+//   G = (Ysum * kCY - U' * kCUG - V' * kCVG + kBias) >> 14
+//   R = (Ysum * kCY + V' * kCVR + kBias) >> 14
+static const int kShift = 14;
+static const int kCY  = 4768;    // 1.164 * 2^14 / 4
+static const int kCUB = 16531;   // 2.018 * 2^14 / 2
+static const int kCUG = 3203;    // 0.391 * 2^14 / 2
+static const int kCVG = 6660;    // 0.813 * 2^14 / 2
+static const int kCVR = 13074;   // 1.596 * 2^14 / 2
+static const int kBias = (1 << (kShift - 1)) - 64 * kCY;
+
+inline uint8_t clampToByte(const int x) {
+  return static_cast<uint8_t>(std::min(255, std::max(0, x)));
+}
+
+// Converts output pixels [xBegin, xEnd) of one output row from input rows p0 and p1
+inline void convertPixelsScalar(const uint8_t* p0, const uint8_t* p1, uint8_t* out, const int xBegin, const int xEnd) {
+  for (int x = xBegin; x < xEnd; ++x) {
+    const uint8_t* a = p0 + 4 * x;
+    const uint8_t* b = p1 + 4 * x;
+    const int yTerm = (a[0] + a[2] + b[0] + b[2]) * kCY + kBias;
+    const int u = a[1] + b[1] - 256;
+    const int v = a[3] + b[3] - 256;
+    uint8_t* o = out + 3 * x;
+    o[0] = clampToByte((yTerm + u * kCUB) >> kShift);
+    o[1] = clampToByte((yTerm - u * kCUG - v * kCVG) >> kShift);
+    o[2] = clampToByte((yTerm + v * kCVR) >> kShift);
+  }
+}
+
+#ifdef KINECTONETRACKER_HAVE_SSE2
+
+// Integer vector operations overloaded for 128 and 256-bit vectors. All of them work within 128-bit lanes, so the
+// same conversion code runs on SSE registers and, lane by lane, on AVX2 registers
+inline __m128i unpackLo8(const __m128i a) { return _mm_unpacklo_epi8(a, _mm_setzero_si128()); }
+inline __m128i unpackHi8(const __m128i a) { return _mm_unpackhi_epi8(a, _mm_setzero_si128()); }
+inline __m128i add16(const __m128i a, const __m128i b) { return _mm_add_epi16(a, b); }
+inline __m128i sub16(const __m128i a, const __m128i b) { return _mm_sub_epi16(a, b); }
+inline __m128i add32(const __m128i a, const __m128i b) { return _mm_add_epi32(a, b); }
+inline __m128i and128(const __m128i a, const __m128i b) { return _mm_and_si128(a, b); }
+inline __m128i srli32(const __m128i a) { return _mm_srli_epi32(a, 16); }
+inline __m128i srai32(const __m128i a) { return _mm_srai_epi32(a, kShift); }
+inline __m128i packs32(const __m128i a, const __m128i b) { return _mm_packs_epi32(a, b); }
+inline __m128i packus16(const __m128i a, const __m128i b) { return _mm_packus_epi16(a, b); }
+inline __m128i madd(const __m128i a, const __m128i b) { return _mm_madd_epi16(a, b); }
+#ifdef KINECTONETRACKER_HAVE_AVX2
+inline __m256i unpackLo8(const __m256i a) { return _mm256_unpacklo_epi8(a, _mm256_setzero_si256()); }
+inline __m256i unpackHi8(const __m256i a) { return _mm256_unpackhi_epi8(a, _mm256_setzero_si256()); }
+inline __m256i add16(const __m256i a, const __m256i b) { return _mm256_add_epi16(a, b); }
+inline __m256i sub16(const __m256i a, const __m256i b) { return _mm256_sub_epi16(a, b); }
+inline __m256i add32(const __m256i a, const __m256i b) { return _mm256_add_epi32(a, b); }
+inline __m256i and128(const __m256i a, const __m256i b) { return _mm256_and_si256(a, b); }
+inline __m256i srli32(const __m256i a) { return _mm256_srli_epi32(a, 16); }
+inline __m256i srai32(const __m256i a) { return _mm256_srai_epi32(a, kShift); }
+inline __m256i packs32(const __m256i a, const __m256i b) { return _mm256_packs_epi32(a, b); }
+inline __m256i packus16(const __m256i a, const __m256i b) { return _mm256_packus_epi16(a, b); }
+inline __m256i madd(const __m256i a, const __m256i b) { return _mm256_madd_epi16(a, b); }
+#endif
+
+// Broadcast constants for the conversion
+struct ConvertConstants128 {
+  __m128i lowWord, chromaOffset, cy, bias, cB, cG, cR;
+};
+
+inline void makeConstants(ConvertConstants128& k) {  // NOLINT
+  k.lowWord = _mm_set1_epi32(0xffff);
+  k.chromaOffset = _mm_set1_epi16(256);
+  k.cy = _mm_set1_epi16(kCY);
+  k.bias = _mm_set1_epi32(kBias);
+  // Chroma coefficients as (U', V') 16-bit pairs for madd
+  k.cB = _mm_set1_epi32(kCUB & 0xffff);
+  k.cG = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(-kCVG) << 16) | (-kCUG & 0xffff)));
+  k.cR = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(kCVR) << 16));
+}
+#ifdef KINECTONETRACKER_HAVE_AVX2
+struct ConvertConstants256 {
+  __m256i lowWord, chromaOffset, cy, bias, cB, cG, cR;
+};
+
+inline void makeConstants(ConvertConstants256& k) {  // NOLINT
+  ConvertConstants128 k128;
+  makeConstants(k128);
+  k.lowWord = _mm256_broadcastsi128_si256(k128.lowWord);
+  k.chromaOffset = _mm256_broadcastsi128_si256(k128.chromaOffset);
+  k.cy = _mm256_broadcastsi128_si256(k128.cy);
+  k.bias = _mm256_broadcastsi128_si256(k128.bias);
+  k.cB = _mm256_broadcastsi128_si256(k128.cB);
+  k.cG = _mm256_broadcastsi128_si256(k128.cG);
+  k.cR = _mm256_broadcastsi128_si256(k128.cR);
+}
+#endif
+
+// Converts 16 input bytes (4 macropixels: Y0 U Y1 V) from each of two rows into 4 output pixels per 128-bit lane,
+// returned as 32-bit B, G, R values
+template <typename V, typename K>
+inline void convertQuad(const V a, const V b, const K& k, V& outB, V& outG, V& outR) {  // NOLINT
+  // Vertical sums of the two rows as 16-bit values
+  const V lo = add16(unpackLo8(a), unpackLo8(b));
+  const V hi = add16(unpackHi8(a), unpackHi8(b));
+  // Separate Y pairs [Y0 Y1 ...] and chroma pairs [U V ...] of each macropixel
+  const V y = packs32(and128(lo, k.lowWord), and128(hi, k.lowWord));
+  const V uv = sub16(packs32(srli32(lo), srli32(hi)), k.chromaOffset);
+  const V yTerm = add32(madd(y, k.cy), k.bias);
+  outB = srai32(add32(yTerm, madd(uv, k.cB)));
+  outG = srai32(add32(yTerm, madd(uv, k.cG)));
+  outR = srai32(add32(yTerm, madd(uv, k.cR)));
+}
+
+// Converts 64 input bytes per 128-bit lane from each of two rows (a[0..3], b[0..3]) into 16 output pixels per lane
+// as planar B, G, R bytes
+template <typename V, typename K>
+inline void convertBlock(const V* a, const V* b, const K& k, V& outB, V& outG, V& outR) {  // NOLINT
+  V qB[4], qG[4], qR[4];
+  for (int q = 0; q < 4; ++q) { convertQuad(a[q], b[q], k, qB[q], qG[q], qR[q]); }
+  outB = packus16(packs32(qB[0], qB[1]), packs32(qB[2], qB[3]));
+  outG = packus16(packs32(qG[0], qG[1]), packs32(qG[2], qG[3]));
+  outR = packus16(packs32(qR[0], qR[1]), packs32(qR[2], qR[3]));
+}
+
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+// pshufb masks interleaving 16 planar B, G and R bytes into 48 bytes of BGR: output vector v gets byte i of channel c
+// from position mask[v][c][i] (or zero)
+struct InterleaveMasks {
+  alignas(16) int8_t mask[3][3][16];
+  InterleaveMasks() {
+    for (int v = 0; v < 3; ++v) {
+      for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 16; ++i) {
+          const int k = 16 * v + i;
+          mask[v][c][i] = (k % 3 == c) ? static_cast<int8_t>(k / 3) : static_cast<int8_t>(-128);
+        }
+      }
+    }
+  }
+};
+static const InterleaveMasks kInterleaveMasks;
+
+inline void loadMasks(__m128i m[3][3]) {
+  for (int v = 0; v < 3; ++v) {
+    for (int c = 0; c < 3; ++c) {
+      m[v][c] = _mm_load_si128(reinterpret_cast<const __m128i*>(kInterleaveMasks.mask[v][c]));
+    }
+  }
+}
+
+inline __m128i interleave(const __m128i b, const __m128i g, const __m128i r, const __m128i m[3]) {
+  return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, m[0]), _mm_shuffle_epi8(g, m[1])), _mm_shuffle_epi8(r, m[2]));
+}
+#endif
+
+#ifdef KINECTONETRACKER_HAVE_AVX2
+// Converts output pixels of one row 32 at a time. Returns number of pixels converted
+inline int convertRowAVX2(const uint8_t* p0, const uint8_t* p1, uint8_t* out, const int outWidth) {
+  ConvertConstants256 k;
+  makeConstants(k);
+  __m128i m128[3][3];
+  loadMasks(m128);
+  __m256i m[3][3];
+  for (int v = 0; v < 3; ++v) {
+    for (int c = 0; c < 3; ++c) { m[v][c] = _mm256_broadcastsi128_si256(m128[v][c]); }
+  }
+  int x = 0;
+  for (; x + 32 <= outWidth; x += 32) {
+    // Regroup 128 input bytes per row so that the low lanes hold bytes 0-63 and the high lanes bytes 64-127
+    __m256i a[4], b[4];
+    const __m256i* s0 = reinterpret_cast<const __m256i*>(p0 + 4 * x);
+    const __m256i* s1 = reinterpret_cast<const __m256i*>(p1 + 4 * x);
+    const __m256i a0 = _mm256_loadu_si256(s0), a1 = _mm256_loadu_si256(s0 + 1);
+    const __m256i a2 = _mm256_loadu_si256(s0 + 2), a3 = _mm256_loadu_si256(s0 + 3);
+    const __m256i b0 = _mm256_loadu_si256(s1), b1 = _mm256_loadu_si256(s1 + 1);
+    const __m256i b2 = _mm256_loadu_si256(s1 + 2), b3 = _mm256_loadu_si256(s1 + 3);
+    a[0] = _mm256_permute2x128_si256(a0, a2, 0x20);  a[1] = _mm256_permute2x128_si256(a0, a2, 0x31);
+    a[2] = _mm256_permute2x128_si256(a1, a3, 0x20);  a[3] = _mm256_permute2x128_si256(a1, a3, 0x31);
+    b[0] = _mm256_permute2x128_si256(b0, b2, 0x20);  b[1] = _mm256_permute2x128_si256(b0, b2, 0x31);
+    b[2] = _mm256_permute2x128_si256(b1, b3, 0x20);  b[3] = _mm256_permute2x128_si256(b1, b3, 0x31);
+    __m256i vb, vg, vr;
+    convertBlock(a, b, k, vb, vg, vr);
+    // Interleave within lanes (low lanes: output bytes 0-47, high lanes: 48-95), then store in order
+    __m256i o[3];
+    for (int v = 0; v < 3; ++v) {
+      o[v] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(vb, m[v][0]), _mm256_shuffle_epi8(vg, m[v][1])),
+                             _mm256_shuffle_epi8(vr, m[v][2]));
+    }
+    __m256i* d = reinterpret_cast<__m256i*>(out + 3 * x);
+    _mm256_storeu_si256(d, _mm256_permute2x128_si256(o[0], o[1], 0x20));
+    _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(o[2], o[0], 0x30));
+    _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(o[1], o[2], 0x31));
+  }
+  return x;
+}
+#endif
+
+// Converts output pixels of one row 16 at a time. Returns number of pixels converted
+inline int convertRowSSE(const uint8_t* p0, const uint8_t* p1, uint8_t* out, const int outWidth) {
+  ConvertConstants128 k;
+  makeConstants(k);
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+  __m128i m[3][3];
+  loadMasks(m);
+#endif
+  int x = 0;
+  for (; x + 16 <= outWidth; x += 16) {
+    __m128i a[4], b[4];
+    for (int q = 0; q < 4; ++q) {
+      a[q] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p0 + 4 * x) + q);
+      b[q] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + 4 * x) + q);
+    }
+    __m128i vb, vg, vr;
+    convertBlock(a, b, k, vb, vg, vr);
+    __m128i* d = reinterpret_cast<__m128i*>(out + 3 * x);
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+    for (int v = 0; v < 3; ++v) { _mm_storeu_si128(d + v, interleave(vb, vg, vr, m[v])); }
+#else
+    // No byte shuffles in SSE2: interleave through memory
+    alignas(16) uint8_t planes[3][16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(planes[0]), vb);
+    _mm_store_si128(reinterpret_cast<__m128i*>(planes[1]), vg);
+    _mm_store_si128(reinterpret_cast<__m128i*>(planes[2]), vr);
+    uint8_t* o = reinterpret_cast<uint8_t*>(d);
+    for (int i = 0; i < 16; ++i) {
+      o[3 * i] = planes[0][i];
+      o[3 * i + 1] = planes[1][i];
+      o[3 * i + 2] = planes[2][i];
+    }
+#endif
+  }
+  return x;
+}
+
+#endif  // KINECTONETRACKER_HAVE_SSE2
+
+void yuy2ToBgrHalfRows(const uint8_t* src, const size_t srcStep, uint8_t* dst, const size_t dstStep,
+                       const int outWidth, const int rowBegin, const int rowEnd, const bool simd) {
+  for (int r = rowBegin; r < rowEnd; ++r) {
+    const uint8_t* p0 = src + 2 * r * srcStep;
+    const uint8_t* p1 = p0 + srcStep;
+    uint8_t* out = dst + r * dstStep;
+    int x = 0;
+    if (simd) {
+#if defined(KINECTONETRACKER_HAVE_AVX2)
+      x = convertRowAVX2(p0, p1, out, outWidth);
+#endif
+#if defined(KINECTONETRACKER_HAVE_SSE2)
+      x += convertRowSSE(p0 + 4 * x, p1 + 4 * x, out + 3 * x, outWidth - x);
+#endif
+    }
+    convertPixelsScalar(p0, p1, out, x, outWidth);
+  }
+}
+
+void yuy2GatherToBgr(const uint8_t* src, const int32_t* pixels, const int n, uint8_t* dst) {
+  // Single samples are scaled to the 2x2 block sums the coefficients are defined for: 4 Y, 2 U and 2 V
+  for (int k = 0; k < n; ++k) {
+    const int32_t i = pixels[k];
+    uint8_t* o = dst + 3 * k;
+    if (i < 0) {
+      o[0] = o[1] = o[2] = 0;
+      continue;
+    }
+    const uint8_t* pair = src + 4 * (i >> 1);
+    const int yTerm = 4 * src[2 * i] * kCY + kBias;
+    const int u = 2 * pair[1] - 256;
+    const int v = 2 * pair[3] - 256;
+    o[0] = clampToByte((yTerm + u * kCUB) >> kShift);
+    o[1] = clampToByte((yTerm - u * kCUG - v * kCVG) >> kShift);
+    o[2] = clampToByte((yTerm + v * kCVR) >> kShift);
+  }
+}
+
+// Row-parallel conversion body
+class Yuy2ToBgrHalfBody : public cv::ParallelLoopBody {
+ public:
+  Yuy2ToBgrHalfBody(const cv::Mat& yuy2, cv::Mat& bgr) : m_yuy2(yuy2), m_bgr(bgr) { }  // NOLINT
+  void operator()(const cv::Range& range) const {
+    yuy2ToBgrHalfRows(m_yuy2.data, m_yuy2.step, m_bgr.data, m_bgr.step, m_bgr.cols, range.start, range.end);
+  }
+
+ private:
+  const cv::Mat& m_yuy2;
+  cv::Mat& m_bgr;
+};
+
+void yuy2ToBgrHalf(const cv::Mat& yuy2, cv::Mat& bgr, const bool parallel) {  // NOLINT
+  if (yuy2.type() != CV_8UC2 || (yuy2.cols % 2) != 0) {
+    cerr << "yuy2ToBgrHalf: expected CV_8UC2 image of even width" << endl;
+    return;
+  }
+  bgr.create(yuy2.rows / 2, yuy2.cols / 2, CV_8UC3);
+  if (parallel) {
+    cv::parallel_for_(cv::Range(0, bgr.rows), Yuy2ToBgrHalfBody(yuy2, bgr));
+  } else {
+    yuy2ToBgrHalfRows(yuy2.data, yuy2.step, bgr.data, bgr.step, bgr.cols, 0, bgr.rows);
+  }
+}
+
+void bgrToYuy2Double(const uint8_t* src, const size_t srcStep, const int width, const int height, uint8_t* dst,
+                     const size_t dstStep) {
+  // BT.601 limited-range RGB -> YUV in 8-bit fixed point, the inverse of the coefficients above
+  for (int r = 0; r < height; ++r) {
+    const uint8_t* in = src + r * srcStep;
+    uint8_t* out0 = dst + 2 * r * dstStep;
+    uint8_t* out1 = out0 + dstStep;
+    for (int x = 0; x < width; ++x, in += 3) {
+      const int b = in[0], g = in[1], rr = in[2];
+      const uint8_t y = static_cast<uint8_t>(((66 * rr + 129 * g + 25 * b + 128) >> 8) + 16);
+      const uint8_t u = static_cast<uint8_t>(((-38 * rr - 74 * g + 112 * b + 128) >> 8) + 128);
+      const uint8_t v = static_cast<uint8_t>(((112 * rr - 94 * g - 18 * b + 128) >> 8) + 128);
+      const uint8_t quad[4] = { y, u, y, v };
+      memcpy(out0 + 4 * x, quad, 4);
+      memcpy(out1 + 4 * x, quad, 4);
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef KINECTONETRACKER_COLORCONVERT_H_
+#define KINECTONETRACKER_COLORCONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+// Fused YUY2 -> BGR conversion and 2x downscale of color frames. Each output pixel is converted from the average
+// of a 2x2 block of input pixels (four Y samples and the two U/V pairs covering them), so only a quarter of the
+// pixels go through color conversion and no full-resolution BGR image is ever written. Conversion uses the same
+// BT.601 limited-range coefficients as cv::COLOR_YUV2BGR_YUY2, in 14-bit fixed point. The SIMD paths (AVX2, SSSE3,
+// SSE2, see Simd.h) and the scalar path produce identical output.
+
+//! Converts output rows [rowBegin, rowEnd) of a YUY2 image to half-resolution BGR. src points to the YUY2 image
+//! (2 bytes per pixel, srcStep bytes per row), dst to the BGR output (3 bytes per pixel, dstStep bytes per row) of
+//! outWidth pixels per row; output row r is computed from input rows 2r and 2r+1. With simd false, the scalar
+//! reference path is used
+void yuy2ToBgrHalfRows(const uint8_t* src, const size_t srcStep, uint8_t* dst, const size_t dstStep,
+                       const int outWidth, const int rowBegin, const int rowEnd, const bool simd = true);
+
+//! Converts YUY2 image (CV_8UC2) into half-resolution BGR image bgr (CV_8UC3, allocated if needed). With parallel,
+//! rows are split across OpenCV's thread pool
+void yuy2ToBgrHalf(const cv::Mat& yuy2, cv::Mat& bgr, const bool parallel = false);  // NOLINT
+
+//! Converts the pixels at indices pixels[0, n) of a contiguous YUY2 image (2 bytes per pixel, even width) to BGR
+//! written to dst (3 bytes per pixel), each from its own Y sample and the U/V pair it shares with its neighbour.
+//! Negative indices give black pixels. Used to sample color at scattered pixels, as in depth registration
+void yuy2GatherToBgr(const uint8_t* src, const int32_t* pixels, const int n, uint8_t* dst);
+
+//! Converts a BGR image of width x height pixels (3 bytes per pixel, srcStep bytes per row) to a YUY2 image of twice
+//! its size (2 bytes per pixel, dstStep bytes per row), each input pixel becoming a 2x2 block of its own Y, U and V.
+//! The inverse of yuy2ToBgrHalf() up to rounding, used to play recorded color video back in the sensor's format
+void bgrToYuy2Double(const uint8_t* src, const size_t srcStep, const int width, const int height, uint8_t* dst,
+                     const size_t dstStep);
+
+#endif  // KINECTONETRACKER_COLORCONVERT_H_
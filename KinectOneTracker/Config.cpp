@@ -0,0 +1,122 @@
+#include "./Config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+//! Returns s without leading and trailing whitespace
+inline string trim(const string& s) {
+  const size_t begin = s.find_first_not_of(" \t\r\n");
+  if (begin == string::npos) { return string(); }
+  const size_t end = s.find_last_not_of(" \t\r\n");
+  return s.substr(begin, end - begin + 1);
+}
+
+bool Config::load(const string& file) {
+  std::ifstream ifs(file.c_str());
+  if (!ifs) {
+    cerr << "Could not open config file " << file << endl;
+    return false;
+  }
+  bool ok = true;
+  string line;
+  for (int lineNo = 1; std::getline(ifs, line); ++lineNo) {
+    line = trim(line);
+    if (line.empty() || line[0] == '#') { continue; }
+    const size_t eq = line.find('=');
+    const string key = (eq == string::npos) ? string() : trim(line.substr(0, eq));
+    if (key.empty()) {
+      cerr << file << ":" << lineNo << ": expected key = value" << endl;
+      ok = false;
+      continue;
+    }
+    set(key, trim(line.substr(eq + 1)));
+  }
+  return ok;
+}
+
+bool Config::parseArgs(const int argc, const char** argv, const int first) {
+  bool ok = true;
+  for (int i = first; i < argc; ++i) {
+    const string arg = argv[i];
+    const size_t eq = arg.find('=');
+    if (eq == string::npos || eq == 0) {
+      cerr << "Expected key=value argument instead of " << arg << endl;
+      ok = false;
+      continue;
+    }
+    set(arg.substr(0, eq), arg.substr(eq + 1));
+  }
+  return ok;
+}
+
+void Config::set(const string& key, const string& value) {
+  m_values[key] = value;
+}
+
+bool Config::has(const string& key) const {
+  return m_values.count(key) > 0;
+}
+
+const string* Config::find(const string& key) const {
+  const auto it = m_values.find(key);
+  if (it == m_values.end()) { return nullptr; }
+  m_read.insert(key);
+  return &it->second;
+}
+
+void Config::warnInvalid(const string& key, const string& value, const char* type) {
+  cerr << "Warning: ignoring " << key << " = " << value << " (expected " << type << ")" << endl;
+}
+
+string Config::getString(const string& key, const string& def) const {
+  const string* value = find(key);
+  return value ? *value : def;
+}
+
+double Config::getDouble(const string& key, const double def) const {
+  const string* value = find(key);
+  if (!value) { return def; }
+  char* end;
+  const double d = strtod(value->c_str(), &end);
+  if (value->empty() || *end != '\0') {
+    warnInvalid(key, *value, "a number");
+    return def;
+  }
+  return d;
+}
+
+int64_t Config::getInt(const string& key, const int64_t def) const {
+  const string* value = find(key);
+  if (!value) { return def; }
+  char* end;
+  const int64_t i = strtoll(value->c_str(), &end, 10);
+  if (value->empty() || *end != '\0') {
+    warnInvalid(key, *value, "an integer");
+    return def;
+  }
+  return i;
+}
+
+bool Config::getBool(const string& key, const bool def) const {
+  const string* value = find(key);
+  if (!value) { return def; }
+  string v = *value;
+  std::transform(v.begin(), v.end(), v.begin(), [] (unsigned char c) { return static_cast<char>(tolower(c)); });
+  if (v == "1" || v == "true" || v == "yes" || v == "on") { return true; }
+  if (v == "0" || v == "false" || v == "no" || v == "off") { return false; }
+  warnInvalid(key, *value, "a boolean");
+  return def;
+}
+
+std::vector<string> Config::unusedKeys() const {
+  std::vector<string> keys;
+  for (const auto& kv : m_values) {
+    if (m_read.count(kv.first) == 0) { keys.push_back(kv.first); }
+  }
+  return keys;
+}
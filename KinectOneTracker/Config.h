@@ -0,0 +1,44 @@
+#ifndef KINECTONETRACKER_CONFIG_H_
+#define KINECTONETRACKER_CONFIG_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+//! Settings as string keys and values, read from "key = value" lines of config files and "key=value" command line
+//! arguments. Later settings override earlier ones, so arguments parsed after a file override it. Blank lines and
+//! lines starting with '#' are ignored. Getters return the given default for keys not set, and warn and return it
+//! for values that do not parse
+class Config {
+ public:
+  //! Reads settings from file. Returns false if it cannot be read or has a line that is not a setting
+  bool load(const std::string& file);
+
+  //! Reads settings from arguments argv[first, argc). Returns false if one is not of the form key=value
+  bool parseArgs(const int argc, const char** argv, const int first = 1);
+
+  void set(const std::string& key, const std::string& value);
+  bool has(const std::string& key) const;
+
+  std::string getString(const std::string& key, const std::string& def) const;
+  double getDouble(const std::string& key, const double def) const;
+  int64_t getInt(const std::string& key, const int64_t def) const;
+  //! Accepts 1/0, true/false, yes/no and on/off
+  bool getBool(const std::string& key, const bool def) const;
+
+  //! Keys that were set but never read, such as misspelled ones
+  std::vector<std::string> unusedKeys() const;
+
+ private:
+  //! Value of key if set (marking it as read)
+  const std::string* find(const std::string& key) const;
+  //! Warns about value of key not parsing as type
+  static void warnInvalid(const std::string& key, const std::string& value, const char* type);
+
+  std::map<std::string, std::string> m_values;
+  mutable std::set<std::string> m_read;
+};
+
+#endif  // KINECTONETRACKER_CONFIG_H_
@@ -0,0 +1,466 @@
+#include "./DepthCodec.h"
+#include "./BitStream.h"
+#include "./SkeletonLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+// Samples per Rice parameter block
+static const int kBlockSize = 32;
+// Bits storing a block's Rice parameter, and the parameter value marking a block of zero residuals
+static const int kParamBits = 5;
+static const uint32_t kZeroBlock = 31;
+// Largest Rice parameter needed: zigzag mapped residuals of 16-bit depth fit in 17 bits
+static const uint32_t kMaxParam = 17;
+static const int kResidualBits = 17;
+// Quotients of kEscapeUnary or more are coded as kEscapeUnary zero bits followed by the raw residual
+static const uint32_t kEscapeUnary = 24;
+
+// LOCO-I median edge detector from left (a), upper (b) and upper-left (c) neighbours, written as the (branchless)
+// median of a, b and a + b - c
+inline int predictMED(const int a, const int b, const int c) {
+  return std::max(std::min(a, b), std::min(std::max(a, b), a + b - c));
+}
+
+// Writes the zigzag mapped prediction residuals of rows [r0, r1) of depth to out in raster order. Encoders have all
+// neighbours up front, so this runs over whole rows, which compilers vectorize
+static void computeResiduals(const UINT16* depth, const int width, const int r0, const int r1, uint32_t* out) {
+  for (int r = r0; r < r1; ++r, out += width) {
+    const UINT16* row = depth + r * width;
+    if (r == r0) {
+      out[0] = zigzag(row[0]);
+      for (int x = 1; x < width; ++x) { out[x] = zigzag(row[x] - row[x - 1]); }
+    } else {
+      const UINT16* above = row - width;
+      out[0] = zigzag(row[0] - above[0]);
+      for (int x = 1; x < width; ++x) { out[x] = zigzag(row[x] - predictMED(row[x - 1], above[x], above[x - 1])); }
+    }
+  }
+}
+
+// Calls f(i, pred) for every pixel of rows [r0, r1) of depth in raster order, where pred is the prediction of pixel
+// i from already decoded pixels of the tile (as in computeResiduals()). f must store pixel i before returning
+template <typename F>
+inline void forEachPrediction(const UINT16* depth, const int width, const int r0, const int r1, F f) {
+  for (int r = r0; r < r1; ++r) {
+    const UINT16* row = depth + r * width;
+    const int rowStart = r * width;
+    if (r == r0) {
+      f(rowStart, 0);
+      for (int x = 1; x < width; ++x) { f(rowStart + x, row[x - 1]); }
+    } else {
+      const UINT16* above = row - width;
+      f(rowStart, above[0]);
+      for (int x = 1; x < width; ++x) { f(rowStart + x, predictMED(row[x - 1], above[x], above[x - 1])); }
+    }
+  }
+}
+
+// Rice codes a block of n mapped residuals
+inline void encodeBlock(const uint32_t* v, const int n, BitWriter& bits) {  // NOLINT
+  uint64_t sum = 0;
+  for (int i = 0; i < n; ++i) { sum += v[i]; }
+  if (sum == 0) {
+    bits.put(kZeroBlock, kParamBits);
+    return;
+  }
+  // Largest k with n * 2^k <= sum, i.e. 2^k close to the mean
+  uint32_t k = 0;
+  while (k < kMaxParam && (static_cast<uint64_t>(n) << (k + 1)) <= sum) { ++k; }
+  bits.put(k, kParamBits);
+  const uint32_t mask = (1u << k) - 1;
+  for (int i = 0; i < n; ++i) {
+    const uint32_t q = v[i] >> k;
+    if (q < kEscapeUnary) {
+      // q zeros, a one, then the low k bits
+      const uint64_t code = (static_cast<uint64_t>(v[i] & mask) << (q + 1)) | (1u << q);
+      if (q + 1 + k <= 32) {
+        bits.put(static_cast<uint32_t>(code), q + 1 + k);
+      } else {
+        bits.put(1u << q, q + 1);
+        bits.put(v[i] & mask, k);
+      }
+    } else {
+      bits.put(0, kEscapeUnary);
+      bits.put(v[i], kResidualBits);
+    }
+  }
+}
+
+// Maximum encoded size of a tile of n pixels
+inline size_t maxTileSize(const size_t n) {
+  const size_t depthBits = n * (kEscapeUnary + kResidualBits) + ((n + kBlockSize - 1) / kBlockSize) * kParamBits;
+  return sizeof(uint32_t) + depthBits / 8 + 8 + 2 * n;
+}
+
+// Encodes rows [r0, r1) into out, which holds at least maxTileSize() bytes, using residuals as scratch for
+// (r1 - r0) * width values. Returns encoded size
+static size_t encodeTile(const UINT16* depth, const BYTE* bodyIndex, const int width, const int r0, const int r1,
+                         uint32_t* residuals, uint8_t* out) {
+  const int n = (r1 - r0) * width;
+  computeResiduals(depth, width, r0, r1, residuals);
+  BitWriter bits(out + sizeof(uint32_t));
+  for (int i = 0; i < n; i += kBlockSize) { encodeBlock(residuals + i, std::min(kBlockSize, n - i), bits); }
+  const uint32_t depthSize = static_cast<uint32_t>(bits.finish());
+  memcpy(out, &depthSize, sizeof(depthSize));
+
+  // Body index runs
+  uint8_t* p = out + sizeof(uint32_t) + depthSize;
+  const BYTE* b = bodyIndex + r0 * width;
+  const BYTE* end = bodyIndex + r1 * width;
+  while (b < end) {
+    const BYTE value = *b;
+    const BYTE* runEnd = b + 1;
+    while (runEnd < end && *runEnd == value) { ++runEnd; }
+    *p++ = value;
+    for (size_t run = runEnd - b - 1; ; run >>= 7) {
+      if (run < 0x80) {
+        *p++ = static_cast<uint8_t>(run);
+        break;
+      }
+      *p++ = static_cast<uint8_t>(run | 0x80);
+    }
+    b = runEnd;
+  }
+  return p - out;
+}
+
+// Decodes rows [r0, r1) from in. Returns false if the tile is malformed
+static bool decodeTile(const uint8_t* in, const size_t size, const int width, const int r0, const int r1,
+                       UINT16* depth, BYTE* bodyIndex) {
+  uint32_t depthSize;
+  if (size < sizeof(depthSize)) { return false; }
+  memcpy(&depthSize, in, sizeof(depthSize));
+  if (depthSize > size - sizeof(depthSize)) { return false; }
+
+  BitReader bits(in + sizeof(depthSize), depthSize);
+  uint32_t k = 0;
+  int remaining = 0;  // Samples left in current block
+  bool ok = true;
+  forEachPrediction(depth, width, r0, r1, [&] (const int i, const int pred) {
+    if (remaining == 0) {
+      k = bits.get(kParamBits);
+      if (k > kMaxParam && k != kZeroBlock) {
+        ok = false;
+        k = 0;
+      }
+      remaining = kBlockSize;
+    }
+    --remaining;
+    uint32_t v = 0;
+    if (k != kZeroBlock) {
+      const uint64_t w = bits.peek();
+      const uint32_t q = (w == 0) ? kEscapeUnary : static_cast<uint32_t>(lowestSetBit(w));
+      if (q < kEscapeUnary && q + 1 + k <= 32) {
+        // Whole code within the 32 available bits
+        v = (q << k) | static_cast<uint32_t>((w >> (q + 1)) & ((1ull << k) - 1));
+        bits.skip(q + 1 + k);
+      } else if (q < kEscapeUnary) {
+        bits.skip(q + 1);
+        v = (q << k) | bits.get(k);
+      } else {
+        bits.skip(kEscapeUnary);
+        v = bits.get(kResidualBits);
+      }
+    }
+    depth[i] = static_cast<UINT16>(pred + unzigzag(v));
+  });
+  if (!ok || bits.overrun()) { return false; }
+
+  const uint8_t* p = in + sizeof(depthSize) + depthSize;
+  const uint8_t* end = in + size;
+  BYTE* b = bodyIndex + r0 * width;
+  BYTE* bEnd = bodyIndex + r1 * width;
+  while (b < bEnd) {
+    if (p >= end) { return false; }
+    const BYTE value = *p++;
+    size_t run = 0;
+    for (int shift = 0; ; shift += 7) {
+      if (p >= end || shift > 28) { return false; }
+      const uint8_t c = *p++;
+      run |= static_cast<size_t>(c & 0x7f) << shift;
+      if (c < 0x80) { break; }
+    }
+    if (run >= static_cast<size_t>(bEnd - b)) { return false; }
+    memset(b, value, run + 1);
+    b += run + 1;
+  }
+  return p == end;
+}
+
+// First row of tile t of numTiles over height rows
+inline int tileRow(const int t, const int numTiles, const int height) {
+  return static_cast<int>(static_cast<int64_t>(t) * height / numTiles);
+}
+
+DepthFrameEncoder::DepthFrameEncoder(const int numTiles)
+  : m_numTiles(std::max(1, numTiles))
+  , m_tiles(m_numTiles)
+  , m_residuals(m_numTiles)
+  , m_tileSizes(m_numTiles) { }
+
+void DepthFrameEncoder::encode(const UINT16* depth, const BYTE* bodyIndex, const int width, const int height,
+                               std::vector<uint8_t>& out, ThreadPool* pool) {  // NOLINT
+  const int numTiles = std::max(1, std::min(m_numTiles, height));
+  const auto encodeOne = [&] (const size_t t) {
+    const int r0 = tileRow(static_cast<int>(t), numTiles, height);
+    const int r1 = tileRow(static_cast<int>(t) + 1, numTiles, height);
+    const size_t n = static_cast<size_t>(r1 - r0) * width;
+    std::vector<uint8_t>& buf = m_tiles[t];
+    if (buf.size() < maxTileSize(n)) { buf.resize(maxTileSize(n)); }
+    std::vector<uint32_t>& residuals = m_residuals[t];
+    if (residuals.size() < n) { residuals.resize(n); }
+    m_tileSizes[t] = encodeTile(depth, bodyIndex, width, r0, r1, residuals.data(), buf.data());
+  };
+  if (pool != nullptr && numTiles > 1) {
+    pool->parallelFor(numTiles, encodeOne);
+  } else {
+    for (int t = 0; t < numTiles; ++t) { encodeOne(t); }
+  }
+
+  size_t total = sizeof(uint32_t) * (1 + numTiles);
+  for (int t = 0; t < numTiles; ++t) { total += m_tileSizes[t]; }
+  out.resize(total);
+  uint8_t* p = out.data();
+  const uint32_t n = numTiles;
+  memcpy(p, &n, sizeof(n));
+  p += sizeof(n);
+  for (int t = 0; t < numTiles; ++t) {
+    const uint32_t tileSize = static_cast<uint32_t>(m_tileSizes[t]);
+    memcpy(p, &tileSize, sizeof(tileSize));
+    p += sizeof(tileSize);
+  }
+  for (int t = 0; t < numTiles; ++t) {
+    memcpy(p, m_tiles[t].data(), m_tileSizes[t]);
+    p += m_tileSizes[t];
+  }
+}
+
+bool decodeDepthFrame(const uint8_t* in, const size_t size, const int width, const int height, UINT16* depth,
+                      BYTE* bodyIndex, ThreadPool* pool) {
+  uint32_t numTiles;
+  if (size < sizeof(numTiles)) { return false; }
+  memcpy(&numTiles, in, sizeof(numTiles));
+  if (numTiles == 0 || numTiles > static_cast<uint32_t>(height) || size < sizeof(uint32_t) * (1 + numTiles)) {
+    return false;
+  }
+  std::vector<size_t> offsets(numTiles + 1);
+  offsets[0] = sizeof(uint32_t) * (1 + numTiles);
+  for (uint32_t t = 0; t < numTiles; ++t) {
+    uint32_t tileSize;
+    memcpy(&tileSize, in + sizeof(uint32_t) * (1 + t), sizeof(tileSize));
+    offsets[t + 1] = offsets[t] + tileSize;
+  }
+  if (offsets[numTiles] != size) { return false; }
+
+  std::atomic<bool> ok(true);
+  const auto decodeOne = [&] (const size_t t) {
+    const int r0 = tileRow(static_cast<int>(t), numTiles, height);
+    const int r1 = tileRow(static_cast<int>(t) + 1, numTiles, height);
+    if (!decodeTile(in + offsets[t], offsets[t + 1] - offsets[t], width, r0, r1, depth, bodyIndex)) { ok = false; }
+  };
+  if (pool != nullptr && numTiles > 1) {
+    pool->parallelFor(numTiles, decodeOne);
+  } else {
+    for (uint32_t t = 0; t < numTiles; ++t) { decodeOne(t); }
+  }
+  return ok;
+}
+
+DepthStreamWriter::DepthStreamWriter(const int numTiles, const size_t numThreads)
+  : m_encoder(numTiles)
+  , m_pPool(numThreads > 1 ? new ThreadPool(numThreads - 1) : nullptr)
+  , m_isOpen(false)
+  , m_writeFailed(false)
+  , m_width(0)
+  , m_height(0)
+  , m_fileOffset(0)
+  , m_rawBytes(0)
+  , m_encodedBytes(0) { }
+
+DepthStreamWriter::~DepthStreamWriter() {
+  close();
+}
+
+bool DepthStreamWriter::open(const string& file, const int width, const int height) {
+  close();
+  m_ofs.open(file, std::ios::binary | std::ios::trunc);
+  if (!m_ofs.is_open()) { return false; }
+  DepthStreamHeader header;
+  memcpy(header.magic, kDepthStreamMagic, sizeof(header.magic));
+  header.version = kDepthStreamVersion;
+  header.headerSize = sizeof(header);
+  header.width = width;
+  header.height = height;
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_fileOffset = sizeof(header);
+  m_width = width;
+  m_height = height;
+  m_rawBytes = m_encodedBytes = 0;
+  m_index.clear();
+  m_writeFailed = !m_ofs;
+  m_isOpen = true;
+  return true;
+}
+
+bool DepthStreamWriter::write(const int64_t time, const UINT16* depth, const BYTE* bodyIndex) {
+  if (!m_isOpen) { return false; }
+  m_encoder.encode(depth, bodyIndex, m_width, m_height, m_frame, m_pPool.get());
+  DepthStreamFrameHeader header;
+  header.magic = kDepthStreamFrameMagic;
+  header.size = static_cast<uint32_t>(m_frame.size());
+  header.time = time;
+  header.checksum = skeletonLogChecksum(reinterpret_cast<const char*>(m_frame.data()), m_frame.size());
+  header.reserved = 0;
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_ofs.write(reinterpret_cast<const char*>(m_frame.data()), m_frame.size());
+  if (!m_ofs) { m_writeFailed = true; }
+
+  DepthStreamIndexEntry entry;
+  entry.offset = m_fileOffset;
+  entry.time = time;
+  m_index.push_back(entry);
+  m_fileOffset += sizeof(header) + m_frame.size();
+  m_rawBytes += static_cast<uint64_t>(m_width) * m_height * (sizeof(UINT16) + sizeof(BYTE));
+  m_encodedBytes += m_frame.size();
+  return !m_writeFailed;
+}
+
+bool DepthStreamWriter::close() {
+  if (!m_isOpen) { return true; }
+  DepthStreamFooter footer;
+  footer.indexOffset = m_fileOffset;
+  footer.numFrames = static_cast<uint32_t>(m_index.size());
+  footer.magic = kDepthStreamIndexMagic;
+  if (!m_index.empty()) {
+    m_ofs.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(DepthStreamIndexEntry));
+  }
+  m_ofs.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  m_ofs.close();
+  if (!m_ofs) { m_writeFailed = true; }
+  m_isOpen = false;
+  return !m_writeFailed;
+}
+
+DepthStreamReader::DepthStreamReader()
+  : m_hasFooter(false)
+  , m_verifyChecksums(true)
+  , m_width(0)
+  , m_height(0)
+  , m_dataEnd(0) { }
+
+bool DepthStreamReader::open(const string& file) {
+  close();
+  if (!m_file.open(file)) {
+    cerr << "Could not map depth stream " << file << endl;
+    return false;
+  }
+  DepthStreamHeader header;
+  if (m_file.size() < sizeof(header)) {
+    cerr << "Not a depth stream: " << file << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, kDepthStreamMagic, sizeof(header.magic)) != 0 || header.version != kDepthStreamVersion ||
+      header.headerSize != sizeof(header) || header.width == 0 || header.height == 0) {
+    cerr << "Not a depth stream (or unsupported version): " << file << endl;
+    close();
+    return false;
+  }
+  m_filename = file;
+  m_width = header.width;
+  m_height = header.height;
+  m_hasFooter = loadFooter();
+  if (!m_hasFooter) {
+    m_dataEnd = m_file.size();
+    scanFrames();
+  }
+  return true;
+}
+
+void DepthStreamReader::close() {
+  m_file.close();
+  m_filename.clear();
+  m_hasFooter = false;
+  m_width = m_height = 0;
+  m_dataEnd = 0;
+  m_index.clear();
+}
+
+bool DepthStreamReader::loadFooter() {
+  const uint64_t size = m_file.size();
+  DepthStreamFooter footer;
+  if (size < sizeof(DepthStreamHeader) + sizeof(footer)) { return false; }
+  memcpy(&footer, m_file.data() + size - sizeof(footer), sizeof(footer));
+  const uint64_t indexSize = static_cast<uint64_t>(footer.numFrames) * sizeof(DepthStreamIndexEntry);
+  if (footer.magic != kDepthStreamIndexMagic || footer.indexOffset < sizeof(DepthStreamHeader) ||
+      footer.indexOffset + indexSize + sizeof(footer) != size) {
+    return false;
+  }
+  m_index.resize(footer.numFrames);
+  if (indexSize > 0) { memcpy(m_index.data(), m_file.data() + footer.indexOffset, indexSize); }
+  // An index pointing at anything but whole frames before it is treated like a missing one, and frames are scanned
+  for (const DepthStreamIndexEntry& e : m_index) {
+    DepthStreamFrameHeader header;
+    if (e.offset < sizeof(DepthStreamHeader) || e.offset + sizeof(header) > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+    memcpy(&header, m_file.data() + e.offset, sizeof(header));
+    if (header.magic != kDepthStreamFrameMagic || e.offset + sizeof(header) + header.size > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+  }
+  m_dataEnd = footer.indexOffset;
+  return true;
+}
+
+void DepthStreamReader::scanFrames() {
+  // As for skeleton logs, only the last frame can be torn, so only its payload is checksummed here
+  const char* data = m_file.data();
+  const uint64_t size = m_file.size();
+  uint64_t offset = sizeof(DepthStreamHeader);
+  DepthStreamFrameHeader header;
+  while (offset + sizeof(header) <= size) {
+    memcpy(&header, data + offset, sizeof(header));
+    if (header.magic != kDepthStreamFrameMagic || offset + sizeof(header) + header.size > size) { break; }
+    DepthStreamIndexEntry entry;
+    entry.offset = offset;
+    entry.time = header.time;
+    m_index.push_back(entry);
+    offset += sizeof(header) + header.size;
+  }
+  if (!m_index.empty()) {
+    memcpy(&header, data + m_index.back().offset, sizeof(header));
+    if (skeletonLogChecksum(data + m_index.back().offset + sizeof(header), header.size) != header.checksum) {
+      cerr << "Dropping corrupt last frame of " << m_filename << endl;
+      m_index.pop_back();
+    }
+  }
+}
+
+uint64_t DepthStreamReader::seek(const int64_t t) const {
+  const auto it = std::lower_bound(m_index.begin(), m_index.end(), t,
+                                   [] (const DepthStreamIndexEntry& e, const int64_t time) { return e.time < time; });
+  return it - m_index.begin();
+}
+
+bool DepthStreamReader::read(const uint64_t i, UINT16* depth, BYTE* bodyIndex, ThreadPool* pool) const {
+  if (i >= m_index.size()) { return false; }
+  DepthStreamFrameHeader header;
+  memcpy(&header, m_file.data() + m_index[i].offset, sizeof(header));
+  const char* frame = m_file.data() + m_index[i].offset + sizeof(header);
+  if (header.magic != kDepthStreamFrameMagic || m_index[i].offset + sizeof(header) + header.size > m_dataEnd ||
+      (m_verifyChecksums && skeletonLogChecksum(frame, header.size) != header.checksum) ||
+      !decodeDepthFrame(reinterpret_cast<const uint8_t*>(frame), header.size, m_width, m_height, depth, bodyIndex,
+                        pool)) {
+    cerr << "Corrupt frame " << i << " in " << m_filename << endl;
+    return false;
+  }
+  return true;
+}
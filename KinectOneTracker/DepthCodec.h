@@ -0,0 +1,178 @@
+#ifndef KINECTONETRACKER_DEPTHCODEC_H_
+#define KINECTONETRACKER_DEPTHCODEC_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./KinectTypes.h"
+#include "./MappedFile.h"
+#include "./ThreadPool.h"
+
+// Lossless codec for depth + body index frames, and the .kdc file format storing a stream of them.
+//
+// Frames are split into horizontal bands of rows (tiles) that are coded independently, so that tiles encode and
+// decode in parallel. Within a tile each depth pixel is predicted with the LOCO-I median edge detector from its
+// left, upper and upper-left neighbours (left only on the first row of the tile, upper only on the first column).
+// Residuals are zigzag mapped and Rice coded with a parameter chosen per block of 32 samples; blocks of exact
+// predictions cost 5 bits. Body index images, which are mostly background, are run-length coded.
+//
+// Encoded frame layout (all fields little-endian):
+//   uint32_t numTiles
+//   uint32_t tileSize[numTiles]
+//   Tile*              uint32_t depth size, Rice coded depth, run-length coded body index (value byte, varint run-1)
+//
+// .kdc file layout, which follows the skeleton log (see SkeletonLog.h):
+//   DepthStreamHeader
+//   Frame*             DepthStreamFrameHeader followed by an encoded frame
+//   Index              one DepthStreamIndexEntry per frame, followed by DepthStreamFooter (only after a clean close)
+// Frames are checksummed, so a file cut short by a crash is readable up to its last complete frame by scanning.
+
+#pragma pack(push, 1)
+struct DepthStreamHeader {
+  char     magic[8];      // kDepthStreamMagic
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t width;         // Frame size in pixels
+  uint32_t height;
+};
+
+struct DepthStreamFrameHeader {
+  uint32_t magic;         // kDepthStreamFrameMagic
+  uint32_t size;          // Size of the encoded frame in bytes
+  int64_t  time;          // Frame timestamp
+  uint32_t checksum;      // skeletonLogChecksum() of the encoded frame
+  uint32_t reserved;
+};
+
+struct DepthStreamIndexEntry {
+  uint64_t offset;        // File offset of DepthStreamFrameHeader
+  int64_t  time;
+};
+
+struct DepthStreamFooter {
+  uint64_t indexOffset;   // File offset of first DepthStreamIndexEntry
+  uint32_t numFrames;
+  uint32_t magic;         // kDepthStreamIndexMagic
+};
+#pragma pack(pop)
+
+static const char     kDepthStreamMagic[8]     = { 'K', 'O', 'D', 'E', 'P', 'T', 'H', 'C' };
+static const uint32_t kDepthStreamVersion      = 1;
+static const uint32_t kDepthStreamFrameMagic   = 0x4d415246;  // "FRAM"
+static const uint32_t kDepthStreamIndexMagic   = 0x5844494b;  // "KIDX"
+
+//! Encodes depth and body index frames. Keeps per-tile buffers between frames, so that encoding a stream of equally
+//! sized frames does not allocate
+class DepthFrameEncoder {
+ public:
+  //! Frames are split into numTiles tiles (at most one per row)
+  explicit DepthFrameEncoder(const int numTiles = 8);
+
+  //! Encodes width x height depth and bodyIndex images into out (replacing its contents). Tiles are encoded in
+  //! parallel on pool if given
+  void encode(const UINT16* depth, const BYTE* bodyIndex, const int width, const int height,
+              std::vector<uint8_t>& out, ThreadPool* pool = nullptr);  // NOLINT
+
+  int numTiles() const { return m_numTiles; }
+
+ private:
+  const int m_numTiles;
+  std::vector<std::vector<uint8_t>> m_tiles;
+  std::vector<std::vector<uint32_t>> m_residuals;
+  std::vector<size_t> m_tileSizes;
+};
+
+//! Decodes a frame encoded by DepthFrameEncoder into width x height depth and bodyIndex images, in parallel on pool
+//! if given. Returns false if the frame is malformed
+bool decodeDepthFrame(const uint8_t* in, const size_t size, const int width, const int height, UINT16* depth,
+                      BYTE* bodyIndex, ThreadPool* pool = nullptr);
+
+//! Encodes depth and body index frames into a .kdc file. Frames are encoded and written on the calling thread, with
+//! tiles spread over the writer's own thread pool
+class DepthStreamWriter {
+ public:
+  //! Frames are split into numTiles tiles encoded on numThreads threads (counting the calling thread)
+  explicit DepthStreamWriter(const int numTiles = 8, const size_t numThreads = 2);
+  ~DepthStreamWriter();
+
+  //! Creates file for width x height frames. Returns false if it cannot be opened
+  bool open(const std::string& file, const int width, const int height);
+
+  //! Encodes and appends a frame. Returns false if writing failed
+  bool write(const int64_t time, const UINT16* depth, const BYTE* bodyIndex);
+
+  //! Writes the index and closes the file. Returns false if any write failed
+  bool close();
+
+  bool isOpen() const { return m_isOpen; }
+  uint64_t numFrames() const { return m_index.size(); }
+  //! Total size of written frames before and after encoding, in bytes
+  uint64_t rawBytes() const { return m_rawBytes; }
+  uint64_t encodedBytes() const { return m_encodedBytes; }
+
+ private:
+  DepthStreamWriter(const DepthStreamWriter&);
+  DepthStreamWriter& operator=(const DepthStreamWriter&);
+
+  DepthFrameEncoder m_encoder;
+  std::unique_ptr<ThreadPool> m_pPool;
+  std::ofstream m_ofs;
+  bool m_isOpen;
+  bool m_writeFailed;
+  int m_width, m_height;
+  uint64_t m_fileOffset;
+  uint64_t m_rawBytes, m_encodedBytes;
+  std::vector<uint8_t> m_frame;
+  std::vector<DepthStreamIndexEntry> m_index;
+};
+
+//! Random access reader of .kdc files. The file is memory-mapped and only the frame index is materialized: it is
+//! loaded from the footer of cleanly closed files, or rebuilt by scanning frame headers otherwise
+class DepthStreamReader {
+ public:
+  DepthStreamReader();
+
+  //! Maps file and loads or rebuilds its index. Returns false if it is not a .kdc file
+  bool open(const std::string& file);
+  void close();
+
+  bool isOpen() const { return m_file.isOpen(); }
+  //! Whether the index was loaded from the footer (true) or rebuilt by scanning frame headers (false)
+  bool hasFooter() const { return m_hasFooter; }
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  uint64_t numFrames() const { return m_index.size(); }
+  int64_t frameTime(const uint64_t i) const { return m_index[i].time; }
+
+  //! Index of first frame with timestamp >= t (or numFrames() if none). O(log n)
+  uint64_t seek(const int64_t t) const;
+
+  //! Decodes frame i into width() x height() depth and bodyIndex images, in parallel on pool if given. Returns false
+  //! if the frame is corrupt: its header is invalid, it extends past the frame data, its checksum does not match (if
+  //! checksums are verified) or it does not decode
+  bool read(const uint64_t i, UINT16* depth, BYTE* bodyIndex, ThreadPool* pool = nullptr) const;
+
+  //! Whether read() checksums each frame before decoding it (default true). Verifying costs a pass over the encoded
+  //! frame, a small fraction of decoding it
+  void setVerifyChecksums(const bool verify) { m_verifyChecksums = verify; }
+
+ private:
+  DepthStreamReader(const DepthStreamReader&);
+  DepthStreamReader& operator=(const DepthStreamReader&);
+
+  bool loadFooter();
+  void scanFrames();
+
+  std::string m_filename;
+  MappedFile m_file;
+  bool m_hasFooter;
+  bool m_verifyChecksums;
+  int m_width, m_height;
+  uint64_t m_dataEnd;  // File offset past the last frame (the index offset, or the file size without a footer)
+  std::vector<DepthStreamIndexEntry> m_index;
+};
+
+#endif  // KINECTONETRACKER_DEPTHCODEC_H_
@@ -0,0 +1,180 @@
+#include "./DepthColorRegistration.h"
+#include "./ColorConvert.h"
+#include "./KinectOneTracker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using std::cerr;  using std::endl;
+
+const float
+  DepthColorRegistration::kColorFx = 1081.37f,
+  DepthColorRegistration::kColorFy = 1081.37f,
+  DepthColorRegistration::kColorCx = 959.5f,
+  DepthColorRegistration::kColorCy = 539.5f,
+  DepthColorRegistration::kColorBaseline = 0.052f;
+
+// Depth pixels whose color indices are computed before each gather
+static const int kChunk = 256;
+// Depth rows per parallel work item
+static const int kBandRows = 8;
+
+// Converts color coordinates to the index of the nearest color pixel, or -1 if outside the w x h frame (which
+// includes infinite and NaN coordinates)
+inline int32_t colorPixelIndex(const float u, const float v, const int w, const int h) {
+  const bool inside = (u >= -0.5f) & (u < w - 0.5f) & (v >= -0.5f) & (v < h - 0.5f);
+  return inside ? static_cast<int32_t>(v + 0.5f) * w + static_cast<int32_t>(u + 0.5f) : -1;
+}
+
+DepthColorRegistration::DepthColorRegistration(const int depthWidth, const int depthHeight, const int colorWidth,
+                                               const int colorHeight)
+  : m_depthWidth(depthWidth)
+  , m_depthHeight(depthHeight)
+  , m_colorWidth(colorWidth)
+  , m_colorHeight(colorHeight) { }
+
+bool DepthColorRegistration::setCalibration(const std::vector<std::pair<float, float>>& rays, const float fx,
+                                            const float fy, const float cx, const float cy,
+                                            const std::array<float, 16>& depthToColor, const bool mirror) {
+  if (rays.size() != numDepthPixels()) { return false; }
+  // A depth pixel at depth Z (metres) is at Z * r + t in color camera space, with r its rotated ray. Ignoring t
+  // along the optical axis, it projects to u = cx + s * fx * (r.x + t.x / Z) / r.z (and likewise v, with camera y
+  // pointing up), which splits into a term at infinite depth and a parallax term proportional to 1 / Z
+  const std::array<float, 16>& m = depthToColor;
+  const float su = mirror ? -fx : fx, sv = -fy;
+  const float kMillimetresPerMetre = 1000.f;
+  const size_t n = rays.size();
+  m_u0.resize(n);
+  m_v0.resize(n);
+  m_du.resize(n);
+  m_dv.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    const float x = rays[i].first, y = rays[i].second;
+    const float rx = m[0] * x + m[1] * y + m[2];
+    const float ry = m[4] * x + m[5] * y + m[6];
+    const float rz = std::max(m[8] * x + m[9] * y + m[10], 1e-6f);
+    m_u0[i] = cx + su * rx / rz;
+    m_v0[i] = cy + sv * ry / rz;
+    m_du[i] = su * m[3] * kMillimetresPerMetre / rz;
+    m_dv[i] = sv * m[7] * kMillimetresPerMetre / rz;
+  }
+  return true;
+}
+
+bool DepthColorRegistration::setDefaultCalibration(const std::vector<std::pair<float, float>>& rays) {
+  const std::array<float, 16> depthToColor = {{1, 0, 0, kColorBaseline, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+  return setCalibration(rays, kColorFx, kColorFy, kColorCx, kColorCy, depthToColor);
+}
+
+void DepthColorRegistration::forEachRowBand(ThreadPool* pool, const std::function<void(int, int)>& bandFunc) const {
+  const int numBands = (m_depthHeight + kBandRows - 1) / kBandRows;
+  const auto band = [&] (size_t b) {
+    const int j0 = static_cast<int>(b) * kBandRows;
+    bandFunc(j0, std::min(j0 + kBandRows, m_depthHeight));
+  };
+  if (pool != nullptr) {
+    pool->parallelFor(numBands, band);
+  } else {
+    for (int b = 0; b < numBands; ++b) { band(b); }
+  }
+}
+
+void DepthColorRegistration::registerColor(const UINT16* depth, const BYTE* yuy2, BYTE* registered,
+                                           ThreadPool* pool) const {
+  if (!hasCalibration()) {
+    memset(registered, 0, 3 * numDepthPixels());
+    return;
+  }
+  const int w = m_colorWidth, h = m_colorHeight;
+  forEachRowBand(pool, [&] (int j0, int j1) {
+    int32_t pixels[kChunk];
+    const int begin = j0 * m_depthWidth, end = j1 * m_depthWidth;
+    for (int i0 = begin; i0 < end; i0 += kChunk) {
+      const int count = std::min(kChunk, end - i0);
+      for (int k = 0; k < count; ++k) {
+        const int i = i0 + k;
+        const UINT16 d = depth[i];
+        const float invDepth = 1.f / std::max<float>(d, 1.f);
+        const int32_t p = colorPixelIndex(m_u0[i] + m_du[i] * invDepth, m_v0[i] + m_dv[i] * invDepth, w, h);
+        pixels[k] = (d != 0) ? p : -1;
+      }
+      yuy2GatherToBgr(yuy2, pixels, count, registered + 3 * i0);
+    }
+  });
+}
+
+void DepthColorRegistration::registerColor(const float* colorXY, const BYTE* yuy2, BYTE* registered,
+                                           ThreadPool* pool) const {
+  const int w = m_colorWidth, h = m_colorHeight;
+  forEachRowBand(pool, [&] (int j0, int j1) {
+    int32_t pixels[kChunk];
+    const int begin = j0 * m_depthWidth, end = j1 * m_depthWidth;
+    for (int i0 = begin; i0 < end; i0 += kChunk) {
+      const int count = std::min(kChunk, end - i0);
+      for (int k = 0; k < count; ++k) {
+        const float* xy = colorXY + 2 * (i0 + k);
+        pixels[k] = colorPixelIndex(xy[0], xy[1], w, h);
+      }
+      yuy2GatherToBgr(yuy2, pixels, count, registered + 3 * i0);
+    }
+  });
+}
+
+ColorRegistrationStage::ColorRegistrationStage(const size_t numThreads, const int depthWidth, const int depthHeight,
+                                               const int colorWidth, const int colorHeight)
+  : m_registration(depthWidth, depthHeight, colorWidth, colorHeight)
+  , m_pPool(numThreads > 1 ? new ThreadPool(numThreads - 1) : nullptr)
+  , m_pTracker(nullptr)
+  , m_hasColor(false)
+  , m_warnedSize(false)
+  , m_color(m_registration.colorBufferSize())
+  , m_colorXY(2 * m_registration.numDepthPixels())
+  , m_registered(3 * m_registration.numDepthPixels(), 0) { }
+
+void ColorRegistrationStage::onColor(const INT64, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+  if (nColorBufferSize != m_color.size()) {
+    if (!m_warnedSize) { cerr << "Registration: unexpected color frame size " << nColorBufferSize << endl; }
+    m_warnedSize = true;
+    return;
+  }
+  memcpy(m_color.data(), pColorBuffer, nColorBufferSize);
+  m_hasColor = true;
+}
+
+void ColorRegistrationStage::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize,
+                                                 const UINT16* pDepthBuffer, const UINT nBodyIndexBufferSize,
+                                                 const BYTE* pBodyIndexBuffer) {
+  if (!registerFrame(nDepthBufferSize, pDepthBuffer, m_hasColor ? m_color.data() : nullptr)) { return; }
+  for (KinectOneListener* l : m_listeners) {
+    l->onRegisteredColor(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer,
+                         m_registered.data());
+  }
+}
+
+void ColorRegistrationStage::onFrameBundle(const FrameBundle& b) {
+  const bool hasColor = b.pColorBuffer != nullptr && b.nColorBufferSize == m_color.size();
+  if (!registerFrame(b.nDepthBufferSize, b.pDepthBuffer,
+                     hasColor ? reinterpret_cast<const BYTE*>(b.pColorBuffer) : nullptr)) { return; }
+  FrameBundle registered = b;
+  registered.pRegisteredColor = m_registered.data();
+  for (KinectOneListener* l : m_listeners) { l->onFrameBundle(registered); }
+}
+
+bool ColorRegistrationStage::registerFrame(const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                           const BYTE* yuy2) {
+  if (nDepthBufferSize != m_registration.numDepthPixels()) {
+    if (!m_warnedSize) { cerr << "Registration: unexpected depth frame size " << nDepthBufferSize << endl; }
+    m_warnedSize = true;
+    return false;
+  }
+  if (yuy2 != nullptr && m_registration.hasCalibration()) {
+    m_registration.registerColor(pDepthBuffer, yuy2, m_registered.data(), m_pPool.get());
+  } else if (yuy2 != nullptr && m_pTracker != nullptr &&
+             m_pTracker->mapDepthFrameToColorSpace(nDepthBufferSize, pDepthBuffer, m_colorXY.data())) {
+    m_registration.registerColor(m_colorXY.data(), yuy2, m_registered.data(), m_pPool.get());
+  } else {
+    std::fill(m_registered.begin(), m_registered.end(), 0);
+  }
+  return true;
+}
@@ -0,0 +1,116 @@
+#ifndef KINECTONETRACKER_DEPTHCOLORREGISTRATION_H_
+#define KINECTONETRACKER_DEPTHCOLORREGISTRATION_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./KinectTypes.h"
+#include "./ThreadPool.h"
+
+// Forward declaration
+class KinectOneTracker;
+
+//! Registers color to depth frames: fills an image aligned to the depth frame with the color seen by each depth
+//! pixel, sampled from the YUY2 color frame. Color coordinates come either from per-pixel color coordinates supplied
+//! for each frame (such as the sensor's coordinate mapper output) or from a fixed calibration. For a fixed
+//! calibration, the projection of each depth pixel's ray into the color camera is precomputed, so that per frame a
+//! pixel costs one multiply-add per coordinate with its inverse depth (the parallax of the camera baseline) before
+//! the color gather. Rows are split across threads.
+class DepthColorRegistration {
+ public:
+  // Approximate Kinect One color camera intrinsics, and baseline (metres along x) from depth to color camera
+  static const float kColorFx, kColorFy, kColorCx, kColorCy, kColorBaseline;
+
+  DepthColorRegistration(const int depthWidth = 512, const int depthHeight = 424, const int colorWidth = 1920,
+                         const int colorHeight = 1080);
+
+  //! Sets a fixed calibration: depth pixel rays (camera space (x, y) at unit depth, as returned by
+  //! KinectOneTracker::getDepthPixelCoordsInCameraSpace()), color camera pinhole intrinsics, and the row-major 4x4
+  //! rigid transform from depth to color camera space in metres. Translation along the optical axis is ignored.
+  //! With mirror, color image columns grow towards -x, as in the sensor's (mirrored) frames. Returns false,
+  //! keeping the current calibration, if rays does not have one entry per depth pixel
+  bool setCalibration(const std::vector<std::pair<float, float>>& rays, const float fx, const float fy,
+                      const float cx, const float cy, const std::array<float, 16>& depthToColor,
+                      const bool mirror = true);
+
+  //! Sets the fixed calibration from rays and the default color intrinsics and baseline
+  bool setDefaultCalibration(const std::vector<std::pair<float, float>>& rays);
+
+  bool hasCalibration() const { return !m_u0.empty(); }
+  int depthWidth() const { return m_depthWidth; }
+  int depthHeight() const { return m_depthHeight; }
+  size_t numDepthPixels() const { return static_cast<size_t>(m_depthWidth) * m_depthHeight; }
+  size_t colorBufferSize() const { return 2 * static_cast<size_t>(m_colorWidth) * m_colorHeight; }
+
+  //! Registers yuy2 color frame to depth frame (millimetres) with the fixed calibration, writing 3 bytes (BGR) per
+  //! depth pixel to registered. Pixels without depth or outside the color frame are black. Rows are split across
+  //! pool and the calling thread if pool is given
+  void registerColor(const UINT16* depth, const BYTE* yuy2, BYTE* registered, ThreadPool* pool = nullptr) const;
+
+  //! As above, with per depth pixel (x, y) color coordinates instead of the fixed calibration. Coordinates outside
+  //! the color frame (including infinite ones) give black pixels
+  void registerColor(const float* colorXY, const BYTE* yuy2, BYTE* registered, ThreadPool* pool = nullptr) const;
+
+ private:
+  //! Runs bandFunc(rowBegin, rowEnd) over bands of depth rows covering the frame, on pool if given
+  void forEachRowBand(ThreadPool* pool, const std::function<void(int, int)>& bandFunc) const;
+
+  const int m_depthWidth, m_depthHeight, m_colorWidth, m_colorHeight;
+  // Per depth pixel color coordinates at infinite depth and parallax (coordinate shift times depth in millimetres)
+  std::vector<float> m_u0, m_v0, m_du, m_dv;
+};
+
+//! Listener stage registering color to depth frames. Keeps a copy of the latest color frame and, for each depth
+//! frame, calls onRegisteredColor() of attached listeners with the depth frame and the color registered to it.
+//! Attach it to a tracker as both color and depth listener. Color is registered with the stage's fixed calibration
+//! if set, or else with the tracker's per-frame mapping (see KinectOneTracker::mapDepthFrameToColorSpace()).
+//! Until a color frame has arrived, or if neither is available, registered color is black. Behind a
+//! FrameSynchronizer, each bundle's depth frame is registered with the bundle's own color frame, and the bundle is
+//! passed on with the registered color to onFrameBundle() of attached listeners.
+class ColorRegistrationStage : public KinectOneListener {
+ public:
+  //! Registers on numThreads threads, counting the tracker thread
+  explicit ColorRegistrationStage(const size_t numThreads = 2, const int depthWidth = 512,
+                                  const int depthHeight = 424, const int colorWidth = 1920,
+                                  const int colorHeight = 1080);
+
+  //! Fixed calibration (see DepthColorRegistration::setCalibration())
+  DepthColorRegistration& registration() { return m_registration; }
+
+  //! Maps with pTracker's source for each frame when there is no fixed calibration
+  void setMappingTracker(KinectOneTracker* pTracker) { m_pTracker = pTracker; }
+
+  void attachListener(KinectOneListener* listener) { m_listeners.push_back(listener); }
+
+  void onSkeleton(const Skeleton*) { }
+  void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+  void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                           const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
+  void onFrameBundle(const FrameBundle& b);
+
+ private:
+  //! Registers yuy2 (black if null) to depth frame into m_registered. Returns false if depth has the wrong size
+  bool registerFrame(const UINT nDepthBufferSize, const UINT16* pDepthBuffer, const BYTE* yuy2);
+
+  ColorRegistrationStage(const ColorRegistrationStage&);
+  ColorRegistrationStage& operator=(const ColorRegistrationStage&);
+
+  DepthColorRegistration m_registration;
+  std::unique_ptr<ThreadPool> m_pPool;
+  KinectOneTracker* m_pTracker;
+  std::list<KinectOneListener*> m_listeners;
+  bool m_hasColor;
+  bool m_warnedSize;
+  // Persistent buffers: latest color frame, mapped color coordinates and registered color
+  std::vector<BYTE> m_color;
+  std::vector<float> m_colorXY;
+  std::vector<BYTE> m_registered;
+};
+
+#endif  // KINECTONETRACKER_DEPTHCOLORREGISTRATION_H_
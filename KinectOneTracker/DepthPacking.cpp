@@ -0,0 +1,122 @@
+#include "./DepthPacking.h"
+#include "./Simd.h"
+
+// Pixels per SIMD block
+static const int kBlock = 16;
+
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+
+// pshufb masks moving bytes between three 16-byte source registers and three 16-byte destination registers:
+// destination d is the OR of shuffle(source s, mask[d][s]) over s. Entries of -128 select zero
+struct ShuffleTable {
+  alignas(16) int8_t mask[3][3][16];
+};
+
+// Builds the table for a block of 16 pixels. In the planar registers, register 0 holds the 16 body index bytes and
+// registers 1 and 2 the 32 little-endian depth bytes; the packed registers hold the 48 interleaved bytes. With
+// reverse, the pixels of the block are in reverse order in the destination
+static ShuffleTable makeTable(const bool pack, const bool reverse) {
+  ShuffleTable t;
+  for (int d = 0; d < 3; ++d) {
+    for (int s = 0; s < 3; ++s) {
+      for (int i = 0; i < 16; ++i) { t.mask[d][s][i] = -128; }
+    }
+  }
+  for (int p = 0; p < kBlock; ++p) {
+    const int q = reverse ? kBlock - 1 - p : p;  // Destination pixel
+    // Planar byte positions (register, byte) of pixel p for body index, depth low and high byte
+    const int planar[3][2] = {
+      { 0, p }, { 1 + (2 * p) / 16, (2 * p) % 16 }, { 1 + (2 * p + 1) / 16, (2 * p + 1) % 16 }
+    };
+    for (int c = 0; c < 3; ++c) {
+      if (pack) {
+        const int k = 3 * q + c;
+        t.mask[k / 16][planar[c][0]][k % 16] = static_cast<int8_t>(planar[c][1]);
+      } else {
+        const int k = 3 * p + c;
+        const int qByte = (c == 0) ? q : 2 * q + (c - 1);
+        const int dReg = (c == 0) ? 0 : 1 + qByte / 16;
+        t.mask[dReg][k / 16][(c == 0) ? qByte : qByte % 16] = static_cast<int8_t>(k % 16);
+      }
+    }
+  }
+  return t;
+}
+
+static const ShuffleTable kPackTable = makeTable(true, false);
+static const ShuffleTable kPackMirrorTable = makeTable(true, true);
+static const ShuffleTable kUnpackTable = makeTable(false, false);
+static const ShuffleTable kUnpackMirrorTable = makeTable(false, true);
+
+// Applies table to three source registers
+inline void shuffle3(const __m128i src[3], const ShuffleTable& t, __m128i dst[3]) {
+  for (int d = 0; d < 3; ++d) {
+    const __m128i* m = reinterpret_cast<const __m128i*>(t.mask[d]);
+    dst[d] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(src[0], _mm_load_si128(m)),
+                                       _mm_shuffle_epi8(src[1], _mm_load_si128(m + 1))),
+                          _mm_shuffle_epi8(src[2], _mm_load_si128(m + 2)));
+  }
+}
+
+#endif  // KINECTONETRACKER_HAVE_SSSE3
+
+void packDepthAndBodyIndex(const UINT16* depth, const BYTE* bodyIndex, uint8_t* out, const int width,
+                           const int height, const bool mirror, const bool simd) {
+  for (int r = 0; r < height; ++r) {
+    const UINT16* d = depth + r * width;
+    const BYTE* b = bodyIndex + r * width;
+    uint8_t* o = out + 3 * r * width;
+    int x = 0;
+    if (simd) {
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+      const ShuffleTable& table = mirror ? kPackMirrorTable : kPackTable;
+      for (; x + kBlock <= width; x += kBlock) {
+        __m128i src[3], dst[3];
+        src[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        src[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + x));
+        src[2] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + x + 8));
+        shuffle3(src, table, dst);
+        __m128i* dstPtr = reinterpret_cast<__m128i*>(o + 3 * (mirror ? width - kBlock - x : x));
+        for (int v = 0; v < 3; ++v) { _mm_storeu_si128(dstPtr + v, dst[v]); }
+      }
+#endif
+    }
+    for (; x < width; ++x) {
+      uint8_t* p = o + 3 * (mirror ? width - 1 - x : x);
+      p[0] = b[x];
+      p[1] = static_cast<uint8_t>(d[x] & 0xff);
+      p[2] = static_cast<uint8_t>(d[x] >> 8);
+    }
+  }
+}
+
+void unpackDepthAndBodyIndex(const uint8_t* in, UINT16* depth, BYTE* bodyIndex, const int width, const int height,
+                             const bool mirror, const bool simd) {
+  for (int r = 0; r < height; ++r) {
+    const uint8_t* p = in + 3 * r * width;
+    UINT16* d = depth + r * width;
+    BYTE* b = bodyIndex + r * width;
+    int x = 0;
+    if (simd) {
+#ifdef KINECTONETRACKER_HAVE_SSSE3
+      const ShuffleTable& table = mirror ? kUnpackMirrorTable : kUnpackTable;
+      for (; x + kBlock <= width; x += kBlock) {
+        __m128i src[3], dst[3];
+        const __m128i* srcPtr = reinterpret_cast<const __m128i*>(p + 3 * x);
+        for (int v = 0; v < 3; ++v) { src[v] = _mm_loadu_si128(srcPtr + v); }
+        shuffle3(src, table, dst);
+        const int xOut = mirror ? width - kBlock - x : x;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + xOut), dst[0]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + xOut), dst[1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + xOut + 8), dst[2]);
+      }
+#endif
+    }
+    for (; x < width; ++x) {
+      const uint8_t* q = p + 3 * x;
+      const int xOut = mirror ? width - 1 - x : x;
+      b[xOut] = q[0];
+      d[xOut] = static_cast<UINT16>(q[1] | (q[2] << 8));
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef KINECTONETRACKER_DEPTHPACKING_H_
+#define KINECTONETRACKER_DEPTHPACKING_H_
+
+#include <cstdint>
+
+#include "./KinectTypes.h"
+
+// Conversion between the sensor's separate depth (UINT16) and body index (BYTE) images and the interleaved 3 bytes
+// per pixel layout of recorded depth frames: (body index, depth low byte, depth high byte). Both directions take a
+// single pass and can mirror each row left-right on the fly. With SSSE3 (see Simd.h) 16 pixels are shuffled at a
+// time; otherwise, or with simd false, a scalar loop is used. Both paths produce identical output.
+
+//! Packs width x height depth and bodyIndex images into out (3 * width * height bytes)
+void packDepthAndBodyIndex(const UINT16* depth, const BYTE* bodyIndex, uint8_t* out, const int width,
+                           const int height, const bool mirror = false, const bool simd = true);
+
+//! Unpacks width x height packed pixels from in into depth and bodyIndex images
+void unpackDepthAndBodyIndex(const uint8_t* in, UINT16* depth, BYTE* bodyIndex, const int width, const int height,
+                             const bool mirror = false, const bool simd = true);
+
+#endif  // KINECTONETRACKER_DEPTHPACKING_H_
@@ -0,0 +1,170 @@
+#include "./DepthReprojector.h"
+#include "./Simd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using std::string;
+
+const float
+  DepthReprojector::kDepthFx = 361.56f,
+  DepthReprojector::kDepthFy = 367.19f,
+  DepthReprojector::kDepthCx = 256.f,
+  DepthReprojector::kDepthCy = 212.f;
+
+// Pixels per block computed before compaction (a multiple of SimdFloat::kLanes)
+static const int kBlock = 64;
+
+DepthReprojector::DepthReprojector(const int width, const int height)
+  : m_width(width)
+  , m_height(height)
+  , m_extrinsics({{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}}) {
+  const size_t padded = (maxPoints() + kBlock - 1) / kBlock * kBlock;
+  m_rayX.resize(padded);
+  m_rayY.resize(padded);
+  m_rayZ.resize(padded);
+  setIntrinsics(kDepthFx, kDepthFy, kDepthCx, kDepthCy, true);
+}
+
+void DepthReprojector::setIntrinsics(const float fx, const float fy, const float cx, const float cy,
+                                     const bool mirror) {
+  m_baseRays.resize(maxPoints());
+  for (int j = 0; j < m_height; ++j) {
+    for (int i = 0; i < m_width; ++i) {
+      const int u = mirror ? m_width - 1 - i : i;
+      m_baseRays[j * m_width + i] = std::make_pair((u - cx) / fx, (cy - j) / fy);
+    }
+  }
+  updateRays();
+}
+
+bool DepthReprojector::setRayTable(const std::vector<std::pair<float, float>>& table) {
+  if (table.size() != maxPoints()) { return false; }
+  m_baseRays = table;
+  updateRays();
+  return true;
+}
+
+void DepthReprojector::setExtrinsics(const std::array<float, 16>& m) {
+  m_extrinsics = m;
+  updateRays();
+}
+
+void DepthReprojector::updateRays() {
+  // Point of a ray (x, y, 1) at depth d is d * R * (x, y, 1) + t, with d in millimetres scaled to metres
+  const std::array<float, 16>& m = m_extrinsics;
+  const float kMetresPerUnit = 0.001f;
+  for (size_t i = 0; i < m_baseRays.size(); ++i) {
+    const float x = m_baseRays[i].first, y = m_baseRays[i].second;
+    m_rayX[i] = kMetresPerUnit * (m[0] * x + m[1] * y + m[2]);
+    m_rayY[i] = kMetresPerUnit * (m[4] * x + m[5] * y + m[6]);
+    m_rayZ[i] = kMetresPerUnit * (m[8] * x + m[9] * y + m[10]);
+  }
+  for (int a = 0; a < 3; ++a) { m_translation[a] = m[4 * a + 3]; }
+}
+
+size_t DepthReprojector::reproject(const UINT16* depth, const BYTE* bodyIndex, float* xyz) const {
+  typedef SimdFloat S;
+  const S::V tx = S::set1(m_translation[0]), ty = S::set1(m_translation[1]), tz = S::set1(m_translation[2]);
+  const int n = static_cast<int>(maxPoints());
+  alignas(32) float px[kBlock], py[kBlock], pz[kBlock];
+  UINT16 depthTail[kBlock];
+  BYTE bodyTail[kBlock];
+  uint8_t keep[kBlock];
+  float* out = xyz;
+  for (int i0 = 0; i0 < n; i0 += kBlock) {
+    const int count = std::min(kBlock, n - i0);
+    const UINT16* dBlock = depth + i0;
+    const BYTE* bBlock = (bodyIndex != nullptr) ? bodyIndex + i0 : nullptr;
+    if (count < kBlock) {
+      // Zero-padded copy of the last partial block, so that all loops run over whole blocks
+      std::fill(std::copy(dBlock, dBlock + count, depthTail), depthTail + kBlock, 0);
+      dBlock = depthTail;
+      if (bBlock != nullptr) {
+        std::copy(bBlock, bBlock + count, bodyTail);
+        bBlock = bodyTail;
+      }
+    }
+    for (int k = 0; k < kBlock; k += S::kLanes) {
+      const S::V d = S::loadU16(dBlock + k);
+      S::store(px + k, S::add(S::mul(d, S::load(&m_rayX[i0 + k])), tx));
+      S::store(py + k, S::add(S::mul(d, S::load(&m_rayY[i0 + k])), ty));
+      S::store(pz + k, S::add(S::mul(d, S::load(&m_rayZ[i0 + k])), tz));
+    }
+    // Compaction: keep pixels with depth that are background (or all, without body index). The mask is computed
+    // in a separate branch-free loop, which compilers vectorize, and points are always stored but only kept by
+    // advancing out
+    if (bBlock != nullptr) {
+      for (int k = 0; k < kBlock; ++k) { keep[k] = (dBlock[k] != 0) & (bBlock[k] == 0xff); }
+    } else {
+      for (int k = 0; k < kBlock; ++k) { keep[k] = (dBlock[k] != 0); }
+    }
+    for (int k = 0; k < count; ++k) {
+      out[0] = px[k];
+      out[1] = py[k];
+      out[2] = pz[k];
+      out += 3 * keep[k];
+    }
+  }
+  return (out - xyz) / 3;
+}
+
+PlyWriter::PlyWriter(const size_t bufferSize)
+  : m_buf(std::max<size_t>(bufferSize, 12))
+  , m_used(0)
+  , m_numPoints(0)
+  , m_countOffset(0) { }
+
+PlyWriter::~PlyWriter() {
+  close();
+}
+
+bool PlyWriter::open(const string& file) {
+  close();
+  m_ofs.open(file, std::ios::binary | std::ios::trunc);
+  if (!m_ofs.is_open()) { return false; }
+  // The vertex count is padded with spaces to a fixed width so that close() can overwrite it in place
+  const char* kHeaderStart = "ply\nformat binary_little_endian 1.0\nelement vertex ";
+  m_ofs << kHeaderStart;
+  m_countOffset = static_cast<std::streamoff>(strlen(kHeaderStart));
+  m_ofs << string(20, ' ') << "\nproperty float x\nproperty float y\nproperty float z\nend_header\n";
+  m_used = 0;
+  m_numPoints = 0;
+  return true;
+}
+
+void PlyWriter::append(const float* xyz, const size_t numPoints) {
+  // Floats are stored in native byte order, which is little-endian on all supported platforms
+  const char* p = reinterpret_cast<const char*>(xyz);
+  size_t bytes = numPoints * 3 * sizeof(float);
+  m_numPoints += numPoints;
+  while (bytes > 0) {
+    if (m_used == 0 && bytes >= m_buf.size()) {
+      m_ofs.write(p, bytes);  // Large batches bypass the buffer
+      return;
+    }
+    const size_t n = std::min(bytes, m_buf.size() - m_used);
+    memcpy(m_buf.data() + m_used, p, n);
+    m_used += n;
+    p += n;
+    bytes -= n;
+    if (m_used == m_buf.size()) { flush(); }
+  }
+}
+
+void PlyWriter::flush() {
+  if (m_used > 0) { m_ofs.write(m_buf.data(), m_used); }
+  m_used = 0;
+}
+
+bool PlyWriter::close() {
+  if (!m_ofs.is_open()) { return true; }
+  flush();
+  char count[21];
+  snprintf(count, sizeof(count), "%llu", static_cast<unsigned long long>(m_numPoints));
+  m_ofs.seekp(m_countOffset);
+  m_ofs.write(count, strlen(count));
+  m_ofs.close();
+  return !m_ofs.fail();
+}
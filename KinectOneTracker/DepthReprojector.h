@@ -0,0 +1,91 @@
+#ifndef KINECTONETRACKER_DEPTHREPROJECTOR_H_
+#define KINECTONETRACKER_DEPTHREPROJECTOR_H_
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./KinectTypes.h"
+
+//! Back-projects depth frames to 3D points. Keeps a per-pixel table of rays (camera space points at unit depth,
+//! already transformed by the extrinsics and scaled from millimetres to metres), so that each point costs one
+//! multiply-add per coordinate. Points are computed with SimdFloat (see Simd.h) in blocks of pixels and then
+//! compacted, dropping pixels without depth and, optionally, pixels on tracked bodies.
+class DepthReprojector {
+ public:
+  // Kinect One depth camera intrinsics
+  static const float kDepthFx, kDepthFy, kDepthCx, kDepthCy;
+
+  //! Reprojects width x height frames, starting with rays from the default intrinsics of mirrored frames and
+  //! identity extrinsics
+  explicit DepthReprojector(const int width = 512, const int height = 424);
+
+  //! Builds rays from pinhole intrinsics. Image rows grow downwards and camera y upwards. With mirror, column i is
+  //! treated as column width - 1 - i, as for frames flipped left-right before reprojection
+  void setIntrinsics(const float fx, const float fy, const float cx, const float cy, const bool mirror = false);
+
+  //! Uses per-pixel (x, y) camera space coordinates at unit depth, such as returned by
+  //! KinectOneTracker::getDepthPixelCoordsInCameraSpace(). Returns false, keeping the current rays, if table does not
+  //! have width x height entries
+  bool setRayTable(const std::vector<std::pair<float, float>>& table);
+  //! Per-pixel rays before extrinsics, as set by setIntrinsics() or setRayTable()
+  const std::vector<std::pair<float, float>>& rayTable() const { return m_baseRays; }
+
+  //! Sets the row-major 4x4 rigid transform applied to camera space points (same layout as Recording::camera)
+  void setExtrinsics(const std::array<float, 16>& m);
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  //! Maximum number of points of a frame
+  size_t maxPoints() const { return static_cast<size_t>(m_width) * m_height; }
+
+  //! Back-projects depth (millimetres) to points written to xyz as x, y, z triples in metres. Pixels without depth
+  //! are skipped, as are pixels on tracked bodies if bodyIndex is given. xyz holds at least 3 * maxPoints() floats.
+  //! Returns the number of points
+  size_t reproject(const UINT16* depth, const BYTE* bodyIndex, float* xyz) const;
+
+ private:
+  //! Recomputes m_rayX/Y/Z and m_translation from m_baseRays and m_extrinsics
+  void updateRays();
+
+  const int m_width, m_height;
+  std::vector<std::pair<float, float>> m_baseRays;
+  std::array<float, 16> m_extrinsics;
+  // Transformed rays per pixel, padded to a whole number of blocks
+  std::vector<float> m_rayX, m_rayY, m_rayZ;
+  float m_translation[3];
+};
+
+//! Streams points to a binary little-endian PLY file through a fixed-size buffer. The vertex count in the header is
+//! filled in on close(), so points can be appended in any number of batches.
+class PlyWriter {
+ public:
+  explicit PlyWriter(const size_t bufferSize = 1 << 20);
+  ~PlyWriter();
+
+  //! Creates file and writes the header. Returns false if it cannot be opened
+  bool open(const std::string& file);
+
+  //! Appends numPoints points stored as x, y, z triples
+  void append(const float* xyz, const size_t numPoints);
+
+  //! Writes buffered points, fills in the vertex count and closes the file. Returns false if any write failed
+  bool close();
+
+  bool isOpen() const { return m_ofs.is_open(); }
+  uint64_t numPoints() const { return m_numPoints; }
+
+ private:
+  void flush();
+
+  std::ofstream m_ofs;
+  std::vector<char> m_buf;
+  size_t m_used;
+  uint64_t m_numPoints;
+  std::streamoff m_countOffset;  // File offset of the vertex count in the header
+};
+
+#endif  // KINECTONETRACKER_DEPTHREPROJECTOR_H_
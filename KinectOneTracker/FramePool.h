@@ -0,0 +1,108 @@
+#ifndef KINECTONETRACKER_FRAMEPOOL_H_
+#define KINECTONETRACKER_FRAMEPOOL_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "./WaitStrategy.h"
+
+//! Fixed pool of N preallocated frame slots recycled between one producer and one consumer thread.
+//! The producer acquires a free slot, fills it in place and publishes it. The consumer pops published slots
+//! in order and releases them back to the pool when done. Only slot indices cross threads, so memory is
+//! bounded by N slots and nothing is allocated once the slots have been set up.
+//! Each side can wait for the other with its own WaitPolicy: the consumer for published frames and the
+//! producer for free slots. To drop the oldest frame rather than wait, the producer can also steal back the oldest
+//! published slot the consumer has not popped yet.
+template <typename Slot, size_t N>
+class FramePool {
+ public:
+  explicit FramePool(const WaitPolicy& consumerWait = WaitPolicy(), const WaitPolicy& producerWait = WaitPolicy())
+    : m_numPopped(0)
+    , m_readyWait(consumerWait)
+    , m_freeWait(producerWait) {
+    for (size_t i = 0; i < N; ++i) { m_free.push(i); }
+  }
+
+  //! Number of slots in the pool
+  static size_t capacity() { return N; }
+
+  //! Access slot at index (e.g. for preallocating its buffers before use)
+  Slot& operator[](const size_t idx) { return m_slots[idx]; }
+  const Slot& operator[](const size_t idx) const { return m_slots[idx]; }
+
+  //! Producer: acquires a free slot into idx. Returns false if all slots are in flight
+  bool acquire(size_t& idx) { return m_free.pop(idx); }  // NOLINT
+
+  //! Producer: acquires a free slot into idx, waiting for the consumer to release one if needed.
+  //! Gives up after timeoutMicros (0 = wait forever)
+  bool acquireWait(size_t& idx, const uint64_t timeoutMicros = 0) {  // NOLINT
+    return m_freeWait.wait([&] { return m_free.pop(idx); }, timeoutMicros);
+  }
+
+  //! Producer: hands filled slot idx over to the consumer
+  void publish(const size_t idx) {
+    m_ready.push(idx);
+    m_readyWait.notify();
+  }
+
+  //! Producer: takes back the oldest published slot not yet popped by the consumer into idx, to refill it with a
+  //! newer frame. Returns false if none is pending
+  bool steal(size_t& idx) { return m_ready.pop(idx); }  // NOLINT
+
+  //! Consumer: pops the oldest published slot into idx. Returns false if none is pending
+  bool pop(size_t& idx) {  // NOLINT
+    if (!m_ready.pop(idx)) { return false; }
+    countPop();
+    return true;
+  }
+
+  //! Consumer: pops the oldest published slot into idx, waiting for one while live is set. Once live is cleared,
+  //! pending slots are still returned and false is returned only when none are left
+  bool popWait(size_t& idx, const std::atomic<bool>& live) {  // NOLINT
+    bool popped = false;
+    m_readyWait.wait([&] { popped = m_ready.pop(idx); return popped || !live; });
+    if (popped) { countPop(); }
+    return popped;
+  }
+
+  //! Number of slots popped by the consumer so far (not counting stolen ones). Published slots leave the queue in
+  //! order, so the producer can tell from this which of its frames the consumer has taken
+  uint64_t numPopped() const { return m_numPopped.load(std::memory_order_acquire); }
+
+  //! Wakes a consumer parked in popWait(), e.g. after clearing its live flag
+  void wakeConsumer() { m_readyWait.notify(); }
+
+  //! Consumer: returns slot idx to the pool once its contents are no longer needed
+  void release(const size_t idx) {
+    m_free.push(idx);
+    m_freeWait.notify();
+  }
+
+  //! Producer: number of slots acquired and not yet released, i.e. the backlog of the consumer
+  size_t inFlight() const { return N - m_free.read_available(); }
+
+  bool is_lock_free() const { return m_free.is_lock_free() && m_ready.is_lock_free(); }
+
+  //! Wait statistics of the consumer (waiting for frames) and of the producer (waiting for free slots)
+  WaitStats consumerWaitStats() const { return m_readyWait.stats(); }
+  WaitStats producerWaitStats() const { return m_freeWait.stats(); }
+
+ private:
+  void countPop() { m_numPopped.store(m_numPopped.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  std::array<Slot, N> m_slots;
+  // Both queues have room for every slot, so publish() and release() never fail. Published slots can be popped by
+  // the consumer or stolen by the producer, so their queue allows two readers
+  boost::lockfree::spsc_queue<size_t, boost::lockfree::capacity<N>> m_free;
+  boost::lockfree::queue<size_t, boost::lockfree::capacity<N>> m_ready;
+  std::atomic<uint64_t> m_numPopped;
+  AdaptiveWait
+    m_readyWait,
+    m_freeWait;
+};
+
+#endif  // KINECTONETRACKER_FRAMEPOOL_H_
@@ -0,0 +1,149 @@
+#include "./FrameSynchronizer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+std::ostream& operator<<(std::ostream& os, const SyncStats& s) {  // NOLINT
+  return os << "bundles=" << s.bundles << " withoutColor=" << s.bundlesWithoutColor
+            << " colorUnmatched=" << s.colorUnmatched << " skeletonsUnmatched=" << s.skeletonsUnmatched
+            << " maxColorSkew(ms)=" << s.maxColorSkew * 1.0E-4;
+}
+
+FrameSynchronizer::FrameSynchronizer(const INT64 tolerance, const size_t bufferFrames)
+  : m_tolerance(std::max<INT64>(tolerance, 0))
+  , m_colors(std::max<size_t>(bufferFrames, 1) + 1)
+  , m_colorHead(0)
+  , m_numColors(0)
+  , m_depths(std::max<size_t>(bufferFrames, 1))
+  , m_depthHead(0)
+  , m_numDepths(0)
+  , m_latestTime(0)
+  , m_hasLatestTime(false) {
+  m_skeletons.reserve(BODY_COUNT * (m_depths.size() + 1));
+  m_bundleSkeletons.reserve(m_skeletons.capacity());
+  m_bundleSkeletonPtrs.reserve(m_skeletons.capacity());
+}
+
+void FrameSynchronizer::onSkeleton(const Skeleton* skel) {
+  if (m_skeletons.size() == m_skeletons.capacity()) {
+    // No depth frame claimed the oldest skeleton in time
+    m_skeletons.erase(m_skeletons.begin());
+    ++m_stats.skeletonsUnmatched;
+  }
+  m_skeletons.push_back(*skel);
+  advance(skel->timestamp);
+}
+
+void FrameSynchronizer::onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+  if (m_numColors == m_colors.size()) {
+    m_colorHead = (m_colorHead + 1) % m_colors.size();
+    --m_numColors;
+    ++m_stats.colorUnmatched;
+  }
+  ColorFrame& c = m_colors[(m_colorHead + m_numColors) % m_colors.size()];
+  c.time = nTime;
+  const BYTE* p = reinterpret_cast<const BYTE*>(pColorBuffer);
+  c.data.assign(p, p + nColorBufferSize);
+  ++m_numColors;
+  advance(nTime);
+}
+
+void FrameSynchronizer::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize,
+                                            const UINT16* pDepthBuffer, const UINT nBodyIndexBufferSize,
+                                            const BYTE* pBodyIndexBuffer) {
+  if (m_numDepths == m_depths.size()) { bundleOldestDepth(); }
+  DepthFrame& d = m_depths[(m_depthHead + m_numDepths) % m_depths.size()];
+  d.time = nTime;
+  d.depth.assign(pDepthBuffer, pDepthBuffer + nDepthBufferSize);
+  d.bodyIndex.assign(pBodyIndexBuffer, pBodyIndexBuffer + nBodyIndexBufferSize);
+  ++m_numDepths;
+  advance(nTime);
+}
+
+void FrameSynchronizer::advance(const INT64 nTime) {
+  if (!m_hasLatestTime || nTime > m_latestTime) {
+    m_latestTime = nTime;
+    m_hasLatestTime = true;
+  }
+  // Streams arrive in time order, so nothing earlier than the latest time minus the tolerance is still to come
+  while (m_numDepths > 0 && m_depths[m_depthHead].time + m_tolerance < m_latestTime) { bundleOldestDepth(); }
+}
+
+void FrameSynchronizer::bundleOldestDepth() {
+  const DepthFrame& d = m_depths[m_depthHead];
+  const size_t nc = m_colors.size();
+
+  // Color frames too old for this depth frame will not match later ones either
+  while (m_numColors > 0 && m_colors[m_colorHead].time < d.time - m_tolerance) {
+    m_colorHead = (m_colorHead + 1) % nc;
+    --m_numColors;
+    ++m_stats.colorUnmatched;
+  }
+  // Nearest color frame within the tolerance. Ones before it are dropped with it
+  size_t numColorsUsed = 0;
+  const ColorFrame* pColor = nullptr;
+  for (size_t k = 0; k < m_numColors; ++k) {
+    const ColorFrame& c = m_colors[(m_colorHead + k) % nc];
+    if (c.time > d.time + m_tolerance) { break; }
+    if (pColor == nullptr || std::abs(c.time - d.time) < std::abs(pColor->time - d.time)) {
+      pColor = &c;
+      numColorsUsed = k + 1;
+    }
+  }
+
+  // Skeletons within the tolerance join the bundle, older ones are dropped and later ones keep waiting
+  m_bundleSkeletons.clear();
+  m_bundleSkeletonPtrs.clear();
+  size_t numKept = 0;
+  for (size_t i = 0; i < m_skeletons.size(); ++i) {
+    const Skeleton& s = m_skeletons[i];
+    if (s.timestamp < d.time - m_tolerance) {
+      ++m_stats.skeletonsUnmatched;
+    } else if (s.timestamp <= d.time + m_tolerance) {
+      m_bundleSkeletons.push_back(s);
+    } else {
+      m_skeletons[numKept++] = s;
+    }
+  }
+  m_skeletons.resize(numKept);
+  for (const Skeleton& s : m_bundleSkeletons) { m_bundleSkeletonPtrs.push_back(&s); }
+
+  FrameBundle b;
+  b.time = d.time;
+  b.colorTime = pColor ? pColor->time : 0;
+  b.nColorBufferSize = pColor ? static_cast<UINT>(pColor->data.size()) : 0;
+  b.pColorBuffer = pColor ? reinterpret_cast<const RGBQUAD*>(pColor->data.data()) : nullptr;
+  b.nDepthBufferSize = static_cast<UINT>(d.depth.size());
+  b.pDepthBuffer = d.depth.data();
+  b.nBodyIndexBufferSize = static_cast<UINT>(d.bodyIndex.size());
+  b.pBodyIndexBuffer = d.bodyIndex.data();
+  b.pRegisteredColor = nullptr;
+  b.numSkeletons = m_bundleSkeletonPtrs.size();
+  b.skeletons = m_bundleSkeletonPtrs.data();
+
+  ++m_stats.bundles;
+  if (pColor != nullptr) {
+    m_stats.maxColorSkew = std::max(m_stats.maxColorSkew, static_cast<int64_t>(std::abs(pColor->time - d.time)));
+  } else {
+    ++m_stats.bundlesWithoutColor;
+  }
+  for (KinectOneListener* l : m_listeners) { l->onFrameBundle(b); }
+
+  // Free the slots only after delivery, since the bundle points into them
+  if (numColorsUsed > 0) {
+    m_stats.colorUnmatched += numColorsUsed - 1;
+    m_colorHead = (m_colorHead + numColorsUsed) % nc;
+    m_numColors -= numColorsUsed;
+  }
+  m_depthHead = (m_depthHead + 1) % m_depths.size();
+  --m_numDepths;
+}
+
+void FrameSynchronizer::flush() {
+  while (m_numDepths > 0) { bundleOldestDepth(); }
+  m_stats.colorUnmatched += m_numColors;
+  m_numColors = 0;
+  m_stats.skeletonsUnmatched += m_skeletons.size();
+  m_skeletons.clear();
+  m_hasLatestTime = false;
+}
@@ -0,0 +1,88 @@
+#ifndef KINECTONETRACKER_FRAMESYNCHRONIZER_H_
+#define KINECTONETRACKER_FRAMESYNCHRONIZER_H_
+
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./KinectTypes.h"
+#include "./Recording.h"
+
+//! Counters of a FrameSynchronizer
+struct SyncStats {
+  uint64_t bundles;               // Bundles delivered (one per depth frame)
+  uint64_t bundlesWithoutColor;   // Bundles delivered without a color frame
+  uint64_t colorUnmatched;        // Color frames dropped without matching a depth frame
+  uint64_t skeletonsUnmatched;    // Skeletons dropped without matching a depth frame
+  int64_t maxColorSkew;           // Largest |color time - depth time| of a bundle, in 100 ns ticks
+
+  SyncStats() : bundles(0), bundlesWithoutColor(0), colorUnmatched(0), skeletonsUnmatched(0), maxColorSkew(0) { }
+};
+
+std::ostream& operator<<(std::ostream& os, const SyncStats& s);  // NOLINT
+
+//! Listener stage matching the color, depth and body index, and skeleton streams by timestamp, and delivering one
+//! FrameBundle per depth frame to the onFrameBundle() method of attached listeners. Attach it to a tracker as
+//! skeleton, color and depth listener. Frames are copied into a small jitter buffer of reused slots. A depth frame
+//! is bundled once a frame later than its time plus the tolerance has arrived on any stream (or once the buffer
+//! is full), with the nearest color frame and all skeletons within the tolerance of its time. Frames left over
+//! are dropped and counted. Bundles are delivered on the thread calling the stage, about one frame late.
+class FrameSynchronizer : public KinectOneListener {
+ public:
+  // Default tolerance: half a frame at 30 fps, in 100 ns ticks
+  static const INT64 kDefaultTolerance = 166666;
+
+  //! Matches frames at most tolerance apart, keeping up to bufferFrames depth frames waiting for their match
+  explicit FrameSynchronizer(const INT64 tolerance = kDefaultTolerance, const size_t bufferFrames = 3);
+
+  void attachListener(KinectOneListener* listener) { m_listeners.push_back(listener); }
+
+  void onSkeleton(const Skeleton* skel);
+  void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+  void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                           const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
+
+  //! Bundles all waiting depth frames and drops the remaining color frames and skeletons, e.g. once the tracker
+  //! has stopped
+  void flush();
+
+  const SyncStats& stats() const { return m_stats; }
+
+ private:
+  FrameSynchronizer(const FrameSynchronizer&);
+  FrameSynchronizer& operator=(const FrameSynchronizer&);
+
+  struct ColorFrame {
+    INT64 time;
+    std::vector<BYTE> data;
+  };
+  struct DepthFrame {
+    INT64 time;
+    std::vector<UINT16> depth;
+    std::vector<BYTE> bodyIndex;
+  };
+
+  //! Notes a frame at nTime, then bundles depth frames that can no longer gain a match
+  void advance(const INT64 nTime);
+  //! Bundles the oldest waiting depth frame and delivers the bundle
+  void bundleOldestDepth();
+
+  const INT64 m_tolerance;
+  std::list<KinectOneListener*> m_listeners;
+  // Ring buffers of waiting color and depth frames, oldest at head. Slots keep their buffers between frames
+  std::vector<ColorFrame> m_colors;
+  size_t m_colorHead, m_numColors;
+  std::vector<DepthFrame> m_depths;
+  size_t m_depthHead, m_numDepths;
+  // Waiting skeletons in arrival order, and those of the bundle being delivered
+  std::vector<Skeleton> m_skeletons, m_bundleSkeletons;
+  std::vector<const Skeleton*> m_bundleSkeletonPtrs;
+  // Latest frame time seen on any stream
+  INT64 m_latestTime;
+  bool m_hasLatestTime;
+  SyncStats m_stats;
+};
+
+#endif  // KINECTONETRACKER_FRAMESYNCHRONIZER_H_
@@ -0,0 +1,100 @@
+#include "./JsonWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include <charconv>
+#endif
+#endif
+
+JsonWriter::JsonWriter(std::ostream& os, const size_t bufferSize)  // NOLINT
+  : m_os(os)
+  , m_buf(bufferSize < 64 ? 64 : bufferSize)
+  , m_pos(m_buf.data())
+  , m_end(m_buf.data() + m_buf.size())
+  , m_flushedBytes(0) { }
+
+JsonWriter::~JsonWriter() {
+  flush();
+}
+
+void JsonWriter::flush() {
+  const size_t n = m_pos - m_buf.data();
+  if (n > 0) {
+    m_os.write(m_buf.data(), n);
+    m_flushedBytes += n;
+    m_pos = m_buf.data();
+  }
+}
+
+int formatShortestFloat(const float v, char* out) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  return static_cast<int>(std::to_chars(out, out + 32, v).ptr - out);
+#else
+  // Increase precision until the text parses back to the same float (at most 9 significant digits are needed)
+  for (int precision = 6; precision < 9; ++precision) {
+    const int n = snprintf(out, 32, "%.*g", precision, v);
+    if (strtof(out, nullptr) == v) { return n; }
+  }
+  return snprintf(out, 32, "%.9g", v);
+#endif
+}
+
+JsonWriter& JsonWriter::value(const float v) {
+  if (!std::isfinite(v)) { return raw("null", 4); }
+  reserve(32);
+  m_pos += formatShortestFloat(v, m_pos);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const double v) {
+  if (!std::isfinite(v)) { return raw("null", 4); }
+  reserve(32);
+  m_pos += snprintf(m_pos, 32, "%.17g", v);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const uint64_t v) {
+  char digits[20];
+  int n = 0;
+  uint64_t x = v;
+  do {
+    digits[n++] = static_cast<char>('0' + x % 10);
+    x /= 10;
+  } while (x != 0);
+  reserve(n);
+  while (n > 0) { *m_pos++ = digits[--n]; }
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const int64_t v) {
+  if (v < 0) {
+    raw('-');
+    return value(static_cast<uint64_t>(0) - static_cast<uint64_t>(v));
+  }
+  return value(static_cast<uint64_t>(v));
+}
+
+JsonWriter& JsonWriter::value(const std::string& s) {
+  raw('"');
+  for (const char c : s) {
+    switch (c) {
+      case '"':  raw("\\\"", 2); break;
+      case '\\': raw("\\\\", 2); break;
+      case '\n': raw("\\n", 2);  break;
+      case '\r': raw("\\r", 2);  break;
+      case '\t': raw("\\t", 2);  break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char esc[8];
+          snprintf(esc, sizeof(esc), "\\u%04x", static_cast<unsigned char>(c));
+          raw(esc, 6);
+        } else {
+          raw(c);
+        }
+    }
+  }
+  return raw('"');
+}
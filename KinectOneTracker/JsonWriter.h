@@ -0,0 +1,85 @@
+#ifndef KINECTONETRACKER_JSONWRITER_H_
+#define KINECTONETRACKER_JSONWRITER_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! Buffered JSON text writer. Output accumulates in a fixed buffer that is written to the underlying stream only
+//! when full or on flush(), and numbers are formatted without going through ostream. Floats use the shortest
+//! representation that parses back to the same value; non-finite values are written as null.
+class JsonWriter {
+ public:
+  explicit JsonWriter(std::ostream& os, const size_t bufferSize = 1 << 20);  // NOLINT
+  ~JsonWriter();
+
+  //! Writes the buffer to the underlying stream
+  void flush();
+
+  //! Total number of bytes written so far (including buffered bytes)
+  uint64_t bytesWritten() const { return m_flushedBytes + (m_pos - m_buf.data()); }
+
+  JsonWriter& raw(const char c) {
+    reserve(1);
+    *m_pos++ = c;
+    return *this;
+  }
+  JsonWriter& raw(const char* s, const size_t n) {
+    if (n > m_buf.size()) { flush(); m_os.write(s, n); m_flushedBytes += n; return *this; }
+    reserve(n);
+    memcpy(m_pos, s, n);
+    m_pos += n;
+    return *this;
+  }
+  JsonWriter& raw(const char* s) { return raw(s, strlen(s)); }
+
+  //! Writes "k": (k must not need escaping)
+  JsonWriter& key(const char* k) {
+    raw('"');
+    raw(k);
+    return raw("\": ", 3);
+  }
+
+  JsonWriter& value(const float v);
+  JsonWriter& value(const double v);
+  JsonWriter& value(const int64_t v);
+  JsonWriter& value(const uint64_t v);
+  JsonWriter& value(const int v) { return value(static_cast<int64_t>(v)); }
+  JsonWriter& value(const unsigned int v) { return value(static_cast<uint64_t>(v)); }
+  //! Writes s as an escaped JSON string
+  JsonWriter& value(const std::string& s);
+
+  //! Writes n elements of array-like x as [a,b,...,z]
+  template <typename T>
+  JsonWriter& array(const T& x, const size_t n) {
+    raw('[');
+    for (size_t i = 0; i < n; ++i) {
+      if (i > 0) { raw(','); }
+      element(x[i]);
+    }
+    return raw(']');
+  }
+
+ private:
+  // Scalars are written as values, nested arrays recursively
+  template <typename T> void element(const T& v) { value(v); }
+  template <typename T, size_t N> void element(const std::array<T, N>& a) { array(a, N); }
+
+  void reserve(const size_t n) {
+    if (static_cast<size_t>(m_end - m_pos) < n) { flush(); }
+  }
+
+  std::ostream& m_os;
+  std::vector<char> m_buf;
+  char* m_pos;
+  char* m_end;
+  uint64_t m_flushedBytes;
+};
+
+//! Formats v into out (at least 32 chars) using the shortest round-trip representation. Returns number of chars
+int formatShortestFloat(const float v, char* out);
+
+#endif  // KINECTONETRACKER_JSONWRITER_H_
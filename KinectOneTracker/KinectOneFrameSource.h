@@ -0,0 +1,44 @@
+#ifndef KINECTONETRACKER_KINECTONEFRAMESOURCE_H_
+#define KINECTONETRACKER_KINECTONEFRAMESOURCE_H_
+
+#include <utility>
+#include <vector>
+
+#include "./KinectTypes.h"
+
+// Forward declaration
+struct KinectOneListener;
+
+//! Source of color, depth+bodyIndex and body frames driven by KinectOneTracker::update().
+//! Implemented by the physical sensor as well as by hardware-free sources.
+class KinectOneFrameSource {
+ public:
+  //! Streams that can be requested from a source (or'ed together)
+  enum Stream {
+    Stream_Color = 0x1,
+    Stream_DepthAndBodyIndex = 0x2,
+    Stream_Body = 0x4
+  };
+
+  virtual ~KinectOneFrameSource() { }
+
+  //! Opens the source. Returns false on failure
+  virtual bool init() = 0;
+
+  //! Acquires the next frame set if available and delivers the requested streams (mask of Stream values) to sink
+  //! in color, depth+bodyIndex, body order. Frame buffers are only valid for the duration of each callback.
+  //! Returns whether a frame set was delivered
+  virtual bool update(const int streams, KinectOneListener* sink) = 0;
+
+  //! Returns per depth pixel (X, Y) factors that map a depth value Z to camera space point (X*Z, Y*Z, Z)
+  virtual std::vector<std::pair<float, float>> getDepthPixelCoordsInCameraSpace() = 0;
+
+  //! Maps each pixel of a depth frame to (x, y) color frame coordinates written to colorXY (2 floats per pixel),
+  //! using the source's own calibration. Returns false if the source has none
+  virtual bool mapDepthFrameToColorSpace(const UINT /*nDepthSize*/, const UINT16* /*pDepthBuffer*/,
+                                         float* /*colorXY*/) {
+    return false;
+  }
+};
+
+#endif  // KINECTONETRACKER_KINECTONEFRAMESOURCE_H_
@@ -1,20 +1,88 @@
 #ifndef KINECTONETRACKER_KINECTONELISTENER_H_
 #define KINECTONETRACKER_KINECTONELISTENER_H_
 
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-#include <Kinect.h>
+#include "./KinectTypes.h"
+
+#include <cstddef>
+#include <vector>
 
 // Forward declaration
 struct Skeleton;
 
+//! Color, depth and body index frames and skeletons matched by timestamp (see FrameSynchronizer.h). pColorBuffer is
+//! null if no color frame matched the depth frame, and pRegisteredColor unless a registration stage filled it in
+struct FrameBundle {
+  INT64 time;                       // Timestamp of the depth and body index frame
+  INT64 colorTime;                  // Timestamp of the color frame
+  UINT nColorBufferSize;
+  const RGBQUAD* pColorBuffer;
+  UINT nDepthBufferSize;
+  const UINT16* pDepthBuffer;
+  UINT nBodyIndexBufferSize;
+  const BYTE* pBodyIndexBuffer;
+  const BYTE* pRegisteredColor;     // 3 bytes (BGR) per depth pixel
+  size_t numSkeletons;
+  const Skeleton* const* skeletons;
+};
+
 // Interface for acquiring KinectOne frames
 struct KinectOneListener {
   virtual void onSkeleton(const Skeleton* skel) = 0;
   virtual void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) = 0;
   virtual void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
                                    const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer) = 0;
+  //! Depth and body index frame together with color registered to it (3 bytes, BGR, per depth pixel), delivered by
+  //! registration stages (see DepthColorRegistration.h). By default only the depth and body index frame is used
+  virtual void onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                 const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer,
+                                 const BYTE* /*pRegisteredColor*/) {
+    onDepthAndBodyIndex(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+  }
+  //! Frames of one tick, delivered by FrameSynchronizer. By default they are passed on one by one
+  virtual void onFrameBundle(const FrameBundle& b) {
+    if (b.pColorBuffer != nullptr) { onColor(b.colorTime, b.nColorBufferSize, b.pColorBuffer); }
+    if (b.pRegisteredColor != nullptr) {
+      onRegisteredColor(b.time, b.nDepthBufferSize, b.pDepthBuffer, b.nBodyIndexBufferSize, b.pBodyIndexBuffer,
+                        b.pRegisteredColor);
+    } else {
+      onDepthAndBodyIndex(b.time, b.nDepthBufferSize, b.pDepthBuffer, b.nBodyIndexBufferSize, b.pBodyIndexBuffer);
+    }
+    for (size_t i = 0; i < b.numSkeletons; ++i) { onSkeleton(b.skeletons[i]); }
+  }
+};
+
+//! Passes each stream on to the listeners attached for it, such as the first stages of processing chains. Attached
+//! to the tracker for all of its streams in place of those listeners, it gets a single queue and worker thread under
+//! asynchronous dispatch (see KinectOneTracker::setAsyncDispatch()), so that the stages and the listeners they feed
+//! are all called from that one thread, in source order, whichever chain a frame goes through
+class StreamRouter : public KinectOneListener {
+ public:
+  void attachSkeletonListener(KinectOneListener* listener) { m_skelListeners.push_back(listener); }
+  void attachColorListener(KinectOneListener* listener) { m_colorListeners.push_back(listener); }
+  void attachDepthListener(KinectOneListener* listener) { m_depthListeners.push_back(listener); }
+
+  bool hasSkeletonListeners() const { return !m_skelListeners.empty(); }
+  bool hasColorListeners() const { return !m_colorListeners.empty(); }
+  bool hasDepthListeners() const { return !m_depthListeners.empty(); }
+
+  void onSkeleton(const Skeleton* skel) {
+    for (KinectOneListener* l : m_skelListeners) { l->onSkeleton(skel); }
+  }
+  void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+    for (KinectOneListener* l : m_colorListeners) { l->onColor(nTime, nColorBufferSize, pColorBuffer); }
+  }
+  void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                           const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer) {
+    for (KinectOneListener* l : m_depthListeners) {
+      l->onDepthAndBodyIndex(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+    }
+  }
+
+ private:
+  std::vector<KinectOneListener*>
+    m_skelListeners,
+    m_colorListeners,
+    m_depthListeners;
 };
 
 #endif  // KINECTONETRACKER_KINECTONELISTENER_H_
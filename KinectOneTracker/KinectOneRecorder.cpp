@@ -1,195 +1,559 @@
 #include "./KinectOneRecorder.h"
+#include "./DepthPacking.h"
+#include "./MappedFile.h"
+#include "./Metrics.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <string>
 #include <vector>
-#include <fstream>
 
 using std::string;  using std::cout;  using std::cerr;  using std::endl;
 
+// Returns options with given basic settings and default wait policies
+inline RecorderOptions makeOptions(const bool showCapture, const double fps, const string& recId) {
+  RecorderOptions opts;
+  opts.showCapture = showCapture;
+  opts.fps = fps;
+  opts.id = recId;
+  return opts;
+}
+
 KinectOneRecorder::KinectOneRecorder(const bool showCapture, const double fps, const string& recId)
+  : KinectOneRecorder(makeOptions(showCapture, fps, recId)) { }
+
+KinectOneRecorder::KinectOneRecorder(const RecorderOptions& opts)
   : m_pRecording(new Recording)
   , m_isLive(true)
-  , m_pointCloudDumped(false)
-  , m_showCapture(showCapture)
-  , m_fps(fps)
-  , m_frameDeltaTime(static_cast<int64_t>(1.0E7 / m_fps))
-  , m_colorMatYUY2(kColorHeight, kColorWidth, CV_8UC2)
-  , m_colorMatBGRSmall(kColorHeight / 2, kColorWidth / 2, CV_8UC3)
-  , m_colorMatBGR(kColorHeight, kColorWidth, CV_8UC3)
-  , m_depthMat(kDepthHeight, kDepthWidth, CV_16UC1)
-  , m_depthMatSplit(kDepthHeight, kDepthWidth, CV_8UC2)
-  , m_bodyIndexMat(kDepthHeight, kDepthWidth, CV_8UC1)
-  , m_depthMatGray(kDepthHeight, kDepthWidth, CV_8U)
-  , m_depthBodyIndexMat(kDepthHeight, kDepthWidth, CV_8UC3)
-  , m_colorWorker(&KinectOneRecorder::consumeColor, this)
-  , m_depthWorker(&KinectOneRecorder::consumeDepthAndBodyIndex, this) {
+  , m_showCapture(opts.showCapture)
+  , m_parallelColorConvert(opts.parallelColorConvert)
+  , m_recordRegisteredColor(opts.recordRegisteredColor)
+  , m_colorStage(opts.color, opts.fps, kColorWidth, kColorHeight)
+  , m_depthStage(opts.depth, opts.fps, kDepthWidth, kDepthHeight)
+  , m_colorMatBGRSmall(m_colorStage.outputSize(), CV_8UC3)
+  , m_depthWriter(8, std::max(1, opts.depthCodecThreads))
+  , m_colorSegments(std::max(1, opts.videoSegmentThreads), std::max(1, opts.videoSegmentBuffer))
+  , m_registeredSegments(std::max(1, opts.videoSegmentThreads), std::max(1, opts.videoSegmentBuffer))
+  , m_colorPool(opts.colorConsumerWait, opts.colorProducerWait)
+  , m_depthBodyIndexPool(opts.depthConsumerWait, opts.depthProducerWait)
+  , m_colorStream(opts.colorBackpressure, true, m_colorStage.frameDeltaTime())
+  , m_depthStream(opts.depthBackpressure, false, m_depthStage.frameDeltaTime())
+  , m_depthScratch(m_depthStage.outputSize().area())
+  , m_bodyIndexScratch(m_depthStage.outputSize().area())
+  , m_reprojector(m_depthStage.outputSize().width, m_depthStage.outputSize().height)
+  , m_pointCloudInterval(std::max(0, opts.pointCloudInterval))
+  , m_pointCloudMaxFrames(std::max(0, opts.pointCloudMaxFrames))
+  , m_depthFrameIndex(0)
+  , m_numPointCloudsQueued(0)
+  , m_pointCloudExporter(m_reprojector, std::max(1, opts.pointCloudThreads), std::max(1, opts.pointCloudQueue))
+  , m_numBundles(0)
+  , m_numBundlesWithoutColor(0)
+  , m_printStatsOnStop(opts.printStatsOnStop) {
+    // Slots hold cropped frames: color as YUY2 of the region, depth packed at the output size
+    const cv::Rect& colorRoi = m_colorStage.roi();
+    const cv::Size depthSize = m_depthStage.outputSize();
+    for (size_t i = 0; i < m_colorPool.capacity() && m_colorStage.enabled(); ++i) {
+      m_colorPool[i].mat.create(colorRoi.height, colorRoi.width, CV_8UC2);
+    }
+    for (size_t i = 0; i < m_depthBodyIndexPool.capacity() && m_depthStage.enabled(); ++i) {
+      m_depthBodyIndexPool[i].mat.create(depthSize, CV_8UC3);
+      if (m_recordRegisteredColor) { m_depthBodyIndexPool[i].registered.create(depthSize, CV_8UC3); }
+      m_depthBodyIndexPool[i].hasRegistered = false;
+    }
+    m_reprojector.setRayTable(m_depthStage.cropRays(DepthReprojector(kDepthWidth, kDepthHeight).rayTable()));
     m_pRecording->camera = {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+    m_pRecording->colorGeometry = m_colorStage.geometry();
+    m_pRecording->depthGeometry = m_depthStage.geometry();
+    const string& recId = opts.id;
     m_pRecording->id = recId;
     const int fourccLAGS = cv::VideoWriter::fourcc('L', 'A', 'G', 'S');
     const string
       colorFile = recId + ".color.avi",
-      depthFile = recId + ".depth.avi";
+      depthFile = recId + ".depth.kdc",
+      registeredFile = recId + ".registered.avi",
+      skeletonFile = recId + ".skel",
+      skeletonStreamFile = recId + ".skc",
+      statsFile = recId + (opts.statsJson ? ".stats.json" : ".stats.csv");
+
+    if (m_skeletonLog.open(skeletonFile)) {
+      m_pRecording->skeletonLogFile = skeletonFile;
+    }
+    if (opts.skeletonStream && !m_skeletonStream.open(skeletonStreamFile)) {
+      cerr << "Could not open skeleton stream file " << skeletonStreamFile << endl;
+    }
+
+    const bool segmented = opts.videoSegmentFrames > 0;
+    const double colorFps = m_colorStage.fps(), depthFps = m_depthStage.fps();
+    if (!m_colorStage.enabled()) {
+      // Not recorded
+    } else if (segmented) {
+      m_colorSegments.open(recId + ".color", fourccLAGS, colorFps, m_colorMatBGRSmall.size(),
+                           opts.videoSegmentFrames);
+    } else {
+      m_colorWriter.open(colorFile.c_str(), fourccLAGS, colorFps, m_colorMatBGRSmall.size());
+      if (!m_colorWriter.isOpened()) {
+        cerr << "Could not open color video file " << colorFile << endl;
+      }
+    }
+
+    if (m_depthStage.enabled() && !m_depthWriter.open(depthFile, depthSize.width, depthSize.height)) {
+      cerr << "Could not open depth stream file " << depthFile << endl;
+    }
 
-    m_colorWriter.open(colorFile.c_str(), fourccLAGS, m_fps, m_colorMatBGRSmall.size());
-    if (!m_colorWriter.isOpened()) {
-      cerr << "Could not open color video file " << colorFile << endl;
+    if (!m_recordRegisteredColor || !m_depthStage.enabled()) {
+      // Not recorded
+    } else if (segmented) {
+      m_registeredSegments.open(recId + ".registered", fourccLAGS, depthFps, depthSize, opts.videoSegmentFrames);
+    } else {
+      m_registeredWriter.open(registeredFile.c_str(), fourccLAGS, depthFps, depthSize);
+      if (!m_registeredWriter.isOpened()) {
+        cerr << "Could not open registered color video file " << registeredFile << endl;
+      }
+    }
+
+    if (m_pointCloudInterval > 0 && m_depthStage.enabled()) {
+      const PointCloudExporter::Mode mode =
+        opts.pointCloudChunked ? PointCloudExporter::Mode_Chunked : PointCloudExporter::Mode_PerFrame;
+      if (!m_pointCloudExporter.open(recId, mode)) {
+        cerr << "Could not open point cloud stream file " << recId << ".pcs" << endl;
+      }
     }
 
-    m_depthWriter.open(depthFile.c_str(), fourccLAGS, m_fps, m_depthMat.size());
-    if (!m_depthWriter.isOpened()) {
-      cerr << "Could not open depth video file " << depthFile << endl;
+    if (opts.statsInterval > 0 && !m_metricsReporter.start(statsFile, opts.statsInterval)) {
+      cerr << "Could not open stats file " << statsFile << endl;
     }
 
-    if (!m_colorMatQ.is_lock_free()) {
+    if (!m_colorPool.is_lock_free() || !m_depthBodyIndexPool.is_lock_free()) {
       cerr << "Warning: frame consumer queues not lock-free." << endl;
     }
+
+    // Consumers start once buffers and writers are set up
+    m_colorWorker = std::thread(&KinectOneRecorder::consumeColor, this);
+    m_depthWorker = std::thread(&KinectOneRecorder::consumeDepthAndBodyIndex, this);
 }
 
-KinectOneRecorder::~KinectOneRecorder() {
+void KinectOneRecorder::stop() {
   m_isLive = false;
+  m_colorPool.wakeConsumer();
+  m_depthBodyIndexPool.wakeConsumer();
+  // Nothing queued can be dropped any more, and the consumers drain their queues before exiting
+  commitTaken(m_colorStream, m_colorPool, true);
+  commitTaken(m_depthStream, m_depthBodyIndexPool, true);
+  if (m_skeletonLog.isOpen() && !m_skeletonLog.close(m_pRecording.get())) {
+    cerr << "Error writing skeleton log " << m_pRecording->skeletonLogFile << endl;
+  }
+  if (m_skeletonStream.isOpen() && !m_skeletonStream.close()) {
+    cerr << "Error writing skeleton stream " << m_pRecording->id << ".skc" << endl;
+  }
+  const MetricsSnapshot metrics = m_metricsReporter.stop();
+  if (m_printStatsOnStop) {
+    cout << "Pipeline metrics:" << endl;
+    metrics.printSummary(cout);
+    m_printStatsOnStop = false;  // Only once, not again from the destructor
+  }
+}
+
+KinectOneRecorder::~KinectOneRecorder() {
+  stop();
   if (m_colorWorker.joinable()) { m_colorWorker.join(); }
   if (m_depthWorker.joinable()) { m_depthWorker.join(); }
   if (m_colorWriter.isOpened()) { m_colorWriter.release(); }
-  if (m_depthWriter.isOpened()) { m_depthWriter.release(); }
+  if (m_registeredWriter.isOpened()) { m_registeredWriter.release(); }
+  m_colorSegments.close();
+  m_registeredSegments.close();
+  if (m_depthWriter.isOpen() && !m_depthWriter.close()) {
+    cerr << "Error writing depth stream " << m_pRecording->id << ".depth.kdc" << endl;
+  }
+  if (m_pointCloudExporter.isOpen() && !m_pointCloudExporter.close()) {
+    cerr << "Error writing point clouds of " << m_pRecording->id << endl;
+  }
   m_pRecording->isLive = false;
 }
 
 //! Returns system time as number of microseconds since Jan 1st 1601 UTC
 inline uint64_t systemTimeNow() {
+#ifdef _WIN32
   FILETIME ft;
   GetSystemTimeAsFileTime(&ft);
   ULARGE_INTEGER t;
   t.HighPart = ft.dwHighDateTime;
   t.LowPart = ft.dwLowDateTime;
   return t.QuadPart / 10;
+#else
+  // Offset between the 1601 and 1970 epochs
+  const uint64_t kEpochOffsetMicros = 11644473600ull * 1000000ull;
+  const auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+  return kEpochOffsetMicros + std::chrono::duration_cast<std::chrono::microseconds>(sinceEpoch).count();
+#endif
 }
 
 void KinectOneRecorder::onSkeleton(const Skeleton* skel) {
   if (!m_isLive) { return; }
+  Metrics::count(Counter_Skeletons);
   if (!m_pRecording->isLive) { m_pRecording->isLive = true; }
-  if (m_pRecording->skeletons.empty()) {
+  if (m_pRecording->numSkeletons() == 0) {
     m_pRecording->startTime = systemTimeNow();
   }
-  m_pRecording->skeletons.push_back(*skel);
+  if (m_skeletonLog.isOpen()) {
+    m_skeletonLog.append(*skel);
+    ++m_pRecording->numLoggedSkeletons;
+  } else {
+    m_pRecording->skeletons.push_back(*skel);
+  }
+  if (m_skeletonStream.isOpen()) { m_skeletonStream.append(*skel); }
   m_pRecording->endTime = systemTimeNow();
 }
 
 void KinectOneRecorder::onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
   if (!m_isLive) { return; }
-  if (m_pRecording->colorTimestamps.empty() || (nTime - m_pRecording->colorTimestamps.back()) > m_frameDeltaTime) {
-    memcpy(m_colorMatYUY2.data, pColorBuffer, nColorBufferSize);
-    while (!m_colorMatQ.push(m_colorMatYUY2)) { }
-    m_pRecording->colorTimestamps.push_back(nTime);
+  Metrics::count(Counter_ColorFrames);
+  if (m_colorStage.enabled() && isFrameDue(m_colorStream, nTime)) {
+    pushColorFrame(nTime, nColorBufferSize, pColorBuffer);
   }
 }
 
 void KinectOneRecorder::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
                                             const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer) {
   if (!m_isLive) { return; }
-  if (m_pRecording->depthTimestamps.empty() || (nTime - m_pRecording->depthTimestamps.back()) > m_frameDeltaTime) {
-    memcpy(m_depthMatSplit.data, pDepthBuffer, sizeof(pDepthBuffer[0]) * nDepthBufferSize);
-    memcpy(m_bodyIndexMat.data, pBodyIndexBuffer, sizeof(pBodyIndexBuffer[0]) * nBodyIndexBufferSize);
-    cv::split(m_depthMatSplit, m_depthMatSplitChannels);
-    cv::Mat in[] = { m_bodyIndexMat, m_depthMatSplitChannels[0], m_depthMatSplitChannels[1] };
-    cv::merge(in, 3, m_depthBodyIndexMat);
-    while (!m_depthBodyIndexMatQ.push(m_depthBodyIndexMat)) { }
+  Metrics::count(Counter_DepthFrames);
+  if (m_depthStage.enabled() && isFrameDue(m_depthStream, nTime)) {
+    pushDepthFrame(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer, nullptr);
+  }
+}
+
+void KinectOneRecorder::onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                          const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer,
+                                          const BYTE* pRegisteredColor) {
+  if (!m_isLive) { return; }
+  Metrics::count(Counter_DepthFrames);
+  if (m_depthStage.enabled() && isFrameDue(m_depthStream, nTime)) {
+    pushDepthFrame(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer, pRegisteredColor);
+  }
+}
+
+void KinectOneRecorder::onFrameBundle(const FrameBundle& b) {
+  if (!m_isLive) { return; }
+  for (size_t i = 0; i < b.numSkeletons; ++i) { onSkeleton(b.skeletons[i]); }
+  ++m_numBundles;
+  Metrics::count(Counter_DepthFrames);
+  if (b.pColorBuffer != nullptr) { Metrics::count(Counter_ColorFrames); }
+  // With one of the streams not recorded, the other is decimated and recorded on its own
+  if (!m_colorStage.enabled() || !m_depthStage.enabled()) {
+    if (m_depthStage.enabled() && isFrameDue(m_depthStream, b.time)) {
+      pushDepthFrame(b.time, b.nDepthBufferSize, b.pDepthBuffer, b.nBodyIndexBufferSize, b.pBodyIndexBuffer,
+                     b.pRegisteredColor);
+    } else if (m_colorStage.enabled() && b.pColorBuffer != nullptr && isFrameDue(m_colorStream, b.colorTime)) {
+      pushColorFrame(b.colorTime, b.nColorBufferSize, b.pColorBuffer);
+    }
+    return;
+  }
+  if (b.pColorBuffer == nullptr) {
+    ++m_numBundlesWithoutColor;
+    return;
+  }
+  // Decimate on the depth timestamp, so that color and depth are kept or skipped together, at the lower rate of both
+  // streams: the color timestamp is only checked when color is recorded at the lower rate
+  const int64_t colorDelta = m_colorStream.frameDeltaTime * m_colorStream.rateDivisor;
+  const int64_t depthDelta = m_depthStream.frameDeltaTime * m_depthStream.rateDivisor;
+  if (!isFrameDue(m_depthStream, b.time) || (colorDelta > depthDelta && !isFrameDue(m_colorStream, b.colorTime))) {
+    return;
+  }
+  if (!isValidColorFrame(b.nColorBufferSize) || !isValidDepthFrame(b.nDepthBufferSize, b.nBodyIndexBufferSize)) {
+    return;
+  }
+  // Both slots are acquired before either frame is queued, so that a frame is only dropped together with its pair.
+  // Dropping the oldest queued frame could unpair a frame already recorded, so bundles drop the new pair instead
+  commitTaken(m_colorStream, m_colorPool);
+  commitTaken(m_depthStream, m_depthBodyIndexPool);
+  size_t colorSlot, depthSlot;
+  if (!acquireSlot(m_colorStream, m_colorPool, b.colorTime, false, colorSlot)) {
+    recordDroppedFrame(m_depthStream, b.time);
+    return;
+  }
+  if (!acquireSlot(m_depthStream, m_depthBodyIndexPool, b.time, false, depthSlot)) {
+    m_colorStream.spareSlot = colorSlot;
+    m_colorStream.hasSpareSlot = true;
+    recordDroppedFrame(m_colorStream, b.colorTime);
+    return;
+  }
+  queueColorFrame(colorSlot, b.colorTime, b.pColorBuffer);
+  queueDepthFrame(depthSlot, b.time, b.pDepthBuffer, b.pBodyIndexBuffer, b.pRegisteredColor);
+}
+
+template <size_t N>
+bool KinectOneRecorder::acquireSlot(StreamState& s, FramePool<FrameSlot, N>& pool, const INT64 nTime,
+                                    const bool mayDropOldest, size_t& slot) {  // NOLINT
+  // Ticks after the last rate change before Backpressure_Degrade tries a higher rate again
+  const INT64 kRateRestoreDelay = 20000000;
+  if (s.hasSpareSlot) {
+    slot = s.spareSlot;
+    s.hasSpareSlot = false;
+    return true;
+  }
+  if (pool.acquire(slot)) {
+    if (s.rateDivisor > 1 && nTime - s.lastRateChange > kRateRestoreDelay && pool.inFlight() <= N / 4) {
+      s.rateDivisor /= 2;
+      s.lastRateChange = nTime;
+    }
+    return true;
+  }
+  Metrics::count(s.isColor ? Counter_ColorSlotWaits : Counter_DepthSlotWaits);
+  switch (s.backpressure.policy) {
+    case Backpressure_Block:
+      if (pool.acquireWait(slot, s.backpressure.timeoutMicros)) { return true; }
+      break;
+    case Backpressure_DropOldest:
+      if (!mayDropOldest) { break; }
+      // Commit first, so that every frame left in s.queued holding a slot is still in the pool's queue
+      commitTaken(s, pool);
+      if (pool.steal(slot)) {
+        for (auto it = s.queued.begin(); it != s.queued.end(); ++it) {
+          if (it->first == slot) {
+            recordDroppedFrame(s, it->second);
+            s.queued.erase(it);
+            break;
+          }
+        }
+        return true;
+      }
+      if (pool.acquire(slot)) { return true; }
+      break;
+    case Backpressure_Degrade:
+      if (s.rateDivisor < s.backpressure.maxRateDivisor) {
+        s.rateDivisor *= 2;
+        s.lastRateChange = nTime;
+      }
+      break;
+    case Backpressure_DropNewest:
+      break;
+  }
+  recordDroppedFrame(s, nTime);
+  return false;
+}
+
+void KinectOneRecorder::noteQueued(StreamState& s, const size_t slot, const INT64 nTime) {
+  s.queued.push_back(std::make_pair(slot, nTime));
+  s.hasQueued = true;
+  s.lastQueuedTime = nTime;
+}
+
+template <size_t N>
+void KinectOneRecorder::commitTaken(StreamState& s, const FramePool<FrameSlot, N>& pool, const bool all) {
+  // Consumers take frames in queue order, and frames dropped from the queue have left s.queued already
+  const uint64_t numPopped = pool.numPopped();
+  while (!s.queued.empty() && (all || s.numPoppedSeen < numPopped)) {
+    recordFrame(s, s.queued.front().second);
+    s.queued.pop_front();
+    ++s.numPoppedSeen;
+  }
+}
+
+void KinectOneRecorder::recordFrame(const StreamState& s, const INT64 nTime) {
+  if (s.isColor) {
+    m_pRecording->colorTimestamps.push_back(nTime);
+    m_skeletonLog.appendColorFrame(nTime);
+  } else {
     m_pRecording->depthTimestamps.push_back(nTime);
+    m_skeletonLog.appendDepthFrame(nTime);
+  }
+}
+
+void KinectOneRecorder::recordDroppedFrame(StreamState& s, const INT64 nTime) {
+  ++s.numDropped;
+  if (s.isColor) {
+    m_pRecording->droppedColorTimestamps.push_back(nTime);
+    Metrics::count(Counter_ColorDropped);
+  } else {
+    m_pRecording->droppedDepthTimestamps.push_back(nTime);
+    Metrics::count(Counter_DepthDropped);
   }
 }
 
+bool KinectOneRecorder::isValidColorFrame(const UINT nColorBufferSize) const {
+  if (nColorBufferSize != 2 * kColorWidth * kColorHeight) {
+    cerr << "Unexpected color frame size" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool KinectOneRecorder::isValidDepthFrame(const UINT nDepthBufferSize, const UINT nBodyIndexBufferSize) const {
+  if (nDepthBufferSize != kDepthWidth * kDepthHeight || nBodyIndexBufferSize != kDepthWidth * kDepthHeight) {
+    cerr << "Unexpected depth or body index frame size" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool KinectOneRecorder::pushColorFrame(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+  if (!isValidColorFrame(nColorBufferSize)) { return false; }
+  commitTaken(m_colorStream, m_colorPool);
+  size_t slot;
+  if (!acquireSlot(m_colorStream, m_colorPool, nTime, true, slot)) { return false; }
+  queueColorFrame(slot, nTime, pColorBuffer);
+  return true;
+}
+
+bool KinectOneRecorder::pushDepthFrame(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                       const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer,
+                                       const BYTE* pRegisteredColor) {
+  if (!isValidDepthFrame(nDepthBufferSize, nBodyIndexBufferSize)) { return false; }
+  commitTaken(m_depthStream, m_depthBodyIndexPool);
+  size_t slot;
+  if (!acquireSlot(m_depthStream, m_depthBodyIndexPool, nTime, true, slot)) { return false; }
+  queueDepthFrame(slot, nTime, pDepthBuffer, pBodyIndexBuffer, pRegisteredColor);
+  return true;
+}
+
+void KinectOneRecorder::queueColorFrame(const size_t slot, const INT64 nTime, const RGBQUAD* pColorBuffer) {
+  FrameSlot& frame = m_colorPool[slot];
+  frame.time = nTime;
+  m_colorStage.crop(reinterpret_cast<const uint8_t*>(pColorBuffer), frame.mat.data);
+  m_colorPool.publish(slot);
+  Metrics::count(Counter_ColorRecorded);
+  Metrics::recordQueueLength(Gauge_ColorQueue, m_colorPool.inFlight());
+  noteQueued(m_colorStream, slot, nTime);
+}
+
+void KinectOneRecorder::queueDepthFrame(const size_t slot, const INT64 nTime, const UINT16* pDepthBuffer,
+                                        const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor) {
+  FrameSlot& frame = m_depthBodyIndexPool[slot];
+  frame.time = nTime;
+  m_depthStage.pack(pDepthBuffer, pBodyIndexBuffer, frame.mat.data);
+  frame.hasRegistered = m_recordRegisteredColor && pRegisteredColor != nullptr;
+  if (frame.hasRegistered) { m_depthStage.crop(pRegisteredColor, 3, frame.registered.data); }
+  m_depthBodyIndexPool.publish(slot);
+  Metrics::count(Counter_DepthRecorded);
+  Metrics::recordQueueLength(Gauge_DepthQueue, m_depthBodyIndexPool.inFlight());
+  noteQueued(m_depthStream, slot, nTime);
+}
+
 void KinectOneRecorder::consumeColor() {
-  cv::Mat matYUY2;
-  while (m_isLive) {
-    while (m_colorMatQ.pop(matYUY2)) {
-      cv::cvtColor(matYUY2, m_colorMatBGR, cv::COLOR_YUV2BGR_YUY2);
-      cv::resize(m_colorMatBGR, m_colorMatBGRSmall, m_colorMatBGRSmall.size(), 0, 0, cv::INTER_LINEAR);
-      if (m_showCapture) {
-        cv::imshow("Color", m_colorMatBGRSmall);
-        cv::waitKey(1);
-      }
-      if (m_colorWriter.isOpened()) { m_colorWriter << m_colorMatBGRSmall; }
+  size_t slot;
+  while (m_colorPool.popWait(slot, m_isLive)) {
+    {
+      ScopedLatency latency(Stage_ColorConvert);
+      m_colorStage.convert(m_colorPool[slot].mat, m_colorMatBGRSmall, m_parallelColorConvert);
+    }
+    if (m_showCapture) {
+      ScopedLatency latency(Stage_ColorDisplay);
+      cv::imshow("Color", m_colorMatBGRSmall);
+      cv::waitKey(1);
+    }
+    if (m_colorWriter.isOpened()) {
+      ScopedLatency latency(Stage_ColorWrite);
+      m_colorWriter << m_colorMatBGRSmall;
+    } else if (m_colorSegments.isOpen()) {
+      ScopedLatency latency(Stage_ColorWrite);
+      m_colorSegments.write(m_colorPool[slot].time, m_colorMatBGRSmall);
     }
+    m_colorPool.release(slot);
   }
 }
 
 void KinectOneRecorder::consumeDepthAndBodyIndex() {
-  cv::Mat matDepthAndBodyIndex;
-  while (m_isLive) {
-    while (m_depthBodyIndexMatQ.pop(matDepthAndBodyIndex)) {
-      if (m_showCapture) {
-        cv::imshow("Depth+BodyIndex", matDepthAndBodyIndex);
-        cv::waitKey(1);
-      }
-      if (m_depthWriter.isOpened()) { m_depthWriter << matDepthAndBodyIndex; }
-      if (!m_pointCloudDumped) {
-        reprojectDepthFramePointsToPLY(matDepthAndBodyIndex, m_pRecording->id + ".ply");
-        m_pointCloudDumped = true;
+  size_t slot;
+  while (m_depthBodyIndexPool.popWait(slot, m_isLive)) {
+    const cv::Mat& matDepthAndBodyIndex = m_depthBodyIndexPool[slot].mat;
+    if (m_showCapture) {
+      ScopedLatency latency(Stage_DepthDisplay);
+      cv::imshow("Depth+BodyIndex", matDepthAndBodyIndex);
+      cv::waitKey(1);
+    }
+    const INT64 time = m_depthBodyIndexPool[slot].time;
+    const bool exportPointCloud =
+      m_pointCloudExporter.isOpen() && m_depthFrameIndex % m_pointCloudInterval == 0 &&
+      (m_pointCloudMaxFrames == 0 || m_numPointCloudsQueued < static_cast<uint64_t>(m_pointCloudMaxFrames));
+    if (m_depthWriter.isOpen() || exportPointCloud) {
+      ScopedLatency latency(Stage_DepthUnpack);
+      unpackDepthAndBodyIndex(matDepthAndBodyIndex.data, m_depthScratch.data(), m_bodyIndexScratch.data(),
+                              matDepthAndBodyIndex.cols, matDepthAndBodyIndex.rows);
+    }
+    if (m_depthBodyIndexPool[slot].hasRegistered && m_registeredWriter.isOpened()) {
+      ScopedLatency latency(Stage_RegisteredWrite);
+      m_registeredWriter << m_depthBodyIndexPool[slot].registered;
+    } else if (m_depthBodyIndexPool[slot].hasRegistered && m_registeredSegments.isOpen()) {
+      ScopedLatency latency(Stage_RegisteredWrite);
+      m_registeredSegments.write(time, m_depthBodyIndexPool[slot].registered);
+    }
+    m_depthBodyIndexPool.release(slot);
+    if (m_depthWriter.isOpen()) {
+      ScopedLatency latency(Stage_DepthWrite);
+      m_depthWriter.write(time, m_depthScratch.data(), m_bodyIndexScratch.data());
+    }
+    // The exporter copies the frame and returns at once, dropping it if its workers are busy
+    if (exportPointCloud) {
+      if (m_pointCloudExporter.submit(time, m_depthFrameIndex, m_depthScratch.data(), m_bodyIndexScratch.data())) {
+        ++m_numPointCloudsQueued;
+      } else {
+        Metrics::count(Counter_PointCloudsDropped);
       }
     }
+    ++m_depthFrameIndex;
+  }
+}
+
+uint64_t KinectOneRecorder::bytesOnDisk(const string& id) {
+  uint64_t bytes = 0;
+  for (const string& file : filesOnDisk(id)) { bytes += fileSizeOnDisk(file); }
+  return bytes;
+}
+
+std::vector<string> KinectOneRecorder::filesOnDisk(const string& id) {
+  std::vector<string> files;
+  for (const char* suffix : { ".color.avi", ".registered.avi", ".depth.kdc", ".skel", ".skc", ".pcs", ".stats.csv",
+                              ".stats.json", ".color.segments.json", ".registered.segments.json" }) {
+    if (fileExists(id + suffix)) { files.push_back(id + suffix); }
+  }
+  // Video segments are numbered from 0 without gaps
+  for (const char* video : { ".color", ".registered" }) {
+    for (unsigned i = 0; ; ++i) {
+      char suffix[32];
+      snprintf(suffix, sizeof(suffix), ".%04u.avi", i);
+      if (!fileExists(id + video + suffix)) { break; }
+      files.push_back(id + video + suffix);
+    }
+  }
+  return files;
+}
+
+void KinectOneRecorder::printWaitStats(std::ostream& os) const {  // NOLINT
+  os << "Color consumer: " << m_colorPool.consumerWaitStats() << endl;
+  os << "Color producer: " << m_colorPool.producerWaitStats() << endl;
+  os << "Depth consumer: " << m_depthBodyIndexPool.consumerWaitStats() << endl;
+  os << "Depth producer: " << m_depthBodyIndexPool.producerWaitStats() << endl;
+  os << "Dropped frames: " << m_colorStream.numDropped << " color, " << m_depthStream.numDropped << " depth" << endl;
+  if (m_pointCloudInterval > 0) {
+    os << "Point clouds: " << m_pointCloudExporter.numExported() << " exported, "
+       << m_pointCloudExporter.numDropped() << " dropped" << endl;
+  }
+  if (m_numBundles > 0) {
+    os << "Frame bundles: " << m_numBundles << " received, " << m_numBundlesWithoutColor << " without color" << endl;
   }
 }
 
 void KinectOneRecorder::reprojectDepthFramePointsToPLY(const cv::Mat& depthAndBody, const std::string& plyFile) const {
-  // Inverse of camera intrinsics matrix
-  const cv::Matx44f KINECT_ONE_INTRINSICS_INV(
-    1.f / 361.56f, 0.0f, 0.0f, -256.f / 361.56f,
-    0.0f, -1.f / 367.19f, 0.0f, 212.f / 367.19f,
-    0.0f, 0.0f, 1.0f, 0.0f,
-    0.0f, 0.0f, 0.0f, 1.0f);
-
-  // Compute image plane coords matrix
-  cv::Mat m_imgPlanePts(kDepthHeight, kDepthWidth, CV_32FC4);
-  for (int j = 0; j < m_imgPlanePts.rows; j++) {
-    for (int i = 0; i < m_imgPlanePts.cols; i++) {
-      cv::Vec4f& v = m_imgPlanePts.at<cv::Vec4f>(j, i);
-      v = KINECT_ONE_INTRINSICS_INV * cv::Vec4f(static_cast<float>(i), static_cast<float>(j), 0.0f, 1.f);
-    }
-  }
-
-  cv::flip(depthAndBody, depthAndBody, 1);  // Left-right flip
-
-  // Reconstruct depth and body index matrices
-  cv::Mat ch[3];
-  cv::split(depthAndBody, ch);
-  cv::Mat depth(kDepthWidth, kDepthHeight, CV_8UC2);
-  const cv::Mat body = ch[0];
-  cv::merge(&ch[1], 2, depth);
-  cv::Mat depthMerged(depth.rows, depth.cols, CV_16UC1);
-  memmove(depthMerged.data, depth.data, 2 * depth.rows * depth.cols);
-  const cv::Mat depthMeters = cv::Mat_<float>(depthMerged * 0.001f);
-  const cv::Matx44f extrinsics = cv::Matx44f::eye();
-
-  // Preallocate points
-  std::vector<cv::Vec3f> points;
-  points.reserve(50000);
-
-  // Compute depth and project points to world space
-  for (int j = 0; j < depth.rows; j++) {
-    for (int i = 0; i < depth.cols; i++) {
-      const uchar b = body.at<uchar>(j, i);
-      if (b != 0xff) { continue; }  // This is a body point so ignore
-      const float d = depthMeters.at<float>(j, i);
-      if (d == 0) { continue; }  // No depth value
-      const cv::Vec4f& p = m_imgPlanePts.at<cv::Vec4f>(j, i);
-      const cv::Vec4f p2 = extrinsics * cv::Vec4f(d * p[0], d * p[1], d * p[3], 1.f);
-      points.push_back(cv::Vec3f(p2[0], p2[1], p2[2]) / p2[3]);
-    }
-  }
-
-  // Write PLY file
-  std::ofstream os(plyFile);
-  const size_t numPoints = points.size();
-  os << "ply" << endl;
-  os << "format ascii 1.0" << endl;
-  os << "element vertex " << numPoints << endl;
-  os << "property float x" << endl;
-  os << "property float y" << endl;
-  os << "property float z" << endl;
-  os << "end_header" << endl;
-  for (size_t iPoint = 0; iPoint < numPoints; ++iPoint) {
-    const cv::Vec3f& p = points[iPoint];
-    os << p[0] << " " << p[1] << " " << p[2] << endl;
-  }
-  os.close();
+  std::vector<UINT16> depth(m_reprojector.maxPoints());
+  std::vector<BYTE> body(m_reprojector.maxPoints());
+  unpackDepthAndBodyIndex(depthAndBody.data, depth.data(), body.data(), m_reprojector.width(),
+                          m_reprojector.height());
+  std::vector<float> points(3 * m_reprojector.maxPoints());
+  const size_t numPoints = m_reprojector.reproject(depth.data(), body.data(), points.data());
+
+  PlyWriter ply;
+  if (!ply.open(plyFile)) {
+    cerr << "Could not open point cloud file " << plyFile << endl;
+    return;
+  }
+  ply.append(points.data(), numPoints);
+  if (!ply.close()) {
+    cerr << "Error writing point cloud file " << plyFile << endl;
+  }
 }
 
+void KinectOneRecorder::setDepthRayTable(const std::vector<std::pair<float, float>>& table) {
+  if (!m_reprojector.setRayTable(m_depthStage.cropRays(table))) {
+    cerr << "Ignoring depth ray table of size " << table.size() << endl;
+  }
+}
@@ -1,14 +1,104 @@
 #ifndef KINECTONETRACKER_KINECTONERECORDER_H_
 #define KINECTONETRACKER_KINECTONERECORDER_H_
 
+#include <atomic>
+#include <deque>
+#include <ostream>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
-#include <boost/lockfree/spsc_queue.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "./DepthCodec.h"
+#include "./DepthReprojector.h"
+#include "./FramePool.h"
+#include "./PointCloudExporter.h"
 #include "./Recording.h"
+#include "./SegmentedVideoWriter.h"
+#include "./SkeletonCodec.h"
+#include "./SkeletonLog.h"
+#include "./StreamStage.h"
 #include "./KinectOneListener.h"
+#include "./Metrics.h"
+#include "./WaitStrategy.h"
+
+//! What the recorder does with a color or depth frame due for recording when the stream's consumer has fallen
+//! behind and no frame slot is free. The tracker thread applies it, so only Backpressure_Block ever holds up other
+//! streams, and then at most for its timeout. Dropped frames are listed in Recording::droppedColorTimestamps and
+//! droppedDepthTimestamps
+enum BackpressurePolicy {
+  Backpressure_Block,       // Wait up to timeoutMicros for a free slot (0 = forever), then drop the new frame
+  Backpressure_DropNewest,  // Drop the new frame
+  Backpressure_DropOldest,  // Drop the oldest frame still queued, and queue the new frame in its slot
+  Backpressure_Degrade      // Drop the new frame and halve the stream's recorded frame rate, down to
+                            // 1 / maxRateDivisor. The rate doubles back every 2 seconds once the queue has drained
+};
+
+//! Backpressure settings of a recorded stream
+struct StreamBackpressure {
+  BackpressurePolicy policy;
+  unsigned timeoutMicros;   // Backpressure_Block
+  unsigned maxRateDivisor;  // Backpressure_Degrade
+
+  explicit StreamBackpressure(const BackpressurePolicy p = Backpressure_Block, const unsigned timeout = 10000,
+                              const unsigned maxDivisor = 8)
+    : policy(p), timeoutMicros(timeout), maxRateDivisor(maxDivisor) { }
+};
+
+//! KinectOneRecorder settings
+struct RecorderOptions {
+  // Identifier of recording, used as prefix of all output files
+  std::string id;
+  // Frames per second of recorded color and depth video, unless set per stream
+  double fps;
+  // Rate, region of interest and output size of the recorded color and depth streams, or whether they are recorded
+  // at all (see StreamStage.h). Registered color follows the depth stream
+  StreamStageOptions color, depth;
+  // Whether to show live depth and color frames
+  bool showCapture;
+  // Whether to also log skeletons in the compact format of SkeletonCodec.h to <id>.skc (read with
+  // SkeletonStreamReader), besides the .skel log
+  bool skeletonStream;
+  // Whether to convert color frames with row-parallel threads rather than on the color consumer thread alone
+  bool parallelColorConvert;
+  // Threads encoding each depth frame, including the depth consumer thread
+  int depthCodecThreads;
+  // Depth frames exported as point clouds: every pointCloudInterval-th recorded frame (0 = none), up to
+  // pointCloudMaxFrames (0 = unlimited), each to <id>.<frame index>.ply or, with pointCloudChunked, all to <id>.pcs
+  int pointCloudInterval, pointCloudMaxFrames;
+  bool pointCloudChunked;
+  // Threads exporting point clouds, and exports that can wait for a thread before further frames are dropped
+  int pointCloudThreads, pointCloudQueue;
+  // Whether to record color registered to depth frames (delivered by a ColorRegistrationStage, see
+  // DepthColorRegistration.h) to <id>.registered.avi, frame for frame with the depth stream
+  bool recordRegisteredColor;
+  // Frames per segment file of the color and registered color videos (0 = one file per video). Segments are written
+  // to <id>.color.<segment>.avi and <id>.registered.<segment>.avi, with manifests <id>.color.segments.json and
+  // <id>.registered.segments.json, and encoded concurrently on videoSegmentThreads threads per video, buffering up
+  // to videoSegmentBuffer frames not yet encoded, or videoSegmentThreads segments of frames if that is more (see
+  // SegmentedVideoWriter.h)
+  int videoSegmentFrames, videoSegmentThreads, videoSegmentBuffer;
+  // Seconds between dumps of pipeline metrics (see Metrics.h) to <id>.stats.csv, or <id>.stats.json with
+  // statsJson (0 = no stats file), and whether stop() prints a metrics summary
+  double statsInterval;
+  bool statsJson;
+  bool printStatsOnStop;
+  // What to do with color and depth frames when their consumers fall behind
+  StreamBackpressure colorBackpressure, depthBackpressure;
+  // How the color and depth consumer threads wait for frames
+  WaitPolicy colorConsumerWait, depthConsumerWait;
+  // How the tracker thread waits for free color and depth frame slots when consumers fall behind
+  WaitPolicy colorProducerWait, depthProducerWait;
+
+  RecorderOptions()
+    : id("rec_now"), fps(5.0), showCapture(true), skeletonStream(false), parallelColorConvert(false)
+    , depthCodecThreads(2)
+    , pointCloudInterval(1), pointCloudMaxFrames(1), pointCloudChunked(false), pointCloudThreads(1)
+    , pointCloudQueue(2), recordRegisteredColor(false), videoSegmentFrames(0), videoSegmentThreads(2)
+    , videoSegmentBuffer(32), statsInterval(1.0), statsJson(false), printStatsOnStop(true) { }
+};
 
 //! Accumulates skeletons into a Recording
 class KinectOneRecorder : public KinectOneListener {
@@ -17,19 +107,33 @@ class KinectOneRecorder : public KinectOneListener {
     kDepthHeight  = 424,
     kColorWidth   = 1920,
     kColorHeight  = 1080;
+  // Number of preallocated frames in flight between the tracker thread and each consumer
+  static const size_t
+    kColorSlots   = 32,
+    kDepthSlots   = 64;
+
+  // Frame handed from the tracker thread to a consumer thread
+  struct FrameSlot {
+    INT64 time;
+    cv::Mat mat;
+    // Color registered to depth frames, if recorded
+    cv::Mat registered;
+    bool hasRegistered;
+  };
 
  public:
   KinectOneRecorder(const bool showCapture = true, const double fps = 5.0, const std::string& recId = "rec_now");
 
+  explicit KinectOneRecorder(const RecorderOptions& opts);
+
   ~KinectOneRecorder();
 
   void start() {
     m_isLive = true;
   }
 
-  void stop() {
-    m_isLive = false;
-  }
+  //! Stops recording, finalizes the skeleton log and stats file, and prints the metrics summary if enabled
+  void stop();
 
   void onSkeleton(const Skeleton* skel);
 
@@ -38,43 +142,135 @@ class KinectOneRecorder : public KinectOneListener {
   void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
                            const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
 
+  void onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                         const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor);
+
+  //! Records skeletons and, decimated together, the color and depth frames of bundles from a FrameSynchronizer, so
+  //! that recorded color and depth frames pair up tick for tick. Bundles without color are not recorded
+  void onFrameBundle(const FrameBundle& b);
+
   Recording& getRecording() const {
     return *m_pRecording;
   }
 
-  //! Reprojects combined depthAndBody frame writing point cloud of non-body points in PLY format at plyFile
+  //! Shared ownership of the Recording, so that it can outlive the recorder
+  std::shared_ptr<Recording> getRecordingPtr() const {
+    return m_pRecording;
+  }
+
+  //! Reprojects combined depthAndBody frame writing point cloud of non-body points in binary PLY format at plyFile
   void reprojectDepthFramePointsToPLY(const cv::Mat& depthAndBody, const std::string& plyFile) const;
 
+  //! Reprojects depth with the sensor's per-pixel rays (see KinectOneTracker::getDepthPixelCoordsInCameraSpace())
+  //! instead of the default intrinsics. Call before frames arrive
+  void setDepthRayTable(const std::vector<std::pair<float, float>>& table);
+
+  //! Total size on disk of the files written so far (videos, depth stream, skeleton log, chunked point clouds, stats
+  //! and segment manifests), not counting data still buffered by their writers
+  uint64_t bytesOnDisk() const { return bytesOnDisk(m_pRecording->id); }
+  //! Total size on disk of the files written by a recorder with id recId
+  static uint64_t bytesOnDisk(const std::string& recId);
+  //! Those files that exist for a recorder with id recId
+  static std::vector<std::string> filesOnDisk(const std::string& recId);
+
+  //! Prints wait statistics (including wakeup latencies) of the color and depth frame queues, dropped frames, point
+  //! cloud export counts and skipped bundles, to os
+  void printWaitStats(std::ostream& os) const;  // NOLINT
+
  private:
+  // Tracker thread state of a recorded color or depth stream
+  struct StreamState {
+    const StreamBackpressure backpressure;
+    const bool isColor;
+    // Minimum time between recorded frames at full rate
+    const int64_t frameDeltaTime;
+    bool hasQueued;
+    INT64 lastQueuedTime;
+    // Recorded frame rate reduction of Backpressure_Degrade, and when it last changed
+    unsigned rateDivisor;
+    INT64 lastRateChange;
+    // Frames queued and not yet seen taken by the consumer, oldest first, as (slot, timestamp). Their timestamps
+    // are only recorded once taken, since until then Backpressure_DropOldest may still drop them
+    std::deque<std::pair<size_t, INT64>> queued;
+    uint64_t numPoppedSeen;
+    uint64_t numDropped;
+    // Slot acquired for a frame bundle whose other frame was dropped, to be used by the next frame
+    bool hasSpareSlot;
+    size_t spareSlot;
+
+    StreamState(const StreamBackpressure& bp, const bool color, const int64_t deltaTime)
+      : backpressure(bp), isColor(color), frameDeltaTime(deltaTime), hasQueued(false), lastQueuedTime(0)
+      , rateDivisor(1), lastRateChange(0), numPoppedSeen(0), numDropped(0), hasSpareSlot(false), spareSlot(0) { }
+  };
+
+  //! Whether a frame at nTime is due for recording on stream s
+  bool isFrameDue(const StreamState& s, const INT64 nTime) const {
+    return !s.hasQueued || (nTime - s.lastQueuedTime) > s.frameDeltaTime * s.rateDivisor;
+  }
+  //! Acquires a slot of pool into slot for a frame at nTime of stream s, applying the stream's backpressure policy
+  //! if none is free (except dropping the oldest queued frame, unless mayDropOldest). Returns false if the frame is
+  //! dropped
+  template <size_t N>
+  bool acquireSlot(StreamState& s, FramePool<FrameSlot, N>& pool, const INT64 nTime, const bool mayDropOldest,
+                   size_t& slot);  // NOLINT
+  //! Notes slot published with a frame at nTime
+  void noteQueued(StreamState& s, const size_t slot, const INT64 nTime);
+  //! Records the timestamps of queued frames the consumer of pool has taken since the last call, or of all queued
+  //! frames if all is set (once no frame can be dropped any more)
+  template <size_t N>
+  void commitTaken(StreamState& s, const FramePool<FrameSlot, N>& pool, const bool all = false);  // NOLINT
+  void recordFrame(const StreamState& s, const INT64 nTime);
+  void recordDroppedFrame(StreamState& s, const INT64 nTime);
+  bool isValidColorFrame(const UINT nColorBufferSize) const;
+  bool isValidDepthFrame(const UINT nDepthBufferSize, const UINT nBodyIndexBufferSize) const;
+  //! Queues color frame for the color consumer. Returns false if it was dropped
+  bool pushColorFrame(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+  //! Queues depth frame (and registered color, if not null) for the depth consumer. Returns false if it was dropped
+  bool pushDepthFrame(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                      const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor);
+  //! Fills and publish an acquired slot with a frame
+  void queueColorFrame(const size_t slot, const INT64 nTime, const RGBQUAD* pColorBuffer);
+  void queueDepthFrame(const size_t slot, const INT64 nTime, const UINT16* pDepthBuffer, const BYTE* pBodyIndexBuffer,
+                       const BYTE* pRegisteredColor);
   void consumeColor();
   void consumeDepthAndBodyIndex();
 
-  bool
-    m_isLive,
-    m_pointCloudDumped;
+  std::atomic<bool> m_isLive;
   const bool m_showCapture;
-  const double m_fps;
-  const int64_t m_frameDeltaTime;
+  const bool m_parallelColorConvert;
+  const bool m_recordRegisteredColor;
+  // Decimation, cropping and scaling of each stream. The color stage converts frames on the color consumer thread,
+  // the depth stage packs them on the tracker thread
+  ColorStreamStage m_colorStage;
+  DepthStreamStage m_depthStage;
   std::shared_ptr<Recording> m_pRecording;
-  cv::VideoWriter
-    m_colorWriter,
-    m_depthWriter;
-  boost::lockfree::spsc_queue<cv::Mat, boost::lockfree::capacity<200>>
-    m_colorMatQ,
-    m_depthBodyIndexMatQ;
+  SkeletonLogWriter m_skeletonLog;
+  SkeletonStreamWriter m_skeletonStream;
+  cv::VideoWriter m_colorWriter;
+  DepthStreamWriter m_depthWriter;
+  cv::VideoWriter m_registeredWriter;
+  // Used instead of the video writers above when recording segmented videos
+  SegmentedVideoWriter m_colorSegments, m_registeredSegments;
+  FramePool<FrameSlot, kColorSlots> m_colorPool;
+  FramePool<FrameSlot, kDepthSlots> m_depthBodyIndexPool;
+  StreamState m_colorStream, m_depthStream;
   std::thread
     m_colorWorker,
     m_depthWorker;
-  cv::Mat
-    m_colorMatYUY2,
-    m_colorMatBGR,
-    m_colorMatBGRSmall,
-    m_depthMat,
-    m_depthMatGray,
-    m_bodyIndexMat,
-    m_depthBodyIndexMat,
-    m_depthMatSplit,
-    m_depthMatSplitChannels[2];
+  cv::Mat m_colorMatBGRSmall;
+  // Depth consumer scratch images unpacked from depth frame slots for encoding
+  std::vector<UINT16> m_depthScratch;
+  std::vector<BYTE> m_bodyIndexScratch;
+  DepthReprojector m_reprojector;
+  // Point cloud export of every m_pointCloudInterval-th depth frame, off the depth consumer thread
+  const int m_pointCloudInterval, m_pointCloudMaxFrames;
+  uint64_t m_depthFrameIndex, m_numPointCloudsQueued;
+  PointCloudExporter m_pointCloudExporter;
+  // Frame bundles received, and those not recorded for lack of a color frame
+  uint64_t m_numBundles, m_numBundlesWithoutColor;
+  // Periodic metrics dump, and whether the summary is still to be printed
+  MetricsReporter m_metricsReporter;
+  bool m_printStatsOnStop;
 };
 
 #endif  // KINECTONETRACKER_KINECTONERECORDER_H_
@@ -0,0 +1,56 @@
+#ifndef KINECTONETRACKER_KINECTONESENSORSOURCE_H_
+#define KINECTONETRACKER_KINECTONESENSORSOURCE_H_
+
+#ifdef _WIN32
+
+#include <utility>
+#include <vector>
+
+#include "./KinectTypes.h"
+#include "./KinectOneFrameSource.h"
+
+// Forward declarations
+struct KinectOneListener;
+struct Skeleton;
+
+//! Frame source reading from the default KinectOne sensor through IMultiSourceFrameReader
+class KinectOneSensorSource : public KinectOneFrameSource {
+ public:
+  KinectOneSensorSource();
+  ~KinectOneSensorSource();
+  bool init();
+  bool update(const int streams, KinectOneListener* sink);
+  std::vector<std::pair<float, float>> getDepthPixelCoordsInCameraSpace();
+  bool mapDepthFrameToColorSpace(const UINT nDepthSize, const UINT16* pDepthBuffer, float* colorXY);
+
+ private:
+  void processBody(IMultiSourceFrame* pMultiSourceFrame, KinectOneListener* sink);
+  void processColor(IMultiSourceFrame* pMultiSourceFrame, KinectOneListener* sink);
+  void processDepthAndBodyIndex(IMultiSourceFrame* pMultiSourceFrame, KinectOneListener* sink);
+
+  // Safe release for interfaces
+  template<class Interface>
+  inline void SafeRelease(Interface*& pInterfaceToRelease) {  // NOLINT
+    if (pInterfaceToRelease != NULL) {
+      pInterfaceToRelease->Release();
+      pInterfaceToRelease = NULL;
+    }
+  }
+
+  IKinectSensor*            m_pKinectSensor;
+  IMultiSourceFrameReader*  m_pMultiSourceFrameReader;
+  ICoordinateMapper*        m_pCoordinateMapper;
+
+  Joint                     m_joints[JointType_Count];
+  JointOrientation          m_orients[JointType_Count];
+  DetectionResult           m_activities[Activity_Count];
+  HandState                 m_leftHandState, m_rightHandState;
+  TrackingConfidence        m_leftHandConfidence, m_rightHandConfidence;
+  TrackingState             m_leanTrackingState;
+  PointF                    m_lean;
+  Skeleton*                 m_pSkel;
+};
+
+#endif  // _WIN32
+
+#endif  // KINECTONETRACKER_KINECTONESENSORSOURCE_H_
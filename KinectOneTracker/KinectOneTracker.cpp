@@ -1,275 +1,163 @@
 #include "./KinectOneTracker.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#ifdef _WIN32
 #include <conio.h>
+#endif
 
+#include "./Metrics.h"
 #include "./Recording.h"
-#include "./KinectOneListener.h"
+#include "./KinectOneSensorSource.h"
 
-KinectOneTracker::KinectOneTracker()
-  : m_doQuit(false)
-  , m_pKinectSensor(NULL)
-  , m_pMultiSourceFrameReader(NULL)
-  , m_pCoordinateMapper(NULL)
-  , m_pSkel(new Skeleton()) { }
+KinectOneTracker::KinectOneTracker(std::shared_ptr<KinectOneFrameSource> pSource)
+  : m_asyncDispatch(false)
+  , m_doQuit(false)
+  , m_numFrameSets(0)
+  , m_pSource(pSource)
+  , m_fanOut(*this) { }
 
-KinectOneTracker::~KinectOneTracker() {
-  if (m_pSkel != NULL) { delete m_pSkel; }
-  SafeRelease(m_pMultiSourceFrameReader);
-  SafeRelease(m_pCoordinateMapper);
-  if (m_pKinectSensor) { m_pKinectSensor->Close(); }
-  SafeRelease(m_pKinectSensor);
-}
+KinectOneTracker::~KinectOneTracker() { }
 
 void KinectOneTracker::run() {
   while (!m_doQuit) {
     update();
+#ifdef _WIN32
     if (_kbhit()) { quit(); }
+#endif
   }
+  // Frames already queued for asynchronous listeners are delivered before returning
+  for (const std::unique_ptr<AsyncListener>& a : m_asyncListeners) { a->drain(); }
 }
 
-bool KinectOneTracker::init() {
-  HRESULT hr = GetDefaultKinectSensor(&m_pKinectSensor);
-  if (FAILED(hr)) { return false; }
-
-  // Initialize the Kinect, get coordinate mapper and frame reader
-  if (m_pKinectSensor) {
-    hr = m_pKinectSensor->get_CoordinateMapper(&m_pCoordinateMapper);
-    if (SUCCEEDED(hr)) { hr = m_pKinectSensor->Open(); }
-    if (SUCCEEDED(hr)) {
-      hr = m_pKinectSensor->OpenMultiSourceFrameReader(
-        FrameSourceTypes::FrameSourceTypes_Depth |
-        FrameSourceTypes::FrameSourceTypes_Color |
-        FrameSourceTypes::FrameSourceTypes_BodyIndex |
-        FrameSourceTypes::FrameSourceTypes_Body,
-        &m_pMultiSourceFrameReader);
-    }
+void KinectOneTracker::attachSkeletonListener(KinectOneListener* skelListen) {
+  if (m_asyncDispatch) {
+    m_asyncSkelListeners.push_back(asyncListener(skelListen));
+  } else {
+    m_skelListeners.push_back(skelListen);
   }
-
-  if (!m_pKinectSensor || FAILED(hr)) { return false; }
-  return true;
 }
 
-void KinectOneTracker::processBody(IMultiSourceFrame* pMultiSourceFrame) {
-  // Get BodyFrame
-  IBodyFrame* pBodyFrame = NULL;
-  IBodyFrameReference* pBodyFrameReference = NULL;
-  HRESULT hr = pMultiSourceFrame->get_BodyFrameReference(&pBodyFrameReference);
-  if (SUCCEEDED(hr)) { hr = pBodyFrameReference->AcquireFrame(&pBodyFrame);}
-  SafeRelease(pBodyFrameReference);
-  if (FAILED(hr)) { return; }
-
-  // Process BodyFrame
-  INT64 nBodyTime = 0;
-  hr = pBodyFrame->get_RelativeTime(&nBodyTime);
-  IBody* ppBodies[BODY_COUNT] = {0};
-  if (SUCCEEDED(hr)) { hr = pBodyFrame->GetAndRefreshBodyData(_countof(ppBodies), ppBodies); }
-  SafeRelease(pBodyFrame);
-  if (FAILED(hr)) { return; }
-
-  for (int i = 0; i < BODY_COUNT; ++i) {
-    IBody* pBody = ppBodies[i];
-    if (pBody) {
-      BOOLEAN bTracked = false;
-      hr = pBody->get_IsTracked(&bTracked);
-      if (SUCCEEDED(hr) && bTracked) {
-        pBody->get_TrackingId(&m_pSkel->trackingId);
-        m_pSkel->timestamp = nBodyTime;
-
-        // Hand states
-        m_leftHandState = HandState_Unknown;
-        hr = pBody->get_HandLeftState(&m_leftHandState);
-        if (SUCCEEDED(hr)) { m_pSkel->handLeftState = static_cast<Skeleton::HandState>(m_leftHandState); }
-        pBody->get_HandLeftConfidence(&m_leftHandConfidence);
-        m_pSkel->handLeftConfidence = static_cast<Skeleton::TrackingConfidence>(m_leftHandConfidence);
-        m_rightHandState = HandState_Unknown;
-        hr = pBody->get_HandRightState(&m_rightHandState);
-        if (SUCCEEDED(hr)) { m_pSkel->handRightState = static_cast<Skeleton::HandState>(m_rightHandState); }
-        pBody->get_HandRightConfidence(&m_rightHandConfidence);
-        m_pSkel->handRightConfidence = static_cast<Skeleton::TrackingConfidence>(m_rightHandConfidence);
-
-        // Joints
-        hr = pBody->GetJoints(_countof(m_joints), m_joints);
-        if (SUCCEEDED(hr)) {
-          for (int j = 0; j < _countof(m_joints); ++j) {
-            const auto& p = m_joints[j].Position;
-            auto& pOut = m_pSkel->jointPositions[j];
-            pOut[0] = p.X;  pOut[1] = p.Y;  pOut[2] = p.Z;
-
-            if (m_joints[j].TrackingState == TrackingState_Inferred) { m_pSkel->jointConfidences[j] = 0.5f; }
-            else if (m_joints[j].TrackingState == TrackingState_Tracked) { m_pSkel->jointConfidences[j] = 1.0f; }
-            else { m_pSkel->jointConfidences[j] = 0.0f; }
-          }
-        }
-
-        // Joint orientations
-        hr = pBody->GetJointOrientations(_countof(m_orients), m_orients);
-        if (SUCCEEDED(hr)) {
-          for (int j = 0; j < _countof(m_orients); ++j) {
-            const auto& p = m_orients[j].Orientation;
-            auto& pOut = m_pSkel->jointOrientations[j];
-            pOut[0] = p.x;  pOut[1] = p.y;  pOut[2] = p.z;  pOut[3] = p.w;
-          }
-        }
-
-        // Activities
-        hr = pBody->GetActivityDetectionResults(_countof(m_activities), m_activities);
-        if (SUCCEEDED(hr)) {
-          for (int j = 0; j < _countof(m_activities); ++j) {
-            m_pSkel->activities[j] = static_cast<Skeleton::DetectionResult>(m_activities[j]);
-          }
-        }
-
-        // Lean tracking state
-        m_leanTrackingState = TrackingState_NotTracked;
-        hr = pBody->get_LeanTrackingState(&m_leanTrackingState);
-        if (SUCCEEDED(hr)) {
-          pBody->get_Lean(&m_lean);
-          m_pSkel->leanLeftRight = m_lean.X;
-          m_pSkel->leanForwardBack = m_lean.Y;
-          if (m_leanTrackingState == TrackingState_Tracked) {
-            m_pSkel->leanConfidence = 1.0f;
-          } else if (m_leanTrackingState == TrackingState_Inferred) {
-            m_pSkel->leanConfidence = 0.5f;
-          } else {
-            m_pSkel->leanConfidence = 0.0f;
-          }
-        }
-
-        // Frame edges
-        pBody->get_ClippedEdges(&m_pSkel->clippedEdges);
-
-        for (KinectOneListener* l : m_skelListeners) { l->onSkeleton(m_pSkel); }
-      }
-    }
+void KinectOneTracker::attachColorListener(KinectOneListener* colorListen) {
+  if (m_asyncDispatch) {
+    m_asyncColorListeners.push_back(asyncListener(colorListen));
+  } else {
+    m_colorListeners.push_back(colorListen);
   }
-
-  for (int i = 0; i < _countof(ppBodies); ++i) { SafeRelease(ppBodies[i]); }
 }
 
-std::vector<std::pair<float, float>> KinectOneTracker::getDepthPixelCoordsInCameraSpace() {
-  PointF* pTable;
-  UINT32 nTableCount = 0;
-  HRESULT hr = m_pCoordinateMapper->GetDepthFrameToCameraSpaceTable(&nTableCount, &pTable);
-  std::vector<std::pair<float, float>> out(nTableCount);
-  if (SUCCEEDED(hr)) {
-    memcpy(out.data(), pTable, sizeof(pTable[0]) * nTableCount);
+void KinectOneTracker::attachDepthListener(KinectOneListener* depthListen) {
+  if (m_asyncDispatch) {
+    m_asyncDepthListeners.push_back(asyncListener(depthListen));
+  } else {
+    m_depthListeners.push_back(depthListen);
   }
-  return out;
 }
 
-// Aligns colors in pColorBuffer to depth points in pDepthBuffer and returns aligned color in colorOut
-void KinectOneTracker::depthToColor(const UINT nDepthSize, const uint16_t* pDepthBuffer,
-                                    const UINT colorWidth, const UINT colorHeight, const uint32_t* pColorBuffer,
-                                    uint32_t* colorOut) {
-  ColorSpacePoint* pColorCoordinates = new ColorSpacePoint[nDepthSize];
-  HRESULT hr = m_pCoordinateMapper->MapDepthFrameToColorSpace(nDepthSize, pDepthBuffer, nDepthSize, pColorCoordinates);
-  if (FAILED(hr)) { return; }
-  for (UINT depthIndex = 0; depthIndex < nDepthSize; ++depthIndex) {
-    ColorSpacePoint colorPoint = pColorCoordinates[depthIndex];
-    int colorX = static_cast<int>(floor(colorPoint.X + 0.5));
-    int colorY = static_cast<int>(floor(colorPoint.Y + 0.5));
-    if ((colorX >= 0) && (colorX < static_cast<int>(colorWidth)) &&
-        (colorY >= 0) && (colorY < static_cast<int>(colorHeight))) {
-      int colorIndex = colorX + (colorY * colorWidth);
-      *colorOut = pColorBuffer[colorIndex];
-    }
-  }
-  delete [] pColorCoordinates;
+void KinectOneTracker::setAsyncDispatch(const bool async, const DispatchOptions& opts) {
+  m_asyncDispatch = async;
+  m_defaultDispatchOpts = opts;
 }
 
-void KinectOneTracker::processColor(IMultiSourceFrame* pMultiSourceFrame) {
-  IColorFrame* pColorFrame = NULL;
-  IColorFrameReference* pColorFrameReference = NULL;
-  HRESULT hr = pMultiSourceFrame->get_ColorFrameReference(&pColorFrameReference);
-  if (SUCCEEDED(hr)) { hr = pColorFrameReference->AcquireFrame(&pColorFrame);}
-
-  int64_t nColorTime = 0;
-  IFrameDescription* pColorFrameDescription = NULL;
-  int nColorWidth = 0;
-  int nColorHeight = 0;
-  ColorImageFormat imageFormat = ColorImageFormat_None;
-  UINT nColorBufferSize = 0;
-  RGBQUAD* pColorBuffer = NULL;
-
-  if (SUCCEEDED(hr)) { hr = pColorFrame->get_RelativeTime(&nColorTime); }
-  if (SUCCEEDED(hr)) { hr = pColorFrame->get_FrameDescription(&pColorFrameDescription); }
-  if (SUCCEEDED(hr)) { hr = pColorFrameDescription->get_Width(&nColorWidth); }
-  if (SUCCEEDED(hr)) { hr = pColorFrameDescription->get_Height(&nColorHeight); }
-  if (SUCCEEDED(hr)) { hr = pColorFrame->get_RawColorImageFormat(&imageFormat); }
-  if (SUCCEEDED(hr)) {
-    //assert(imageFormat == ColorImageFormat_Yuy2);
-    hr = pColorFrame->AccessRawUnderlyingBuffer(&nColorBufferSize, reinterpret_cast<BYTE**>(&pColorBuffer));
-    for (KinectOneListener* l : m_colorListeners) { l->onColor(nColorTime, nColorBufferSize, pColorBuffer); }
+AsyncListener* KinectOneTracker::asyncListener(KinectOneListener* listener) {
+  for (const std::unique_ptr<AsyncListener>& a : m_asyncListeners) {
+    if (a->listener() == listener) { return a.get(); }
   }
-
-  SafeRelease(pColorFrameReference);
-  SafeRelease(pColorFrameDescription);
-  SafeRelease(pColorFrame);
+  const auto it = m_dispatchOpts.find(listener);
+  const DispatchOptions& opts = (it != m_dispatchOpts.end()) ? it->second : m_defaultDispatchOpts;
+  m_asyncListeners.emplace_back(new AsyncListener(listener, opts));
+  return m_asyncListeners.back().get();
 }
 
-void KinectOneTracker::processDepthAndBodyIndex(IMultiSourceFrame* pMultiSourceFrame) {
-  // Depth Frame
-  IDepthFrame* pDepthFrame = NULL;
-  IDepthFrameReference* pDepthFrameReference = NULL;
-  HRESULT hr = pMultiSourceFrame->get_DepthFrameReference(&pDepthFrameReference);
-  if (SUCCEEDED(hr)) { hr = pDepthFrameReference->AcquireFrame(&pDepthFrame); }
+void KinectOneTracker::printDispatchStats(std::ostream& os) const {  // NOLINT
+  for (size_t i = 0; i < m_asyncListeners.size(); ++i) {
+    os << "Async listener " << i << ": " << m_asyncListeners[i]->stats() << std::endl;
+  }
+}
 
-  INT64 nDepthTime = 0;
-  IFrameDescription* pDepthFrameDescription = NULL;
-  int nDepthWidth = 0;
-  int nDepthHeight = 0;
-  UINT nDepthBufferSize = 0;
-  UINT16* pDepthBuffer = NULL;
+bool KinectOneTracker::init() {
+#ifdef _WIN32
+  if (!m_pSource) { m_pSource.reset(new KinectOneSensorSource()); }
+#endif
+  if (!m_pSource) { return false; }
+  return m_pSource->init();
+}
 
-  if (SUCCEEDED(hr)) { hr = pDepthFrame->get_RelativeTime(&nDepthTime); }
-  if (SUCCEEDED(hr)) { hr = pDepthFrame->get_FrameDescription(&pDepthFrameDescription); }
-  if (SUCCEEDED(hr)) { hr = pDepthFrameDescription->get_Width(&nDepthWidth); }
-  if (SUCCEEDED(hr)) { hr = pDepthFrameDescription->get_Height(&nDepthHeight); }
-  if (SUCCEEDED(hr)) { hr = pDepthFrame->AccessUnderlyingBuffer(&nDepthBufferSize, &pDepthBuffer); }
+std::vector<std::pair<float, float>> KinectOneTracker::getDepthPixelCoordsInCameraSpace() {
+  if (!m_pSource) { return std::vector<std::pair<float, float>>(); }
+  return m_pSource->getDepthPixelCoordsInCameraSpace();
+}
 
-  // Body Index Frame
-  IBodyIndexFrame* pBodyIndexFrame = NULL;
-  IBodyIndexFrameReference* pBodyIndexFrameReference = NULL;
-  hr = pMultiSourceFrame->get_BodyIndexFrameReference(&pBodyIndexFrameReference);
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrameReference->AcquireFrame(&pBodyIndexFrame); }
+bool KinectOneTracker::mapDepthFrameToColorSpace(const UINT nDepthSize, const UINT16* pDepthBuffer, float* colorXY) {
+  if (!m_pSource) { return false; }
+  return m_pSource->mapDepthFrameToColorSpace(nDepthSize, pDepthBuffer, colorXY);
+}
 
-  INT64 nBodyIndexTime = 0;
-  IFrameDescription* pBodyIndexFrameDescription = NULL;
-  int nBodyIndexWidth = 0;
-  int nBodyIndexHeight = 0;
-  UINT nBodyIndexBufferSize = 0;
-  BYTE* pBodyIndexBuffer = NULL;
+// Queues frame with listeners and drops the caller's reference
+inline void fanOutShared(SharedFrame* frame, const std::list<AsyncListener*>& listeners) {
+  for (AsyncListener* a : listeners) { a->push(frame); }
+  SharedFramePool::release(frame);
+}
 
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrame->get_RelativeTime(&nBodyIndexTime); }
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrame->get_FrameDescription(&pBodyIndexFrameDescription); }
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrameDescription->get_Width(&nBodyIndexWidth); }
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrameDescription->get_Height(&nBodyIndexHeight); }
-  if (SUCCEEDED(hr)) { hr = pBodyIndexFrame->AccessUnderlyingBuffer(&nBodyIndexBufferSize, &pBodyIndexBuffer); }
+void KinectOneTracker::ListenerFanOut::onSkeleton(const Skeleton* skel) {
+  ScopedLatency latency(Stage_OnSkeleton);
+  for (KinectOneListener* l : m_tracker.m_skelListeners) { l->onSkeleton(skel); }
+  if (!m_tracker.m_asyncSkelListeners.empty()) {
+    SharedFrame* frame = m_tracker.m_skelFrames.acquire();
+    frame->kind = SharedFrame::Kind_Skeleton;
+    frame->time = skel->timestamp;
+    frame->skeleton = *skel;
+    fanOutShared(frame, m_tracker.m_asyncSkelListeners);
+  }
+}
 
-  for (KinectOneListener* l : m_depthListeners) {
-    l->onDepthAndBodyIndex(nDepthTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+void KinectOneTracker::ListenerFanOut::onColor(const INT64 nTime, const UINT nColorBufferSize,
+                                               const RGBQUAD* pColorBuffer) {
+  ScopedLatency latency(Stage_OnColor);
+  for (KinectOneListener* l : m_tracker.m_colorListeners) { l->onColor(nTime, nColorBufferSize, pColorBuffer); }
+  if (!m_tracker.m_asyncColorListeners.empty()) {
+    SharedFrame* frame = m_tracker.m_colorFrames.acquire();
+    frame->kind = SharedFrame::Kind_Color;
+    frame->time = nTime;
+    const BYTE* p = reinterpret_cast<const BYTE*>(pColorBuffer);
+    frame->color.assign(p, p + nColorBufferSize);
+    fanOutShared(frame, m_tracker.m_asyncColorListeners);
   }
+}
 
-  SafeRelease(pDepthFrameReference);
-  SafeRelease(pDepthFrameDescription);
-  SafeRelease(pDepthFrame);
-  SafeRelease(pBodyIndexFrameReference);
-  SafeRelease(pBodyIndexFrameDescription);
-  SafeRelease(pBodyIndexFrame);
+void KinectOneTracker::ListenerFanOut::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize,
+                                                           const UINT16* pDepthBuffer,
+                                                           const UINT nBodyIndexBufferSize,
+                                                           const BYTE* pBodyIndexBuffer) {
+  ScopedLatency latency(Stage_OnDepth);
+  for (KinectOneListener* l : m_tracker.m_depthListeners) {
+    l->onDepthAndBodyIndex(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+  }
+  if (!m_tracker.m_asyncDepthListeners.empty()) {
+    SharedFrame* frame = m_tracker.m_depthFrames.acquire();
+    frame->kind = SharedFrame::Kind_DepthAndBodyIndex;
+    frame->time = nTime;
+    frame->depth.assign(pDepthBuffer, pDepthBuffer + nDepthBufferSize);
+    frame->bodyIndex.assign(pBodyIndexBuffer, pBodyIndexBuffer + nBodyIndexBufferSize);
+    fanOutShared(frame, m_tracker.m_asyncDepthListeners);
+  }
 }
 
 void KinectOneTracker::update() {
-  if (!m_pMultiSourceFrameReader) { return; }
+  if (!m_pSource) { return; }
+  ScopedLatency latency(Stage_TrackerUpdate);
 
-  IMultiSourceFrame* pMultiSourceFrame = NULL;
-  HRESULT hr = m_pMultiSourceFrameReader->AcquireLatestFrame(&pMultiSourceFrame);
-  if (FAILED(hr) || pMultiSourceFrame == NULL) { return; }
-
-  if (!m_colorListeners.empty()) { processColor(pMultiSourceFrame); }
-  if (!m_depthListeners.empty()) { processDepthAndBodyIndex(pMultiSourceFrame); }
-  if (!m_skelListeners.empty())  { processBody(pMultiSourceFrame); }
+  int streams = 0;
+  if (!m_colorListeners.empty() || !m_asyncColorListeners.empty()) {
+    streams |= KinectOneFrameSource::Stream_Color;
+  }
+  if (!m_depthListeners.empty() || !m_asyncDepthListeners.empty()) {
+    streams |= KinectOneFrameSource::Stream_DepthAndBodyIndex;
+  }
+  if (!m_skelListeners.empty() || !m_asyncSkelListeners.empty()) {
+    streams |= KinectOneFrameSource::Stream_Body;
+  }
 
-  SafeRelease(pMultiSourceFrame);
+  if (m_pSource->update(streams, &m_fanOut)) { ++m_numFrameSets; }
 }
@@ -1,68 +1,95 @@
 #ifndef KINECTONETRACKER_KINECTONETRACKER_H_
 #define KINECTONETRACKER_KINECTONETRACKER_H_
 
+#include <atomic>
+#include <cstdint>
 #include <list>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <utility>
 #include <vector>
 
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-#include <Kinect.h>
+#include "./AsyncDispatch.h"
+#include "./KinectOneListener.h"
+#include "./KinectOneFrameSource.h"
 
 // Forward declarations
-struct KinectOneListener;
 struct Skeleton;
 
-// Kinect One skeleton tracker
+// Kinect One skeleton tracker. Pulls frames from a KinectOneFrameSource (the physical sensor by default)
+// and fans them out to attached listeners.
 class KinectOneTracker {
  public:
-  KinectOneTracker();
+  explicit KinectOneTracker(std::shared_ptr<KinectOneFrameSource> pSource = nullptr);
   ~KinectOneTracker();
   bool init();
   void run();
-  void attachSkeletonListener(KinectOneListener* skelListen) { m_skelListeners.push_back(skelListen); }
-  void attachColorListener(KinectOneListener* colorListen) { m_colorListeners.push_back(colorListen); }
-  void attachDepthListener(KinectOneListener* depthListen) { m_depthListeners.push_back(depthListen); }
+  void attachSkeletonListener(KinectOneListener* skelListen);
+  void attachColorListener(KinectOneListener* colorListen);
+  void attachDepthListener(KinectOneListener* depthListen);
   void quit() { m_doQuit = true; }
 
+  //! Sets how listeners attached from now on receive frames: on the tracker thread while the source still holds
+  //! the frame (default), or asynchronously, each listener through its own bounded queue and worker thread (see
+  //! AsyncDispatch.h) with queue settings opts. A listener attached to several streams shares one queue for all
+  //! of them, so it sees frames in source order
+  void setAsyncDispatch(const bool async, const DispatchOptions& opts = DispatchOptions());
+
+  //! Overrides the queue settings of asynchronous listener, if attached after this call
+  void setDispatchOptions(KinectOneListener* listener, const DispatchOptions& opts) { m_dispatchOpts[listener] = opts; }
+
+  //! Prints queue statistics of asynchronous listeners to os
+  void printDispatchStats(std::ostream& os) const;  // NOLINT
+
   std::vector<std::pair<float, float>> getDepthPixelCoordsInCameraSpace();
 
+  //! Maps depth pixels to color frame coordinates with the source's calibration (see
+  //! KinectOneFrameSource::mapDepthFrameToColorSpace()). Returns false if the source has none
+  bool mapDepthFrameToColorSpace(const UINT nDepthSize, const UINT16* pDepthBuffer, float* colorXY);
+
+  //! Number of frame sets delivered by the source so far
+  uint64_t getNumFrameSets() const { return m_numFrameSets; }
+
  private:
-  void processBody(IMultiSourceFrame* pMultiSourceFrame);
-  void processColor(IMultiSourceFrame* pMultiSourceFrame);
-  void processDepthAndBodyIndex(IMultiSourceFrame* pMultiSourceFrame);
-  void depthToColor(const unsigned int nDepthSize, const unsigned short* pDepthBuffer,
-                    const unsigned int colorWidth, const unsigned int colorHeight,
-                    const unsigned int* pColorBuffer, unsigned int* colorOut);
   void update();
 
-  // Safe release for interfaces
-  template<class Interface>
-  inline void SafeRelease(Interface*& pInterfaceToRelease) {  // NOLINT
-    if (pInterfaceToRelease != NULL) {
-      pInterfaceToRelease->Release();
-      pInterfaceToRelease = NULL;
-    }
-  }
+  //! Returns the asynchronous wrapper of listener, creating it on first use
+  AsyncListener* asyncListener(KinectOneListener* listener);
+
+  // Forwards frames from the source to all attached listeners of each stream
+  struct ListenerFanOut : public KinectOneListener {
+    explicit ListenerFanOut(KinectOneTracker& tracker) : m_tracker(tracker) { }
+    void onSkeleton(const Skeleton* skel);
+    void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+    void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                             const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
+    KinectOneTracker& m_tracker;
+  };
 
   std::list<KinectOneListener*>
     m_skelListeners,
     m_colorListeners,
     m_depthListeners;
-  bool m_doQuit;
-
-  IKinectSensor*            m_pKinectSensor;
-  IMultiSourceFrameReader*  m_pMultiSourceFrameReader;
-  ICoordinateMapper*        m_pCoordinateMapper;
-
-  Joint                     m_joints[JointType_Count];
-  JointOrientation          m_orients[JointType_Count];
-  DetectionResult           m_activities[Activity_Count];
-  HandState                 m_leftHandState, m_rightHandState;
-  TrackingConfidence        m_leftHandConfidence, m_rightHandConfidence;
-  TrackingState             m_leanTrackingState;
-  PointF                    m_lean;
-  Skeleton*                 m_pSkel;
+
+  // Asynchronous dispatch. Frame pools are declared before the listeners so that they outlive queued frames
+  bool m_asyncDispatch;
+  DispatchOptions m_defaultDispatchOpts;
+  std::map<KinectOneListener*, DispatchOptions> m_dispatchOpts;
+  SharedFramePool
+    m_skelFrames,
+    m_colorFrames,
+    m_depthFrames;
+  std::vector<std::unique_ptr<AsyncListener>> m_asyncListeners;
+  std::list<AsyncListener*>
+    m_asyncSkelListeners,
+    m_asyncColorListeners,
+    m_asyncDepthListeners;
+  std::atomic<bool> m_doQuit;
+  uint64_t m_numFrameSets;
+
+  std::shared_ptr<KinectOneFrameSource> m_pSource;
+  ListenerFanOut m_fanOut;
 };
 
 #endif  // KINECTONETRACKER_KINECTONETRACKER_H_
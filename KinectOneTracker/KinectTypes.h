@@ -0,0 +1,32 @@
+#ifndef KINECTONETRACKER_KINECTTYPES_H_
+#define KINECTONETRACKER_KINECTTYPES_H_
+
+// Kinect SDK v2 scalar types used by the listener interface. On Windows these come from the SDK itself, elsewhere
+// a minimal equivalent is declared so that hardware-free frame sources and listeners build on any platform.
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Kinect.h>
+#else
+#include <cstdint>
+
+typedef int64_t   INT64;
+typedef uint32_t  UINT;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint8_t   BYTE;
+
+struct RGBQUAD {
+  BYTE rgbBlue;
+  BYTE rgbGreen;
+  BYTE rgbRed;
+  BYTE rgbReserved;
+};
+
+#ifndef BODY_COUNT
+#define BODY_COUNT 6
+#endif
+#endif  // _WIN32
+
+#endif  // KINECTONETRACKER_KINECTTYPES_H_
@@ -0,0 +1,108 @@
+#include "./MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+  : m_data(nullptr)
+  , m_size(0)
+#ifdef _WIN32
+  , m_hFile(INVALID_HANDLE_VALUE)
+  , m_hMapping(NULL) { }
+#else
+  , m_fd(-1) { }
+#endif
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& file) {
+  close();
+  m_hFile = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+  if (m_hFile == INVALID_HANDLE_VALUE) { return false; }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0) { close(); return false; }
+  m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_hMapping == NULL) { close(); return false; }
+  m_data = static_cast<const char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) { close(); return false; }
+  m_size = static_cast<uint64_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr) { UnmapViewOfFile(m_data); }
+  if (m_hMapping != NULL) { CloseHandle(m_hMapping); }
+  if (m_hFile != INVALID_HANDLE_VALUE) { CloseHandle(m_hFile); }
+  m_data = nullptr;
+  m_size = 0;
+  m_hMapping = NULL;
+  m_hFile = INVALID_HANDLE_VALUE;
+}
+
+uint64_t fileSizeOnDisk(const std::string& file) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(file.c_str(), GetFileExInfoStandard, &attributes)) { return 0; }
+  return (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+}
+
+bool fileExists(const std::string& file) {
+  return GetFileAttributesA(file.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+  return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& file) {
+  close();
+  m_fd = ::open(file.c_str(), O_RDONLY);
+  if (m_fd < 0) { return false; }
+  struct stat st;
+  if (fstat(m_fd, &st) != 0 || st.st_size == 0) { close(); return false; }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (p == MAP_FAILED) { close(); return false; }
+  m_data = static_cast<const char*>(p);
+  m_size = static_cast<uint64_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr) { munmap(const_cast<char*>(m_data), m_size); }
+  if (m_fd >= 0) { ::close(m_fd); }
+  m_data = nullptr;
+  m_size = 0;
+  m_fd = -1;
+}
+
+uint64_t fileSizeOnDisk(const std::string& file) {
+  struct stat st;
+  return stat(file.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+bool fileExists(const std::string& file) {
+  struct stat st;
+  return stat(file.c_str(), &st) == 0;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+  return rename(from.c_str(), to.c_str()) == 0;
+}
+
+#endif  // _WIN32
@@ -0,0 +1,45 @@
+#ifndef KINECTONETRACKER_MAPPEDFILE_H_
+#define KINECTONETRACKER_MAPPEDFILE_H_
+
+#include <cstdint>
+#include <string>
+
+//! Read-only memory mapping of a whole file. Pages are loaded lazily by the OS, so opening is cheap regardless
+//! of file size
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  //! Maps file. Returns false if it cannot be opened or mapped
+  bool open(const std::string& file);
+  void close();
+
+  bool isOpen() const { return m_data != nullptr; }
+  const char* data() const { return m_data; }
+  uint64_t size() const { return m_size; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* m_data;
+  uint64_t m_size;
+#ifdef _WIN32
+  void* m_hFile;
+  void* m_hMapping;
+#else
+  int m_fd;
+#endif
+};
+
+//! Size of file on disk in bytes, or 0 if it does not exist. Data still buffered by its writer is not included
+uint64_t fileSizeOnDisk(const std::string& file);
+
+//! Whether file exists (empty or not)
+bool fileExists(const std::string& file);
+
+//! Renames file from to file to, atomically replacing to if it exists. Returns false if it could not be renamed
+bool replaceFile(const std::string& from, const std::string& to);
+
+#endif  // KINECTONETRACKER_MAPPEDFILE_H_
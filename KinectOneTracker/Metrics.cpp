@@ -0,0 +1,286 @@
+#include "./Metrics.h"
+#include "./JsonWriter.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using std::string;  using std::endl;
+
+std::atomic<bool> Metrics::s_enabled(true);
+
+static const char* kStageNames[Stage_Count] = {
+  "trackerUpdate", "onSkeleton", "onColor", "onDepth", "colorConvert", "colorDisplay", "colorWrite",
+  "depthDisplay", "depthUnpack", "depthWrite", "registeredWrite"
+};
+static const char* kCounterNames[Counter_Count] = {
+  "colorFrames", "depthFrames", "skeletons", "colorRecorded", "depthRecorded", "colorSlotWaits", "depthSlotWaits",
+  "colorDropped", "depthDropped", "pointCloudsDropped"
+};
+static const char* kGaugeNames[Gauge_Count] = { "colorQueue", "depthQueue" };
+
+// Index of highest set bit of a nonzero x
+inline int highestSetBit(const uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanReverse64(&i, x);
+  return static_cast<int>(i);
+#else
+  return 63 - __builtin_clzll(x);
+#endif
+}
+
+int LatencyHistogram::bucket(const uint64_t ns) {
+  if (ns < 4) { return static_cast<int>(ns); }
+  const int msb = highestSetBit(ns);
+  const int b = 4 * (msb - 1) + static_cast<int>((ns >> (msb - kSubBits)) & 3);
+  return std::min(b, kNumBuckets - 1);
+}
+
+uint64_t LatencyHistogram::bucketLow(const int b) {
+  if (b < 4) { return b; }
+  return static_cast<uint64_t>(4 + (b & 3)) << (b / 4 - 1);
+}
+
+double LatencyHistogram::percentileMicros(const double q) const {
+  if (count == 0) { return 0.0; }
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+  uint64_t seen = 0;
+  for (int b = 0; b < kNumBuckets; ++b) {
+    seen += counts[b];
+    if (seen >= rank) {
+      const double mid = 0.5 * (bucketLow(b) + (b + 1 < kNumBuckets ? bucketLow(b + 1) : bucketLow(b)));
+      return std::min(mid, static_cast<double>(maxNs)) * 1.0E-3;
+    }
+  }
+  return maxNs * 1.0E-3;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& h, const int sign) {
+  if (sign > 0) {
+    for (int b = 0; b < kNumBuckets; ++b) { counts[b] += h.counts[b]; }
+    count += h.count;
+    sumNs += h.sumNs;
+    maxNs = std::max(maxNs, h.maxNs);
+  } else {
+    for (int b = 0; b < kNumBuckets; ++b) { counts[b] -= h.counts[b]; }
+    count -= h.count;
+    sumNs -= h.sumNs;
+  }
+}
+
+// Counters written by one thread. Updates are relaxed load and store pairs, which is safe with a single writer
+// and needs no locked instruction
+struct ThreadMetrics {
+  std::array<std::array<std::atomic<uint64_t>, LatencyHistogram::kNumBuckets>, Stage_Count> buckets;
+  std::array<std::atomic<uint64_t>, Stage_Count> count, sumNs, maxNs;
+  std::array<std::atomic<uint64_t>, Counter_Count> counters;
+  std::array<std::atomic<uint64_t>, Gauge_Count> highWater;
+
+  static void add(std::atomic<uint64_t>& a, const uint64_t n) {  // NOLINT
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  static void raise(std::atomic<uint64_t>& a, const uint64_t v) {  // NOLINT
+    if (v > a.load(std::memory_order_relaxed)) { a.store(v, std::memory_order_relaxed); }
+  }
+};
+
+// Blocks of all threads that recorded metrics, kept until exit
+struct MetricsRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadMetrics>> blocks;
+  const int64_t startNs;
+
+  MetricsRegistry() : startNs(Metrics::nowNs()) { }
+};
+
+static MetricsRegistry& registry() {
+  static MetricsRegistry r;
+  return r;
+}
+
+// Block of the calling thread, registered on first use
+static ThreadMetrics& threadMetrics() {
+  thread_local ThreadMetrics* t_pMetrics = nullptr;
+  if (t_pMetrics == nullptr) {
+    MetricsRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.emplace_back(new ThreadMetrics());  // Value-initialized, so all zero
+    t_pMetrics = r.blocks.back().get();
+  }
+  return *t_pMetrics;
+}
+
+void Metrics::recordLatency(const MetricStage stage, const uint64_t ns) {
+  if (!enabled()) { return; }
+  ThreadMetrics& m = threadMetrics();
+  ThreadMetrics::add(m.buckets[stage][LatencyHistogram::bucket(ns)], 1);
+  ThreadMetrics::add(m.count[stage], 1);
+  ThreadMetrics::add(m.sumNs[stage], ns);
+  ThreadMetrics::raise(m.maxNs[stage], ns);
+}
+
+void Metrics::count(const MetricCounter counter, const uint64_t n) {
+  if (!enabled()) { return; }
+  ThreadMetrics::add(threadMetrics().counters[counter], n);
+}
+
+void Metrics::recordQueueLength(const MetricGauge gauge, const uint64_t length) {
+  if (!enabled()) { return; }
+  ThreadMetrics::raise(threadMetrics().highWater[gauge], length);
+}
+
+MetricsSnapshot Metrics::snapshot() {
+  MetricsSnapshot s;
+  MetricsRegistry& r = registry();
+  s.seconds = (nowNs() - r.startNs) * 1.0E-9;
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const std::unique_ptr<ThreadMetrics>& m : r.blocks) {
+    for (int i = 0; i < Stage_Count; ++i) {
+      LatencyHistogram& h = s.stages[i];
+      for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b) {
+        h.counts[b] += m->buckets[i][b].load(std::memory_order_relaxed);
+      }
+      h.count += m->count[i].load(std::memory_order_relaxed);
+      h.sumNs += m->sumNs[i].load(std::memory_order_relaxed);
+      h.maxNs = std::max(h.maxNs, m->maxNs[i].load(std::memory_order_relaxed));
+    }
+    for (int i = 0; i < Counter_Count; ++i) { s.counters[i] += m->counters[i].load(std::memory_order_relaxed); }
+    for (int i = 0; i < Gauge_Count; ++i) {
+      s.highWater[i] = std::max(s.highWater[i], m->highWater[i].load(std::memory_order_relaxed));
+    }
+  }
+  return s;
+}
+
+const char* Metrics::name(const MetricStage stage) { return kStageNames[stage]; }
+const char* Metrics::name(const MetricCounter counter) { return kCounterNames[counter]; }
+const char* Metrics::name(const MetricGauge gauge) { return kGaugeNames[gauge]; }
+
+void MetricsSnapshot::printSummary(std::ostream& os) const {  // NOLINT
+  os << std::left << std::setw(16) << "Stage" << std::right << std::setw(10) << "count" << std::setw(11)
+     << "mean(us)" << std::setw(11) << "p50(us)" << std::setw(11) << "p90(us)" << std::setw(11) << "p99(us)"
+     << std::setw(11) << "max(us)" << endl;
+  const std::streamsize precision = os.precision();
+  os << std::fixed << std::setprecision(1);
+  for (int i = 0; i < Stage_Count; ++i) {
+    const LatencyHistogram& h = stages[i];
+    if (h.count == 0) { continue; }
+    os << std::left << std::setw(16) << Metrics::name(static_cast<MetricStage>(i)) << std::right
+       << std::setw(10) << h.count << std::setw(11) << h.meanMicros() << std::setw(11) << h.percentileMicros(0.5)
+       << std::setw(11) << h.percentileMicros(0.9) << std::setw(11) << h.percentileMicros(0.99)
+       << std::setw(11) << h.maxNs * 1.0E-3 << endl;
+  }
+  os.unsetf(std::ios::floatfield);
+  os.precision(precision);
+  os << "Counters:";
+  for (int i = 0; i < Counter_Count; ++i) {
+    if (counters[i] > 0) { os << " " << Metrics::name(static_cast<MetricCounter>(i)) << "=" << counters[i]; }
+  }
+  os << endl << "Queue high-water:";
+  for (int i = 0; i < Gauge_Count; ++i) {
+    os << " " << Metrics::name(static_cast<MetricGauge>(i)) << "=" << highWater[i];
+  }
+  os << endl;
+}
+
+bool MetricsReporter::start(const string& file, const double intervalSeconds) {
+  stop();
+  m_file.open(file, std::ios::out | std::ios::trunc);
+  if (!m_file.is_open()) { return false; }
+  m_json = file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0;
+  if (!m_json) { m_file << "seconds,kind,name,count,meanUs,p50Us,p90Us,p99Us,maxUs" << endl; }
+  m_intervalSeconds = std::max(intervalSeconds, 0.01);
+  m_stopping = false;
+  m_previous = Metrics::snapshot();
+  m_thread = std::thread(&MetricsReporter::run, this);
+  return true;
+}
+
+MetricsSnapshot MetricsReporter::stop() {
+  const bool running = m_thread.joinable();
+  if (running) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
+  const MetricsSnapshot s = Metrics::snapshot();
+  if (running) {
+    dump(s);
+    m_file.close();
+  }
+  return s;
+}
+
+void MetricsReporter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const auto interval = std::chrono::duration<double>(m_intervalSeconds);
+  while (!m_cv.wait_for(lock, interval, [this] { return m_stopping; })) {
+    lock.unlock();
+    dump(Metrics::snapshot());
+    lock.lock();
+  }
+}
+
+void MetricsReporter::dump(const MetricsSnapshot& s) {
+  // Latencies and counts of the interval since the previous dump
+  std::array<LatencyHistogram, Stage_Count> stages = s.stages;
+  for (int i = 0; i < Stage_Count; ++i) {
+    stages[i].merge(m_previous.stages[i], -1);
+    // The maximum is only known overall, so bound the interval's by its highest nonempty bucket
+    int top = LatencyHistogram::kNumBuckets - 1;
+    while (top > 0 && stages[i].counts[top] == 0) { --top; }
+    stages[i].maxNs = stages[i].count ? std::min(s.stages[i].maxNs, LatencyHistogram::bucketLow(top + 1)) : 0;
+  }
+  if (m_json) {
+    JsonWriter w(m_file, 1 << 14);
+    w.raw('{').key("seconds").value(s.seconds).raw(", ").key("stages").raw('{');
+    for (int i = 0; i < Stage_Count; ++i) {
+      const LatencyHistogram& h = stages[i];
+      if (i > 0) { w.raw(", "); }
+      w.key(Metrics::name(static_cast<MetricStage>(i))).raw('{').key("count").value(h.count)
+       .raw(", ").key("meanUs").value(h.meanMicros())
+       .raw(", ").key("p50Us").value(h.percentileMicros(0.5))
+       .raw(", ").key("p90Us").value(h.percentileMicros(0.9))
+       .raw(", ").key("p99Us").value(h.percentileMicros(0.99))
+       .raw(", ").key("maxUs").value(h.maxNs * 1.0E-3).raw('}');
+    }
+    w.raw("}, ").key("counters").raw('{');
+    for (int i = 0; i < Counter_Count; ++i) {
+      if (i > 0) { w.raw(", "); }
+      w.key(Metrics::name(static_cast<MetricCounter>(i))).value(s.counters[i] - m_previous.counters[i]);
+    }
+    w.raw("}, ").key("highWater").raw('{');
+    for (int i = 0; i < Gauge_Count; ++i) {
+      if (i > 0) { w.raw(", "); }
+      w.key(Metrics::name(static_cast<MetricGauge>(i))).value(s.highWater[i]);
+    }
+    w.raw("}}\n");
+    w.flush();
+  } else {
+    for (int i = 0; i < Stage_Count; ++i) {
+      const LatencyHistogram& h = stages[i];
+      m_file << s.seconds << ",stage," << Metrics::name(static_cast<MetricStage>(i)) << "," << h.count << ","
+             << h.meanMicros() << "," << h.percentileMicros(0.5) << "," << h.percentileMicros(0.9) << ","
+             << h.percentileMicros(0.99) << "," << h.maxNs * 1.0E-3 << "\n";
+    }
+    for (int i = 0; i < Counter_Count; ++i) {
+      m_file << s.seconds << ",counter," << Metrics::name(static_cast<MetricCounter>(i)) << ","
+             << s.counters[i] - m_previous.counters[i] << ",,,,,\n";
+    }
+    for (int i = 0; i < Gauge_Count; ++i) {
+      m_file << s.seconds << ",highWater," << Metrics::name(static_cast<MetricGauge>(i)) << "," << s.highWater[i]
+             << ",,,,,\n";
+    }
+  }
+  m_file.flush();
+  m_previous = s;
+}
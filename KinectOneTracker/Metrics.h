@@ -0,0 +1,167 @@
+#ifndef KINECTONETRACKER_METRICS_H_
+#define KINECTONETRACKER_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Low-overhead instrumentation of the capture pipeline: per-stage latency histograms, frame and drop counters and
+// queue high-water marks. Each thread records into its own block of counters, registered once on its first use,
+// with plain relaxed stores and no locks or read-modify-write instructions. Snapshots sum the blocks of all threads
+// that ever recorded, so counts survive their threads.
+
+//! Timed pipeline stages
+enum MetricStage {
+  Stage_TrackerUpdate,    // One pull of frames from the source, including synchronous listeners
+  Stage_OnSkeleton,       // Tracker fan-out of a skeleton: synchronous listener calls and asynchronous queueing
+  Stage_OnColor,          // Tracker fan-out of a color frame
+  Stage_OnDepth,          // Tracker fan-out of a depth and body index frame
+  Stage_ColorConvert,     // Color consumer: YUY2 to half resolution BGR
+  Stage_ColorDisplay,     // Color consumer: live view
+  Stage_ColorWrite,       // Color consumer: color video writer
+  Stage_DepthDisplay,     // Depth consumer: live view
+  Stage_DepthUnpack,      // Depth consumer: unpacking of the packed depth and body index slot
+  Stage_DepthWrite,       // Depth consumer: depth codec and stream writer
+  Stage_RegisteredWrite,  // Depth consumer: registered color video writer
+  Stage_Count
+};
+
+//! Event counters
+enum MetricCounter {
+  Counter_ColorFrames,        // Color frames received by the recorder
+  Counter_DepthFrames,        // Depth frames received by the recorder
+  Counter_Skeletons,          // Skeletons received by the recorder
+  Counter_ColorRecorded,      // Color frames queued for recording
+  Counter_DepthRecorded,      // Depth frames queued for recording
+  Counter_ColorSlotWaits,     // Times the tracker thread waited for a free color slot
+  Counter_DepthSlotWaits,     // Times the tracker thread waited for a free depth slot
+  Counter_ColorDropped,       // Color frames dropped by the color backpressure policy
+  Counter_DepthDropped,       // Depth frames dropped by the depth backpressure policy
+  Counter_PointCloudsDropped, // Point cloud exports dropped by a busy exporter
+  Counter_Count
+};
+
+//! Queue lengths tracked by their high-water mark
+enum MetricGauge {
+  Gauge_ColorQueue,  // Color frames waiting for the color consumer
+  Gauge_DepthQueue,  // Depth frames waiting for the depth consumer
+  Gauge_Count
+};
+
+//! Log-linear latency histogram in nanoseconds: 4 buckets per power of two, so that bucket bounds are within 25%
+//! of each other
+struct LatencyHistogram {
+  static const int kSubBits = 2, kNumBuckets = 4 * 48;
+
+  std::array<uint64_t, kNumBuckets> counts;
+  uint64_t count, sumNs, maxNs;
+
+  LatencyHistogram() : count(0), sumNs(0), maxNs(0) { counts.fill(0); }
+
+  static int bucket(const uint64_t ns);
+  //! Smallest value of bucket b
+  static uint64_t bucketLow(const int b);
+
+  double meanMicros() const { return count ? sumNs * 1.0E-3 / count : 0.0; }
+  //! Approximate q-quantile (0 <= q <= 1) in microseconds: the middle of the bucket holding it
+  double percentileMicros(const double q) const;
+  //! Adds (sign > 0) or subtracts (sign < 0) h's counts. Subtraction leaves maxNs unchanged
+  void merge(const LatencyHistogram& h, const int sign = 1);
+};
+
+//! Totals of all threads at one point in time
+struct MetricsSnapshot {
+  double seconds;  // Since the metrics were first used
+  std::array<LatencyHistogram, Stage_Count> stages;
+  std::array<uint64_t, Counter_Count> counters;
+  std::array<uint64_t, Gauge_Count> highWater;
+
+  MetricsSnapshot() : seconds(0) { counters.fill(0); highWater.fill(0); }
+
+  //! Prints a table of stage latencies, counters and high-water marks of stages and counters that saw use
+  void printSummary(std::ostream& os) const;  // NOLINT
+};
+
+//! Global pipeline metrics
+class Metrics {
+ public:
+  static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+  //! Recording is on by default. Turning it off makes the recording calls return at once
+  static void setEnabled(const bool on) { s_enabled.store(on, std::memory_order_relaxed); }
+
+  static void recordLatency(const MetricStage stage, const uint64_t ns);
+  static void count(const MetricCounter counter, const uint64_t n = 1);
+  static void recordQueueLength(const MetricGauge gauge, const uint64_t length);
+
+  //! Sums the counts of all threads. Blocks being written are read without locking, so a snapshot may miss the
+  //! latest few events
+  static MetricsSnapshot snapshot();
+
+  static const char* name(const MetricStage stage);
+  static const char* name(const MetricCounter counter);
+  static const char* name(const MetricGauge gauge);
+
+  static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+ private:
+  static std::atomic<bool> s_enabled;
+};
+
+//! Records the time from construction to destruction as a latency of stage
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(const MetricStage stage)
+    : m_stage(stage), m_startNs(Metrics::enabled() ? Metrics::nowNs() : -1) { }
+  ~ScopedLatency() {
+    if (m_startNs >= 0) { Metrics::recordLatency(m_stage, Metrics::nowNs() - m_startNs); }
+  }
+
+ private:
+  const MetricStage m_stage;
+  const int64_t m_startNs;
+};
+
+//! Appends metrics to a file every interval from a background thread: as CSV rows (one per stage, counter and
+//! gauge), or as one JSON object per line if the file name ends in ".json". Latencies and counts are those of the
+//! interval since the previous dump, and high-water marks are overall
+class MetricsReporter {
+ public:
+  MetricsReporter() : m_json(false), m_intervalSeconds(0), m_stopping(false) { }
+  ~MetricsReporter() { stop(); }
+
+  //! Starts dumping to file every intervalSeconds. Returns false if file could not be opened
+  bool start(const std::string& file, const double intervalSeconds);
+
+  //! Writes a final dump and stops. Returns the final snapshot
+  MetricsSnapshot stop();
+
+  bool isRunning() const { return m_thread.joinable(); }
+
+ private:
+  MetricsReporter(const MetricsReporter&);
+  MetricsReporter& operator=(const MetricsReporter&);
+
+  void dump(const MetricsSnapshot& s);
+  void run();
+
+  std::ofstream m_file;
+  bool m_json;
+  double m_intervalSeconds;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stopping;
+  MetricsSnapshot m_previous;
+  std::thread m_thread;
+};
+
+#endif  // KINECTONETRACKER_METRICS_H_
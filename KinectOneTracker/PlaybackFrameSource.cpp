@@ -0,0 +1,303 @@
+#include "./PlaybackFrameSource.h"
+#include "./ColorConvert.h"
+#include "./DepthReprojector.h"
+#include "./KinectOneListener.h"
+#include "./MappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <opencv2/opencv.hpp>
+
+using std::string;  using std::cerr;  using std::endl;
+
+std::ostream& operator<<(std::ostream& os, const PlaybackStats& s) {  // NOLINT
+  return os << "frameSets=" << s.frameSets << " color=" << s.colorFrames << " depth=" << s.depthFrames
+            << " skeletons=" << s.skeletons << " corrupt=" << s.corruptFrames << " prefetchWaits=" << s.prefetchWaits
+            << " resyncs=" << s.resyncs << " wall(s)=" << s.wallSeconds << " recording(s)=" << s.recordingSeconds
+            << " speed=" << s.speed() << "x fps=" << (s.wallSeconds > 0 ? s.frameSets / s.wallSeconds : 0.0);
+}
+
+//! Whether frames of geometry g are a region of frameWidth x frameHeight sensor frames (with pixels step apart)
+inline bool fitsSensorFrame(const StreamGeometry& g, const int frameWidth, const int frameHeight) {
+  return g.roiX >= 0 && g.roiY >= 0 && g.roiWidth > 0 && g.roiHeight > 0 && g.roiX + g.roiWidth <= frameWidth &&
+         g.roiY + g.roiHeight <= frameHeight && g.width > 0 && g.height > 0 &&
+         (g.step == 0 || ((g.width - 1) * g.step < g.roiWidth && (g.height - 1) * g.step < g.roiHeight));
+}
+
+PlaybackFrameSource::PlaybackFrameSource(const string& recId, const PlaybackOptions& opts)
+  : m_recId(recId)
+  , m_opts(opts)
+  , m_isOpen(false)
+  , m_finished(false)
+  , m_colorLive(false)
+  , m_depthLive(false)
+  , m_stopping(false)
+  , m_numCorrupt(0)
+  , m_hasColor(false)
+  , m_hasDepth(false)
+  , m_colorSlot(0)
+  , m_depthSlot(0)
+  , m_nextSkeleton(0)
+  , m_paceTime(0)
+  , m_firstTime(0)
+  , m_lastTime(0) { }
+
+PlaybackFrameSource::~PlaybackFrameSource() {
+  m_stopping = true;
+  if (m_colorThread.joinable()) { m_colorThread.join(); }
+  if (m_depthThread.joinable()) { m_depthThread.join(); }
+}
+
+bool PlaybackFrameSource::init() {
+  if (m_isOpen) { return true; }
+  const string skeletonFile = m_recId + ".skel";
+  if (!m_skeletons.open(skeletonFile)) {
+    cerr << "Could not open skeleton log " << skeletonFile << endl;
+    return false;
+  }
+  if (!m_skeletons.load(m_recording)) {
+    cerr << "Warning: " << skeletonFile << " has no recording metadata (not closed cleanly?)" << endl;
+  }
+  m_isOpen = true;
+
+  if (m_opts.streams & Stream_DepthAndBodyIndex) {
+    const StreamGeometry& g = m_recording.depthGeometry;
+    const string depthFile = m_recId + ".depth.kdc";
+    if (!fileExists(depthFile)) {
+      // Not recorded
+    } else if (!m_depth.open(depthFile)) {
+      cerr << "Could not open depth stream " << depthFile << endl;
+    } else if (!fitsSensorFrame(g, kDepthWidth, kDepthHeight) || g.step < 1 || g.width != m_depth.width() ||
+               g.height != m_depth.height()) {
+      cerr << "Depth stream " << depthFile << " of " << m_depth.width() << "x" << m_depth.height()
+           << " frames does not match the recorded depth region" << endl;
+      m_depth.close();
+    } else {
+      const int numThreads = std::max(1, m_opts.depthDecodeThreads);
+      if (numThreads > 1) { m_pDepthDecodePool.reset(new ThreadPool(numThreads - 1)); }
+      // Pixels not recorded are never written, so they are cleared once here
+      for (size_t i = 0; i < kDepthSlots; ++i) {
+        m_depthPool[i].depth.assign(kDepthWidth * kDepthHeight, 0);
+        m_depthPool[i].bodyIndex.assign(kDepthWidth * kDepthHeight, 0xff);
+      }
+      m_depthLive = true;
+      m_depthThread = std::thread(&PlaybackFrameSource::prefetchDepth, this);
+    }
+  }
+
+  if (m_opts.streams & Stream_Color) {
+    const string colorFile = m_recId + ".color.avi";
+    if (fileExists(colorFile)) {
+      m_colorFiles.push_back(colorFile);
+    } else {
+      // Segmented video: segment files numbered from 0 in recording order
+      for (int k = 0; ; ++k) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".color.%04d.avi", k);
+        if (!fileExists(m_recId + suffix)) { break; }
+        m_colorFiles.push_back(m_recId + suffix);
+      }
+    }
+    const StreamGeometry& g = m_recording.colorGeometry;
+    if (m_colorFiles.empty()) {
+      // Not recorded
+    } else if (!fitsSensorFrame(g, kColorWidth, kColorHeight) || g.roiX % 2 != 0 || 2 * g.width != g.roiWidth ||
+               2 * g.height != g.roiHeight) {
+      cerr << "Color of " << m_recId << " was recorded at " << g.width << "x" << g.height << " from a region of "
+           << g.roiWidth << "x" << g.roiHeight << ", only color at half the size of its region is played" << endl;
+      m_colorFiles.clear();
+    } else {
+      // Black (in limited-range YUY2) around the region, which is never written
+      const BYTE black[4] = { 16, 128, 16, 128 };
+      for (size_t i = 0; i < kColorSlots; ++i) {
+        std::vector<BYTE>& yuy2 = m_colorPool[i].yuy2;
+        yuy2.resize(2 * kColorWidth * kColorHeight);
+        for (size_t b = 0; b < yuy2.size(); b += 4) { memcpy(&yuy2[b], black, 4); }
+      }
+      m_colorLive = true;
+      m_colorThread = std::thread(&PlaybackFrameSource::prefetchColor, this);
+    }
+  }
+  return true;
+}
+
+void PlaybackFrameSource::prefetchColor() {
+  // Recorded frames are in the order of their timestamps, across segments
+  const uint64_t numFrames = m_skeletons.numColorFrames();
+  const StreamGeometry& g = m_recording.colorGeometry;
+  const size_t regionOffset = 2 * (static_cast<size_t>(g.roiY) * kColorWidth + g.roiX);
+  cv::Mat bgr;
+  uint64_t frame = 0;
+  for (size_t f = 0; f < m_colorFiles.size() && frame < numFrames && !m_stopping; ++f) {
+    cv::VideoCapture capture(m_colorFiles[f]);
+    if (!capture.isOpened()) {
+      cerr << "Could not open color video " << m_colorFiles[f] << endl;
+      break;
+    }
+    while (frame < numFrames && !m_stopping && capture.read(bgr)) {
+      const INT64 time = m_skeletons.colorFrameTime(frame++);
+      if (bgr.type() != CV_8UC3 || bgr.cols != g.width || bgr.rows != g.height) {
+        ++m_numCorrupt;
+        continue;
+      }
+      size_t slot;
+      while (!m_colorPool.acquireWait(slot, 100000)) {
+        if (m_stopping) { return; }
+      }
+      ColorSlot& s = m_colorPool[slot];
+      s.time = time;
+      bgrToYuy2Double(bgr.data, bgr.step, bgr.cols, bgr.rows, s.yuy2.data() + regionOffset, 2 * kColorWidth);
+      m_colorPool.publish(slot);
+    }
+  }
+  m_colorLive = false;
+  m_colorPool.wakeConsumer();
+}
+
+void PlaybackFrameSource::prefetchDepth() {
+  // A slot is refilled with the next frame if its frame turns out corrupt, as only the consumer releases slots
+  bool hasSlot = false;
+  size_t slot = 0;
+  // Frames that are not whole sensor frames are decoded here and then placed into their slot
+  const StreamGeometry& g = m_recording.depthGeometry;
+  const bool whole = g.width == kDepthWidth && g.height == kDepthHeight;
+  std::vector<UINT16> depth(whole ? 0 : static_cast<size_t>(g.width) * g.height);
+  std::vector<BYTE> bodyIndex(depth.size());
+  for (uint64_t i = 0; i < m_depth.numFrames() && !m_stopping; ++i) {
+    while (!hasSlot) {
+      hasSlot = m_depthPool.acquireWait(slot, 100000);
+      if (m_stopping) { return; }
+    }
+    DepthSlot& s = m_depthPool[slot];
+    s.time = m_depth.frameTime(i);
+    const bool ok = whole ? m_depth.read(i, s.depth.data(), s.bodyIndex.data(), m_pDepthDecodePool.get())
+                          : m_depth.read(i, depth.data(), bodyIndex.data(), m_pDepthDecodePool.get());
+    if (!ok) {
+      ++m_numCorrupt;
+      continue;
+    }
+    for (int y = 0; y < g.height && !whole; ++y) {
+      const size_t row = static_cast<size_t>(g.roiY + y * g.step) * kDepthWidth + g.roiX;
+      for (int x = 0; x < g.width; ++x) {
+        s.depth[row + x * g.step] = depth[y * g.width + x];
+        s.bodyIndex[row + x * g.step] = bodyIndex[y * g.width + x];
+      }
+    }
+    m_depthPool.publish(slot);
+    hasSlot = false;
+  }
+  m_depthLive = false;
+  m_depthPool.wakeConsumer();
+}
+
+bool PlaybackFrameSource::nextColor() {
+  if (m_hasColor || m_colorFiles.empty()) { return m_hasColor; }
+  if (!m_colorPool.pop(m_colorSlot)) {
+    // A prefetch thread may publish its last frame just before clearing its live flag, so try once more after
+    if (!m_colorPool.popWait(m_colorSlot, m_colorLive) && !m_colorPool.pop(m_colorSlot)) { return false; }
+    ++m_stats.prefetchWaits;
+  }
+  m_hasColor = true;
+  return true;
+}
+
+bool PlaybackFrameSource::nextDepth() {
+  if (m_hasDepth || !m_depth.isOpen()) { return m_hasDepth; }
+  if (!m_depthPool.pop(m_depthSlot)) {
+    if (!m_depthPool.popWait(m_depthSlot, m_depthLive) && !m_depthPool.pop(m_depthSlot)) { return false; }
+    ++m_stats.prefetchWaits;
+  }
+  m_hasDepth = true;
+  return true;
+}
+
+void PlaybackFrameSource::pace(const INT64 t) {
+  const auto now = std::chrono::steady_clock::now();
+  if (m_stats.frameSets == 0) {
+    m_firstWall = m_paceWall = now;
+    m_firstTime = m_paceTime = t;
+  }
+  if (m_opts.speed > 0) {
+    const auto due = m_paceWall + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>((t - m_paceTime) * 1.0E-7 / m_opts.speed));
+    if (now > due + std::chrono::milliseconds(static_cast<int64_t>(kMaxLagMillis))) {
+      // Fell behind: continue from here instead of bursting through the backlog
+      m_paceWall = now;
+      m_paceTime = t;
+      ++m_stats.resyncs;
+    } else {
+      std::this_thread::sleep_until(due);
+    }
+  }
+}
+
+bool PlaybackFrameSource::update(const int streams, KinectOneListener* sink) {
+  if (!m_isOpen || m_finished) { return false; }
+  const bool hasColor = nextColor(), hasDepth = nextDepth();
+  const bool hasSkeleton = (m_opts.streams & Stream_Body) && m_nextSkeleton < m_skeletons.numSkeletons();
+  if (!hasColor && !hasDepth && !hasSkeleton) {
+    m_finished = true;
+    return false;
+  }
+
+  INT64 t = INT64_MAX;
+  if (hasColor) { t = std::min(t, m_colorPool[m_colorSlot].time); }
+  if (hasDepth) { t = std::min(t, m_depthPool[m_depthSlot].time); }
+  if (hasSkeleton) { t = std::min(t, m_skeletons.skeletonTime(m_nextSkeleton)); }
+  pace(t);
+
+  // Frames of streams the sink did not ask for are consumed all the same, so that all streams stay in step
+  const INT64 end = t + kFrameSetTolerance;
+  if (hasColor && m_colorPool[m_colorSlot].time < end) {
+    const ColorSlot& s = m_colorPool[m_colorSlot];
+    if (streams & Stream_Color) {
+      sink->onColor(s.time, static_cast<UINT>(s.yuy2.size()), reinterpret_cast<const RGBQUAD*>(s.yuy2.data()));
+      ++m_stats.colorFrames;
+    }
+    m_colorPool.release(m_colorSlot);
+    m_hasColor = false;
+  }
+  if (hasDepth && m_depthPool[m_depthSlot].time < end) {
+    const DepthSlot& s = m_depthPool[m_depthSlot];
+    if (streams & Stream_DepthAndBodyIndex) {
+      sink->onDepthAndBodyIndex(s.time, static_cast<UINT>(s.depth.size()), s.depth.data(),
+                                static_cast<UINT>(s.bodyIndex.size()), s.bodyIndex.data());
+      ++m_stats.depthFrames;
+    }
+    m_depthPool.release(m_depthSlot);
+    m_hasDepth = false;
+  }
+  if (m_opts.streams & Stream_Body) {
+    for (; m_nextSkeleton < m_skeletons.numSkeletons() && m_skeletons.skeletonTime(m_nextSkeleton) < end;
+         ++m_nextSkeleton) {
+      if (streams & Stream_Body) {
+        m_skeletons.skeleton(m_nextSkeleton, m_skel);
+        sink->onSkeleton(&m_skel);
+        ++m_stats.skeletons;
+      }
+    }
+  }
+
+  ++m_stats.frameSets;
+  m_lastWall = std::chrono::steady_clock::now();
+  m_lastTime = t;
+  return true;
+}
+
+std::vector<std::pair<float, float>> PlaybackFrameSource::getDepthPixelCoordsInCameraSpace() {
+  // Mirrored, as are the sensor's frames, so that replayed depth reprojects as it did when it was recorded
+  return DepthReprojector(kDepthWidth, kDepthHeight).rayTable();
+}
+
+PlaybackStats PlaybackFrameSource::stats() const {
+  PlaybackStats s = m_stats;
+  s.corruptFrames = m_numCorrupt;
+  if (s.frameSets > 0) {
+    s.wallSeconds = std::chrono::duration<double>(m_lastWall - m_firstWall).count();
+    s.recordingSeconds = (m_lastTime - m_firstTime) * 1.0E-7;
+  }
+  return s;
+}
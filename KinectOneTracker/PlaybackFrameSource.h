@@ -0,0 +1,159 @@
+#ifndef KINECTONETRACKER_PLAYBACKFRAMESOURCE_H_
+#define KINECTONETRACKER_PLAYBACKFRAMESOURCE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./DepthCodec.h"
+#include "./FramePool.h"
+#include "./KinectOneFrameSource.h"
+#include "./KinectTypes.h"
+#include "./Recording.h"
+#include "./RecordingReader.h"
+#include "./ThreadPool.h"
+
+//! PlaybackFrameSource settings
+struct PlaybackOptions {
+  // Playback rate relative to the recording's device time: 1 = real time, 2 = twice as fast, ... (0 = as fast as
+  // frames are decoded and consumed)
+  double speed;
+  // Streams to play (mask of KinectOneFrameSource::Stream values). Streams without recorded files are skipped
+  int streams;
+  // Threads decoding each depth frame, including the depth prefetch thread
+  int depthDecodeThreads;
+
+  PlaybackOptions()
+    : speed(1.0)
+    , streams(KinectOneFrameSource::Stream_Color | KinectOneFrameSource::Stream_DepthAndBodyIndex |
+              KinectOneFrameSource::Stream_Body)
+    , depthDecodeThreads(2) { }
+};
+
+//! Counters of a PlaybackFrameSource
+struct PlaybackStats {
+  uint64_t frameSets;         // Frame sets delivered
+  uint64_t colorFrames;       // Frames delivered per stream
+  uint64_t depthFrames;
+  uint64_t skeletons;
+  uint64_t corruptFrames;     // Color or depth frames that could not be decoded, and were skipped
+  uint64_t prefetchWaits;     // Frame sets that waited for a frame still being decoded
+  uint64_t resyncs;           // Times playback fell behind its pace by more than kMaxLag and continued from there
+  double wallSeconds;         // Wall time from the first frame set to the last
+  double recordingSeconds;    // Device time from the first frame set to the last
+
+  PlaybackStats()
+    : frameSets(0), colorFrames(0), depthFrames(0), skeletons(0), corruptFrames(0), prefetchWaits(0), resyncs(0)
+    , wallSeconds(0), recordingSeconds(0) { }
+
+  //! Achieved playback rate relative to real time
+  double speed() const { return wallSeconds > 0 ? recordingSeconds / wallSeconds : 0.0; }
+};
+
+std::ostream& operator<<(std::ostream& os, const PlaybackStats& s);  // NOLINT
+
+//! Frame source replaying a recording written by KinectOneRecorder through the same listener interface as the
+//! sensor: skeletons from the skeleton log <id>.skel, depth and body index frames from <id>.depth.kdc and color
+//! frames from <id>.color.avi (or the segments <id>.color.0000.avi, <id>.color.0001.avi, ...), each with its
+//! original device timestamp. Frames are played back at the sensor's size, with recorded regions placed where the
+//! recorder cropped them from (see Recording::colorGeometry and depthGeometry): recorded color is BGR at half the
+//! size of its region and is scaled back up to YUY2 (see bgrToYuy2Double()), with black around the region, and
+//! subsampled depth pixels are placed step pixels apart, with pixels not recorded having no depth and no body.
+//! Color recorded at any other size is not played.
+//! Color and depth frames are decoded ahead on a thread per stream into small pools of reused frame slots (see
+//! FramePool.h), so that update() only hands out frames that are ready. Skeletons are decoded from the memory-mapped
+//! log as they are due. Each update() delivers the next frame set: all frames within half a sensor frame of the
+//! earliest timestamp still to be played, paced at opts.speed times the recording's own rate.
+class PlaybackFrameSource : public KinectOneFrameSource {
+ public:
+  static const int
+    kDepthWidth   = 512,
+    kDepthHeight  = 424,
+    kColorWidth   = 1920,
+    kColorHeight  = 1080;
+  //! Frames later than the earliest one to be played by less than this (in 100 ns ticks) are in the same frame set
+  static const INT64 kFrameSetTolerance = 166666;
+  //! Lag behind the pace of playback after which it continues from the current frame set instead of catching up
+  static const int kMaxLagMillis = 250;
+
+  explicit PlaybackFrameSource(const std::string& recId, const PlaybackOptions& opts = PlaybackOptions());
+  ~PlaybackFrameSource();
+
+  //! Opens the recording's files and starts decoding ahead. Returns false if it has no skeleton log
+  bool init();
+  //! Delivers the next frame set. Returns false once all frames have been played
+  bool update(const int streams, KinectOneListener* sink);
+  //! Rays of the default depth intrinsics of mirrored frames (see DepthReprojector.h), as recordings do not store the
+  //! sensor's
+  std::vector<std::pair<float, float>> getDepthPixelCoordsInCameraSpace();
+
+  //! Metadata and frame timestamps of the recording being played
+  const Recording& recording() const { return m_recording; }
+  //! Whether all frames have been played. Can be called from any thread
+  bool finished() const { return m_finished; }
+  //! Counters so far. Only for the thread calling update(), or once finished
+  PlaybackStats stats() const;
+
+ private:
+  PlaybackFrameSource(const PlaybackFrameSource&);
+  PlaybackFrameSource& operator=(const PlaybackFrameSource&);
+
+  // Frame slots decoded ahead per stream
+  static const size_t
+    kColorSlots   = 8,
+    kDepthSlots   = 16;
+
+  struct ColorSlot {
+    INT64 time;
+    std::vector<BYTE> yuy2;
+  };
+  struct DepthSlot {
+    INT64 time;
+    std::vector<UINT16> depth;
+    std::vector<BYTE> bodyIndex;
+  };
+
+  void prefetchColor();
+  void prefetchDepth();
+  //! Makes sure the next color / depth frame to be played, if any, has been popped from its pool
+  bool nextColor();
+  bool nextDepth();
+  //! Waits until the frame set at time t is due
+  void pace(const INT64 t);
+
+  const std::string m_recId;
+  const PlaybackOptions m_opts;
+  Recording m_recording;
+  RecordingReader m_skeletons;
+  DepthStreamReader m_depth;
+  std::vector<std::string> m_colorFiles;
+  bool m_isOpen;
+  std::atomic<bool> m_finished;
+
+  // Decoding ahead. Each prefetch thread clears its live flag once it has published its last frame
+  FramePool<ColorSlot, kColorSlots> m_colorPool;
+  FramePool<DepthSlot, kDepthSlots> m_depthPool;
+  std::unique_ptr<ThreadPool> m_pDepthDecodePool;
+  std::atomic<bool> m_colorLive, m_depthLive, m_stopping;
+  std::atomic<uint64_t> m_numCorrupt;
+  std::thread m_colorThread, m_depthThread;
+
+  // Playback position: popped frames not yet played, and the next skeleton
+  bool m_hasColor, m_hasDepth;
+  size_t m_colorSlot, m_depthSlot;
+  uint64_t m_nextSkeleton;
+  Skeleton m_skel;
+
+  // Pacing: wall time at which the frame set at device time m_paceTime is due
+  std::chrono::steady_clock::time_point m_paceWall, m_firstWall, m_lastWall;
+  INT64 m_paceTime, m_firstTime, m_lastTime;
+  PlaybackStats m_stats;
+};
+
+#endif  // KINECTONETRACKER_PLAYBACKFRAMESOURCE_H_
@@ -0,0 +1,274 @@
+#include "./PointCloudExporter.h"
+#include "./SkeletonLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+PointCloudExporter::PointCloudExporter(const DepthReprojector& reprojector, const size_t numThreads,
+                                       const size_t maxQueued)
+  : m_reprojector(reprojector)
+  , m_mode(Mode_PerFrame)
+  , m_isOpen(false)
+  , m_fileOffset(0)
+  , m_writeFailed(false)
+  , m_numExported(0)
+  , m_numDropped(0)
+  , m_numPoints(0)
+  , m_pool(std::max<size_t>(numThreads, 1), std::max<size_t>(maxQueued, 1)) {
+  // One buffer per running or queued export, so that a free buffer always finds room in the pool queue
+  const size_t numFrames = m_pool.numThreads() + std::max<size_t>(maxQueued, 1);
+  const size_t n = m_reprojector.maxPoints();
+  for (size_t i = 0; i < numFrames; ++i) {
+    m_frames.emplace_back(new Frame());
+    Frame& f = *m_frames.back();
+    f.depth.resize(n);
+    f.bodyIndex.resize(n);
+    f.points.resize(3 * n);
+    m_free.push_back(&f);
+  }
+}
+
+PointCloudExporter::~PointCloudExporter() {
+  close();
+}
+
+bool PointCloudExporter::open(const string& prefix, const Mode mode) {
+  close();
+  m_prefix = prefix;
+  m_mode = mode;
+  m_writeFailed = false;
+  m_numExported = m_numDropped = m_numPoints = 0;
+  if (mode == Mode_Chunked) {
+    m_ofs.open(prefix + ".pcs", std::ios::binary | std::ios::trunc);
+    if (!m_ofs.is_open()) { return false; }
+    PointCloudStreamHeader header;
+    memcpy(header.magic, kPointCloudStreamMagic, sizeof(header.magic));
+    header.version = kPointCloudStreamVersion;
+    header.headerSize = sizeof(header);
+    m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_fileOffset = sizeof(header);
+    m_index.clear();
+    if (!m_ofs) { m_writeFailed = true; }
+  }
+  m_isOpen = true;
+  return true;
+}
+
+bool PointCloudExporter::submit(const int64_t time, const uint64_t frameIndex, const UINT16* depth,
+                                const BYTE* bodyIndex) {
+  if (!m_isOpen) { return false; }
+  Frame* frame = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_freeMutex);
+    if (!m_free.empty()) {
+      frame = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  if (frame == nullptr) {
+    ++m_numDropped;
+    return false;
+  }
+  frame->time = time;
+  frame->index = frameIndex;
+  std::copy(depth, depth + frame->depth.size(), frame->depth.begin());
+  std::copy(bodyIndex, bodyIndex + frame->bodyIndex.size(), frame->bodyIndex.begin());
+  if (!m_pool.trySubmit([this, frame] () { exportFrame(frame); })) {
+    releaseFrame(frame);
+    ++m_numDropped;
+    return false;
+  }
+  return true;
+}
+
+void PointCloudExporter::exportFrame(Frame* frame) {
+  const size_t numPoints = m_reprojector.reproject(frame->depth.data(), frame->bodyIndex.data(),
+                                                   frame->points.data());
+  write(frame->time, frame->index, frame->points.data(), numPoints);
+  releaseFrame(frame);
+}
+
+bool PointCloudExporter::write(const int64_t time, const uint64_t frameIndex, const float* xyz,
+                               const size_t numPoints) {
+  if (!m_isOpen) { return false; }
+  bool ok;
+  if (m_mode == Mode_PerFrame) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%06llu.ply", static_cast<unsigned long long>(frameIndex));
+    const string file = m_prefix + suffix;
+    PlyWriter ply;
+    ok = ply.open(file);
+    if (ok) {
+      ply.append(xyz, numPoints);
+      ok = ply.close();
+    }
+    if (!ok) { cerr << "Error writing point cloud " << file << endl; }
+  } else {
+    const size_t bytes = 3 * numPoints * sizeof(float);
+    PointCloudFrameHeader header;
+    header.magic = kPointCloudFrameMagic;
+    header.numPoints = static_cast<uint32_t>(numPoints);
+    header.time = time;
+    header.frameIndex = frameIndex;
+    header.checksum = skeletonLogChecksum(reinterpret_cast<const char*>(xyz), bytes);
+    header.reserved = 0;
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_ofs.write(reinterpret_cast<const char*>(xyz), bytes);
+    ok = !m_ofs.fail();
+    // A frame that was not written is left out of the index, which the footer would otherwise point into
+    if (ok) {
+      PointCloudIndexEntry entry;
+      entry.offset = m_fileOffset;
+      entry.time = time;
+      m_index.push_back(entry);
+      m_fileOffset += sizeof(header) + bytes;
+    }
+  }
+  if (ok) {
+    ++m_numExported;
+    m_numPoints += numPoints;
+  } else {
+    m_writeFailed = true;
+  }
+  return ok;
+}
+
+void PointCloudExporter::releaseFrame(Frame* frame) {
+  std::lock_guard<std::mutex> lock(m_freeMutex);
+  m_free.push_back(frame);
+}
+
+bool PointCloudExporter::close() {
+  if (!m_isOpen) { return true; }
+  m_pool.wait();
+  if (m_mode == Mode_Chunked) {
+    // Workers may finish out of order, so the index is sorted to keep it in time order
+    std::stable_sort(m_index.begin(), m_index.end(),
+                     [] (const PointCloudIndexEntry& a, const PointCloudIndexEntry& b) { return a.time < b.time; });
+    PointCloudFooter footer;
+    footer.indexOffset = m_fileOffset;
+    footer.numFrames = static_cast<uint32_t>(m_index.size());
+    footer.magic = kPointCloudIndexMagic;
+    if (!m_index.empty()) {
+      m_ofs.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(PointCloudIndexEntry));
+    }
+    m_ofs.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    m_ofs.close();
+    if (!m_ofs) { m_writeFailed = true; }
+  }
+  m_isOpen = false;
+  return !m_writeFailed;
+}
+
+PointCloudStreamReader::PointCloudStreamReader()
+  : m_hasFooter(false) { }
+
+bool PointCloudStreamReader::open(const string& file) {
+  close();
+  if (!m_file.open(file)) {
+    cerr << "Could not map point cloud stream " << file << endl;
+    return false;
+  }
+  PointCloudStreamHeader header;
+  if (m_file.size() < sizeof(header)) {
+    cerr << "Not a point cloud stream: " << file << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, kPointCloudStreamMagic, sizeof(header.magic)) != 0 ||
+      header.version != kPointCloudStreamVersion || header.headerSize != sizeof(header)) {
+    cerr << "Not a point cloud stream (or unsupported version): " << file << endl;
+    close();
+    return false;
+  }
+  m_filename = file;
+  m_hasFooter = loadFooter();
+  if (!m_hasFooter) { scanFrames(); }
+  return true;
+}
+
+void PointCloudStreamReader::close() {
+  m_file.close();
+  m_filename.clear();
+  m_hasFooter = false;
+  m_index.clear();
+}
+
+bool PointCloudStreamReader::loadFooter() {
+  const uint64_t size = m_file.size();
+  PointCloudFooter footer;
+  if (size < sizeof(PointCloudStreamHeader) + sizeof(footer)) { return false; }
+  memcpy(&footer, m_file.data() + size - sizeof(footer), sizeof(footer));
+  const uint64_t indexSize = static_cast<uint64_t>(footer.numFrames) * sizeof(PointCloudIndexEntry);
+  if (footer.magic != kPointCloudIndexMagic || footer.indexOffset < sizeof(PointCloudStreamHeader) ||
+      footer.indexOffset + indexSize + sizeof(footer) != size) {
+    return false;
+  }
+  m_index.resize(footer.numFrames);
+  if (indexSize > 0) { memcpy(m_index.data(), m_file.data() + footer.indexOffset, indexSize); }
+  for (const PointCloudIndexEntry& e : m_index) {
+    PointCloudFrameHeader header;
+    if (e.offset < sizeof(PointCloudStreamHeader) || e.offset + sizeof(header) > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+    memcpy(&header, m_file.data() + e.offset, sizeof(header));
+    if (header.magic != kPointCloudFrameMagic ||
+        e.offset + sizeof(header) + 3 * sizeof(float) * header.numPoints > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+void PointCloudStreamReader::scanFrames() {
+  // Only the last frame can be torn, so only its points are checksummed here
+  const char* data = m_file.data();
+  const uint64_t size = m_file.size();
+  uint64_t offset = sizeof(PointCloudStreamHeader);
+  PointCloudFrameHeader header;
+  while (offset + sizeof(header) <= size) {
+    memcpy(&header, data + offset, sizeof(header));
+    const uint64_t bytes = 3 * sizeof(float) * static_cast<uint64_t>(header.numPoints);
+    if (header.magic != kPointCloudFrameMagic || offset + sizeof(header) + bytes > size) { break; }
+    PointCloudIndexEntry entry;
+    entry.offset = offset;
+    entry.time = header.time;
+    m_index.push_back(entry);
+    offset += sizeof(header) + bytes;
+  }
+  if (!m_index.empty()) {
+    memcpy(&header, data + m_index.back().offset, sizeof(header));
+    if (skeletonLogChecksum(data + m_index.back().offset + sizeof(header), 3 * sizeof(float) * header.numPoints) !=
+        header.checksum) {
+      cerr << "Dropping corrupt last frame of " << m_filename << endl;
+      m_index.pop_back();
+    }
+  }
+  std::stable_sort(m_index.begin(), m_index.end(),
+                   [] (const PointCloudIndexEntry& a, const PointCloudIndexEntry& b) { return a.time < b.time; });
+}
+
+uint64_t PointCloudStreamReader::seek(const int64_t t) const {
+  const auto it = std::lower_bound(m_index.begin(), m_index.end(), t,
+                                   [] (const PointCloudIndexEntry& e, const int64_t time) { return e.time < time; });
+  return it - m_index.begin();
+}
+
+PointCloudFrameHeader PointCloudStreamReader::frameHeader(const uint64_t i) const {
+  PointCloudFrameHeader header;
+  memcpy(&header, m_file.data() + m_index[i].offset, sizeof(header));
+  return header;
+}
+
+const float* PointCloudStreamReader::points(const uint64_t i) const {
+  // Headers are multiples of 4 bytes long, so points in the page-aligned mapping are float aligned
+  return reinterpret_cast<const float*>(m_file.data() + m_index[i].offset + sizeof(PointCloudFrameHeader));
+}
@@ -0,0 +1,165 @@
+#ifndef KINECTONETRACKER_POINTCLOUDEXPORTER_H_
+#define KINECTONETRACKER_POINTCLOUDEXPORTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "./DepthReprojector.h"
+#include "./KinectTypes.h"
+#include "./MappedFile.h"
+#include "./ThreadPool.h"
+
+// Chunked point cloud stream (.pcs) file layout (all fields little-endian), which follows the skeleton log and depth
+// stream formats (see SkeletonLog.h and DepthCodec.h):
+//   PointCloudStreamHeader
+//   Frame*             PointCloudFrameHeader followed by numPoints x, y, z float triples
+//   Index              one PointCloudIndexEntry per frame in time order, followed by PointCloudFooter (only after a
+//                      clean close)
+// Frames are written in the order their exports finish, which with several workers is not always time order.
+
+#pragma pack(push, 1)
+struct PointCloudStreamHeader {
+  char     magic[8];      // kPointCloudStreamMagic
+  uint32_t version;
+  uint32_t headerSize;
+};
+
+struct PointCloudFrameHeader {
+  uint32_t magic;         // kPointCloudFrameMagic
+  uint32_t numPoints;
+  int64_t  time;          // Depth frame timestamp
+  uint64_t frameIndex;    // Index of the depth frame among recorded frames
+  uint32_t checksum;      // skeletonLogChecksum() of the points
+  uint32_t reserved;
+};
+
+struct PointCloudIndexEntry {
+  uint64_t offset;        // File offset of PointCloudFrameHeader
+  int64_t  time;
+};
+
+struct PointCloudFooter {
+  uint64_t indexOffset;   // File offset of first PointCloudIndexEntry
+  uint32_t numFrames;
+  uint32_t magic;         // kPointCloudIndexMagic
+};
+#pragma pack(pop)
+
+static const char     kPointCloudStreamMagic[8]   = { 'K', 'O', 'P', 'C', 'L', 'O', 'U', 'D' };
+static const uint32_t kPointCloudStreamVersion    = 1;
+static const uint32_t kPointCloudFrameMagic       = 0x44554c43;  // "CLUD"
+static const uint32_t kPointCloudIndexMagic       = 0x5844494b;  // "KIDX"
+
+//! Exports depth frames as point clouds in the background. submit() copies a frame into one of a fixed set of
+//! buffers and queues it on a bounded ThreadPool, whose workers reproject it and write it either to its own binary
+//! PLY file or to a chunked .pcs file. submit() never waits: when all buffers are in use the frame is dropped and
+//! counted instead.
+class PointCloudExporter {
+ public:
+  enum Mode {
+    Mode_PerFrame,  // One PLY file per frame, named <prefix>.<frame index>.ply
+    Mode_Chunked    // All frames in <prefix>.pcs
+  };
+
+  //! Exports with reprojector (which must outlive the exporter) on numThreads workers, with up to maxQueued frames
+  //! waiting for a worker
+  explicit PointCloudExporter(const DepthReprojector& reprojector, const size_t numThreads = 1,
+                              const size_t maxQueued = 2);
+  //! Finishes queued exports
+  ~PointCloudExporter();
+
+  //! Starts exporting to files starting with prefix. Returns false if the chunked file cannot be opened
+  bool open(const std::string& prefix, const Mode mode);
+
+  //! Queues export of depth frame frameIndex. Returns false if it was dropped because all buffers are in use
+  bool submit(const int64_t time, const uint64_t frameIndex, const UINT16* depth, const BYTE* bodyIndex);
+
+  //! Writes numPoints points (x, y, z triples) of depth frame frameIndex on the calling thread, for callers that
+  //! reproject frames themselves. May be called from several threads at once. Returns false if writing failed
+  bool write(const int64_t time, const uint64_t frameIndex, const float* xyz, const size_t numPoints);
+
+  //! Waits for queued exports and closes the chunked file. Returns false if any write failed
+  bool close();
+
+  bool isOpen() const { return m_isOpen; }
+  uint64_t numExported() const { return m_numExported; }
+  uint64_t numDropped() const { return m_numDropped; }
+  uint64_t numPoints() const { return m_numPoints; }
+
+ private:
+  PointCloudExporter(const PointCloudExporter&);
+  PointCloudExporter& operator=(const PointCloudExporter&);
+
+  struct Frame {
+    int64_t time;
+    uint64_t index;
+    std::vector<UINT16> depth;
+    std::vector<BYTE> bodyIndex;
+    std::vector<float> points;
+  };
+
+  void exportFrame(Frame* frame);
+  void releaseFrame(Frame* frame);
+
+  const DepthReprojector& m_reprojector;
+  std::string m_prefix;
+  Mode m_mode;
+  bool m_isOpen;
+  std::vector<std::unique_ptr<Frame>> m_frames;
+  std::mutex m_freeMutex;
+  std::vector<Frame*> m_free;
+
+  // Chunked file, written by one worker at a time
+  std::mutex m_fileMutex;
+  std::ofstream m_ofs;
+  uint64_t m_fileOffset;
+  std::vector<PointCloudIndexEntry> m_index;
+
+  std::atomic<bool> m_writeFailed;
+  std::atomic<uint64_t> m_numExported, m_numDropped, m_numPoints;
+  // Joined first on destruction: its tasks use the frames and file above
+  ThreadPool m_pool;
+};
+
+//! Random access reader of .pcs files. The file is memory-mapped, so points are returned without copying
+class PointCloudStreamReader {
+ public:
+  PointCloudStreamReader();
+
+  //! Maps file and loads or rebuilds its index. Returns false if it is not a .pcs file
+  bool open(const std::string& file);
+  void close();
+
+  bool isOpen() const { return m_file.isOpen(); }
+  //! Whether the index was loaded from the footer (true) or rebuilt by scanning frame headers (false)
+  bool hasFooter() const { return m_hasFooter; }
+  uint64_t numFrames() const { return m_index.size(); }
+  int64_t frameTime(const uint64_t i) const { return m_index[i].time; }
+
+  //! Index of first frame with timestamp >= t (or numFrames() if none). O(log n)
+  uint64_t seek(const int64_t t) const;
+
+  //! Header of frame i (in time order)
+  PointCloudFrameHeader frameHeader(const uint64_t i) const;
+  //! Points of frame i as x, y, z triples
+  const float* points(const uint64_t i) const;
+
+ private:
+  PointCloudStreamReader(const PointCloudStreamReader&);
+  PointCloudStreamReader& operator=(const PointCloudStreamReader&);
+
+  bool loadFooter();
+  void scanFrames();
+
+  std::string m_filename;
+  MappedFile m_file;
+  bool m_hasFooter;
+  std::vector<PointCloudIndexEntry> m_index;
+};
+
+#endif  // KINECTONETRACKER_POINTCLOUDEXPORTER_H_
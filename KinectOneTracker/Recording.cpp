@@ -1,89 +1,109 @@
 #include "./Recording.h"
+#include "./JsonWriter.h"
+#include "./RecordingReader.h"
 
 #include <string>
 #include <iostream>
 #include <fstream>
-#include <functional>
 
 using std::string;  using std::cout;  using std::cerr;  using std::endl;
 using std::ostream;
 
-// Return a function that outputs string s and optionally endline into ostream os on every call
-std::function<void(void)> put(std::ostream& os, const string& s, bool endlines = false) {  // NOLINT
-  return ([&os, s, endlines] () {
-    os << s;
-    if (endlines) {
-      os << endl;
-    }
-  });
+// Writes Skeleton s as JSON object
+void skel2json(JsonWriter& w, const Skeleton& s) {  // NOLINT
+  w.raw('{');
+  w.key("trackingId").value(static_cast<uint64_t>(s.trackingId)).raw(',');
+  w.key("jointPositions").array(s.jointPositions, s.JointType_Count).raw(',');
+  w.key("jointConfidences").array(s.jointConfidences, s.JointType_Count).raw(',');
+  w.key("jointOrientations").array(s.jointOrientations, s.JointType_Count).raw(',');
+  w.key("handState").raw('[').value(s.handLeftState).raw(',').value(s.handLeftConfidence).raw(',')
+                    .value(s.handRightState).raw(',').value(s.handRightConfidence).raw("],", 2);
+  w.key("activities").array(s.activities, s.Activity_Count).raw(',');
+  w.key("leanState").raw('[').value(s.leanLeftRight).raw(',').value(s.leanForwardBack).raw(',')
+                    .value(s.leanConfidence).raw("],", 2);
+  w.key("clippedEdges").value(static_cast<uint64_t>(s.clippedEdges)).raw(',');
+  w.key("timestamp").value(static_cast<int64_t>(s.timestamp));
+  w.raw('}');
 }
 
-// Writes each element of array-like type x to os in JSON format: [a, b, ..., z]
-template<typename T>
-ostream& arr2json(ostream& os, const T& x, const size_t numXs) {  // NOLINT
-  if (numXs == 0) {
-    return os << "[]";
-  }
-  os << "[" << x[0];
-  for (size_t i = 1; i < numXs; ++i) {
-    os << "," << x[i];
-  }
-  return os << "]";
+// Writes StreamGeometry g as JSON object {"roi": [x, y, width, height], "step": step, "size": [width, height]}
+void geometry2json(JsonWriter& w, const StreamGeometry& g) {  // NOLINT
+  const int roi[4] = { g.roiX, g.roiY, g.roiWidth, g.roiHeight };
+  const int size[2] = { g.width, g.height };
+  w.raw('{');
+  w.key("roi").array(roi, 4).raw(',');
+  w.key("step").value(g.step).raw(',');
+  w.key("size").array(size, 2);
+  w.raw('}');
 }
 
-// Writes each element of array a to os in JSON format: [a, b, ..., z]
-template <typename T, size_t DIM>
-ostream& operator<<(ostream& os, const std::array<T,DIM>& a) {  // NOLINT
-  return arr2json(os, a, DIM);
-}
-template <typename T>
-ostream& operator<<(ostream& os, const std::vector<T>& v) {  // NOLINT
-  return arr2json(os, v, v.size());
-}
-
-// Writes Recording as JSON format string to ostream
+// Writes Recording as JSON to ostream. Skeletons are streamed one at a time (from memory or from the skeleton log)
+// through a buffered writer; with endlines, each top-level field and each skeleton starts on a new line
 void rec2json(ostream& os, const Recording& rec, bool endlines) {  // NOLINT
-  const std::function<string(string)> key = [ ] (const string& id) { return "\"" + id + "\": "; };
-  const std::function<void(void)>     sep = put(os, ",", endlines);
-
-  const auto skel2json = [&] (ostream& os, const Skeleton& s, bool endlines) {  // NOLINT
-    os << "{";                      if (endlines) { os << endl; }
-    os << key("trackingId")         << s.trackingId; sep();
-    os << key("jointPositions");    arr2json(os, s.jointPositions, s.JointType_Count); sep();
-    os << key("jointConfidences");  arr2json(os, s.jointConfidences, s.JointType_Count); sep();
-    os << key("jointOrientations"); arr2json(os, s.jointOrientations, s.JointType_Count); sep();
-    os << key("handState")          << "[" << s.handLeftState << "," << s.handLeftConfidence << ","
-                                    << s.handRightState << "," << s.handRightConfidence << "]"; sep();
-    os << key("activities");        arr2json(os, s.activities, s.Activity_Count); sep();
-    os << key("leanState")          << "[" << s.leanLeftRight << "," << s.leanForwardBack
-                                    << "," << s.leanConfidence << "]"; sep();
-    os << key("clippedEdges")       << s.clippedEdges; sep();
-    os << key("timestamp")          << s.timestamp;  if (endlines) { os << endl; }
-    os << "}";                      if (endlines) { os << endl; }
-  };
+  JsonWriter w(os);
+  const char* sep = endlines ? ",\n" : ",";
+  const size_t sepLen = endlines ? 2 : 1;
+  const auto newline = [&] () { if (endlines) { w.raw('\n'); } };
 
-  os << "{";                        if (endlines) { os << endl; }
-  os << key("id")                   << "\"" + rec.id + "\"";  sep();
-  os << key("camera")               << rec.camera;  sep();
-  os << key("startTime")            << rec.startTime;  sep();
-  os << key("endTime")              << rec.endTime;  sep();
-  os << key("skeletons") << "[";    if (endlines) { os << endl; }
-  const size_t numSkels = rec.skeletons.size();
-  for (size_t iSkel = 0; iSkel < numSkels; ++iSkel) {
-    skel2json(os, rec.skeletons[iSkel], endlines);
-    if (iSkel < numSkels - 1) { sep(); }
+  w.raw('{');                       newline();
+  w.key("id").value(rec.id).raw(sep, sepLen);
+  w.key("camera").array(rec.camera, rec.camera.size()).raw(sep, sepLen);
+  w.key("startTime").value(rec.startTime).raw(sep, sepLen);
+  w.key("endTime").value(rec.endTime).raw(sep, sepLen);
+  w.key("skeletons").raw('[');      newline();
+  bool first = true;
+  for (const Skeleton& s : rec.skeletons) {
+    if (!first) { w.raw(sep, sepLen); }
+    first = false;
+    skel2json(w, s);
   }
-  os << "]"; sep();
-  os << key("colorTimestamps");     arr2json(os, rec.colorTimestamps, rec.colorTimestamps.size());  sep();
-  os << key("depthTimestamps");     arr2json(os, rec.depthTimestamps, rec.colorTimestamps.size());
-                                    if (endlines) { os << endl; }
-  os << "}";                        if (endlines) { os << endl; }
+  if (!rec.skeletonLogFile.empty()) {  // Stream logged skeletons without loading them all
+    RecordingReader log;
+    if (log.open(rec.skeletonLogFile)) {
+      for (const Skeleton& s : log.skeletons()) {
+        if (!first) { w.raw(sep, sepLen); }
+        first = false;
+        skel2json(w, s);
+      }
+    } else {
+      cerr << "Could not read skeleton log " << rec.skeletonLogFile << endl;
+    }
+  }
+  newline();
+  w.raw(']').raw(sep, sepLen);
+  w.key("colorTimestamps").array(rec.colorTimestamps, rec.colorTimestamps.size()).raw(sep, sepLen);
+  w.key("depthTimestamps").array(rec.depthTimestamps, rec.depthTimestamps.size()).raw(sep, sepLen);
+  w.key("droppedColorTimestamps").array(rec.droppedColorTimestamps, rec.droppedColorTimestamps.size());
+  w.raw(sep, sepLen);
+  w.key("droppedDepthTimestamps").array(rec.droppedDepthTimestamps, rec.droppedDepthTimestamps.size());
+  w.raw(sep, sepLen);
+  w.key("colorGeometry");
+  geometry2json(w, rec.colorGeometry);
+  w.raw(sep, sepLen);
+  w.key("depthGeometry");
+  geometry2json(w, rec.depthGeometry);
+  newline();
+  w.raw('}');                       newline();
+  w.flush();
 }
 
 
 bool Recording::saveToJSON(const std::string& file) {
-  std::ofstream ofs(file);
+  std::ofstream ofs(file, std::ios::binary);
+  if (!ofs) {
+    cerr << "Could not open " << file << endl;
+    return false;
+  }
   rec2json(ofs, *this, true);
   ofs.close();
+  return static_cast<bool>(ofs);
+}
+
+bool Recording::loadFromLog(const std::string& file) {
+  RecordingReader reader;
+  if (!reader.open(file)) { return false; }
+  if (!reader.load(*this)) {
+    cerr << "Warning: " << file << " has no recording metadata (not closed cleanly?)" << endl;
+  }
   return true;
 }
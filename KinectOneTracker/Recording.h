@@ -97,10 +97,38 @@ struct Skeleton {
   int64_t                   timestamp;
 };
 
+//! Part of the sensor's frames held by the frames of a recorded stream (see StreamStage.h): the region kept and the
+//! size it was recorded at
+struct StreamGeometry {
+  StreamGeometry(const int x = 0, const int y = 0, const int regionWidth = 0, const int regionHeight = 0,
+                 const int step_ = 0, const int width_ = 0, const int height_ = 0)
+    : roiX(x), roiY(y), roiWidth(regionWidth), roiHeight(regionHeight), step(step_), width(width_)
+    , height(height_) { }
+
+  bool operator==(const StreamGeometry& o) const {
+    return roiX == o.roiX && roiY == o.roiY && roiWidth == o.roiWidth && roiHeight == o.roiHeight && step == o.step &&
+           width == o.width && height == o.height;
+  }
+
+  // Region of sensor frames kept
+  int roiX, roiY, roiWidth, roiHeight;
+  // Whole factor by which the region is subsampled (depth), or 0 if it is scaled to the recorded size (color)
+  int step;
+  // Size of recorded frames
+  int width, height;
+};
+
 //! Recording containing a stream of Skeletons as well as optional color
 //! and combined depth+bodyIndex frame timestamps. Actual frames are stored
-//! externally in video files.
+//! externally in video files. Skeletons are either held in memory or streamed
+//! to a binary skeleton log (see SkeletonLog.h), in which case only metadata
+//! is kept here.
 struct Recording {
+  Recording()
+    : camera(), startTime(0), endTime(0), numLoggedSkeletons(0)
+    , colorGeometry(0, 0, 1920, 1080, 0, 960, 540), depthGeometry(0, 0, 512, 424, 1, 512, 424)
+    , isLive(false), isLoaded(false) { }
+
   // Identifier of this recording
   std::string id;
   // 4x4 row-major camera transformation matrix
@@ -109,12 +137,22 @@ struct Recording {
   uint64_t startTime;
   // Device timestamp at end of recording (microseconds)
   uint64_t endTime;
-  // Vector of tracked Skeletons
+  // Vector of tracked Skeletons (empty when streamed to skeletonLogFile)
   std::vector<Skeleton> skeletons;
+  // Binary log holding the tracked Skeletons, if they are not kept in memory
+  std::string skeletonLogFile;
+  // Number of Skeletons written to skeletonLogFile
+  uint64_t numLoggedSkeletons;
   // Timestamps of recorded color frames
   std::vector<int64_t> colorTimestamps;
   // Timestamps of recorded depth frames
   std::vector<int64_t> depthTimestamps;
+  // Timestamps of color and depth frames that were due for recording but dropped because their encoder fell behind
+  std::vector<int64_t> droppedColorTimestamps;
+  std::vector<int64_t> droppedDepthTimestamps;
+  // Geometry of recorded color and depth frames. Defaults to that of recordings made before it was stored: color
+  // at half the sensor's size and whole depth frames
+  StreamGeometry colorGeometry, depthGeometry;
 
   // STATE - NOT STORED
   //! Whether this Recording is currently being recorded
@@ -122,8 +160,15 @@ struct Recording {
   //! Whether this Recording has been loaded from file
   bool isLoaded;
 
+  //! Number of tracked Skeletons, whether in memory or logged
+  uint64_t numSkeletons() const { return skeletons.size() + numLoggedSkeletons; }
+
   //! Save to JSON file
   bool saveToJSON(const std::string& file);
+
+  //! Load from binary recording (skeleton log) file. Skeletons stay on disk and are read through
+  //! skeletonLogFile (see RecordingReader.h for random access without loading them)
+  bool loadFromLog(const std::string& file);
 };
 
 #endif  // RECORDING_H_
@@ -0,0 +1,216 @@
+#include "./RecordingReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+RecordingReader::RecordingReader()
+  : m_hasFooter(false)
+  , m_pMetadata(nullptr) {
+  close();
+}
+
+void RecordingReader::close() {
+  m_file.close();
+  m_filename.clear();
+  m_hasFooter = false;
+  m_index.clear();
+  m_pMetadata = nullptr;
+  for (int s = 0; s < kNumStreams; ++s) {
+    m_streams[s].chunks.clear();
+    m_streams[s].firstRecord.clear();
+    m_streams[s].recordSize = 0;
+    m_streams[s].numRecords = 0;
+  }
+}
+
+bool RecordingReader::open(const string& file) {
+  close();
+  if (!m_file.open(file)) {
+    cerr << "Could not map recording " << file << endl;
+    return false;
+  }
+  SkeletonLogHeader header;
+  if (m_file.size() < sizeof(header)) {
+    cerr << "Not a skeleton log: " << file << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, kSkeletonLogMagic, sizeof(header.magic)) != 0 || header.version != kSkeletonLogVersion) {
+    cerr << "Not a skeleton log (or unsupported version): " << file << endl;
+    close();
+    return false;
+  }
+  m_filename = file;
+  m_hasFooter = loadFooter();
+  if (!m_hasFooter) { scanChunks(); }
+  buildStreams();
+  return true;
+}
+
+//! Whether chunks of recordType may hold records of recordSize bytes: skeletons are always packed to
+//! kSkeletonRecordSize bytes and frames are single timestamps, as readers assume
+inline bool isValidRecordSize(const uint32_t recordType, const uint32_t recordSize) {
+  switch (recordType) {
+    case SkeletonLogRecord_Skeleton:    return recordSize == kSkeletonRecordSize;
+    case SkeletonLogRecord_ColorFrame:
+    case SkeletonLogRecord_DepthFrame:  return recordSize == sizeof(int64_t);
+    case SkeletonLogRecord_Metadata:    return recordSize > 0;
+    default:                            return false;
+  }
+}
+
+bool RecordingReader::loadFooter() {
+  const uint64_t size = m_file.size();
+  SkeletonLogFooter footer;
+  if (size < sizeof(SkeletonLogHeader) + sizeof(footer)) { return false; }
+  memcpy(&footer, m_file.data() + size - sizeof(footer), sizeof(footer));
+  const uint64_t indexSize = static_cast<uint64_t>(footer.numChunks) * sizeof(SkeletonLogIndexEntry);
+  if (footer.magic != kSkeletonLogIndexMagic || footer.indexOffset < sizeof(SkeletonLogHeader) ||
+      footer.indexOffset + indexSize + sizeof(footer) != size) {
+    return false;
+  }
+  m_index.resize(footer.numChunks);
+  if (indexSize > 0) { memcpy(m_index.data(), m_file.data() + footer.indexOffset, indexSize); }
+  // An index that disagrees with the chunks it points to is treated like a missing one, and the chunks are scanned
+  for (const SkeletonLogIndexEntry& e : m_index) {
+    SkeletonLogChunkHeader header;
+    if (e.recordType < SkeletonLogRecord_Skeleton || e.recordType > SkeletonLogRecord_Metadata ||
+        e.offset < sizeof(SkeletonLogHeader) || e.offset + sizeof(header) > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+    memcpy(&header, m_file.data() + e.offset, sizeof(header));
+    const uint64_t payloadSize = static_cast<uint64_t>(header.recordSize) * header.count;
+    if (header.magic != kSkeletonLogChunkMagic || header.recordType != e.recordType || header.count != e.count ||
+        !isValidRecordSize(header.recordType, header.recordSize) ||
+        e.offset + sizeof(header) + payloadSize > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+void RecordingReader::scanChunks() {
+  // Walk chunk headers until the first one that is incomplete or not a chunk (e.g. the index). Only the payload of
+  // the last chunk is checksummed: earlier chunks were followed by further writes, so only the tail can be torn
+  const char* data = m_file.data();
+  const uint64_t size = m_file.size();
+  uint64_t offset = sizeof(SkeletonLogHeader);
+  SkeletonLogChunkHeader header;
+  while (offset + sizeof(header) <= size) {
+    memcpy(&header, data + offset, sizeof(header));
+    const uint64_t payloadSize = static_cast<uint64_t>(header.recordSize) * header.count;
+    if (header.magic != kSkeletonLogChunkMagic || !isValidRecordSize(header.recordType, header.recordSize) ||
+        offset + sizeof(header) + payloadSize > size) {
+      break;
+    }
+    SkeletonLogIndexEntry entry;
+    entry.offset = offset;
+    entry.recordType = header.recordType;
+    entry.count = header.count;
+    entry.firstTime = header.firstTime;
+    entry.lastTime = header.lastTime;
+    m_index.push_back(entry);
+    offset += sizeof(header) + payloadSize;
+  }
+  if (!m_index.empty()) {
+    const SkeletonLogIndexEntry& last = m_index.back();
+    memcpy(&header, data + last.offset, sizeof(header));
+    const char* payload = data + last.offset + sizeof(header);
+    if (skeletonLogChecksum(payload, static_cast<size_t>(header.recordSize) * header.count) != header.checksum) {
+      cerr << "Dropping corrupt last chunk of " << m_filename << endl;
+      m_index.pop_back();
+    }
+  }
+}
+
+void RecordingReader::buildStreams() {
+  for (const SkeletonLogIndexEntry& e : m_index) {
+    SkeletonLogChunkHeader header;
+    memcpy(&header, m_file.data() + e.offset, sizeof(header));
+    if (e.recordType == SkeletonLogRecord_Metadata) {
+      m_pMetadata = &e;
+      continue;
+    }
+    if (e.count == 0) { continue; }
+    Stream& stream = m_streams[e.recordType - SkeletonLogRecord_Skeleton];
+    // Record sizes were checked against the record type when the index was loaded or scanned
+    stream.recordSize = header.recordSize;
+    stream.chunks.push_back(&e);
+    stream.firstRecord.push_back(stream.numRecords);
+    stream.numRecords += e.count;
+  }
+}
+
+const char* RecordingReader::record(const Stream& stream, const uint64_t i) const {
+  // Last chunk whose first record is <= i
+  const size_t c = std::upper_bound(stream.firstRecord.begin(), stream.firstRecord.end(), i)
+                   - stream.firstRecord.begin() - 1;
+  return m_file.data() + stream.chunks[c]->offset + sizeof(SkeletonLogChunkHeader) +
+         (i - stream.firstRecord[c]) * stream.recordSize;
+}
+
+int64_t RecordingReader::recordTime(const Stream& stream, const uint64_t i) const {
+  int64_t t;
+  memcpy(&t, record(stream, i), sizeof(t));
+  return t;
+}
+
+uint64_t RecordingReader::seek(const Stream& stream, const int64_t t) const {
+  // First chunk that ends at or after t, then first record in it at or after t
+  const auto endsBefore = [] (const SkeletonLogIndexEntry* e, const int64_t time) { return e->lastTime < time; };
+  const auto chunk = std::lower_bound(stream.chunks.begin(), stream.chunks.end(), t, endsBefore);
+  if (chunk == stream.chunks.end()) { return stream.numRecords; }
+  const size_t c = chunk - stream.chunks.begin();
+  uint64_t lo = stream.firstRecord[c], hi = lo + (*chunk)->count;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    if (recordTime(stream, mid) < t) { lo = mid + 1; } else { hi = mid; }
+  }
+  return lo;
+}
+
+void RecordingReader::skeleton(const uint64_t i, Skeleton& s) const {  // NOLINT
+  unpackSkeleton(record(m_streams[kSkeletonStream], i), s);
+}
+
+RecordingReader::SkeletonRange RecordingReader::skeletons(const int64_t t0, const int64_t t1) const {
+  const uint64_t first = seekSkeleton(t0);
+  const uint64_t last = (t1 == kEndOfTime) ? numSkeletons() : std::max(first, seekSkeleton(t1));
+  SkeletonRange range = { SkeletonIterator(this, first), SkeletonIterator(this, last) };
+  return range;
+}
+
+bool RecordingReader::load(Recording& rec, const bool withSkeletons) const {  // NOLINT
+  bool hasMetadata = false;
+  if (m_pMetadata != nullptr) {
+    SkeletonLogChunkHeader header;
+    memcpy(&header, m_file.data() + m_pMetadata->offset, sizeof(header));
+    const char* metadata = m_file.data() + m_pMetadata->offset + sizeof(header);
+    hasMetadata = unpackRecordingMetadata(metadata, header.recordSize, rec);
+  }
+
+  rec.colorTimestamps.resize(numColorFrames());
+  for (uint64_t i = 0; i < numColorFrames(); ++i) { rec.colorTimestamps[i] = colorFrameTime(i); }
+  rec.depthTimestamps.resize(numDepthFrames());
+  for (uint64_t i = 0; i < numDepthFrames(); ++i) { rec.depthTimestamps[i] = depthFrameTime(i); }
+
+  if (withSkeletons) {
+    rec.skeletons.resize(numSkeletons());
+    for (uint64_t i = 0; i < numSkeletons(); ++i) { skeleton(i, rec.skeletons[i]); }
+    rec.skeletonLogFile.clear();
+    rec.numLoggedSkeletons = 0;
+  } else {
+    rec.skeletons.clear();
+    rec.skeletonLogFile = m_filename;
+    rec.numLoggedSkeletons = numSkeletons();
+  }
+  rec.isLive = false;
+  rec.isLoaded = true;
+  return hasMetadata;
+}
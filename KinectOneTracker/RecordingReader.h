@@ -0,0 +1,112 @@
+#ifndef KINECTONETRACKER_RECORDINGREADER_H_
+#define KINECTONETRACKER_RECORDINGREADER_H_
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "./MappedFile.h"
+#include "./Recording.h"
+#include "./SkeletonLog.h"
+
+//! Random access reader of binary recordings written by SkeletonLogWriter. The file is memory-mapped and only the
+//! chunk index is materialized: it is loaded from the footer of cleanly closed logs, or rebuilt from the chunk
+//! headers otherwise. Skeletons and frame timestamps are decoded on access, so opening is near-instant regardless
+//! of recording size and seeking by time is a binary search over chunks followed by one within the chunk.
+class RecordingReader {
+ public:
+  //! Sentinel meaning "no upper time bound"
+  static const int64_t kEndOfTime = INT64_MAX;
+
+  RecordingReader();
+
+  //! Maps file and loads or rebuilds its index. Returns false if it is not a skeleton log
+  bool open(const std::string& file);
+  void close();
+
+  bool isOpen() const { return m_file.isOpen(); }
+  //! Whether the index was loaded from the footer (true) or rebuilt by scanning chunk headers (false)
+  bool hasFooter() const { return m_hasFooter; }
+  //! Index of all complete chunks
+  const std::vector<SkeletonLogIndexEntry>& chunks() const { return m_index; }
+
+  uint64_t numSkeletons() const { return m_streams[kSkeletonStream].numRecords; }
+  uint64_t numColorFrames() const { return m_streams[kColorStream].numRecords; }
+  uint64_t numDepthFrames() const { return m_streams[kDepthStream].numRecords; }
+
+  //! Fills rec with the recording metadata and frame timestamps, pointing its skeletonLogFile at this file instead
+  //! of loading Skeletons unless withSkeletons is set. Marks rec as loaded. Returns false if the log has no
+  //! metadata (e.g. it was not closed cleanly), in which case the remaining fields are still filled in
+  bool load(Recording& rec, const bool withSkeletons = false) const;  // NOLINT
+
+  //! Decodes Skeleton i (0 <= i < numSkeletons())
+  void skeleton(const uint64_t i, Skeleton& s) const;  // NOLINT
+  int64_t skeletonTime(const uint64_t i) const { return recordTime(m_streams[kSkeletonStream], i); }
+  int64_t colorFrameTime(const uint64_t i) const { return recordTime(m_streams[kColorStream], i); }
+  int64_t depthFrameTime(const uint64_t i) const { return recordTime(m_streams[kDepthStream], i); }
+
+  //! Index of first Skeleton / color frame / depth frame with timestamp >= t (or count if none). O(log n)
+  uint64_t seekSkeleton(const int64_t t) const { return seek(m_streams[kSkeletonStream], t); }
+  uint64_t seekColorFrame(const int64_t t) const { return seek(m_streams[kColorStream], t); }
+  uint64_t seekDepthFrame(const int64_t t) const { return seek(m_streams[kDepthStream], t); }
+
+  //! Forward iterator decoding Skeletons on dereference
+  class SkeletonIterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Skeleton value_type;
+    typedef int64_t difference_type;
+    typedef const Skeleton* pointer;
+    typedef const Skeleton& reference;
+
+    SkeletonIterator(const RecordingReader* reader, const uint64_t i) : m_reader(reader), m_i(i) { }
+    const Skeleton& operator*() { m_reader->skeleton(m_i, m_skel); return m_skel; }
+    const Skeleton* operator->() { return &**this; }
+    SkeletonIterator& operator++() { ++m_i; return *this; }
+    bool operator==(const SkeletonIterator& o) const { return m_i == o.m_i; }
+    bool operator!=(const SkeletonIterator& o) const { return m_i != o.m_i; }
+    uint64_t index() const { return m_i; }
+   private:
+    const RecordingReader* m_reader;
+    uint64_t m_i;
+    Skeleton m_skel;
+  };
+
+  //! Range of Skeletons with timestamps in [t0, t1), usable in range-based for loops
+  struct SkeletonRange {
+    SkeletonIterator first, last;
+    SkeletonIterator begin() const { return first; }
+    SkeletonIterator end() const { return last; }
+    uint64_t size() const { return last.index() - first.index(); }
+  };
+  SkeletonRange skeletons(const int64_t t0 = INT64_MIN, const int64_t t1 = kEndOfTime) const;
+
+ private:
+  enum { kSkeletonStream = 0, kColorStream = 1, kDepthStream = 2, kNumStreams = 3 };
+
+  // Chunks of one record type in file order with the global index of their first record
+  struct Stream {
+    std::vector<const SkeletonLogIndexEntry*> chunks;
+    std::vector<uint64_t> firstRecord;
+    uint32_t recordSize;
+    uint64_t numRecords;
+  };
+
+  bool loadFooter();
+  void scanChunks();
+  void buildStreams();
+  //! Returns pointer to record i of stream
+  const char* record(const Stream& stream, const uint64_t i) const;
+  int64_t recordTime(const Stream& stream, const uint64_t i) const;
+  uint64_t seek(const Stream& stream, const int64_t t) const;
+
+  std::string m_filename;
+  MappedFile m_file;
+  bool m_hasFooter;
+  std::vector<SkeletonLogIndexEntry> m_index;
+  const SkeletonLogIndexEntry* m_pMetadata;
+  Stream m_streams[kNumStreams];
+};
+
+#endif  // KINECTONETRACKER_RECORDINGREADER_H_
@@ -0,0 +1,169 @@
+#include "./SegmentedVideoWriter.h"
+#include "./JsonWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+SegmentedVideoWriter::SegmentedVideoWriter(const size_t numThreads, const size_t maxBufferedFrames)
+  : m_numThreads(std::max<size_t>(numThreads, 1))
+  , m_maxBufferedFrames(std::max<size_t>(maxBufferedFrames, 1))
+  , m_bufferLimit(m_maxBufferedFrames)
+  , m_fourcc(0)
+  , m_fps(0)
+  , m_framesPerSegment(0)
+  , m_isOpen(false)
+  , m_openFailed(false)
+  , m_pool(m_numThreads) { }
+
+SegmentedVideoWriter::~SegmentedVideoWriter() {
+  close();
+}
+
+bool SegmentedVideoWriter::open(const string& prefix, const int fourcc, const double fps, const cv::Size& frameSize,
+                                const int framesPerSegment) {
+  close();
+  if (framesPerSegment <= 0) { return false; }
+  m_prefix = prefix;
+  m_manifestFile = prefix + ".segments.json";
+  m_fourcc = fourcc;
+  m_fps = fps;
+  m_frameSize = frameSize;
+  m_framesPerSegment = framesPerSegment;
+  // A segment only starts once the previous one has all its frames, so with fewer buffers than frames of
+  // m_numThreads segments the encoders would mostly take turns
+  m_bufferLimit = std::max(m_maxBufferedFrames, m_numThreads * framesPerSegment);
+  m_manifest.clear();
+  m_openFailed = false;
+  {
+    // Buffers of another frame size are dropped, and all are allocated again as needed
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const cv::Mat* b = m_buffers.empty() ? nullptr : m_buffers.front().get();
+    if (b != nullptr && (b->cols != frameSize.width || b->rows != frameSize.height)) {
+      m_buffers.clear();
+      m_free.clear();
+    }
+  }
+  m_isOpen = true;
+  return true;
+}
+
+void SegmentedVideoWriter::write(const int64_t time, const cv::Mat& frame) {
+  if (!m_isOpen) { return; }
+  if (!m_current || m_manifest.back().timestamps.size() == static_cast<size_t>(m_framesPerSegment)) {
+    completeSegment();
+    startSegment();
+  }
+  cv::Mat* buffer = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free.empty() && m_buffers.size() < m_bufferLimit) {
+      m_buffers.emplace_back(new cv::Mat(m_frameSize.height, m_frameSize.width, CV_8UC3));
+      m_free.push_back(m_buffers.back().get());
+    }
+    m_framesCv.wait(lock, [&] { return !m_free.empty(); });
+    buffer = m_free.back();
+    m_free.pop_back();
+  }
+  frame.copyTo(*buffer);
+  m_manifest.back().timestamps.push_back(time);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_current->frames.push_back(buffer);
+  m_framesCv.notify_all();
+}
+
+void SegmentedVideoWriter::startSegment() {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%04llu.avi", static_cast<unsigned long long>(m_manifest.size()));
+  m_current = std::make_shared<Segment>();
+  m_current->file = m_prefix + suffix;
+  m_current->complete = false;
+  m_manifest.push_back(VideoSegment());
+  m_manifest.back().file = m_current->file;
+  // Segments queue for a worker in order, and the task keeps its segment alive
+  const std::shared_ptr<Segment> segment = m_current;
+  m_pool.submit([this, segment] () { encodeSegment(*segment); });
+}
+
+void SegmentedVideoWriter::completeSegment() {
+  if (!m_current) { return; }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current->complete = true;
+    m_framesCv.notify_all();
+  }
+  m_current.reset();
+}
+
+void SegmentedVideoWriter::encodeSegment(Segment& segment) {  // NOLINT
+  cv::VideoWriter writer;
+  writer.open(segment.file, m_fourcc, m_fps, m_frameSize);
+  const bool opened = writer.isOpened();
+  if (!opened) { cerr << "Could not open video segment " << segment.file << endl; }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!opened) { m_openFailed = true; }
+  for (;;) {
+    m_framesCv.wait(lock, [&] { return !segment.frames.empty() || segment.complete; });
+    if (segment.frames.empty()) { break; }
+    cv::Mat* frame = segment.frames.front();
+    segment.frames.pop_front();
+    // Frames of a segment that could not be opened are only returned to the free buffers
+    if (opened) {
+      lock.unlock();
+      writer << *frame;
+      lock.lock();
+    }
+    m_free.push_back(frame);
+    m_framesCv.notify_all();
+  }
+  lock.unlock();
+  if (opened) { writer.release(); }
+}
+
+bool SegmentedVideoWriter::close() {
+  if (!m_isOpen) { return true; }
+  completeSegment();
+  m_pool.wait();
+  m_isOpen = false;
+  const bool manifestOk = writeManifest();
+  if (!manifestOk) { cerr << "Could not write video segment manifest " << m_manifestFile << endl; }
+  return manifestOk && !m_openFailed;
+}
+
+bool SegmentedVideoWriter::writeManifest() const {
+  std::ofstream ofs(m_manifestFile, std::ios::binary);
+  if (!ofs.is_open()) { return false; }
+  JsonWriter w(ofs);
+  w.raw("{\n");
+  w.key("fps").value(m_fps).raw(",\n");
+  w.key("width").value(m_frameSize.width).raw(",\n");
+  w.key("height").value(m_frameSize.height).raw(",\n");
+  w.key("framesPerSegment").value(m_framesPerSegment).raw(",\n");
+  w.key("segments").raw("[\n");
+  for (size_t i = 0; i < m_manifest.size(); ++i) {
+    const VideoSegment& s = m_manifest[i];
+    w.raw('{').key("file").value(s.file).raw(", ");
+    w.key("timestamps").array(s.timestamps, s.timestamps.size()).raw('}');
+    w.raw(i + 1 < m_manifest.size() ? ",\n" : "\n");
+  }
+  w.raw("]\n}\n");
+  w.flush();
+  return !ofs.fail();
+}
+
+bool SegmentedVideoWriter::locate(const int64_t time, size_t& segment, size_t& offset) const {  // NOLINT
+  // Segments are in time order and none is empty, so the frame can only be in the last segment starting at or
+  // before time
+  const auto it = std::upper_bound(m_manifest.begin(), m_manifest.end(), time,
+                                   [] (const int64_t t, const VideoSegment& s) { return t < s.timestamps.front(); });
+  if (it == m_manifest.begin()) { return false; }
+  const VideoSegment& s = *(it - 1);
+  const auto f = std::lower_bound(s.timestamps.begin(), s.timestamps.end(), time);
+  if (f == s.timestamps.end() || *f != time) { return false; }
+  segment = static_cast<size_t>(it - 1 - m_manifest.begin());
+  offset = static_cast<size_t>(f - s.timestamps.begin());
+  return true;
+}
@@ -0,0 +1,99 @@
+#ifndef KINECTONETRACKER_SEGMENTEDVIDEOWRITER_H_
+#define KINECTONETRACKER_SEGMENTEDVIDEOWRITER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "./ThreadPool.h"
+
+//! Segment of a segmented video: file name and timestamps of its frames in file order, so that frame k of the
+//! segment is frame k of the file
+struct VideoSegment {
+  std::string file;
+  std::vector<int64_t> timestamps;
+};
+
+//! Writes a video stream as a sequence of fixed-length segment files <prefix>.<segment index>.avi, each with its own
+//! cv::VideoWriter, so that segments are encoded concurrently on a ThreadPool when one encoder cannot keep up. A
+//! segment is encoded while it is being filled, so workers only fall behind by the frames they have yet to encode.
+//! write() copies each frame into one of a bounded set of buffers and waits for a free one when all hold frames not
+//! yet encoded. So that numThreads segments can be in flight at once, the bound is at least numThreads segments'
+//! worth of frames; buffers are only allocated as encoders fall behind. On close() a manifest
+//! <prefix>.segments.json lists the segment files with the timestamps of their frames, mapping each timestamp to a
+//! segment and a frame offset within it.
+class SegmentedVideoWriter {
+ public:
+  //! Encodes up to numThreads segments at a time, buffering up to maxBufferedFrames frames not yet encoded, or
+  //! numThreads segments of frames if that is more
+  explicit SegmentedVideoWriter(const size_t numThreads = 2, const size_t maxBufferedFrames = 32);
+  //! Finishes encoding and writes the manifest
+  ~SegmentedVideoWriter();
+
+  //! Starts writing segments of framesPerSegment frames of frameSize (and type CV_8UC3), encoded with fourcc at fps.
+  //! Returns false if framesPerSegment is not positive
+  bool open(const std::string& prefix, const int fourcc, const double fps, const cv::Size& frameSize,
+            const int framesPerSegment);
+
+  //! Queues frame with timestamp time for encoding
+  void write(const int64_t time, const cv::Mat& frame);
+
+  //! Waits for all segments to be encoded and writes the manifest. Returns false if a segment file could not be
+  //! opened or the manifest could not be written
+  bool close();
+
+  bool isOpen() const { return m_isOpen; }
+  const std::string& manifestFile() const { return m_manifestFile; }
+  //! Segments started so far. Only for the writing thread, or once closed
+  const std::vector<VideoSegment>& segments() const { return m_manifest; }
+  //! Finds the segment and the offset within it of the frame with timestamp time. Returns false if there is none.
+  //! Only for the writing thread, or once closed
+  bool locate(const int64_t time, size_t& segment, size_t& offset) const;  // NOLINT
+
+ private:
+  SegmentedVideoWriter(const SegmentedVideoWriter&);
+  SegmentedVideoWriter& operator=(const SegmentedVideoWriter&);
+
+  // Frames of a segment queued for its encoder
+  struct Segment {
+    std::string file;
+    std::deque<cv::Mat*> frames;
+    bool complete;  // No more frames will be queued
+  };
+
+  void startSegment();
+  void completeSegment();
+  //! Encodes segment as its frames arrive, until it is complete
+  void encodeSegment(Segment& segment);  // NOLINT
+  bool writeManifest() const;
+
+  const size_t m_numThreads, m_maxBufferedFrames;
+  // Frames buffered at most for the current segment length
+  size_t m_bufferLimit;
+  std::string m_prefix, m_manifestFile;
+  int m_fourcc;
+  double m_fps;
+  cv::Size m_frameSize;
+  int m_framesPerSegment;
+  bool m_isOpen;
+  std::vector<VideoSegment> m_manifest;
+  // Segment being filled, shared with its encoder
+  std::shared_ptr<Segment> m_current;
+
+  // Guards frame buffers and segment queues, shared with the encoders
+  std::mutex m_mutex;
+  std::condition_variable m_framesCv;
+  std::vector<std::unique_ptr<cv::Mat>> m_buffers;
+  std::vector<cv::Mat*> m_free;
+  bool m_openFailed;
+  // Encoders, destroyed (and joined) before the segments and buffers they fill
+  ThreadPool m_pool;
+};
+
+#endif  // KINECTONETRACKER_SEGMENTEDVIDEOWRITER_H_
@@ -0,0 +1,247 @@
+#include "./SessionRecorder.h"
+#include "./JsonWriter.h"
+#include "./MappedFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+SessionRecorder::SessionRecorder(const RecorderOptions& opts, const RolloverOptions& rollover)
+  : m_opts(opts)
+  , m_rollover(rollover)
+  , m_indexFile(opts.id + ".session.json")
+  , m_currentIndex(0)
+  , m_hasFrames(false)
+  , m_rollOverDue(false)
+  , m_firstTime(0)
+  , m_lastTime(0)
+  , m_nextBytesCheck(0)
+  , m_stopped(false)
+  , m_finalizer(1) {
+  m_current = createPart(0);
+  {
+    std::lock_guard<std::mutex> lock(m_partsMutex);
+    SessionPart p;
+    p.id = partId(0);
+    p.file = p.id + ".json";
+    m_parts.push_back(p);
+  }
+  writeIndex();
+  const string statsFile = opts.id + (opts.statsJson ? ".stats.json" : ".stats.csv");
+  if (opts.statsInterval > 0 && !m_metricsReporter.start(statsFile, opts.statsInterval)) {
+    cerr << "Could not open stats file " << statsFile << endl;
+  }
+  m_finalizer.submit([this] () { prepareNextPart(1); });
+}
+
+SessionRecorder::~SessionRecorder() {
+  stop();
+}
+
+void SessionRecorder::setDepthRayTable(const std::vector<std::pair<float, float>>& table) {
+  std::lock_guard<std::mutex> lock(m_nextMutex);
+  m_depthRayTable = table;
+  if (m_current) { m_current->setDepthRayTable(table); }
+  if (m_next) { m_next->setDepthRayTable(table); }
+}
+
+string SessionRecorder::partId(const size_t index) const {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%04llu", static_cast<unsigned long long>(index));
+  return m_opts.id + suffix;
+}
+
+std::unique_ptr<KinectOneRecorder> SessionRecorder::createPart(const size_t index) {
+  RecorderOptions opts = m_opts;
+  opts.id = partId(index);
+  // Metrics are global, so the session reports them once, rather than each part
+  opts.printStatsOnStop = false;
+  opts.statsInterval = 0;
+  return std::unique_ptr<KinectOneRecorder>(new KinectOneRecorder(opts));
+}
+
+void SessionRecorder::prepareNextPart(const size_t index) {
+  std::unique_ptr<KinectOneRecorder> next = createPart(index);
+  std::lock_guard<std::mutex> lock(m_nextMutex);
+  if (!m_depthRayTable.empty()) { next->setDepthRayTable(m_depthRayTable); }
+  m_next = std::move(next);
+}
+
+void SessionRecorder::rollOver(std::unique_ptr<KinectOneRecorder> next) {
+  KinectOneRecorder* previous = m_current.release();
+  m_current = std::move(next);
+  const size_t index = m_currentIndex++;
+  const int64_t firstTime = m_firstTime, lastTime = m_lastTime;
+  m_hasFrames = false;
+  m_rollOverDue = false;
+  // The part after the new one is set up before the previous one is drained, which can take a while
+  m_finalizer.submit([this, index] () { prepareNextPart(index + 2); });
+  m_finalizer.submit([this, previous, index, firstTime, lastTime] () {
+    finalizePart(previous, index, firstTime, lastTime, true);
+  });
+}
+
+void SessionRecorder::finalizePart(KinectOneRecorder* recorder, const size_t index, const int64_t firstTime,
+                                   const int64_t lastTime, const bool nextStarted) {
+  // Stopping commits the part's frame timestamps, so that they are complete before the part is saved
+  recorder->stop();
+  {
+    std::lock_guard<std::mutex> lock(m_partsMutex);
+    m_parts[index].firstTime = firstTime;
+    m_parts[index].lastTime = lastTime;
+    if (nextStarted) {
+      SessionPart p;
+      p.id = partId(index + 1);
+      p.file = p.id + ".json";
+      m_parts.push_back(p);
+    }
+  }
+  writeIndex();
+
+  const std::shared_ptr<Recording> rec(recorder->getRecordingPtr());
+  // Destruction drains the consumers and closes the part's files
+  delete recorder;
+  const string file = rec->id + ".json";
+  if (!rec->saveToJSON(file)) { cerr << "Could not save recording " << file << endl; }
+  const uint64_t bytes = KinectOneRecorder::bytesOnDisk(rec->id) + fileSizeOnDisk(file);
+  {
+    std::lock_guard<std::mutex> lock(m_partsMutex);
+    SessionPart& p = m_parts[index];
+    p.numSkeletons = rec->numSkeletons();
+    p.numColorFrames = rec->colorTimestamps.size();
+    p.numDepthFrames = rec->depthTimestamps.size();
+    p.bytes = bytes;
+    p.complete = true;
+  }
+  writeIndex();
+}
+
+KinectOneRecorder& SessionRecorder::part(const INT64 nTime) {
+  if (m_hasFrames && !m_rollOverDue) {
+    m_rollOverDue = m_rollover.maxPartSeconds > 0 && (nTime - m_firstTime) >= m_rollover.maxPartSeconds * 1.0E7;
+    if (!m_rollOverDue && m_rollover.maxPartBytes > 0 && nTime >= m_nextBytesCheck) {
+      m_rollOverDue = m_current->bytesOnDisk() >= m_rollover.maxPartBytes;
+      m_nextBytesCheck = nTime + static_cast<int64_t>(m_rollover.bytesCheckSeconds * 1.0E7);
+    }
+  }
+  if (m_rollOverDue) {
+    std::unique_ptr<KinectOneRecorder> next;
+    {
+      std::lock_guard<std::mutex> lock(m_nextMutex);
+      next.swap(m_next);
+    }
+    if (next) { rollOver(std::move(next)); }
+  }
+  if (!m_hasFrames) {
+    m_hasFrames = true;
+    m_firstTime = nTime;
+    m_nextBytesCheck = nTime + static_cast<int64_t>(m_rollover.bytesCheckSeconds * 1.0E7);
+  }
+  if (nTime > m_lastTime) { m_lastTime = nTime; }
+  return *m_current;
+}
+
+void SessionRecorder::onSkeleton(const Skeleton* skel) {
+  if (m_stopped) { return; }
+  part(skel->timestamp).onSkeleton(skel);
+}
+
+void SessionRecorder::onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+  if (m_stopped) { return; }
+  part(nTime).onColor(nTime, nColorBufferSize, pColorBuffer);
+}
+
+void SessionRecorder::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                          const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer) {
+  if (m_stopped) { return; }
+  part(nTime).onDepthAndBodyIndex(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+}
+
+void SessionRecorder::onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                                        const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer,
+                                        const BYTE* pRegisteredColor) {
+  if (m_stopped) { return; }
+  part(nTime).onRegisteredColor(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer,
+                                pRegisteredColor);
+}
+
+void SessionRecorder::onFrameBundle(const FrameBundle& b) {
+  if (m_stopped) { return; }
+  part(b.time).onFrameBundle(b);
+}
+
+void SessionRecorder::stop() {
+  if (m_stopped) { return; }
+  m_stopped = true;
+  KinectOneRecorder* last = m_current.release();
+  const size_t index = m_currentIndex;
+  const int64_t firstTime = m_firstTime, lastTime = m_lastTime;
+  m_finalizer.submit([this, last, index, firstTime, lastTime] () {
+    finalizePart(last, index, firstTime, lastTime, false);
+  });
+  m_finalizer.wait();
+  // The part set up to follow the last one is discarded, with the files its recorder created
+  std::unique_ptr<KinectOneRecorder> spare;
+  {
+    std::lock_guard<std::mutex> lock(m_nextMutex);
+    spare.swap(m_next);
+  }
+  if (spare) {
+    spare.reset();
+    for (const string& file : KinectOneRecorder::filesOnDisk(partId(index + 1))) { std::remove(file.c_str()); }
+  }
+  const MetricsSnapshot metrics = m_metricsReporter.stop();
+  if (m_opts.printStatsOnStop) {
+    cout << "Pipeline metrics:" << endl;
+    metrics.printSummary(cout);
+  }
+}
+
+std::vector<SessionPart> SessionRecorder::parts() const {
+  std::lock_guard<std::mutex> lock(m_partsMutex);
+  return m_parts;
+}
+
+void SessionRecorder::writeIndex() const {
+  // Written from a copy, so that the frame path never waits on file I/O for m_partsMutex, and to a temporary file
+  // that then replaces the index, so that a crash never leaves a truncated or missing index
+  const std::vector<SessionPart> parts = this->parts();
+  const string tmpFile = m_indexFile + ".tmp";
+  {
+    std::ofstream ofs(tmpFile, std::ios::binary);
+    if (!ofs.is_open()) {
+      cerr << "Could not write session index " << m_indexFile << endl;
+      return;
+    }
+    JsonWriter w(ofs);
+    w.raw("{\n");
+    w.key("id").value(m_opts.id).raw(",\n");
+    w.key("maxPartSeconds").value(m_rollover.maxPartSeconds).raw(",\n");
+    w.key("maxPartBytes").value(m_rollover.maxPartBytes).raw(",\n");
+    w.key("parts").raw("[\n");
+    for (size_t i = 0; i < parts.size(); ++i) {
+      const SessionPart& p = parts[i];
+      w.raw('{').key("id").value(p.id).raw(", ");
+      w.key("file").value(p.file).raw(", ");
+      w.key("complete").raw(p.complete ? "true" : "false").raw(", ");
+      w.key("firstTime").value(p.firstTime).raw(", ");
+      w.key("lastTime").value(p.lastTime).raw(", ");
+      w.key("numSkeletons").value(p.numSkeletons).raw(", ");
+      w.key("numColorFrames").value(p.numColorFrames).raw(", ");
+      w.key("numDepthFrames").value(p.numDepthFrames).raw(", ");
+      w.key("bytes").value(p.bytes).raw('}');
+      w.raw(i + 1 < parts.size() ? ",\n" : "\n");
+    }
+    w.raw("]\n}\n");
+    w.flush();
+    if (ofs.fail()) {
+      cerr << "Could not write session index " << m_indexFile << endl;
+      return;
+    }
+  }
+  if (!replaceFile(tmpFile, m_indexFile)) {
+    cerr << "Could not write session index " << m_indexFile << endl;
+  }
+}
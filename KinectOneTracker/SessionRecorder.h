@@ -0,0 +1,121 @@
+#ifndef KINECTONETRACKER_SESSIONRECORDER_H_
+#define KINECTONETRACKER_SESSIONRECORDER_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./KinectOneRecorder.h"
+#include "./Metrics.h"
+#include "./ThreadPool.h"
+
+//! When a SessionRecorder starts a new part
+struct RolloverOptions {
+  // Longest part in seconds of device time (0 = no limit)
+  double maxPartSeconds;
+  // Largest part in bytes on disk (0 = no limit), checked every bytesCheckSeconds of device time
+  uint64_t maxPartBytes;
+  double bytesCheckSeconds;
+
+  RolloverOptions() : maxPartSeconds(0), maxPartBytes(0), bytesCheckSeconds(1.0) { }
+};
+
+//! Entry of a session index
+struct SessionPart {
+  std::string id;          // Recording id, prefix of the part's files
+  std::string file;        // Recording JSON of the part
+  int64_t firstTime;       // Device time of the first and last frames passed to the part
+  int64_t lastTime;
+  uint64_t numSkeletons, numColorFrames, numDepthFrames;
+  uint64_t bytes;          // Size of all its files on disk, once finalized
+  bool complete;           // Whether the part has been finalized
+
+  SessionPart()
+    : firstTime(0), lastTime(0), numSkeletons(0), numColorFrames(0), numDepthFrames(0), bytes(0), complete(false) { }
+};
+
+//! Records an unbounded capture as a sequence of parts, each a complete recording of its own (<id>.NNNN.json and
+//! the files of a KinectOneRecorder with id <id>.NNNN), so that files and memory stay bounded and a crash loses at
+//! most the buffered end of the current part. Attach it to a tracker (or FrameSynchronizer, or
+//! ColorRegistrationStage) in place of a KinectOneRecorder. Once a part exceeds its duration or byte budget, the
+//! next frame of any stream (or frame bundle) starts a new part, which also gets the other frames of its tick. The
+//! next part's recorder is set up ahead of time on a background thread, so that rolling over only swaps recorders
+//! on the calling thread and no frame is lost, while the previous part is stopped, drained and saved on that
+//! thread. Should a part reach its limit before the next one is ready, it records on until it is. The session index
+//! <id>.session.json lists the parts in order, and is rewritten whenever a part starts or is finalized. Pipeline
+//! metrics of the whole session go to <id>.stats.csv (or .json).
+class SessionRecorder : public KinectOneListener {
+ public:
+  //! Records parts with opts (whose id is the session id), rolling over as set by rollover
+  SessionRecorder(const RecorderOptions& opts, const RolloverOptions& rollover);
+  //! Stops and finalizes all parts
+  ~SessionRecorder();
+
+  //! Applies table to the recorder of each part (see KinectOneRecorder::setDepthRayTable())
+  void setDepthRayTable(const std::vector<std::pair<float, float>>& table);
+
+  void onSkeleton(const Skeleton* skel);
+  void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+  void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                           const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
+  void onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                         const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor);
+  void onFrameBundle(const FrameBundle& b);
+
+  //! Finalizes the current part and waits for all parts to be saved. Call once frames have stopped arriving
+  void stop();
+
+  const std::string& indexFile() const { return m_indexFile; }
+  //! Parts started so far, finalized or not
+  std::vector<SessionPart> parts() const;
+
+ private:
+  SessionRecorder(const SessionRecorder&);
+  SessionRecorder& operator=(const SessionRecorder&);
+
+  //! Notes a frame at nTime of the current part, rolling over first if the part is over its budget and the next
+  //! part is ready. Returns the current part's recorder
+  KinectOneRecorder& part(const INT64 nTime);
+  //! Id of part index
+  std::string partId(const size_t index) const;
+  //! Creates the recorder of part index
+  std::unique_ptr<KinectOneRecorder> createPart(const size_t index);
+  //! Creates the recorder of part index as the next part (on the finalizer thread)
+  void prepareNextPart(const size_t index);
+  //! Makes next the current part and queues the finalization of the previous one
+  void rollOver(std::unique_ptr<KinectOneRecorder> next);
+  //! Stops the part's recorder, records its time range, and whether the next part has started, in the index, then
+  //! saves its Recording and updates the index (on the finalizer thread)
+  void finalizePart(KinectOneRecorder* recorder, const size_t index, const int64_t firstTime, const int64_t lastTime,
+                    const bool nextStarted);
+  //! Writes the index from a copy of the parts (on the finalizer thread, or before it has tasks)
+  void writeIndex() const;
+
+  const RecorderOptions m_opts;
+  const RolloverOptions m_rollover;
+  const std::string m_indexFile;
+
+  // Current part, used only by the thread delivering frames
+  std::unique_ptr<KinectOneRecorder> m_current;
+  size_t m_currentIndex;
+  bool m_hasFrames, m_rollOverDue;
+  int64_t m_firstTime, m_lastTime, m_nextBytesCheck;
+  bool m_stopped;
+
+  // Next part, built on the finalizer thread and taken over by the thread delivering frames
+  std::mutex m_nextMutex;
+  std::unique_ptr<KinectOneRecorder> m_next;
+  std::vector<std::pair<float, float>> m_depthRayTable;
+
+  mutable std::mutex m_partsMutex;
+  std::vector<SessionPart> m_parts;
+  MetricsReporter m_metricsReporter;
+  // Runs part setup and finalization; joined before the parts and index state above are destroyed
+  ThreadPool m_finalizer;
+};
+
+#endif  // KINECTONETRACKER_SESSIONRECORDER_H_
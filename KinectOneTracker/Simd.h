@@ -0,0 +1,134 @@
+#ifndef KINECTONETRACKER_SIMD_H_
+#define KINECTONETRACKER_SIMD_H_
+
+// Compile-time selection of SIMD instruction sets for the vectorized kernels. SSE2 is always available on x64;
+// AVX/AVX2 paths are compiled in when the compiler targets them (-mavx2 / /arch:AVX2, see the KINECTONETRACKER_AVX2
+// CMake option). Every kernel also has a scalar path, so other architectures still build.
+#if defined(__AVX2__)
+#define KINECTONETRACKER_HAVE_AVX2 1
+#endif
+#if defined(__AVX__) || defined(KINECTONETRACKER_HAVE_AVX2)
+#define KINECTONETRACKER_HAVE_AVX 1
+#endif
+#if defined(__SSSE3__) || defined(KINECTONETRACKER_HAVE_AVX)  // MSVC defines no SSSE3 macro, but AVX implies it
+#define KINECTONETRACKER_HAVE_SSSE3 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KINECTONETRACKER_HAVE_SSE2 1
+#endif
+
+#if defined(KINECTONETRACKER_HAVE_AVX)
+#include <immintrin.h>
+#elif defined(KINECTONETRACKER_HAVE_SSSE3)
+#include <tmmintrin.h>
+#elif defined(KINECTONETRACKER_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//! Name of the widest instruction set compiled in
+inline const char* simdInstructionSet() {
+#if defined(KINECTONETRACKER_HAVE_AVX2)
+  return "AVX2";
+#elif defined(KINECTONETRACKER_HAVE_AVX)
+  return "AVX";
+#elif defined(KINECTONETRACKER_HAVE_SSSE3)
+  return "SSSE3";
+#elif defined(KINECTONETRACKER_HAVE_SSE2)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
+
+//! Packed float operations at the widest width compiled in (8 lanes with AVX, 4 with SSE2, 1 otherwise), so that
+//! float kernels are written once. Loads and stores are unaligned, and loadU16() loads kLanes uint16 values as floats.
+//! Masks are all-ones/all-zeros lanes from cmpge()
+struct SimdFloat {
+#if defined(KINECTONETRACKER_HAVE_AVX)
+  typedef __m256 V;
+  static const int kLanes = 8;
+  static V zero() { return _mm256_setzero_ps(); }
+  static V set1(const float x) { return _mm256_set1_ps(x); }
+  static V load(const float* p) { return _mm256_loadu_ps(p); }
+  static V loadU16(const uint16_t* p) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), z = _mm_setzero_si128();
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, z))),
+                                _mm_cvtepi32_ps(_mm_unpackhi_epi16(x, z)), 1);
+  }
+  static void store(float* p, const V v) { _mm256_storeu_ps(p, v); }
+  static V add(const V a, const V b) { return _mm256_add_ps(a, b); }
+  static V sub(const V a, const V b) { return _mm256_sub_ps(a, b); }
+  static V mul(const V a, const V b) { return _mm256_mul_ps(a, b); }
+  static V div(const V a, const V b) { return _mm256_div_ps(a, b); }
+  static V min(const V a, const V b) { return _mm256_min_ps(a, b); }
+  static V max(const V a, const V b) { return _mm256_max_ps(a, b); }
+  static V sqrt(const V a) { return _mm256_sqrt_ps(a); }
+  static V cmpge(const V a, const V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  static V select(const V mask, const V a) { return _mm256_and_ps(mask, a); }
+  static void toArray(const V v, float* out) { _mm256_storeu_ps(out, v); }
+#elif defined(KINECTONETRACKER_HAVE_SSE2)
+  typedef __m128 V;
+  static const int kLanes = 4;
+  static V zero() { return _mm_setzero_ps(); }
+  static V set1(const float x) { return _mm_set1_ps(x); }
+  static V load(const float* p) { return _mm_loadu_ps(p); }
+  static V loadU16(const uint16_t* p) {
+    const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, _mm_setzero_si128()));
+  }
+  static void store(float* p, const V v) { _mm_storeu_ps(p, v); }
+  static V add(const V a, const V b) { return _mm_add_ps(a, b); }
+  static V sub(const V a, const V b) { return _mm_sub_ps(a, b); }
+  static V mul(const V a, const V b) { return _mm_mul_ps(a, b); }
+  static V div(const V a, const V b) { return _mm_div_ps(a, b); }
+  static V min(const V a, const V b) { return _mm_min_ps(a, b); }
+  static V max(const V a, const V b) { return _mm_max_ps(a, b); }
+  static V sqrt(const V a) { return _mm_sqrt_ps(a); }
+  static V cmpge(const V a, const V b) { return _mm_cmpge_ps(a, b); }
+  static V select(const V mask, const V a) { return _mm_and_ps(mask, a); }
+  static void toArray(const V v, float* out) { _mm_storeu_ps(out, v); }
+#else
+  typedef float V;
+  static const int kLanes = 1;
+  static V zero() { return 0.0f; }
+  static V set1(const float x) { return x; }
+  static V load(const float* p) { return *p; }
+  static V loadU16(const uint16_t* p) { return *p; }
+  static void store(float* p, const V v) { *p = v; }
+  static V add(const V a, const V b) { return a + b; }
+  static V sub(const V a, const V b) { return a - b; }
+  static V mul(const V a, const V b) { return a * b; }
+  static V div(const V a, const V b) { return a / b; }
+  static V min(const V a, const V b) { return std::min(a, b); }
+  static V max(const V a, const V b) { return std::max(a, b); }
+  static V sqrt(const V a) { return std::sqrt(a); }
+  static V cmpge(const V a, const V b) { return (a >= b) ? 1.0f : 0.0f; }
+  static V select(const V mask, const V a) { return (mask != 0.0f) ? a : 0.0f; }
+  static void toArray(const V v, float* out) { *out = v; }
+#endif
+
+  //! Horizontal sum, min and max of all lanes
+  static float hsum(const V v) {
+    float x[kLanes];
+    toArray(v, x);
+    float s = x[0];
+    for (int i = 1; i < kLanes; ++i) { s += x[i]; }
+    return s;
+  }
+  static float hmin(const V v) {
+    float x[kLanes];
+    toArray(v, x);
+    return *std::min_element(x, x + kLanes);
+  }
+  static float hmax(const V v) {
+    float x[kLanes];
+    toArray(v, x);
+    return *std::max_element(x, x + kLanes);
+  }
+};
+
+#endif  // KINECTONETRACKER_SIMD_H_
@@ -0,0 +1,685 @@
+#include "./SkeletonCodec.h"
+#include "./BitStream.h"
+#include "./SkeletonLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+using std::string;  using std::cerr;  using std::endl;
+
+static const int kNumJoints = SkeletonCodecBody::kNumJoints;
+static const uint8_t kZeroQuat = SkeletonCodecBody::kZeroQuat;
+
+// Quantization steps per unit and clamping limits
+static const float kPositionScale = 1.0E4f;
+static const float kMaxPosition = 100.0f;
+static const int kMaxQuat = 2047;
+static const float kQuatScale = 2047.0f * 1.41421356f;  // Smallest three components lie in [-1/sqrt(2), 1/sqrt(2)]
+static const float kLeanScale = 2048.0f;
+static const float kMaxLean = 2.0f;
+
+// Bits storing a group's Rice parameter, and the parameter value marking a group of zero residuals
+static const int kParamBits = 5;
+static const uint32_t kZeroGroup = 31;
+static const uint32_t kMaxParam = 30;
+// Quotients of kEscapeUnary or more are coded as kEscapeUnary zero bits followed by the raw 32-bit residual
+static const uint32_t kEscapeUnary = 16;
+static const int kRawBits = 32;
+
+// Bit widths of fields coded as they are
+static const int kSlotBits = 3, kConfidenceBits = 2 * kNumJoints, kQuatIndexBits = 2 * kNumJoints, kStateBits = 24;
+
+// Upper bound of a payload: every residual escaped, every field present, plus BitWriter's word of slack
+static const size_t kMaxPayloadSize =
+  (1 + kSlotBits + 128 + 2 * (3 * (kParamBits + kNumJoints * (kEscapeUnary + kRawBits))) + 2 + kNumJoints +
+   kQuatIndexBits + 1 + kConfidenceBits + 1 + kStateBits + kParamBits + 2 * (kEscapeUnary + kRawBits)) / 8 + 16;
+
+inline int32_t quantize(const float v, const float scale, const float limit) {
+  // NaNs fail both comparisons and map to 0
+  const float c = (v >= -limit && v <= limit) ? v : ((v > limit) ? limit : ((v < -limit) ? -limit : 0.0f));
+  return static_cast<int32_t>(std::lrint(c * scale));
+}
+
+// a + b modulo 2^32, so that corrupt input cannot overflow
+inline int32_t addWrapped(const int32_t a, const int32_t b) {
+  return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+// Confidence 0, 0.5 or 1 as 0, 1 or 2 (other values rounded to the nearest)
+inline uint64_t quantizeConfidence(const float c) {
+  return static_cast<uint64_t>(quantize(c, 2.0f, 1.0f) & 3);
+}
+
+// Smallest-three quantization of q into the index of its largest component and the other three components
+static void quantizeQuat(const std::array<float, 4>& q, uint8_t& index, int32_t c[3]) {  // NOLINT
+  float norm2 = 0.0f;
+  int largest = 0;
+  for (int k = 0; k < 4; ++k) {
+    norm2 += q[k] * q[k];
+    if (std::fabs(q[k]) > std::fabs(q[largest])) { largest = k; }
+  }
+  if (!(norm2 > 1.0E-12f)) {
+    index = kZeroQuat;
+    c[0] = c[1] = c[2] = 0;
+    return;
+  }
+  index = static_cast<uint8_t>(largest);
+  // Normalized with the largest component positive
+  const float scale = ((q[largest] < 0) ? -kQuatScale : kQuatScale) / std::sqrt(norm2);
+  for (int k = 0, i = 0; k < 4; ++k) {
+    if (k == largest) { continue; }
+    const int32_t v = static_cast<int32_t>(std::lrint(q[k] * scale));
+    c[i++] = (v < -kMaxQuat) ? -kMaxQuat : ((v > kMaxQuat) ? kMaxQuat : v);
+  }
+}
+
+static void dequantizeQuat(const uint8_t index, const int32_t c0, const int32_t c1, const int32_t c2,
+                           std::array<float, 4>& q) {  // NOLINT
+  if (index == kZeroQuat) {
+    q.fill(0.0f);
+    return;
+  }
+  const float a = c0 * (1.0f / kQuatScale), b = c1 * (1.0f / kQuatScale), c = c2 * (1.0f / kQuatScale);
+  const float w = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+  switch (index) {
+    case 0:  q[0] = w;  q[1] = a;  q[2] = b;  q[3] = c;  break;
+    case 1:  q[0] = a;  q[1] = w;  q[2] = b;  q[3] = c;  break;
+    case 2:  q[0] = a;  q[1] = b;  q[2] = w;  q[3] = c;  break;
+    default: q[0] = a;  q[1] = b;  q[2] = c;  q[3] = w;  break;
+  }
+}
+
+// Hand states (3 bits each), hand confidences (1 bit each), activities (2 bits each), clippedEdges (4 bits) and
+// lean confidence (2 bits)
+static uint32_t packStates(const Skeleton& s) {
+  uint32_t v = (s.handLeftState & 7) | ((s.handRightState & 7) << 3) | ((s.handLeftConfidence & 1) << 6) |
+               ((s.handRightConfidence & 1) << 7);
+  for (int a = 0; a < Skeleton::Activity_Count; ++a) { v |= (s.activities[a] & 3) << (8 + 2 * a); }
+  v |= static_cast<uint32_t>(s.clippedEdges & 15) << 18;
+  v |= static_cast<uint32_t>(quantizeConfidence(s.leanConfidence)) << 22;
+  return v;
+}
+
+static void unpackStates(const uint32_t v, Skeleton& s) {  // NOLINT
+  s.handLeftState = static_cast<Skeleton::HandState>(v & 7);
+  s.handRightState = static_cast<Skeleton::HandState>((v >> 3) & 7);
+  s.handLeftConfidence = static_cast<Skeleton::TrackingConfidence>((v >> 6) & 1);
+  s.handRightConfidence = static_cast<Skeleton::TrackingConfidence>((v >> 7) & 1);
+  for (int a = 0; a < Skeleton::Activity_Count; ++a) {
+    s.activities[a] = static_cast<Skeleton::DetectionResult>((v >> (8 + 2 * a)) & 3);
+  }
+  s.clippedEdges = (v >> 18) & 15;
+  s.leanConfidence = ((v >> 22) & 3) * 0.5f;
+}
+
+// Zero quaternion mask and largest component indices of b
+inline uint32_t zeroQuatMask(const SkeletonCodecBody& b) {
+  uint32_t m = 0;
+  for (int j = 0; j < kNumJoints; ++j) { m |= static_cast<uint32_t>(b.quatIndex[j] == kZeroQuat) << j; }
+  return m;
+}
+inline uint64_t quatIndices(const SkeletonCodecBody& b) {
+  uint64_t m = 0;
+  for (int j = 0; j < kNumJoints; ++j) { m |= static_cast<uint64_t>(b.quatIndex[j] & 3) << (2 * j); }
+  return m;
+}
+
+inline void put64(const uint64_t v, const int n, BitWriter& bits) {  // NOLINT
+  bits.put(static_cast<uint32_t>(v), std::min(n, 32));
+  if (n > 32) { bits.put(static_cast<uint32_t>(v >> 32), n - 32); }
+}
+inline uint64_t get64(const int n, BitReader& bits) {  // NOLINT
+  uint64_t v = bits.get(std::min(n, 32));
+  if (n > 32) { v |= static_cast<uint64_t>(bits.get(n - 32)) << 32; }
+  return v;
+}
+
+// Rice codes a group of n mapped residuals with the parameter that suits their mean
+static void putGroup(const uint32_t* v, const int n, BitWriter& bits) {  // NOLINT
+  uint64_t sum = 0;
+  for (int i = 0; i < n; ++i) { sum += v[i]; }
+  if (sum == 0) {
+    bits.put(kZeroGroup, kParamBits);
+    return;
+  }
+  uint32_t k = 0;
+  while (k < kMaxParam && (static_cast<uint64_t>(n) << (k + 1)) <= sum) { ++k; }
+  bits.put(k, kParamBits);
+  const uint32_t mask = (1u << k) - 1;
+  for (int i = 0; i < n; ++i) {
+    const uint32_t q = v[i] >> k;
+    if (q < kEscapeUnary) {
+      if (q + 1 + k <= 32) {
+        bits.put(static_cast<uint32_t>((static_cast<uint64_t>(v[i] & mask) << (q + 1)) | (1u << q)), q + 1 + k);
+      } else {
+        bits.put(1u << q, q + 1);
+        bits.put(v[i] & mask, k);
+      }
+    } else {
+      bits.put(0, kEscapeUnary);
+      bits.put(v[i], kRawBits);
+    }
+  }
+}
+
+// Decodes a group of n residuals written by putGroup() and unmaps them. Returns false if its parameter is invalid
+static bool getGroup(BitReader& bits, const int n, int32_t* v) {  // NOLINT
+  // Works on a local copy of the reader, which the compiler keeps in registers: stores to v could alias its fields
+  BitReader r = bits;
+  const uint32_t k = r.get(kParamBits);
+  if (k == kZeroGroup) {
+    memset(v, 0, n * sizeof(*v));
+    bits = r;
+    return true;
+  }
+  if (k > kMaxParam) { return false; }
+  for (int i = 0; i < n; ++i) {
+    const uint64_t w = r.peek();
+    const uint32_t q = (w == 0) ? kEscapeUnary : static_cast<uint32_t>(lowestSetBit(w));
+    uint32_t u;
+    if (q < kEscapeUnary && q + 1 + k <= 32) {
+      u = (q << k) | static_cast<uint32_t>((w >> (q + 1)) & ((1ull << k) - 1));
+      r.skip(q + 1 + k);
+    } else if (q < kEscapeUnary) {
+      r.skip(q + 1);
+      u = (q << k) | r.get(k);
+    } else {
+      r.skip(kEscapeUnary);
+      u = r.get(kRawBits);
+    }
+    v[i] = unzigzag(u);
+  }
+  bits = r;
+  return true;
+}
+
+SkeletonEncoder::SkeletonEncoder(const int keyframeInterval)
+  : m_keyframeInterval(keyframeInterval)
+  , m_buf(kMaxPayloadSize)
+  , m_numRecords(0)
+  , m_numKeyframes(0) {
+  reset();
+}
+
+void SkeletonEncoder::reset() {
+  memset(m_bodies, 0, sizeof(m_bodies));
+}
+
+int SkeletonEncoder::findSlot(const uint64_t trackingId) const {
+  int oldest = -1;
+  for (int i = 0; i < BODY_COUNT; ++i) {
+    const SkeletonCodecBody& b = m_bodies[i];
+    if (b.inUse && b.trackingId == trackingId) { return i; }
+    if (oldest < 0 || (m_bodies[oldest].inUse && (!b.inUse || b.timestamp < m_bodies[oldest].timestamp))) {
+      oldest = i;
+    }
+  }
+  return oldest;
+}
+
+size_t SkeletonEncoder::encode(const Skeleton& s, std::vector<uint8_t>& out) {  // NOLINT
+  const int slot = findSlot(s.trackingId);
+  SkeletonCodecBody& prev = m_bodies[slot];
+  SkeletonCodecBody cur;
+  cur.inUse = true;
+  cur.trackingId = s.trackingId;
+  cur.timestamp = s.timestamp;
+  cur.interval = 0;
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int c = 0; c < 3; ++c) { cur.position[c][j] = quantize(s.jointPositions[j][c], kPositionScale, kMaxPosition); }
+    int32_t q[3];
+    quantizeQuat(s.jointOrientations[j], cur.quatIndex[j], q);
+    for (int c = 0; c < 3; ++c) { cur.quat[c][j] = q[c]; }
+  }
+  cur.confidences = 0;
+  for (int j = 0; j < kNumJoints; ++j) { cur.confidences |= quantizeConfidence(s.jointConfidences[j]) << (2 * j); }
+  cur.states = packStates(s);
+  cur.lean[0] = quantize(s.leanLeftRight, kLeanScale, kMaxLean);
+  cur.lean[1] = quantize(s.leanForwardBack, kLeanScale, kMaxLean);
+
+  bool key = !prev.inUse || prev.trackingId != s.trackingId ||
+             (m_keyframeInterval > 0 && prev.sinceKeyframe + 1 >= m_keyframeInterval);
+  int64_t intervalChange = 0;
+  if (!key) {
+    cur.interval = s.timestamp - prev.timestamp;
+    intervalChange = cur.interval - prev.interval;
+    if (intervalChange < std::numeric_limits<int32_t>::min() || intervalChange > std::numeric_limits<int32_t>::max()) {
+      key = true;
+      cur.interval = 0;
+    }
+  }
+  cur.sinceKeyframe = key ? 0 : prev.sinceKeyframe + 1;
+
+  BitWriter bits(m_buf.data());
+  bits.put(key ? 1 : 0, 1);
+  bits.put(slot, kSlotBits);
+  if (key) {
+    put64(cur.trackingId, 64, bits);
+    put64(static_cast<uint64_t>(cur.timestamp), 64, bits);
+  } else {
+    const uint32_t v = zigzag(static_cast<int>(intervalChange));
+    putGroup(&v, 1, bits);
+  }
+
+  uint32_t r[kNumJoints];
+  for (int c = 0; c < 3; ++c) {
+    const int32_t* p = cur.position[c];
+    if (key) {
+      r[0] = zigzag(p[0]);
+      for (int j = 1; j < kNumJoints; ++j) { r[j] = zigzag(p[j] - p[j - 1]); }
+    } else {
+      for (int j = 0; j < kNumJoints; ++j) { r[j] = zigzag(p[j] - prev.position[c][j]); }
+    }
+    putGroup(r, kNumJoints, bits);
+  }
+
+  const uint32_t zeroMask = zeroQuatMask(cur);
+  const uint64_t indices = quatIndices(cur);
+  if (key) {
+    bits.put(zeroMask, kNumJoints);
+    put64(indices, kQuatIndexBits, bits);
+  } else {
+    const bool zeroMaskChanged = zeroMask != zeroQuatMask(prev), indicesChanged = indices != quatIndices(prev);
+    bits.put(zeroMaskChanged, 1);
+    if (zeroMaskChanged) { bits.put(zeroMask, kNumJoints); }
+    bits.put(indicesChanged, 1);
+    if (indicesChanged) { put64(indices, kQuatIndexBits, bits); }
+  }
+  for (int c = 0; c < 3; ++c) {
+    int n = 0;
+    for (int j = 0; j < kNumJoints; ++j) {
+      if (cur.quatIndex[j] == kZeroQuat) { continue; }
+      const int32_t pred = (!key && prev.quatIndex[j] == cur.quatIndex[j]) ? prev.quat[c][j] : 0;
+      r[n++] = zigzag(cur.quat[c][j] - pred);
+    }
+    if (n > 0) { putGroup(r, n, bits); }
+  }
+
+  if (key) {
+    put64(cur.confidences, kConfidenceBits, bits);
+    bits.put(cur.states, kStateBits);
+  } else {
+    bits.put(cur.confidences != prev.confidences, 1);
+    if (cur.confidences != prev.confidences) { put64(cur.confidences, kConfidenceBits, bits); }
+    bits.put(cur.states != prev.states, 1);
+    if (cur.states != prev.states) { bits.put(cur.states, kStateBits); }
+  }
+  for (int i = 0; i < 2; ++i) { r[i] = zigzag(cur.lean[i] - (key ? 0 : prev.lean[i])); }
+  putGroup(r, 2, bits);
+
+  // Size prefix, then the payload
+  const size_t payloadSize = bits.finish();
+  const size_t start = out.size();
+  for (size_t v = payloadSize; ; v >>= 7) {
+    if (v < 0x80) {
+      out.push_back(static_cast<uint8_t>(v));
+      break;
+    }
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+  }
+  out.insert(out.end(), m_buf.begin(), m_buf.begin() + payloadSize);
+
+  prev = cur;
+  ++m_numRecords;
+  if (key) { ++m_numKeyframes; }
+  return out.size() - start;
+}
+
+SkeletonDecoder::SkeletonDecoder() {
+  reset();
+}
+
+void SkeletonDecoder::reset() {
+  memset(m_bodies, 0, sizeof(m_bodies));
+}
+
+size_t SkeletonDecoder::decode(const uint8_t* in, const size_t size, Skeleton& s) {  // NOLINT
+  size_t payloadSize = 0, headerSize = 0;
+  for (int shift = 0; ; shift += 7) {
+    if (headerSize >= size || shift > 28) { return 0; }
+    const uint8_t c = in[headerSize++];
+    payloadSize |= static_cast<size_t>(c & 0x7f) << shift;
+    if (c < 0x80) { break; }
+  }
+  if (payloadSize > size - headerSize) { return 0; }
+
+  BitReader bits(in + headerSize, payloadSize);
+  const bool key = bits.get(1) != 0;
+  const uint32_t slot = bits.get(kSlotBits);
+  if (slot >= BODY_COUNT) { return 0; }
+  SkeletonCodecBody& b = m_bodies[slot];
+  if (!key && !b.inUse) { return 0; }
+
+  if (key) {
+    b.inUse = true;
+    b.trackingId = get64(64, bits);
+    b.timestamp = static_cast<int64_t>(get64(64, bits));
+    b.interval = 0;
+  } else {
+    int32_t intervalChange;
+    if (!getGroup(bits, 1, &intervalChange)) { return 0; }
+    b.interval = static_cast<int64_t>(static_cast<uint64_t>(b.interval) + intervalChange);
+    b.timestamp = static_cast<int64_t>(static_cast<uint64_t>(b.timestamp) + b.interval);
+  }
+
+  int32_t r[kNumJoints];
+  for (int c = 0; c < 3; ++c) {
+    if (!getGroup(bits, kNumJoints, r)) { return 0; }
+    int32_t* p = b.position[c];
+    if (key) {
+      p[0] = r[0];
+      for (int j = 1; j < kNumJoints; ++j) { p[j] = addWrapped(p[j - 1], r[j]); }
+    } else {
+      for (int j = 0; j < kNumJoints; ++j) { p[j] = addWrapped(p[j], r[j]); }
+    }
+  }
+
+  uint32_t zeroMask = zeroQuatMask(b);
+  uint64_t indices = quatIndices(b);
+  if (key || bits.get(1) != 0) { zeroMask = bits.get(kNumJoints); }
+  if (key || bits.get(1) != 0) { indices = get64(kQuatIndexBits, bits); }
+  uint8_t quatIndex[kNumJoints];
+  for (int j = 0; j < kNumJoints; ++j) {
+    quatIndex[j] = ((zeroMask >> j) & 1) ? kZeroQuat : static_cast<uint8_t>((indices >> (2 * j)) & 3);
+  }
+  int n = 0;
+  for (int j = 0; j < kNumJoints; ++j) { n += (quatIndex[j] != kZeroQuat); }
+  for (int c = 0; c < 3; ++c) {
+    if (n > 0 && !getGroup(bits, n, r)) { return 0; }
+    for (int j = 0, i = 0; j < kNumJoints; ++j) {
+      if (quatIndex[j] == kZeroQuat) {
+        b.quat[c][j] = 0;
+      } else {
+        const int32_t pred = (!key && b.quatIndex[j] == quatIndex[j]) ? b.quat[c][j] : 0;
+        b.quat[c][j] = addWrapped(pred, r[i++]);
+      }
+    }
+  }
+  memcpy(b.quatIndex, quatIndex, sizeof(quatIndex));
+
+  if (key || bits.get(1) != 0) { b.confidences = get64(kConfidenceBits, bits); }
+  if (key || bits.get(1) != 0) { b.states = bits.get(kStateBits); }
+  if (!getGroup(bits, 2, r)) { return 0; }
+  for (int i = 0; i < 2; ++i) { b.lean[i] = addWrapped(key ? 0 : b.lean[i], r[i]); }
+  if (bits.overrun()) { return 0; }
+
+  s.trackingId = b.trackingId;
+  s.timestamp = b.timestamp;
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int c = 0; c < 3; ++c) { s.jointPositions[j][c] = b.position[c][j] * (1.0f / kPositionScale); }
+    dequantizeQuat(b.quatIndex[j], b.quat[0][j], b.quat[1][j], b.quat[2][j], s.jointOrientations[j]);
+    s.jointConfidences[j] = ((b.confidences >> (2 * j)) & 3) * 0.5f;
+  }
+  unpackStates(b.states, s);
+  s.leanLeftRight = b.lean[0] * (1.0f / kLeanScale);
+  s.leanForwardBack = b.lean[1] * (1.0f / kLeanScale);
+  return headerSize + payloadSize;
+}
+
+void encodeSkeletons(const std::vector<Skeleton>& skels, std::vector<uint8_t>& out,  // NOLINT
+                     const int keyframeInterval) {
+  SkeletonEncoder encoder(keyframeInterval);
+  out.clear();
+  for (const Skeleton& s : skels) { encoder.encode(s, out); }
+}
+
+bool decodeSkeletons(const uint8_t* in, const size_t size, std::vector<Skeleton>& skels) {  // NOLINT
+  SkeletonDecoder decoder;
+  Skeleton s;
+  size_t offset = 0;
+  while (offset < size) {
+    const size_t n = decoder.decode(in + offset, size - offset, s);
+    if (n == 0) { return false; }
+    skels.push_back(s);
+    offset += n;
+  }
+  return true;
+}
+
+SkeletonStreamWriter::SkeletonStreamWriter(const uint32_t recordsPerBlock, const int keyframeInterval,
+                                           const size_t maxPendingBlocks)
+  : m_recordsPerBlock(std::max<uint32_t>(recordsPerBlock, 1))
+  , m_keyframeInterval(keyframeInterval)
+  , m_encoder(keyframeInterval)
+  , m_isOpen(false)
+  , m_numRecords(0)
+  , m_encodedBytes(0)
+  , m_fileOffset(0)
+  , m_writeFailed(false)
+  , m_writer(1, std::max<size_t>(maxPendingBlocks, 1)) {
+  m_blockHeader.count = 0;
+}
+
+SkeletonStreamWriter::~SkeletonStreamWriter() {
+  close();
+}
+
+bool SkeletonStreamWriter::open(const string& file) {
+  close();
+  m_ofs.open(file, std::ios::binary | std::ios::trunc);
+  if (!m_ofs.is_open()) { return false; }
+  SkeletonStreamHeader header;
+  memcpy(header.magic, kSkeletonStreamMagic, sizeof(header.magic));
+  header.version = kSkeletonStreamVersion;
+  header.headerSize = sizeof(header);
+  header.recordsPerBlock = m_recordsPerBlock;
+  header.keyframeInterval = static_cast<uint32_t>(std::max(m_keyframeInterval, 0));
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_fileOffset = sizeof(header);
+  m_index.clear();
+  m_writeFailed = !m_ofs;
+  m_numRecords = m_encodedBytes = 0;
+  m_block.clear();
+  m_blockHeader.count = 0;
+  m_isOpen = true;
+  return true;
+}
+
+void SkeletonStreamWriter::append(const Skeleton& s) {
+  if (!m_isOpen) { return; }
+  if (m_blockHeader.count == 0) {
+    // Every block starts with keyframes of its bodies
+    m_encoder.reset();
+    m_blockHeader.firstTime = m_blockHeader.lastTime = s.timestamp;
+  }
+  m_encodedBytes += m_encoder.encode(s, m_block);
+  if (s.timestamp > m_blockHeader.lastTime) { m_blockHeader.lastTime = s.timestamp; }
+  ++m_numRecords;
+  if (++m_blockHeader.count == m_recordsPerBlock) { submitBlock(); }
+}
+
+void SkeletonStreamWriter::submitBlock() {
+  if (m_blockHeader.count == 0) { return; }
+  const SkeletonStreamBlockHeader header = m_blockHeader;
+  const std::shared_ptr<std::vector<uint8_t>> records(new std::vector<uint8_t>());
+  records->reserve(m_block.size());
+  records->swap(m_block);
+  m_writer.submit([this, header, records] () { writeBlock(header, *records); });
+  m_blockHeader.count = 0;
+}
+
+void SkeletonStreamWriter::writeBlock(const SkeletonStreamBlockHeader& blockHeader,
+                                      const std::vector<uint8_t>& records) {
+  SkeletonStreamBlockHeader header = blockHeader;
+  header.magic = kSkeletonStreamBlockMagic;
+  header.size = static_cast<uint32_t>(records.size());
+  header.checksum = skeletonLogChecksum(reinterpret_cast<const char*>(records.data()), records.size());
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_ofs.write(reinterpret_cast<const char*>(records.data()), records.size());
+  m_ofs.flush();
+  if (!m_ofs) { m_writeFailed = true; }
+
+  SkeletonStreamIndexEntry entry;
+  entry.offset = m_fileOffset;
+  entry.count = header.count;
+  entry.reserved = 0;
+  entry.firstTime = header.firstTime;
+  entry.lastTime = header.lastTime;
+  m_index.push_back(entry);
+  m_fileOffset += sizeof(header) + records.size();
+}
+
+bool SkeletonStreamWriter::close() {
+  if (!m_isOpen) { return true; }
+  submitBlock();
+  m_writer.wait();
+  SkeletonStreamFooter footer;
+  footer.indexOffset = m_fileOffset;
+  footer.numBlocks = static_cast<uint32_t>(m_index.size());
+  footer.magic = kSkeletonStreamIndexMagic;
+  if (!m_index.empty()) {
+    m_ofs.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(SkeletonStreamIndexEntry));
+  }
+  m_ofs.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  m_ofs.close();
+  if (!m_ofs) { m_writeFailed = true; }
+  m_isOpen = false;
+  return !m_writeFailed;
+}
+
+SkeletonStreamReader::SkeletonStreamReader()
+  : m_hasFooter(false)
+  , m_dataEnd(0)
+  , m_numSkeletons(0) { }
+
+bool SkeletonStreamReader::open(const string& file) {
+  close();
+  if (!m_file.open(file)) {
+    cerr << "Could not map skeleton stream " << file << endl;
+    return false;
+  }
+  SkeletonStreamHeader header;
+  if (m_file.size() < sizeof(header)) {
+    cerr << "Not a skeleton stream: " << file << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, kSkeletonStreamMagic, sizeof(header.magic)) != 0 ||
+      header.version != kSkeletonStreamVersion || header.headerSize != sizeof(header)) {
+    cerr << "Not a skeleton stream (or unsupported version): " << file << endl;
+    close();
+    return false;
+  }
+  m_filename = file;
+  m_hasFooter = loadFooter();
+  if (!m_hasFooter) {
+    m_dataEnd = m_file.size();
+    scanBlocks();
+  }
+  for (const SkeletonStreamIndexEntry& e : m_index) { m_numSkeletons += e.count; }
+  return true;
+}
+
+void SkeletonStreamReader::close() {
+  m_file.close();
+  m_filename.clear();
+  m_hasFooter = false;
+  m_dataEnd = 0;
+  m_numSkeletons = 0;
+  m_index.clear();
+}
+
+bool SkeletonStreamReader::loadFooter() {
+  const uint64_t size = m_file.size();
+  SkeletonStreamFooter footer;
+  if (size < sizeof(SkeletonStreamHeader) + sizeof(footer)) { return false; }
+  memcpy(&footer, m_file.data() + size - sizeof(footer), sizeof(footer));
+  const uint64_t indexSize = static_cast<uint64_t>(footer.numBlocks) * sizeof(SkeletonStreamIndexEntry);
+  if (footer.magic != kSkeletonStreamIndexMagic || footer.indexOffset < sizeof(SkeletonStreamHeader) ||
+      footer.indexOffset + indexSize + sizeof(footer) != size) {
+    return false;
+  }
+  m_index.resize(footer.numBlocks);
+  if (indexSize > 0) { memcpy(m_index.data(), m_file.data() + footer.indexOffset, indexSize); }
+  // As for depth streams, an index pointing at anything but whole blocks before it is ignored and blocks are scanned
+  for (const SkeletonStreamIndexEntry& e : m_index) {
+    SkeletonStreamBlockHeader header;
+    if (e.offset < sizeof(SkeletonStreamHeader) || e.offset + sizeof(header) > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+    memcpy(&header, m_file.data() + e.offset, sizeof(header));
+    if (header.magic != kSkeletonStreamBlockMagic || header.count != e.count ||
+        e.offset + sizeof(header) + header.size > footer.indexOffset) {
+      m_index.clear();
+      return false;
+    }
+  }
+  m_dataEnd = footer.indexOffset;
+  return true;
+}
+
+void SkeletonStreamReader::scanBlocks() {
+  // Only the last block can be torn, so only its records are checksummed here
+  const char* data = m_file.data();
+  const uint64_t size = m_file.size();
+  uint64_t offset = sizeof(SkeletonStreamHeader);
+  SkeletonStreamBlockHeader header;
+  while (offset + sizeof(header) <= size) {
+    memcpy(&header, data + offset, sizeof(header));
+    if (header.magic != kSkeletonStreamBlockMagic || offset + sizeof(header) + header.size > size) { break; }
+    SkeletonStreamIndexEntry entry;
+    entry.offset = offset;
+    entry.count = header.count;
+    entry.reserved = 0;
+    entry.firstTime = header.firstTime;
+    entry.lastTime = header.lastTime;
+    m_index.push_back(entry);
+    offset += sizeof(header) + header.size;
+  }
+  if (!m_index.empty()) {
+    memcpy(&header, data + m_index.back().offset, sizeof(header));
+    if (skeletonLogChecksum(data + m_index.back().offset + sizeof(header), header.size) != header.checksum) {
+      cerr << "Dropping corrupt last block of " << m_filename << endl;
+      m_index.pop_back();
+    }
+  }
+}
+
+size_t SkeletonStreamReader::seek(const int64_t t) const {
+  const auto endsBefore = [] (const SkeletonStreamIndexEntry& e, const int64_t time) { return e.lastTime < time; };
+  return std::lower_bound(m_index.begin(), m_index.end(), t, endsBefore) - m_index.begin();
+}
+
+bool SkeletonStreamReader::readBlock(const size_t b, std::vector<Skeleton>& skels) const {  // NOLINT
+  if (b >= m_index.size()) { return false; }
+  const SkeletonStreamIndexEntry& e = m_index[b];
+  SkeletonStreamBlockHeader header;
+  memcpy(&header, m_file.data() + e.offset, sizeof(header));
+  const char* records = m_file.data() + e.offset + sizeof(header);
+  bool ok = header.magic == kSkeletonStreamBlockMagic && e.offset + sizeof(header) + header.size <= m_dataEnd &&
+            skeletonLogChecksum(records, header.size) == header.checksum;
+  // Decoded on the side, so that a corrupt block adds nothing to skels
+  std::vector<Skeleton> block;
+  if (ok) {
+    ok = decodeSkeletons(reinterpret_cast<const uint8_t*>(records), header.size, block) &&
+         block.size() == header.count;
+  }
+  if (!ok) {
+    cerr << "Corrupt block " << b << " in " << m_filename << endl;
+    return false;
+  }
+  skels.insert(skels.end(), block.begin(), block.end());
+  return true;
+}
+
+bool SkeletonStreamReader::read(const int64_t t0, const int64_t t1, std::vector<Skeleton>& skels) const {  // NOLINT
+  bool ok = true;
+  std::vector<Skeleton> block;
+  for (size_t b = seek(t0); b < m_index.size() && m_index[b].firstTime < t1; ++b) {
+    block.clear();
+    if (!readBlock(b, block)) {
+      ok = false;
+      continue;
+    }
+    for (const Skeleton& s : block) {
+      if (s.timestamp >= t0 && s.timestamp < t1) { skels.push_back(s); }
+    }
+  }
+  return ok;
+}
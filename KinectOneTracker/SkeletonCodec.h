@@ -0,0 +1,263 @@
+#ifndef KINECTONETRACKER_SKELETONCODEC_H_
+#define KINECTONETRACKER_SKELETONCODEC_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./KinectTypes.h"
+#include "./MappedFile.h"
+#include "./Recording.h"
+#include "./ThreadPool.h"
+
+// Compact lossy codec for streams of Skeletons. With the 2 mm joint jitter of sensor output, records take about
+// 120 bytes, 1/7 of a packSkeleton() record and 1/18 of JSON (see bench_skeleton_codec).
+//
+// Values are quantized to fixed point:
+//   joint positions     0.1 mm steps (error <= 0.05 mm), clamped to +-100 m
+//   joint orientations  smallest-three: index of the largest component (made positive, as q and -q are the same
+//                       rotation) and the other three in steps of 1 / (2047 sqrt(2)) (error <= 1.8E-4 each). Zero
+//                       quaternions (leaf joints the SDK does not orient) are kept exactly
+//   joint confidences   2 bits: 0, 0.5 or 1 (the values the SDK reports)
+//   lean                1/2048 steps, lean confidence as joint confidences
+//   hand states, hand confidences, activities and clippedEdges are exact, bit-packed into 24 bits
+//
+// Each record is either a keyframe, coded on its own, or a delta against the previous sample of the same
+// trackingId. Encoder and decoder keep the last (quantized) sample of up to BODY_COUNT bodies in numbered slots
+// that records name explicitly, so decoders need no bookkeeping of their own to stay in step. Position and
+// orientation residuals are zigzag mapped and Rice coded in groups (one group per axis or component) with a
+// parameter chosen per group, as in DepthCodec.h; groups of exact predictions cost 5 bits. Flags skip the
+// confidences and discrete states when they equal the previous sample's, and timestamps are coded as the change
+// of the interval to the previous sample.
+//
+// Record layout:
+//   varint payload size (LEB128)
+//   payload, LSB-first bits:
+//     1 keyframe flag, 3 slot
+//     keyframe: 64 trackingId, 64 timestamp
+//     delta:    Rice coded change of the timestamp interval
+//     positions: 3 Rice groups of 25 residuals (keyframes predict each joint from the previous joint)
+//     orientations: zero quaternion mask and largest component indices (keyframe: 25 + 50 bits, delta: 1 bit flag
+//                   per field plus the field if changed), then 3 Rice groups of the non-zero joints' components,
+//                   predicted from the previous sample for joints whose largest component index is unchanged
+//     confidences: 50 bits (delta: 1 bit flag plus the field if changed)
+//     discrete states: 24 bits (delta: 1 bit flag plus the field if changed)
+//     lean: 1 Rice group of 2 residuals
+// A body's records are keyframes again every keyframeInterval samples, after an interval change that does not fit
+// 32 bits, and whenever its slot is reused, so that streams can be cut at keyframes of all bodies.
+//
+// .skc file layout, which follows the depth stream (see DepthCodec.h):
+//   SkeletonStreamHeader
+//   Block*             SkeletonStreamBlockHeader followed by records. The encoder is reset at the start of each
+//                      block, so every block decodes on its own
+//   Index              one SkeletonStreamIndexEntry per block, followed by SkeletonStreamFooter (only after a clean
+//                      close)
+// Blocks are checksummed, so a file cut short by a crash is readable up to its last complete block by scanning.
+
+#pragma pack(push, 1)
+struct SkeletonStreamHeader {
+  char     magic[8];          // kSkeletonStreamMagic
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t recordsPerBlock;
+  uint32_t keyframeInterval;
+};
+
+struct SkeletonStreamBlockHeader {
+  uint32_t magic;             // kSkeletonStreamBlockMagic
+  uint32_t size;              // Size of the records in bytes
+  uint32_t count;             // Number of records
+  uint32_t checksum;          // skeletonLogChecksum() of the records
+  int64_t  firstTime;         // Timestamps of the first and last records
+  int64_t  lastTime;
+};
+
+struct SkeletonStreamIndexEntry {
+  uint64_t offset;            // File offset of SkeletonStreamBlockHeader
+  uint32_t count;
+  uint32_t reserved;
+  int64_t  firstTime;
+  int64_t  lastTime;
+};
+
+struct SkeletonStreamFooter {
+  uint64_t indexOffset;       // File offset of first SkeletonStreamIndexEntry
+  uint32_t numBlocks;
+  uint32_t magic;             // kSkeletonStreamIndexMagic
+};
+#pragma pack(pop)
+
+static const char     kSkeletonStreamMagic[8]     = { 'K', 'O', 'S', 'K', 'E', 'L', 'C', 'S' };
+static const uint32_t kSkeletonStreamVersion      = 1;
+static const uint32_t kSkeletonStreamBlockMagic   = 0x4b434c42;  // "BLCK"
+static const uint32_t kSkeletonStreamIndexMagic   = 0x58444953;  // "SIDX"
+
+//! Quantized last sample of a body, from which the codec predicts its next one
+struct SkeletonCodecBody {
+  static const int kNumJoints = Skeleton::JointType_Count;
+  // Value of quatIndex marking a zero quaternion
+  static const uint8_t kZeroQuat = 4;
+
+  bool inUse;
+  uint64_t trackingId;
+  int64_t timestamp, interval;
+  // Samples since the last keyframe
+  int sinceKeyframe;
+  int32_t position[3][kNumJoints];
+  // Index of the largest component (or kZeroQuat) and the other three components in order
+  uint8_t quatIndex[kNumJoints];
+  int32_t quat[3][kNumJoints];
+  uint64_t confidences;
+  uint32_t states;
+  int32_t lean[2];
+};
+
+//! Encodes Skeletons into records of the format described above
+class SkeletonEncoder {
+ public:
+  //! Bodies are coded as keyframes every keyframeInterval samples (0 = only when they appear)
+  explicit SkeletonEncoder(const int keyframeInterval = 300);
+
+  //! Appends the record of s to out and returns its size in bytes
+  size_t encode(const Skeleton& s, std::vector<uint8_t>& out);  // NOLINT
+
+  //! Forgets all bodies, so that the next record of each is a keyframe
+  void reset();
+
+  uint64_t numRecords() const { return m_numRecords; }
+  uint64_t numKeyframes() const { return m_numKeyframes; }
+
+ private:
+  //! Slot of trackingId, or else a free or the least recently updated one
+  int findSlot(const uint64_t trackingId) const;
+
+  const int m_keyframeInterval;
+  SkeletonCodecBody m_bodies[BODY_COUNT];
+  // Bit buffer of the record being encoded
+  std::vector<uint8_t> m_buf;
+  uint64_t m_numRecords, m_numKeyframes;
+};
+
+//! Decodes records written by SkeletonEncoder. Records must be decoded in stream order, starting at a point where
+//! every body's next record is a keyframe (such as the start of the stream)
+class SkeletonDecoder {
+ public:
+  SkeletonDecoder();
+
+  //! Decodes the record at in, of which size bytes are available, into s. Returns the size of the record, or 0 if
+  //! it is truncated or malformed or is a delta of a body without a previous sample
+  size_t decode(const uint8_t* in, const size_t size, Skeleton& s);  // NOLINT
+
+  //! Forgets all bodies
+  void reset();
+
+ private:
+  SkeletonCodecBody m_bodies[BODY_COUNT];
+};
+
+//! Encodes skels into a stream of records (replacing the contents of out) with a fresh SkeletonEncoder
+void encodeSkeletons(const std::vector<Skeleton>& skels, std::vector<uint8_t>& out,  // NOLINT
+                     const int keyframeInterval = 300);
+
+//! Decodes all records of size bytes at in, appending them to skels. Returns false if a record is malformed, in
+//! which case skels holds the skeletons before it
+bool decodeSkeletons(const uint8_t* in, const size_t size, std::vector<Skeleton>& skels);  // NOLINT
+
+//! Encodes Skeletons into a .skc file. append() only encodes into the current block; full blocks are written by a
+//! background thread, which append() waits for only if maxPendingBlocks blocks are already queued. All append calls
+//! must come from the same thread.
+class SkeletonStreamWriter {
+ public:
+  //! Blocks hold recordsPerBlock records, and within them bodies are coded as keyframes every keyframeInterval
+  //! samples (see SkeletonEncoder)
+  explicit SkeletonStreamWriter(const uint32_t recordsPerBlock = 256, const int keyframeInterval = 300,
+                                const size_t maxPendingBlocks = 16);
+  ~SkeletonStreamWriter();
+
+  //! Creates file and writes the header. Returns false if it cannot be opened
+  bool open(const std::string& file);
+
+  //! Encodes and appends s
+  void append(const Skeleton& s);
+
+  //! Writes the current block and the index, and closes the file. Returns false if any write failed
+  bool close();
+
+  bool isOpen() const { return m_isOpen; }
+  uint64_t numRecords() const { return m_numRecords; }
+  //! Total size of the encoded records in bytes
+  uint64_t encodedBytes() const { return m_encodedBytes; }
+
+ private:
+  SkeletonStreamWriter(const SkeletonStreamWriter&);
+  SkeletonStreamWriter& operator=(const SkeletonStreamWriter&);
+
+  //! Hands the current block to the writer thread and starts the next one
+  void submitBlock();
+  //! Writes a block (on the writer thread)
+  void writeBlock(const SkeletonStreamBlockHeader& header, const std::vector<uint8_t>& records);
+
+  const uint32_t m_recordsPerBlock;
+  const int m_keyframeInterval;
+  SkeletonEncoder m_encoder;
+  bool m_isOpen;
+  uint64_t m_numRecords, m_encodedBytes;
+  // Block being encoded
+  std::vector<uint8_t> m_block;
+  SkeletonStreamBlockHeader m_blockHeader;
+
+  // Used by the writer thread, and by open() and close() when it is idle
+  std::ofstream m_ofs;
+  uint64_t m_fileOffset;
+  std::vector<SkeletonStreamIndexEntry> m_index;
+  std::atomic<bool> m_writeFailed;
+  // Writes blocks in order; joined before the file state above is destroyed
+  ThreadPool m_writer;
+};
+
+//! Random access reader of .skc files. The file is memory-mapped and only the block index is materialized: it is
+//! loaded from the footer of cleanly closed files, or rebuilt by scanning block headers otherwise
+class SkeletonStreamReader {
+ public:
+  SkeletonStreamReader();
+
+  //! Maps file and loads or rebuilds its index. Returns false if it is not a .skc file
+  bool open(const std::string& file);
+  void close();
+
+  bool isOpen() const { return m_file.isOpen(); }
+  //! Whether the index was loaded from the footer (true) or rebuilt by scanning block headers (false)
+  bool hasFooter() const { return m_hasFooter; }
+  size_t numBlocks() const { return m_index.size(); }
+  uint64_t numSkeletons() const { return m_numSkeletons; }
+  const SkeletonStreamIndexEntry& block(const size_t b) const { return m_index[b]; }
+
+  //! Index of first block with a skeleton at or after t (or numBlocks() if none). O(log n)
+  size_t seek(const int64_t t) const;
+
+  //! Decodes block b, appending its skeletons to skels. Returns false if the block is corrupt
+  bool readBlock(const size_t b, std::vector<Skeleton>& skels) const;  // NOLINT
+
+  //! Appends the skeletons with timestamps in [t0, t1) to skels, decoding only the blocks that overlap the range.
+  //! Returns false if a block was corrupt, in which case its skeletons are skipped
+  bool read(const int64_t t0, const int64_t t1, std::vector<Skeleton>& skels) const;  // NOLINT
+
+ private:
+  SkeletonStreamReader(const SkeletonStreamReader&);
+  SkeletonStreamReader& operator=(const SkeletonStreamReader&);
+
+  bool loadFooter();
+  void scanBlocks();
+
+  std::string m_filename;
+  MappedFile m_file;
+  bool m_hasFooter;
+  uint64_t m_dataEnd;  // File offset past the last block
+  uint64_t m_numSkeletons;
+  std::vector<SkeletonStreamIndexEntry> m_index;
+};
+
+#endif  // KINECTONETRACKER_SKELETONCODEC_H_
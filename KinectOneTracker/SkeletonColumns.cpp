@@ -0,0 +1,204 @@
+#include "./SkeletonColumns.h"
+#include "./Simd.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+using std::string;  using std::cerr;  using std::endl;
+
+typedef SimdFloat SF;
+
+// Float sums over long columns are accumulated in lanes for at most this many elements before being added to a
+// double total, which bounds the rounding error regardless of recording length
+static const size_t kSumBlock = 4096;
+
+void SkeletonColumns::reserve(const size_t n) {
+  m_timestamps.reserve(n);
+  m_trackingIds.reserve(n);
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int a = 0; a < 3; ++a) { m_positions[j][a].reserve(n); }
+    m_confidences[j].reserve(n);
+    for (int q = 0; q < 4; ++q) { m_orientations[j][q].reserve(n); }
+  }
+}
+
+void SkeletonColumns::clear() {
+  m_size = 0;
+  m_timestamps.clear();
+  m_trackingIds.clear();
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int a = 0; a < 3; ++a) { m_positions[j][a].clear(); }
+    m_confidences[j].clear();
+    for (int q = 0; q < 4; ++q) { m_orientations[j][q].clear(); }
+  }
+}
+
+void SkeletonColumns::push_back(const Skeleton& s) {
+  m_timestamps.push_back(s.timestamp);
+  m_trackingIds.push_back(s.trackingId);
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int a = 0; a < 3; ++a) { m_positions[j][a].push_back(s.jointPositions[j][a]); }
+    m_confidences[j].push_back(s.jointConfidences[j]);
+    for (int q = 0; q < 4; ++q) { m_orientations[j][q].push_back(s.jointOrientations[j][q]); }
+  }
+  ++m_size;
+}
+
+void SkeletonColumns::append(const Recording& rec) {
+  reserve(m_size + rec.numSkeletons());
+  for (const Skeleton& s : rec.skeletons) { push_back(s); }
+  if (!rec.skeletonLogFile.empty()) {
+    RecordingReader reader;
+    if (reader.open(rec.skeletonLogFile)) {
+      append(reader.skeletons());
+    } else {
+      cerr << "Could not read skeleton log " << rec.skeletonLogFile << endl;
+    }
+  }
+}
+
+void SkeletonColumns::append(const RecordingReader::SkeletonRange& range) {
+  reserve(m_size + range.size());
+  for (const Skeleton& s : range) { push_back(s); }
+}
+
+void SkeletonColumns::selectBody(const uint64_t trackingId, SkeletonColumns& out) const {  // NOLINT
+  out.clear();
+  const size_t n = std::count(m_trackingIds.begin(), m_trackingIds.end(), trackingId);
+  out.reserve(n);
+  for (size_t i = 0; i < m_size; ++i) {
+    if (m_trackingIds[i] != trackingId) { continue; }
+    out.m_timestamps.push_back(m_timestamps[i]);
+    out.m_trackingIds.push_back(trackingId);
+    for (int j = 0; j < kNumJoints; ++j) {
+      for (int a = 0; a < 3; ++a) { out.m_positions[j][a].push_back(m_positions[j][a][i]); }
+      out.m_confidences[j].push_back(m_confidences[j][i]);
+      for (int q = 0; q < 4; ++q) { out.m_orientations[j][q].push_back(m_orientations[j][q][i]); }
+    }
+  }
+  out.m_size = n;
+}
+
+std::vector<uint64_t> SkeletonColumns::trackingIds() const {
+  std::vector<uint64_t> ids;
+  for (const uint64_t id : m_trackingIds) {
+    if (std::find(ids.begin(), ids.end(), id) == ids.end()) { ids.push_back(id); }
+  }
+  return ids;
+}
+
+void jointSpeeds(const SkeletonColumns& c, const int joint, std::vector<float>& out) {  // NOLINT
+  const size_t n = c.size();
+  if (n < 2) { out.clear(); return; }
+  const size_t m = n - 1;
+  out.resize(m);
+
+  // Inverse time steps first (int64 timestamps do not vectorize without AVX-512), then distances
+  const int64_t* t = c.timestamps();
+  for (size_t i = 0; i < m; ++i) {
+    const int64_t dt = t[i + 1] - t[i];
+    out[i] = (dt > 0) ? static_cast<float>(1.0E7 / dt) : 0.0f;
+  }
+  const float *x = c.position(joint, 0), *y = c.position(joint, 1), *z = c.position(joint, 2);
+  float* o = out.data();
+  size_t i = 0;
+  for (; i + SF::kLanes <= m; i += SF::kLanes) {
+    const SF::V dx = SF::sub(SF::load(x + i + 1), SF::load(x + i));
+    const SF::V dy = SF::sub(SF::load(y + i + 1), SF::load(y + i));
+    const SF::V dz = SF::sub(SF::load(z + i + 1), SF::load(z + i));
+    const SF::V d2 = SF::add(SF::add(SF::mul(dx, dx), SF::mul(dy, dy)), SF::mul(dz, dz));
+    SF::store(o + i, SF::mul(SF::sqrt(d2), SF::load(o + i)));
+  }
+  for (; i < m; ++i) {
+    const float dx = x[i + 1] - x[i], dy = y[i + 1] - y[i], dz = z[i + 1] - z[i];
+    o[i] *= std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+}
+
+std::array<float, 3> jointCentroid(const SkeletonColumns& c, const int joint) {
+  std::array<float, 3> mean = {{0, 0, 0}};
+  const size_t n = c.size();
+  if (n == 0) { return mean; }
+  for (int a = 0; a < 3; ++a) {
+    const float* x = c.position(joint, a);
+    double total = 0;
+    for (size_t b = 0; b < n; b += kSumBlock) {
+      const size_t end = std::min(n, b + kSumBlock);
+      SF::V s0 = SF::zero(), s1 = SF::zero();
+      size_t i = b;
+      for (; i + 2 * SF::kLanes <= end; i += 2 * SF::kLanes) {
+        s0 = SF::add(s0, SF::load(x + i));
+        s1 = SF::add(s1, SF::load(x + i + SF::kLanes));
+      }
+      float tail = 0;
+      for (; i < end; ++i) { tail += x[i]; }
+      total += SF::hsum(SF::add(s0, s1)) + tail;
+    }
+    mean[a] = static_cast<float>(total / n);
+  }
+  return mean;
+}
+
+JointExtents jointExtents(const SkeletonColumns& c, const int joint) {
+  JointExtents e;
+  const size_t n = c.size();
+  for (int a = 0; a < 3; ++a) {
+    const float* x = c.position(joint, a);
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    size_t i = 0;
+    if (n >= static_cast<size_t>(SF::kLanes)) {
+      SF::V vlo = SF::load(x), vhi = vlo;
+      for (i = SF::kLanes; i + SF::kLanes <= n; i += SF::kLanes) {
+        const SF::V v = SF::load(x + i);
+        vlo = SF::min(vlo, v);
+        vhi = SF::max(vhi, v);
+      }
+      lo = SF::hmin(vlo);
+      hi = SF::hmax(vhi);
+    }
+    for (; i < n; ++i) {
+      lo = std::min(lo, x[i]);
+      hi = std::max(hi, x[i]);
+    }
+    e.min[a] = lo;
+    e.max[a] = hi;
+  }
+  return e;
+}
+
+size_t jointConfidentMean(const SkeletonColumns& c, const int joint, const float minConfidence,
+                          std::array<float, 3>& mean) {  // NOLINT
+  const size_t n = c.size();
+  const float *x = c.position(joint, 0), *y = c.position(joint, 1), *z = c.position(joint, 2);
+  const float* conf = c.confidence(joint);
+  const SF::V threshold = SF::set1(minConfidence), one = SF::set1(1.0f);
+  double total[3] = { 0, 0, 0 };
+  double count = 0;
+  for (size_t b = 0; b < n; b += kSumBlock) {
+    const size_t end = std::min(n, b + kSumBlock);
+    SF::V sx = SF::zero(), sy = SF::zero(), sz = SF::zero(), sn = SF::zero();
+    size_t i = b;
+    for (; i + SF::kLanes <= end; i += SF::kLanes) {
+      const SF::V mask = SF::cmpge(SF::load(conf + i), threshold);
+      sx = SF::add(sx, SF::select(mask, SF::load(x + i)));
+      sy = SF::add(sy, SF::select(mask, SF::load(y + i)));
+      sz = SF::add(sz, SF::select(mask, SF::load(z + i)));
+      sn = SF::add(sn, SF::select(mask, one));
+    }
+    total[0] += SF::hsum(sx);
+    total[1] += SF::hsum(sy);
+    total[2] += SF::hsum(sz);
+    count += SF::hsum(sn);
+    for (; i < end; ++i) {
+      if (conf[i] >= minConfidence) {
+        total[0] += x[i];
+        total[1] += y[i];
+        total[2] += z[i];
+        count += 1;
+      }
+    }
+  }
+  for (int a = 0; a < 3; ++a) { mean[a] = (count > 0) ? static_cast<float>(total[a] / count) : 0.0f; }
+  return static_cast<size_t>(count);
+}
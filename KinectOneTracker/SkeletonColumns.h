@@ -0,0 +1,91 @@
+#ifndef KINECTONETRACKER_SKELETONCOLUMNS_H_
+#define KINECTONETRACKER_SKELETONCOLUMNS_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./Recording.h"
+#include "./RecordingReader.h"
+
+//! Columnar (structure-of-arrays) store of Skeleton joint data. Each joint component (position x/y/z, confidence,
+//! orientation x/y/z/w) is a contiguous float column, alongside timestamp and trackingId columns, so per-joint
+//! queries touch only the bytes they need and vectorize. Hand, activity and lean fields are not kept.
+class SkeletonColumns {
+ public:
+  static const int kNumJoints = Skeleton::JointType_Count;
+
+  SkeletonColumns() : m_size(0) { }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  void reserve(const size_t n);
+  void clear();
+
+  //! Appends one Skeleton as a new row
+  void push_back(const Skeleton& s);
+  //! Appends all Skeletons of rec, both in memory and in its skeleton log
+  void append(const Recording& rec);
+  //! Appends a range of Skeletons read from a binary recording
+  void append(const RecordingReader::SkeletonRange& range);
+
+  //! Copies the rows of the body with trackingId into out (replacing its contents)
+  void selectBody(const uint64_t trackingId, SkeletonColumns& out) const;  // NOLINT
+  //! Distinct trackingIds in order of first appearance
+  std::vector<uint64_t> trackingIds() const;
+
+  //! Columns, each holding size() values
+  const int64_t* timestamps() const { return m_timestamps.data(); }
+  const uint64_t* trackingIdColumn() const { return m_trackingIds.data(); }
+  const float* position(const int joint, const int axis) const { return m_positions[joint][axis].data(); }
+  const float* confidence(const int joint) const { return m_confidences[joint].data(); }
+  const float* orientation(const int joint, const int component) const {
+    return m_orientations[joint][component].data();
+  }
+
+ private:
+  size_t m_size;
+  std::vector<int64_t> m_timestamps;
+  std::vector<uint64_t> m_trackingIds;
+  std::vector<float> m_positions[kNumJoints][3];
+  std::vector<float> m_confidences[kNumJoints];
+  std::vector<float> m_orientations[kNumJoints][4];
+};
+
+//! Fills a SkeletonColumns store directly from a KinectOneTracker
+class SkeletonColumnsListener : public KinectOneListener {
+ public:
+  explicit SkeletonColumnsListener(SkeletonColumns& columns) : m_columns(columns) { }  // NOLINT
+  void onSkeleton(const Skeleton* skel) { m_columns.push_back(*skel); }
+  void onColor(const INT64, const UINT, const RGBQUAD*) { }
+  void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { }
+
+ private:
+  SkeletonColumns& m_columns;
+};
+
+//! Axis-aligned bounding box of a joint's positions
+struct JointExtents {
+  std::array<float, 3> min, max;
+};
+
+// Vectorized per-joint reductions over all rows of a SkeletonColumns store (see Simd.h for the instruction sets).
+// Speeds assume the rows are consecutive samples of one body (see SkeletonColumns::selectBody).
+
+//! Speed of joint in m/s between consecutive rows: out[i] is the speed from row i to i+1 (size() - 1 values).
+//! Rows with equal timestamps get speed 0
+void jointSpeeds(const SkeletonColumns& c, const int joint, std::vector<float>& out);  // NOLINT
+
+//! Mean position of joint (zero if empty)
+std::array<float, 3> jointCentroid(const SkeletonColumns& c, const int joint);
+
+//! Min and max position of joint along each axis (+inf/-inf if empty)
+JointExtents jointExtents(const SkeletonColumns& c, const int joint);
+
+//! Mean position of joint over rows with confidence >= minConfidence, written to mean (zero if none qualify).
+//! Returns number of qualifying rows
+size_t jointConfidentMean(const SkeletonColumns& c, const int joint, const float minConfidence,
+                          std::array<float, 3>& mean);  // NOLINT
+
+#endif  // KINECTONETRACKER_SKELETONCOLUMNS_H_
@@ -0,0 +1,181 @@
+#include "./SkeletonFilter.h"
+#include "./Simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const float kTwoPi = 6.28318530718f;
+
+//! Exponential smoothing factor of a cutoff frequency (Hz) at sampling interval dt (seconds)
+inline float smoothingFactor(const float cutoff, const float dt) {
+  const float r = kTwoPi * cutoff * dt;
+  return r / (r + 1.0f);
+}
+
+SkeletonFilter::SkeletonFilter(const SkeletonFilterOptions& opts)
+  : m_opts(opts) {
+  reset();
+}
+
+void SkeletonFilter::reset() {
+  memset(m_bodies, 0, sizeof(m_bodies));
+  // Padding lanes hold a valid point and identity rotation, so that they never produce NaNs
+  memset(m_in, 0, sizeof(m_in));
+  memset(m_weight, 0, sizeof(m_weight));
+  for (int j = kNumJoints; j < kPadded; ++j) { m_in[6][j] = 1.0f; }
+}
+
+SkeletonFilter::Body& SkeletonFilter::findBody(const uint64_t trackingId) {  // NOLINT
+  Body* pOldest = nullptr;
+  for (Body& b : m_bodies) {
+    if (b.inUse && b.trackingId == trackingId) { return b; }
+    if (pOldest == nullptr || (pOldest->inUse && (!b.inUse || b.lastTime < pOldest->lastTime))) { pOldest = &b; }
+  }
+  pOldest->inUse = false;
+  return *pOldest;
+}
+
+void SkeletonFilter::startBody(Body& b, const Skeleton& s) {  // NOLINT
+  b.inUse = true;
+  b.trackingId = s.trackingId;
+  b.lastTime = s.timestamp;
+  for (int c = 0; c < 3; ++c) {
+    memcpy(b.position[c], m_in[c], sizeof(b.position[c]));
+    memset(b.dPosition[c], 0, sizeof(b.dPosition[c]));
+  }
+  for (int c = 0; c < 4; ++c) {
+    memcpy(b.orientation[c], m_in[3 + c], sizeof(b.orientation[c]));
+    memset(b.dOrientation[c], 0, sizeof(b.dOrientation[c]));
+  }
+}
+
+void SkeletonFilter::filter(Skeleton& s) {  // NOLINT
+  typedef SimdFloat S;
+  typedef S::V V;
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int c = 0; c < 3; ++c) { m_in[c][j] = s.jointPositions[j][c]; }
+    for (int c = 0; c < 4; ++c) { m_in[3 + c][j] = s.jointOrientations[j][c]; }
+    const float conf = std::min(std::max(s.jointConfidences[j], 0.0f), 1.0f);
+    m_weight[j] = m_opts.lowConfidenceWeight + (1.0f - m_opts.lowConfidenceWeight) * conf;
+  }
+
+  Body& b = findBody(s.trackingId);
+  const float dt = static_cast<float>(s.timestamp - b.lastTime) * 1.0E-7f;
+  if (!b.inUse || dt <= 0 || dt > m_opts.resetAfter) {
+    startBody(b, s);
+    return;
+  }
+  b.lastTime = s.timestamp;
+
+  // Per-frame constants. Each joint's cutoff is minCutoff + beta * speed, and its factor r / (r + 1) with
+  // r = 2 pi cutoff dt
+  const V rate = S::set1(1.0f / dt), twoPiDt = S::set1(kTwoPi * dt), one = S::set1(1.0f), zero = S::zero();
+  const V alphaD = S::set1(smoothingFactor(m_opts.derivativeCutoff, dt));
+  const V minCutoff = S::set1(m_opts.minCutoff), beta = S::set1(m_opts.beta);
+  const V rotMinCutoff = S::set1(m_opts.orientationMinCutoff), rotBeta = S::set1(m_opts.orientationBeta);
+  const V two = S::set1(2.0f), tiny = S::set1(1.0E-12f);
+
+  for (int j = 0; j < kPadded; j += S::kLanes) {
+    const V weight = S::load(m_weight + j);
+
+    // Positions: speed estimate from the change of the filtered position, then adaptive smoothing
+    V x[3], p[3], d[3];
+    V speed2 = zero;
+    for (int c = 0; c < 3; ++c) {
+      x[c] = S::load(m_in[c] + j);
+      p[c] = S::load(b.position[c] + j);
+      d[c] = S::load(b.dPosition[c] + j);
+      const V raw = S::mul(S::sub(x[c], p[c]), rate);
+      d[c] = S::add(d[c], S::mul(alphaD, S::sub(raw, d[c])));
+      speed2 = S::add(speed2, S::mul(d[c], d[c]));
+    }
+    V r = S::mul(twoPiDt, S::add(minCutoff, S::mul(beta, S::sqrt(speed2))));
+    V alpha = S::mul(weight, S::div(r, S::add(r, one)));
+    for (int c = 0; c < 3; ++c) {
+      S::store(b.position[c] + j, S::add(p[c], S::mul(alpha, S::sub(x[c], p[c]))));
+      S::store(b.dPosition[c] + j, d[c]);
+    }
+
+    // Orientations: flip the new quaternion onto the hemisphere of the filtered one, smooth as 4-vectors and
+    // renormalize
+    V q[4], f[4], dq[4];
+    V dot = zero;
+    for (int c = 0; c < 4; ++c) {
+      q[c] = S::load(m_in[3 + c] + j);
+      f[c] = S::load(b.orientation[c] + j);
+      dot = S::add(dot, S::mul(q[c], f[c]));
+    }
+    const V flip = S::cmpge(zero, dot);
+    speed2 = zero;
+    for (int c = 0; c < 4; ++c) {
+      q[c] = S::sub(q[c], S::mul(two, S::select(flip, q[c])));
+      dq[c] = S::load(b.dOrientation[c] + j);
+      const V raw = S::mul(S::sub(q[c], f[c]), rate);
+      dq[c] = S::add(dq[c], S::mul(alphaD, S::sub(raw, dq[c])));
+      speed2 = S::add(speed2, S::mul(dq[c], dq[c]));
+    }
+    r = S::mul(twoPiDt, S::add(rotMinCutoff, S::mul(rotBeta, S::sqrt(speed2))));
+    alpha = S::mul(weight, S::div(r, S::add(r, one)));
+    V norm2 = zero;
+    for (int c = 0; c < 4; ++c) {
+      f[c] = S::add(f[c], S::mul(alpha, S::sub(q[c], f[c])));
+      norm2 = S::add(norm2, S::mul(f[c], f[c]));
+    }
+    const V invNorm = S::div(one, S::sqrt(S::max(norm2, tiny)));
+    for (int c = 0; c < 4; ++c) {
+      S::store(b.orientation[c] + j, S::mul(f[c], invNorm));
+      S::store(b.dOrientation[c] + j, dq[c]);
+    }
+  }
+
+  for (int j = 0; j < kNumJoints; ++j) {
+    for (int c = 0; c < 3; ++c) { s.jointPositions[j][c] = b.position[c][j]; }
+    for (int c = 0; c < 4; ++c) { s.jointOrientations[j][c] = b.orientation[c][j]; }
+  }
+}
+
+SkeletonFilterStage::SkeletonFilterStage(const SkeletonFilterOptions& opts)
+  : m_filter(opts) { }
+
+void SkeletonFilterStage::onSkeleton(const Skeleton* skel) {
+  m_skel = *skel;
+  m_filter.filter(m_skel);
+  for (KinectOneListener* l : m_listeners) { l->onSkeleton(&m_skel); }
+}
+
+void SkeletonFilterStage::onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+  for (KinectOneListener* l : m_listeners) { l->onColor(nTime, nColorBufferSize, pColorBuffer); }
+}
+
+void SkeletonFilterStage::onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize,
+                                              const UINT16* pDepthBuffer, const UINT nBodyIndexBufferSize,
+                                              const BYTE* pBodyIndexBuffer) {
+  for (KinectOneListener* l : m_listeners) {
+    l->onDepthAndBodyIndex(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer);
+  }
+}
+
+void SkeletonFilterStage::onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize,
+                                            const UINT16* pDepthBuffer, const UINT nBodyIndexBufferSize,
+                                            const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor) {
+  for (KinectOneListener* l : m_listeners) {
+    l->onRegisteredColor(nTime, nDepthBufferSize, pDepthBuffer, nBodyIndexBufferSize, pBodyIndexBuffer,
+                         pRegisteredColor);
+  }
+}
+
+void SkeletonFilterStage::onFrameBundle(const FrameBundle& b) {
+  // Buffers only grow, so that bundles stop allocating once they have held the most bodies
+  if (m_bundleSkeletons.size() < b.numSkeletons) {
+    m_bundleSkeletons.resize(b.numSkeletons);
+    m_bundleSkeletonPtrs.resize(b.numSkeletons);
+  }
+  for (size_t i = 0; i < b.numSkeletons; ++i) {
+    m_bundleSkeletons[i] = *b.skeletons[i];
+    m_filter.filter(m_bundleSkeletons[i]);
+    m_bundleSkeletonPtrs[i] = &m_bundleSkeletons[i];
+  }
+  FrameBundle filtered = b;
+  filtered.skeletons = m_bundleSkeletonPtrs.data();
+  for (KinectOneListener* l : m_listeners) { l->onFrameBundle(filtered); }
+}
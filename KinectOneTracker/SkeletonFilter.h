@@ -0,0 +1,110 @@
+#ifndef KINECTONETRACKER_SKELETONFILTER_H_
+#define KINECTONETRACKER_SKELETONFILTER_H_
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "./KinectOneListener.h"
+#include "./KinectTypes.h"
+#include "./Recording.h"
+
+//! Parameters of the One-Euro filter (Casiez et al. 2012) smoothing each joint: an exponential smoother whose cutoff
+//! frequency rises with the joint's speed, so that jitter is removed at rest while fast motion lags little
+struct SkeletonFilterOptions {
+  // Cutoff frequency in Hz of joint positions at rest. Lower removes more jitter but adds more lag
+  float minCutoff;
+  // Increase of the position cutoff in Hz per m/s of joint speed. Higher lags less on fast motion
+  float beta;
+  // Cutoff frequency in Hz of the speed estimates
+  float derivativeCutoff;
+  // Same as minCutoff and beta for orientations, with speeds in quaternion units per second
+  float orientationMinCutoff, orientationBeta;
+  // Weight of a joint sample of confidence 0 relative to one of confidence 1 (linear in between), so that inferred
+  // joints move towards their new positions more slowly
+  float lowConfidenceWeight;
+  // A body not seen for this many seconds starts over from its next sample
+  float resetAfter;
+
+  SkeletonFilterOptions()
+    : minCutoff(1.0f), beta(10.0f), derivativeCutoff(1.0f), orientationMinCutoff(1.0f), orientationBeta(5.0f)
+    , lowConfidenceWeight(0.25f), resetAfter(0.5f) { }
+};
+
+//! Temporal filter of joint positions and orientations, with state per trackingId for up to BODY_COUNT bodies. Joints
+//! are filtered in columns (all x, then all y, ...) with SimdFloat, so a body costs a handful of vector operations
+//! per component. Orientations are sign-aligned with the previous filtered quaternion (q and -q are the same
+//! rotation), smoothed componentwise and renormalized, i.e. a normalized lerp standing in for slerp at the small
+//! steps between frames.
+class SkeletonFilter {
+ public:
+  static const int kNumJoints = Skeleton::JointType_Count;
+
+  explicit SkeletonFilter(const SkeletonFilterOptions& opts = SkeletonFilterOptions());
+
+  const SkeletonFilterOptions& options() const { return m_opts; }
+
+  //! Smooths the joints of s in place with the state of its trackingId, and updates that state. The first sample of
+  //! a body (or after a gap of resetAfter seconds, or a timestamp going backwards) is passed through unchanged
+  void filter(Skeleton& s);  // NOLINT
+
+  //! Forgets all bodies
+  void reset();
+
+ private:
+  // Joints padded to a whole number of SIMD blocks at the widest width (8 lanes)
+  static const int kPadded = (kNumJoints + 7) / 8 * 8;
+
+  // Filtered values and speed estimates of a body, in columns
+  struct Body {
+    bool inUse;
+    uint64_t trackingId;
+    int64_t lastTime;
+    float position[3][kPadded], dPosition[3][kPadded];
+    float orientation[4][kPadded], dOrientation[4][kPadded];
+  };
+
+  //! State of trackingId, or a free or least recently updated one (which is then reset) if it has none
+  Body& findBody(const uint64_t trackingId);  // NOLINT
+  //! Starts b over from the sample in m_in
+  void startBody(Body& b, const Skeleton& s);  // NOLINT
+
+  const SkeletonFilterOptions m_opts;
+  Body m_bodies[BODY_COUNT];
+  // Joints of the skeleton being filtered, in columns: position x, y, z, orientation x, y, z, w
+  float m_in[7][kPadded];
+  float m_weight[kPadded];
+};
+
+//! Pipeline stage smoothing skeletons with a SkeletonFilter on their way to its listeners, whether they arrive one by
+//! one or in frame bundles. Other frames are passed on unchanged, so the stage can sit on the skeleton stream only
+//! or on all streams
+class SkeletonFilterStage : public KinectOneListener {
+ public:
+  explicit SkeletonFilterStage(const SkeletonFilterOptions& opts = SkeletonFilterOptions());
+
+  SkeletonFilter& filter() { return m_filter; }
+
+  void attachListener(KinectOneListener* listener) { m_listeners.push_back(listener); }
+
+  void onSkeleton(const Skeleton* skel);
+  void onColor(const INT64 nTime, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer);
+  void onDepthAndBodyIndex(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                           const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer);
+  void onRegisteredColor(const INT64 nTime, const UINT nDepthBufferSize, const UINT16* pDepthBuffer,
+                         const UINT nBodyIndexBufferSize, const BYTE* pBodyIndexBuffer, const BYTE* pRegisteredColor);
+  void onFrameBundle(const FrameBundle& b);
+
+ private:
+  SkeletonFilterStage(const SkeletonFilterStage&);
+  SkeletonFilterStage& operator=(const SkeletonFilterStage&);
+
+  SkeletonFilter m_filter;
+  std::list<KinectOneListener*> m_listeners;
+  // Filtered copies of the skeletons being passed on
+  Skeleton m_skel;
+  std::vector<Skeleton> m_bundleSkeletons;
+  std::vector<const Skeleton*> m_bundleSkeletonPtrs;
+};
+
+#endif  // KINECTONETRACKER_SKELETONFILTER_H_
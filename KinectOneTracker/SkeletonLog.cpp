@@ -0,0 +1,343 @@
+#include "./SkeletonLog.h"
+
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+// Sequential writer/reader of packed fields
+struct PackCursor {
+  char* p;
+  template <typename T> void put(const T& v) { memcpy(p, &v, sizeof(T)); p += sizeof(T); }
+};
+struct UnpackCursor {
+  const char* p;
+  template <typename T> void get(T& v) { memcpy(&v, p, sizeof(T)); p += sizeof(T); }  // NOLINT
+};
+
+// StreamGeometry of metadata records: region, step and size as int32
+static const size_t kStreamGeometrySize = 7 * sizeof(int32_t);
+
+void putGeometry(PackCursor& c, const StreamGeometry& g) {  // NOLINT
+  const int32_t v[7] = { g.roiX, g.roiY, g.roiWidth, g.roiHeight, g.step, g.width, g.height };
+  c.put(v);
+}
+
+void getGeometry(UnpackCursor& c, StreamGeometry& g) {  // NOLINT
+  int32_t v[7];
+  c.get(v);
+  g = StreamGeometry(v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+}
+
+void packSkeleton(const Skeleton& s, char* out) {
+  PackCursor c = { out };
+  c.put(static_cast<int64_t>(s.timestamp));
+  c.put(static_cast<uint64_t>(s.trackingId));
+  for (int j = 0; j < Skeleton::JointType_Count; ++j) { c.put(s.jointPositions[j]); }
+  c.put(s.jointConfidences);
+  for (int j = 0; j < Skeleton::JointType_Count; ++j) { c.put(s.jointOrientations[j]); }
+  c.put(static_cast<uint8_t>(s.handLeftState));
+  c.put(static_cast<uint8_t>(s.handRightState));
+  c.put(static_cast<uint8_t>(s.handLeftConfidence));
+  c.put(static_cast<uint8_t>(s.handRightConfidence));
+  for (int a = 0; a < Skeleton::Activity_Count; ++a) { c.put(static_cast<uint8_t>(s.activities[a])); }
+  c.put(s.leanConfidence);
+  c.put(s.leanLeftRight);
+  c.put(s.leanForwardBack);
+  c.put(static_cast<uint32_t>(s.clippedEdges));
+  memset(c.p, 0, kSkeletonRecordSize - (c.p - out));
+}
+
+void unpackSkeleton(const char* in, Skeleton& s) {  // NOLINT
+  UnpackCursor c = { in };
+  int64_t timestamp;  uint64_t trackingId;
+  c.get(timestamp);
+  c.get(trackingId);
+  s.timestamp = timestamp;
+  s.trackingId = trackingId;
+  for (int j = 0; j < Skeleton::JointType_Count; ++j) { c.get(s.jointPositions[j]); }
+  c.get(s.jointConfidences);
+  for (int j = 0; j < Skeleton::JointType_Count; ++j) { c.get(s.jointOrientations[j]); }
+  uint8_t b;
+  c.get(b);  s.handLeftState = static_cast<Skeleton::HandState>(b);
+  c.get(b);  s.handRightState = static_cast<Skeleton::HandState>(b);
+  c.get(b);  s.handLeftConfidence = static_cast<Skeleton::TrackingConfidence>(b);
+  c.get(b);  s.handRightConfidence = static_cast<Skeleton::TrackingConfidence>(b);
+  for (int a = 0; a < Skeleton::Activity_Count; ++a) {
+    c.get(b);  s.activities[a] = static_cast<Skeleton::DetectionResult>(b);
+  }
+  c.get(s.leanConfidence);
+  c.get(s.leanLeftRight);
+  c.get(s.leanForwardBack);
+  uint32_t edges;
+  c.get(edges);
+  s.clippedEdges = edges;
+}
+
+void packRecordingMetadata(const Recording& rec, std::vector<char>& out) {  // NOLINT
+  const size_t numDropped = rec.droppedColorTimestamps.size() + rec.droppedDepthTimestamps.size();
+  out.resize(sizeof(uint64_t) * 2 + sizeof(rec.camera) + sizeof(uint32_t) + rec.id.size() +
+             sizeof(uint64_t) * 2 + sizeof(int64_t) * numDropped + 2 * kStreamGeometrySize);
+  PackCursor c = { out.data() };
+  c.put(rec.startTime);
+  c.put(rec.endTime);
+  c.put(rec.camera);
+  c.put(static_cast<uint32_t>(rec.id.size()));
+  memcpy(c.p, rec.id.data(), rec.id.size());
+  c.p += rec.id.size();
+  // Dropped frame timestamps follow the id (absent in older logs)
+  c.put(static_cast<uint64_t>(rec.droppedColorTimestamps.size()));
+  c.put(static_cast<uint64_t>(rec.droppedDepthTimestamps.size()));
+  for (const int64_t t : rec.droppedColorTimestamps) { c.put(t); }
+  for (const int64_t t : rec.droppedDepthTimestamps) { c.put(t); }
+  // Then the geometry of color and depth frames (absent in older logs, whose frames have the defaults of Recording)
+  putGeometry(c, rec.colorGeometry);
+  putGeometry(c, rec.depthGeometry);
+}
+
+bool unpackRecordingMetadata(const char* in, const size_t size, Recording& rec) {  // NOLINT
+  const size_t fixedSize = sizeof(uint64_t) * 2 + sizeof(rec.camera) + sizeof(uint32_t);
+  if (size < fixedSize) { return false; }
+  UnpackCursor c = { in };
+  c.get(rec.startTime);
+  c.get(rec.endTime);
+  c.get(rec.camera);
+  uint32_t idLength;
+  c.get(idLength);
+  if (fixedSize + idLength > size) { return false; }
+  rec.id.assign(c.p, idLength);
+  c.p += idLength;
+  rec.droppedColorTimestamps.clear();
+  rec.droppedDepthTimestamps.clear();
+  const Recording defaults;
+  rec.colorGeometry = defaults.colorGeometry;
+  rec.depthGeometry = defaults.depthGeometry;
+  const size_t droppedSize = size - fixedSize - idLength;
+  if (droppedSize >= sizeof(uint64_t) * 2) {
+    uint64_t numColor, numDepth;
+    c.get(numColor);
+    c.get(numDepth);
+    const uint64_t maxCount = (droppedSize - sizeof(uint64_t) * 2) / sizeof(int64_t);
+    if (numColor > maxCount || numDepth > maxCount - numColor) { return false; }
+    rec.droppedColorTimestamps.resize(numColor);
+    rec.droppedDepthTimestamps.resize(numDepth);
+    for (int64_t& t : rec.droppedColorTimestamps) { c.get(t); }
+    for (int64_t& t : rec.droppedDepthTimestamps) { c.get(t); }
+    const size_t geometrySize = droppedSize - sizeof(uint64_t) * 2 - sizeof(int64_t) * (numColor + numDepth);
+    if (geometrySize >= 2 * kStreamGeometrySize) {
+      getGeometry(c, rec.colorGeometry);
+      getGeometry(c, rec.depthGeometry);
+    }
+  }
+  return true;
+}
+
+uint32_t skeletonLogChecksum(const char* data, const size_t n) {
+  // FNV-1a over 32-bit words, then remaining bytes
+  uint32_t h = 2166136261u;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    uint32_t w;
+    memcpy(&w, data + i, 4);
+    h = (h ^ w) * 16777619u;
+  }
+  for (; i < n; ++i) { h = (h ^ static_cast<uint8_t>(data[i])) * 16777619u; }
+  return h;
+}
+
+SkeletonLogWriter::SkeletonLogWriter(const size_t recordsPerChunk, const size_t maxPendingChunks,
+                                     const int64_t flushIntervalTicks)
+  : m_recordsPerChunk(recordsPerChunk > 0 ? recordsPerChunk : 1)
+  , m_maxPendingChunks(maxPendingChunks > 0 ? maxPendingChunks : 1)
+  , m_flushIntervalTicks(flushIntervalTicks)
+  , m_isOpen(false)
+  , m_writeFailed(false)
+  , m_numRecords(0)
+  , m_numStalls(0)
+  , m_fileOffset(0)
+  , m_pCurrent()
+  , m_closing(false) { }
+
+SkeletonLogWriter::~SkeletonLogWriter() {
+  close();
+}
+
+bool SkeletonLogWriter::open(const string& file) {
+  if (m_isOpen) { close(); }
+  m_ofs.open(file, std::ios::binary | std::ios::trunc);
+  if (!m_ofs) {
+    cerr << "Could not open skeleton log " << file << endl;
+    return false;
+  }
+  SkeletonLogHeader header;
+  memcpy(header.magic, kSkeletonLogMagic, sizeof(header.magic));
+  header.version = kSkeletonLogVersion;
+  header.headerSize = sizeof(SkeletonLogHeader);
+  header.reserved = 0;
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_ofs.flush();
+  m_fileOffset = sizeof(header);
+
+  // Preallocate every chunk buffer up front: one being filled per record type plus up to m_maxPendingChunks
+  // being written
+  m_allChunks.clear();
+  m_pending.clear();
+  m_free.clear();
+  m_index.clear();
+  for (size_t i = 0; i < m_maxPendingChunks + kNumStreamedTypes; ++i) {
+    m_allChunks.emplace_back(new Chunk());
+    Chunk* c = m_allChunks.back().get();
+    c->data.resize(m_recordsPerChunk * kSkeletonRecordSize);
+    c->count = 0;
+    m_free.push_back(c);
+  }
+  for (int t = 0; t < kNumStreamedTypes; ++t) {
+    m_pCurrent[t] = m_free.front();
+    m_free.pop_front();
+  }
+
+  m_numRecords = 0;
+  m_numStalls = 0;
+  m_writeFailed = false;
+  m_closing = false;
+  m_isOpen = true;
+  m_writer = std::thread(&SkeletonLogWriter::writeLoop, this);
+  return true;
+}
+
+char* SkeletonLogWriter::nextRecord(const int type, const uint32_t recordSize, const int64_t time) {
+  Chunk* c = m_pCurrent[type - SkeletonLogRecord_Skeleton];
+  if (c->count == 0) {
+    c->recordType = type;
+    c->recordSize = recordSize;
+    c->firstTime = time;
+  }
+  c->lastTime = time;
+  char* out = c->data.data() + c->count * recordSize;
+  ++c->count;
+  ++m_numRecords;
+  return out;
+}
+
+void SkeletonLogWriter::endRecord(const int type) {
+  const Chunk* c = m_pCurrent[type - SkeletonLogRecord_Skeleton];
+  if (c->count >= m_recordsPerChunk || (c->lastTime - c->firstTime) >= m_flushIntervalTicks) {
+    submitCurrent(type);
+  }
+}
+
+void SkeletonLogWriter::append(const Skeleton& s) {
+  if (!m_isOpen) { return; }
+  packSkeleton(s, nextRecord(SkeletonLogRecord_Skeleton, kSkeletonRecordSize, s.timestamp));
+  endRecord(SkeletonLogRecord_Skeleton);
+}
+
+void SkeletonLogWriter::appendTimestamp(const int type, const int64_t time) {
+  if (!m_isOpen) { return; }
+  memcpy(nextRecord(type, sizeof(time), time), &time, sizeof(time));
+  endRecord(type);
+}
+
+void SkeletonLogWriter::flush() {
+  if (!m_isOpen) { return; }
+  for (int t = 0; t < kNumStreamedTypes; ++t) { submitCurrent(SkeletonLogRecord_Skeleton + t); }
+}
+
+void SkeletonLogWriter::submitCurrent(const int type) {
+  Chunk*& current = m_pCurrent[type - SkeletonLogRecord_Skeleton];
+  if (current->count == 0) { return; }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_pending.push_back(current);
+  m_pendingCv.notify_one();
+  if (m_free.empty()) {
+    ++m_numStalls;
+    m_freeCv.wait(lock, [&] { return !m_free.empty(); });
+  }
+  current = m_free.front();
+  m_free.pop_front();
+  current->count = 0;
+}
+
+void SkeletonLogWriter::writeChunk(const Chunk& c) {
+  const size_t payloadSize = c.count * c.recordSize;
+  SkeletonLogChunkHeader header;
+  header.magic = kSkeletonLogChunkMagic;
+  header.recordType = c.recordType;
+  header.recordSize = c.recordSize;
+  header.count = c.count;
+  header.firstTime = c.firstTime;
+  header.lastTime = c.lastTime;
+  header.checksum = skeletonLogChecksum(c.data.data(), payloadSize);
+  header.reserved = 0;
+  m_ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_ofs.write(c.data.data(), payloadSize);
+  m_ofs.flush();
+  if (!m_ofs) { m_writeFailed = true; }
+
+  SkeletonLogIndexEntry entry;
+  entry.offset = m_fileOffset;
+  entry.recordType = header.recordType;
+  entry.count = header.count;
+  entry.firstTime = header.firstTime;
+  entry.lastTime = header.lastTime;
+  m_index.push_back(entry);
+  m_fileOffset += sizeof(header) + payloadSize;
+}
+
+void SkeletonLogWriter::writeLoop() {
+  while (true) {
+    Chunk* c = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_pendingCv.wait(lock, [&] { return !m_pending.empty() || m_closing; });
+      if (m_pending.empty()) { break; }
+      c = m_pending.front();
+      m_pending.pop_front();
+    }
+    writeChunk(*c);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_free.push_back(c);
+    }
+    m_freeCv.notify_one();
+  }
+}
+
+bool SkeletonLogWriter::close(const Recording* pRecording) {
+  if (!m_isOpen) { return true; }
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_pendingCv.notify_one();
+  if (m_writer.joinable()) { m_writer.join(); }
+
+  if (pRecording != nullptr) {
+    Chunk metadata;
+    packRecordingMetadata(*pRecording, metadata.data);
+    metadata.recordType = SkeletonLogRecord_Metadata;
+    metadata.recordSize = static_cast<uint32_t>(metadata.data.size());
+    metadata.count = 1;
+    metadata.firstTime = metadata.lastTime = 0;
+    writeChunk(metadata);
+  }
+
+  SkeletonLogFooter footer;
+  footer.indexOffset = m_fileOffset;
+  footer.numChunks = static_cast<uint32_t>(m_index.size());
+  footer.magic = kSkeletonLogIndexMagic;
+  if (!m_index.empty()) {
+    m_ofs.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(SkeletonLogIndexEntry));
+  }
+  m_ofs.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  m_ofs.close();
+  if (!m_ofs) { m_writeFailed = true; }
+
+  m_allChunks.clear();
+  m_pending.clear();
+  m_free.clear();
+  for (int t = 0; t < kNumStreamedTypes; ++t) { m_pCurrent[t] = nullptr; }
+  m_isOpen = false;
+  return !m_writeFailed;
+}
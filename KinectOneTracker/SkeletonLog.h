@@ -0,0 +1,166 @@
+#ifndef KINECTONETRACKER_SKELETONLOG_H_
+#define KINECTONETRACKER_SKELETONLOG_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./Recording.h"
+
+// Binary skeleton log file layout (all fields little-endian):
+//   SkeletonLogHeader
+//   Chunk*            each chunk is a SkeletonLogChunkHeader followed by count fixed-size records of one type
+//   Index             one SkeletonLogIndexEntry per chunk, followed by SkeletonLogFooter (only after a clean close)
+// Every chunk is self-describing and checksummed, so a log cut short by a crash is still readable up to its last
+// complete chunk by scanning. The index lets readers locate chunks without scanning.
+// Besides Skeletons, the log holds the timestamps of recorded color and depth frames and, after a clean close, the
+// Recording metadata, so that it is a complete binary Recording (see RecordingReader.h).
+
+//! Record types that can be stored in log chunks
+enum SkeletonLogRecordType {
+  SkeletonLogRecord_Skeleton = 1,     // packSkeleton() records
+  SkeletonLogRecord_ColorFrame = 2,   // int64_t timestamp of a recorded color frame
+  SkeletonLogRecord_DepthFrame = 3,   // int64_t timestamp of a recorded depth frame
+  SkeletonLogRecord_Metadata = 4      // Single packRecordingMetadata() record
+};
+
+#pragma pack(push, 1)
+struct SkeletonLogHeader {
+  char     magic[8];      // kSkeletonLogMagic
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t reserved;
+};
+
+struct SkeletonLogChunkHeader {
+  uint32_t magic;         // kSkeletonLogChunkMagic
+  uint32_t recordType;    // SkeletonLogRecordType
+  uint32_t recordSize;    // Size of each record in bytes
+  uint32_t count;         // Number of records in chunk
+  int64_t  firstTime;     // Timestamp of first record
+  int64_t  lastTime;      // Timestamp of last record
+  uint32_t checksum;      // skeletonLogChecksum() of the records
+  uint32_t reserved;
+};
+
+struct SkeletonLogIndexEntry {
+  uint64_t offset;        // File offset of SkeletonLogChunkHeader
+  uint32_t recordType;
+  uint32_t count;
+  int64_t  firstTime;
+  int64_t  lastTime;
+};
+
+struct SkeletonLogFooter {
+  uint64_t indexOffset;   // File offset of first SkeletonLogIndexEntry
+  uint32_t numChunks;
+  uint32_t magic;         // kSkeletonLogIndexMagic
+};
+#pragma pack(pop)
+
+static const char     kSkeletonLogMagic[8]     = { 'K', 'O', 'S', 'K', 'E', 'L', 'O', 'G' };
+static const uint32_t kSkeletonLogVersion      = 1;
+static const uint32_t kSkeletonLogChunkMagic   = 0x4b4e4843;  // "CHNK"
+static const uint32_t kSkeletonLogIndexMagic   = 0x5844494b;  // "KIDX"
+
+//! Size of a packed Skeleton record. The timestamp is stored first so that readers can binary search records
+static const size_t kSkeletonRecordSize = 848;
+
+//! Packs s into kSkeletonRecordSize bytes at out
+void packSkeleton(const Skeleton& s, char* out);
+
+//! Unpacks a record written by packSkeleton() into s
+void unpackSkeleton(const char* in, Skeleton& s);  // NOLINT
+
+//! Packs id, camera, startTime, endTime, dropped frame timestamps and stream geometry of rec into out (replacing its
+//! contents)
+void packRecordingMetadata(const Recording& rec, std::vector<char>& out);  // NOLINT
+
+//! Unpacks a record written by packRecordingMetadata() into rec. Returns false if it is malformed
+bool unpackRecordingMetadata(const char* in, const size_t size, Recording& rec);  // NOLINT
+
+//! Checksum of n bytes used to validate chunks
+uint32_t skeletonLogChecksum(const char* data, const size_t n);
+
+//! Streams Skeletons and frame timestamps into a binary log. append() only copies into the current chunk of its
+//! record type; full chunks are written and flushed by a background thread. Memory is bounded by maxPendingChunks:
+//! if the disk falls that far behind, append() waits for the writer rather than dropping records.
+//! All append calls must come from the same thread.
+class SkeletonLogWriter {
+ public:
+  //! Chunks hold recordsPerChunk records and are also handed to the writer once they span flushIntervalTicks of
+  //! device time (100ns units), which bounds what a crash can lose
+  explicit SkeletonLogWriter(const size_t recordsPerChunk = 256, const size_t maxPendingChunks = 64,
+                             const int64_t flushIntervalTicks = 10000000);
+  ~SkeletonLogWriter();
+
+  //! Creates file and starts the writer thread. Returns false if file cannot be opened
+  bool open(const std::string& file);
+
+  //! Appends s to the log
+  void append(const Skeleton& s);
+
+  //! Appends timestamp of a recorded color or depth frame
+  void appendColorFrame(const int64_t time) { appendTimestamp(SkeletonLogRecord_ColorFrame, time); }
+  void appendDepthFrame(const int64_t time) { appendTimestamp(SkeletonLogRecord_DepthFrame, time); }
+
+  //! Hands the partially filled current chunks to the writer
+  void flush();
+
+  //! Writes all pending chunks, the metadata of pRecording (if given) and the index, then closes the file.
+  //! Returns false if any write failed
+  bool close(const Recording* pRecording = nullptr);
+
+  bool isOpen() const { return m_isOpen; }
+  uint64_t numRecords() const { return m_numRecords; }
+  //! Number of times append() had to wait for the writer thread
+  uint64_t numStalls() const { return m_numStalls; }
+
+ private:
+  // Number of record types that have a chunk being filled (Skeleton, ColorFrame, DepthFrame)
+  static const int kNumStreamedTypes = 3;
+
+  struct Chunk {
+    std::vector<char> data;
+    uint32_t recordType;
+    uint32_t recordSize;
+    uint32_t count;
+    int64_t firstTime, lastTime;
+  };
+
+  //! Returns storage for the next record of type in its current chunk
+  char* nextRecord(const int type, const uint32_t recordSize, const int64_t time);
+  //! Submits the current chunk of type if it is full or spans the flush interval
+  void endRecord(const int type);
+  void appendTimestamp(const int type, const int64_t time);
+  void writeLoop();
+  void writeChunk(const Chunk& c);
+  void submitCurrent(const int type);
+
+  const size_t m_recordsPerChunk;
+  const size_t m_maxPendingChunks;
+  const int64_t m_flushIntervalTicks;
+  std::ofstream m_ofs;
+  bool m_isOpen;
+  bool m_writeFailed;
+  uint64_t m_numRecords;
+  uint64_t m_numStalls;
+  uint64_t m_fileOffset;
+  Chunk* m_pCurrent[kNumStreamedTypes];
+  std::vector<std::unique_ptr<Chunk>> m_allChunks;
+  std::vector<SkeletonLogIndexEntry> m_index;
+
+  std::mutex m_mutex;
+  std::condition_variable m_pendingCv, m_freeCv;
+  std::deque<Chunk*> m_pending, m_free;
+  bool m_closing;
+  std::thread m_writer;
+};
+
+#endif  // KINECTONETRACKER_SKELETONLOG_H_
@@ -0,0 +1,174 @@
+#include "./StreamStage.h"
+#include "./ColorConvert.h"
+#include "./DepthPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using std::string;  using std::cerr;  using std::endl;
+
+bool parseRoi(const string& s, cv::Rect& roi) {  // NOLINT
+  int x, y, w, h;
+  char extra;
+  if (sscanf(s.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &extra) != 4 || w <= 0 || h <= 0) { return false; }
+  roi = cv::Rect(x, y, w, h);
+  return true;
+}
+
+bool parseSize(const string& s, cv::Size& size) {  // NOLINT
+  int w, h;
+  char extra;
+  if (sscanf(s.c_str(), "%dx%d%c", &w, &h, &extra) != 2 || w <= 0 || h <= 0) { return false; }
+  size = cv::Size(w, h);
+  return true;
+}
+
+StreamStageOptions streamStageOptions(const StreamGeometry& g) {
+  StreamStageOptions opts;
+  opts.roi = cv::Rect(g.roiX, g.roiY, g.roiWidth, g.roiHeight);
+  opts.outputSize = cv::Size(g.width, g.height);
+  return opts;
+}
+
+StreamStage::StreamStage(const StreamStageOptions& opts, const double defaultFps, const cv::Size& frameSize,
+                         const int align, const char* name)
+  : m_frameSize(frameSize)
+  , m_enabled(opts.enabled)
+  , m_fps(opts.fps > 0 ? opts.fps : defaultFps)
+  , m_frameDeltaTime(m_fps > 0 ? static_cast<int64_t>(1.0E7 / m_fps) : 0)
+  , m_roi(0, 0, frameSize.width, frameSize.height)
+  , m_outputSize(0, 0) {
+  const cv::Rect& r = opts.roi;
+  if (r.width <= 0 || r.height <= 0) { return; }
+  // Clamp to the frame, then shrink to aligned edges
+  const int x0 = (std::max(r.x, 0) + align - 1) / align * align;
+  const int y0 = (std::max(r.y, 0) + align - 1) / align * align;
+  const int x1 = std::min(r.x + r.width, frameSize.width) / align * align;
+  const int y1 = std::min(r.y + r.height, frameSize.height) / align * align;
+  if (x1 <= x0 || y1 <= y0) {
+    cerr << "Ignoring " << name << " region outside of " << frameSize.width << "x" << frameSize.height
+         << " frames" << endl;
+    return;
+  }
+  m_roi = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+  if (m_roi.x != r.x || m_roi.y != r.y || m_roi.width != r.width || m_roi.height != r.height) {
+    cerr << "Warning: " << name << " region adjusted to " << m_roi.x << "," << m_roi.y << "," << m_roi.width << ","
+         << m_roi.height << endl;
+  }
+}
+
+ColorStreamStage::ColorStreamStage(const StreamStageOptions& opts, const double defaultFps, const int frameWidth,
+                                   const int frameHeight)
+  // YUY2 pixel pairs share their U and V, and half-size conversion takes 2x2 blocks, so the region is aligned to 2
+  : StreamStage(opts, defaultFps, cv::Size(frameWidth, frameHeight), 2, "color") {
+  if (opts.outputSize.width > 0 && opts.outputSize.height > 0) {
+    m_outputSize = opts.outputSize;
+  } else {
+    m_outputSize = cv::Size(m_roi.width / 2, m_roi.height / 2);
+  }
+}
+
+void ColorStreamStage::crop(const uint8_t* frame, uint8_t* dst) const {
+  const size_t rowBytes = 2 * m_roi.width, frameStep = 2 * m_frameSize.width;
+  if (isFullFrame()) {
+    memcpy(dst, frame, rowBytes * m_roi.height);
+    return;
+  }
+  const uint8_t* src = frame + m_roi.y * frameStep + 2 * m_roi.x;
+  for (int r = 0; r < m_roi.height; ++r) { memcpy(dst + r * rowBytes, src + r * frameStep, rowBytes); }
+}
+
+void ColorStreamStage::convert(const cv::Mat& yuy2, cv::Mat& bgr, const bool parallel) {  // NOLINT
+  const int w = m_outputSize.width, h = m_outputSize.height;
+  if (2 * w == yuy2.cols && 2 * h == yuy2.rows) {
+    yuy2ToBgrHalf(yuy2, bgr, parallel);
+  } else if (w == yuy2.cols && h == yuy2.rows) {
+    cv::cvtColor(yuy2, bgr, cv::COLOR_YUV2BGR_YUY2);
+  } else if (2 * w < yuy2.cols && 2 * h < yuy2.rows) {
+    // Smaller than half size: the fused kernel does the first halving
+    yuy2ToBgrHalf(yuy2, m_bgrScratch, parallel);
+    cv::resize(m_bgrScratch, bgr, m_outputSize, 0, 0, cv::INTER_AREA);
+  } else {
+    cv::cvtColor(yuy2, m_bgrScratch, cv::COLOR_YUV2BGR_YUY2);
+    const bool shrink = w < yuy2.cols && h < yuy2.rows;
+    cv::resize(m_bgrScratch, bgr, m_outputSize, 0, 0, shrink ? cv::INTER_AREA : cv::INTER_LINEAR);
+  }
+}
+
+StreamGeometry ColorStreamStage::geometry() const {
+  return StreamGeometry(m_roi.x, m_roi.y, m_roi.width, m_roi.height, 0, m_outputSize.width, m_outputSize.height);
+}
+
+DepthStreamStage::DepthStreamStage(const StreamStageOptions& opts, const double defaultFps, const int frameWidth,
+                                   const int frameHeight)
+  : StreamStage(opts, defaultFps, cv::Size(frameWidth, frameHeight), 1, "depth")
+  , m_step(1) {
+  const cv::Size& out = opts.outputSize;
+  if (out.width > 0 && out.height > 0) {
+    m_step = std::max(1, static_cast<int>(std::lround(static_cast<double>(m_roi.width) / out.width)));
+  }
+  m_outputSize = cv::Size(m_roi.width / m_step, m_roi.height / m_step);
+  if (out.width > 0 && out.height > 0 && (out.width != m_outputSize.width || out.height != m_outputSize.height)) {
+    cerr << "Warning: depth frames are subsampled by a whole factor, recording " << m_outputSize.width << "x"
+         << m_outputSize.height << " frames" << endl;
+  }
+  if (m_step > 1) {
+    m_depthScratch.resize(m_outputSize.area());
+    m_bodyIndexScratch.resize(m_outputSize.area());
+  }
+}
+
+void DepthStreamStage::pack(const UINT16* depth, const BYTE* bodyIndex, uint8_t* out) {
+  const int frameWidth = m_frameSize.width, w = m_outputSize.width, h = m_outputSize.height;
+  if (m_step == 1 && isFullFrame()) {
+    packDepthAndBodyIndex(depth, bodyIndex, out, w, h);
+  } else if (m_step == 1) {
+    const size_t offset = m_roi.y * frameWidth + m_roi.x;
+    for (int r = 0; r < h; ++r) {
+      packDepthAndBodyIndex(depth + offset + r * frameWidth, bodyIndex + offset + r * frameWidth, out + 3 * r * w,
+                            w, 1);
+    }
+  } else {
+    for (int j = 0; j < h; ++j) {
+      const size_t row = (m_roi.y + j * m_step) * frameWidth + m_roi.x;
+      for (int i = 0; i < w; ++i) {
+        m_depthScratch[j * w + i] = depth[row + i * m_step];
+        m_bodyIndexScratch[j * w + i] = bodyIndex[row + i * m_step];
+      }
+    }
+    packDepthAndBodyIndex(m_depthScratch.data(), m_bodyIndexScratch.data(), out, w, h);
+  }
+}
+
+void DepthStreamStage::crop(const BYTE* frame, const int bytesPerPixel, BYTE* dst) const {
+  const int frameWidth = m_frameSize.width, w = m_outputSize.width, h = m_outputSize.height;
+  for (int j = 0; j < h; ++j) {
+    const BYTE* src = frame + ((m_roi.y + j * m_step) * frameWidth + m_roi.x) * bytesPerPixel;
+    BYTE* row = dst + j * w * bytesPerPixel;
+    if (m_step == 1) {
+      memcpy(row, src, w * bytesPerPixel);
+      continue;
+    }
+    for (int i = 0; i < w; ++i) { memcpy(row + i * bytesPerPixel, src + i * m_step * bytesPerPixel, bytesPerPixel); }
+  }
+}
+
+StreamGeometry DepthStreamStage::geometry() const {
+  return StreamGeometry(m_roi.x, m_roi.y, m_roi.width, m_roi.height, m_step, m_outputSize.width, m_outputSize.height);
+}
+
+std::vector<std::pair<float, float>> DepthStreamStage::cropRays(
+    const std::vector<std::pair<float, float>>& table) const {
+  std::vector<std::pair<float, float>> out;
+  if (table.size() != static_cast<size_t>(m_frameSize.area())) { return out; }
+  out.reserve(m_outputSize.area());
+  for (int j = 0; j < m_outputSize.height; ++j) {
+    for (int i = 0; i < m_outputSize.width; ++i) {
+      out.push_back(table[(m_roi.y + j * m_step) * m_frameSize.width + m_roi.x + i * m_step]);
+    }
+  }
+  return out;
+}
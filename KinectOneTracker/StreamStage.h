@@ -0,0 +1,123 @@
+#ifndef KINECTONETRACKER_STREAMSTAGE_H_
+#define KINECTONETRACKER_STREAMSTAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "./KinectTypes.h"
+#include "./Recording.h"
+
+// Per-stream processing of recorded color and depth frames: decimation to a target rate, cropping to a region of
+// interest and scaling to an output resolution. Frames are cropped on the tracker thread as they are copied into
+// frame slots, so pixels outside the region are never copied, converted or encoded. For fixed scenes that only
+// need part of the field of view this cuts the copy and conversion cost in proportion to the area left out.
+
+//! Settings of a recorded color or depth stream
+struct StreamStageOptions {
+  // Whether the stream is recorded at all
+  bool enabled;
+  // Frames per second recorded (0 = RecorderOptions::fps)
+  double fps;
+  // Region of sensor frames kept (empty = the whole frame). Clamped to the frame, and for color to even coordinates
+  cv::Rect roi;
+  // Size of recorded frames (empty = stream default: half the region for color, the region for depth). Depth frames
+  // are only ever subsampled by a whole factor, the same for both axes
+  cv::Size outputSize;
+
+  StreamStageOptions() : enabled(true), fps(0), roi(0, 0, 0, 0), outputSize(0, 0) { }
+};
+
+//! Parses a region given as "x,y,width,height" into roi. Returns false if s is malformed
+bool parseRoi(const std::string& s, cv::Rect& roi);  // NOLINT
+//! Parses a size given as "widthxheight" into size. Returns false if s is malformed
+bool parseSize(const std::string& s, cv::Size& size);  // NOLINT
+
+//! Options of a stage that records frames of geometry g, such as one stored in a Recording. The stage's own
+//! geometry() is g unless g was not made by a stage of the same stream
+StreamStageOptions streamStageOptions(const StreamGeometry& g);
+
+//! Decimation and region of a stream of frameSize frames, resolved from StreamStageOptions
+class StreamStage {
+ public:
+  bool enabled() const { return m_enabled; }
+  double fps() const { return m_fps; }
+  //! Minimum time between recorded frames, in 100 ns ticks
+  int64_t frameDeltaTime() const { return m_frameDeltaTime; }
+  //! Region of sensor frames kept
+  const cv::Rect& roi() const { return m_roi; }
+  //! Size of recorded frames
+  const cv::Size& outputSize() const { return m_outputSize; }
+  //! Whether frames are kept whole
+  bool isFullFrame() const { return m_roi.width == m_frameSize.width && m_roi.height == m_frameSize.height; }
+
+ protected:
+  //! Resolves opts for frameSize frames, with fps defaulting to defaultFps and the region aligned to multiples of
+  //! align pixels
+  StreamStage(const StreamStageOptions& opts, const double defaultFps, const cv::Size& frameSize, const int align,
+              const char* name);
+
+  const cv::Size m_frameSize;
+  bool m_enabled;
+  double m_fps;
+  int64_t m_frameDeltaTime;
+  cv::Rect m_roi;
+  cv::Size m_outputSize;
+};
+
+//! Color stream stage: crops sensor YUY2 frames into frame slots on the tracker thread, and converts them to BGR
+//! frames of the output size on the color consumer thread. Output of half the region's size goes through the fused
+//! kernel of ColorConvert.h, any other size through cv::cvtColor and cv::resize
+class ColorStreamStage : public StreamStage {
+ public:
+  ColorStreamStage(const StreamStageOptions& opts, const double defaultFps, const int frameWidth,
+                   const int frameHeight);
+
+  //! Copies the region of YUY2 frame (frameWidth x frameHeight, 2 bytes per pixel) to dst, a contiguous YUY2 image
+  //! of the region's size
+  void crop(const uint8_t* frame, uint8_t* dst) const;
+
+  //! Converts a cropped YUY2 image (CV_8UC2 of the region's size) to a BGR image of the output size. Uses scratch
+  //! buffers of the stage, so only one thread may convert at a time
+  void convert(const cv::Mat& yuy2, cv::Mat& bgr, const bool parallel);  // NOLINT
+
+  //! Region and output size of recorded frames, as stored in Recording::colorGeometry
+  StreamGeometry geometry() const;
+
+ private:
+  cv::Mat m_bgrScratch;
+};
+
+//! Depth stream stage: crops depth, body index and registered color frames to the region and keeps every step-th
+//! pixel of it, on the tracker thread. Rays for reprojection are cropped the same way
+class DepthStreamStage : public StreamStage {
+ public:
+  DepthStreamStage(const StreamStageOptions& opts, const double defaultFps, const int frameWidth,
+                   const int frameHeight);
+
+  //! Subsampling factor from the region to the output size
+  int step() const { return m_step; }
+  //! Region, step and output size of recorded frames, as stored in Recording::depthGeometry
+  StreamGeometry geometry() const;
+
+  //! Crops depth and bodyIndex frames and packs them into out (3 bytes per output pixel, see DepthPacking.h). Uses
+  //! scratch buffers of the stage when subsampling, so only one thread may pack at a time
+  void pack(const UINT16* depth, const BYTE* bodyIndex, uint8_t* out);
+
+  //! Crops a frame of bytesPerPixel bytes per pixel (such as registered color) to dst, contiguous of the output size
+  void crop(const BYTE* frame, const int bytesPerPixel, BYTE* dst) const;
+
+  //! Rays of output pixels, from rays of all frameWidth x frameHeight sensor pixels (empty if table is not of that
+  //! size)
+  std::vector<std::pair<float, float>> cropRays(const std::vector<std::pair<float, float>>& table) const;
+
+ private:
+  int m_step;
+  std::vector<UINT16> m_depthScratch;
+  std::vector<BYTE> m_bodyIndexScratch;
+};
+
+#endif  // KINECTONETRACKER_STREAMSTAGE_H_
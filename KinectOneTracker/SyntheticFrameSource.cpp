@@ -0,0 +1,184 @@
+#include "./SyntheticFrameSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "./KinectOneListener.h"
+
+// Approximate camera intrinsics of the KinectOne depth camera
+static const float
+  kDepthFx = 361.56f,
+  kDepthFy = 367.19f,
+  kDepthCx = 256.f,
+  kDepthCy = 212.f;
+
+// Rest pose joint offsets (meters) relative to SpineBase, indexed by Skeleton::JointType
+static const float kRestPose[Skeleton::JointType_Count][3] = {
+  {  0.00f,  0.00f,  0.00f }, {  0.00f,  0.30f,  0.00f }, {  0.00f,  0.55f,  0.00f }, {  0.00f,  0.70f,  0.00f },
+  { -0.18f,  0.48f,  0.00f }, { -0.30f,  0.25f,  0.00f }, { -0.35f,  0.02f,  0.00f }, { -0.36f, -0.05f,  0.00f },
+  {  0.18f,  0.48f,  0.00f }, {  0.30f,  0.25f,  0.00f }, {  0.35f,  0.02f,  0.00f }, {  0.36f, -0.05f,  0.00f },
+  { -0.10f, -0.05f,  0.00f }, { -0.11f, -0.48f,  0.00f }, { -0.12f, -0.88f,  0.00f }, { -0.12f, -0.93f, -0.08f },
+  {  0.10f, -0.05f,  0.00f }, {  0.11f, -0.48f,  0.00f }, {  0.12f, -0.88f,  0.00f }, {  0.12f, -0.93f, -0.08f },
+  {  0.00f,  0.48f,  0.00f }, { -0.37f, -0.13f,  0.00f }, { -0.33f, -0.07f, -0.03f }, {  0.37f, -0.13f,  0.00f },
+  {  0.33f, -0.07f, -0.03f }
+};
+
+// Position of the SpineBase of body b at rest
+inline void bodyRestPosition(const int b, float* xyz) {
+  xyz[0] = -1.0f + 0.5f * b;
+  xyz[1] = 0.0f;
+  xyz[2] = 2.5f + 0.3f * (b % 2);
+}
+
+SyntheticFrameSource::SyntheticFrameSource(const double fps, const int numBodies, const int numVariants)
+  : m_fps(fps)
+  , m_numBodies(std::max(0, std::min(numBodies, static_cast<int>(BODY_COUNT))))
+  , m_numVariants(std::max(1, numVariants))
+  , m_frameDeltaTime(static_cast<INT64>(1.0E7 / (fps > 0 ? fps : 30.0)))
+  , m_skel()
+  , m_relativeTime(0)
+  , m_frameCount(0) { }
+
+bool SyntheticFrameSource::init() {
+  m_colorFrames.resize(m_numVariants);
+  m_depthFrames.resize(m_numVariants);
+  m_bodyIndexFrames.resize(m_numVariants);
+  for (int v = 0; v < m_numVariants; ++v) {
+    m_colorFrames[v].resize(kColorWidth * kColorHeight * 2);
+    m_depthFrames[v].resize(kDepthWidth * kDepthHeight);
+    m_bodyIndexFrames[v].resize(kDepthWidth * kDepthHeight);
+    generateColor(v, m_colorFrames[v].data());
+    generateDepthAndBodyIndex(v, m_depthFrames[v].data(), m_bodyIndexFrames[v].data());
+  }
+  m_relativeTime = 0;
+  m_frameCount = 0;
+  return true;
+}
+
+void SyntheticFrameSource::generateColor(const int variant, BYTE* out) const {
+  // YUY2: each pair of pixels is stored as Y0 U Y1 V
+  for (int y = 0; y < kColorHeight; ++y) {
+    BYTE* row = out + y * kColorWidth * 2;
+    for (int x = 0; x < kColorWidth; x += 2) {
+      BYTE* p = row + x * 2;
+      p[0] = static_cast<BYTE>((x + y + variant * 16) & 0xff);
+      p[1] = static_cast<BYTE>(128 + ((x >> 4) & 63));
+      p[2] = static_cast<BYTE>((x + 1 + y + variant * 16) & 0xff);
+      p[3] = static_cast<BYTE>(128 - ((y >> 3) & 63));
+    }
+  }
+}
+
+void SyntheticFrameSource::generateDepthAndBodyIndex(const int variant, UINT16* depthOut, BYTE* bodyIndexOut) const {
+  // Background is a floor-to-wall ramp with bodies as boxes in front of it
+  for (int j = 0; j < kDepthHeight; ++j) {
+    for (int i = 0; i < kDepthWidth; ++i) {
+      const int idx = j * kDepthWidth + i;
+      depthOut[idx] = static_cast<UINT16>(1500 + 3 * j + ((i + variant * 4) & 31));
+      bodyIndexOut[idx] = 0xff;
+    }
+  }
+  for (int b = 0; b < m_numBodies; ++b) {
+    float p[3];
+    bodyRestPosition(b, p);
+    const int
+      u0 = static_cast<int>(kDepthCx + kDepthFx * (p[0] - 0.25f) / p[2]) + variant * 4,
+      u1 = static_cast<int>(kDepthCx + kDepthFx * (p[0] + 0.25f) / p[2]) + variant * 4,
+      v0 = static_cast<int>(kDepthCy - kDepthFy * (p[1] + 0.8f) / p[2]),
+      v1 = static_cast<int>(kDepthCy - kDepthFy * (p[1] - 0.95f) / p[2]);
+    const UINT16 d = static_cast<UINT16>(p[2] * 1000.f);
+    for (int j = std::max(0, v0); j < std::min(v1, static_cast<int>(kDepthHeight)); ++j) {
+      for (int i = std::max(0, u0); i < std::min(u1, static_cast<int>(kDepthWidth)); ++i) {
+        const int idx = j * kDepthWidth + i;
+        depthOut[idx] = d;
+        bodyIndexOut[idx] = static_cast<BYTE>(b);
+      }
+    }
+  }
+}
+
+void SyntheticFrameSource::updateSkeleton(const int body, const INT64 nTime) {
+  const float t = static_cast<float>(nTime * 1.0E-7);
+  float base[3];
+  bodyRestPosition(body, base);
+  base[0] += 0.2f * std::sin(0.5f * t + body);
+  const float wave = 0.1f * std::sin(2.0f * t + body);
+  const float yaw = 0.3f * std::sin(0.25f * t + body);
+
+  m_skel.trackingId = 72057594037927936ull + body;
+  m_skel.timestamp = nTime;
+  for (int j = 0; j < Skeleton::JointType_Count; ++j) {
+    auto& pOut = m_skel.jointPositions[j];
+    pOut[0] = base[0] + kRestPose[j][0];
+    pOut[1] = base[1] + kRestPose[j][1];
+    pOut[2] = base[2] + kRestPose[j][2];
+    if (j == Skeleton::JointType_HandLeft || j == Skeleton::JointType_HandRight ||
+        j == Skeleton::JointType_HandTipLeft || j == Skeleton::JointType_HandTipRight) {
+      pOut[1] += wave;
+    }
+    m_skel.jointConfidences[j] = (j >= Skeleton::JointType_HandTipLeft) ? 0.5f : 1.0f;
+    auto& qOut = m_skel.jointOrientations[j];
+    qOut[0] = 0.0f;  qOut[1] = std::sin(0.5f * yaw);  qOut[2] = 0.0f;  qOut[3] = std::cos(0.5f * yaw);
+  }
+  const bool closed = wave > 0;
+  m_skel.handLeftState = closed ? Skeleton::HandState_Closed : Skeleton::HandState_Open;
+  m_skel.handRightState = closed ? Skeleton::HandState_Open : Skeleton::HandState_Closed;
+  m_skel.handLeftConfidence = Skeleton::TrackingConfidence_High;
+  m_skel.handRightConfidence = Skeleton::TrackingConfidence_Low;
+  for (int a = 0; a < Skeleton::Activity_Count; ++a) { m_skel.activities[a] = Skeleton::DetectionResult_No; }
+  m_skel.leanLeftRight = 0.5f * std::sin(0.5f * t + body);
+  m_skel.leanForwardBack = 0.0f;
+  m_skel.leanConfidence = 1.0f;
+  m_skel.clippedEdges = Skeleton::FrameEdge_None;
+}
+
+bool SyntheticFrameSource::update(const int streams, KinectOneListener* sink) {
+  if (m_colorFrames.empty()) { return false; }
+
+  if (m_fps > 0) {
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / m_fps));
+    const auto now = std::chrono::steady_clock::now();
+    if (m_frameCount == 0 || now > m_nextFrameTime + period) {
+      m_nextFrameTime = now;  // First frame or fell behind: resynchronize instead of bursting
+    }
+    std::this_thread::sleep_until(m_nextFrameTime);
+    m_nextFrameTime += period;
+  }
+
+  const int variant = static_cast<int>(m_frameCount % m_numVariants);
+  const INT64 nTime = m_relativeTime;
+
+  if (streams & Stream_Color) {
+    const std::vector<BYTE>& color = m_colorFrames[variant];
+    sink->onColor(nTime, static_cast<UINT>(color.size()), reinterpret_cast<const RGBQUAD*>(color.data()));
+  }
+  if (streams & Stream_DepthAndBodyIndex) {
+    const std::vector<UINT16>& depth = m_depthFrames[variant];
+    const std::vector<BYTE>& bodyIndex = m_bodyIndexFrames[variant];
+    sink->onDepthAndBodyIndex(nTime, static_cast<UINT>(depth.size()), depth.data(),
+                              static_cast<UINT>(bodyIndex.size()), bodyIndex.data());
+  }
+  if (streams & Stream_Body) {
+    for (int b = 0; b < m_numBodies; ++b) {
+      updateSkeleton(b, nTime);
+      sink->onSkeleton(&m_skel);
+    }
+  }
+
+  m_relativeTime += m_frameDeltaTime;
+  ++m_frameCount;
+  return true;
+}
+
+std::vector<std::pair<float, float>> SyntheticFrameSource::getDepthPixelCoordsInCameraSpace() {
+  std::vector<std::pair<float, float>> out(kDepthWidth * kDepthHeight);
+  for (int j = 0; j < kDepthHeight; ++j) {
+    for (int i = 0; i < kDepthWidth; ++i) {
+      out[j * kDepthWidth + i] = std::make_pair((i - kDepthCx) / kDepthFx, (kDepthCy - j) / kDepthFy);
+    }
+  }
+  return out;
+}
@@ -0,0 +1,54 @@
+#ifndef KINECTONETRACKER_SYNTHETICFRAMESOURCE_H_
+#define KINECTONETRACKER_SYNTHETICFRAMESOURCE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "./KinectTypes.h"
+#include "./KinectOneFrameSource.h"
+#include "./Recording.h"
+
+//! Hardware-free frame source generating sensor-shaped frames: 1920x1080 YUY2 color, 512x424 depth and body index,
+//! and up to BODY_COUNT moving skeletons. Frames are pre-generated at init() so that update() costs little more
+//! than the listener callbacks themselves, which makes it suitable for load-testing the recording pipeline.
+class SyntheticFrameSource : public KinectOneFrameSource {
+ public:
+  static const int
+    kDepthWidth   = 512,
+    kDepthHeight  = 424,
+    kColorWidth   = 1920,
+    kColorHeight  = 1080;
+
+  //! Generates frames at fps (fps <= 0 generates them as fast as update() is called) with numBodies tracked bodies.
+  //! Device timestamps always advance at the nominal sensor rate (fps, or 30 when unpaced).
+  //! numVariants distinct frames are pre-generated and cycled through.
+  explicit SyntheticFrameSource(const double fps = 30.0, const int numBodies = 2, const int numVariants = 8);
+
+  bool init();
+  bool update(const int streams, KinectOneListener* sink);
+  std::vector<std::pair<float, float>> getDepthPixelCoordsInCameraSpace();
+
+  //! Number of frame sets delivered so far
+  uint64_t getFrameCount() const { return m_frameCount; }
+
+ private:
+  void generateColor(const int variant, BYTE* out) const;
+  void generateDepthAndBodyIndex(const int variant, UINT16* depthOut, BYTE* bodyIndexOut) const;
+  void updateSkeleton(const int body, const INT64 nTime);
+
+  const double m_fps;
+  const int m_numBodies;
+  const int m_numVariants;
+  const INT64 m_frameDeltaTime;
+  std::vector<std::vector<BYTE>> m_colorFrames;
+  std::vector<std::vector<UINT16>> m_depthFrames;
+  std::vector<std::vector<BYTE>> m_bodyIndexFrames;
+  Skeleton m_skel;
+  INT64 m_relativeTime;
+  uint64_t m_frameCount;
+  std::chrono::steady_clock::time_point m_nextFrameTime;
+};
+
+#endif  // KINECTONETRACKER_SYNTHETICFRAMESOURCE_H_
@@ -0,0 +1,100 @@
+#include "./ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+
+ThreadPool::ThreadPool(const size_t numThreads, const size_t maxQueued)
+  : m_maxQueued(maxQueued)
+  , m_numRunning(0)
+  , m_stopping(false) {
+  const size_t n = (numThreads > 0) ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < n; ++i) { m_workers.emplace_back(&ThreadPool::workLoop, this); }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_taskCv.notify_all();
+  for (std::thread& t : m_workers) { t.join(); }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_maxQueued > 0) { m_roomCv.wait(lock, [&] { return m_tasks.size() < m_maxQueued; }); }
+    m_tasks.push_back(std::move(task));
+  }
+  m_taskCv.notify_one();
+}
+
+bool ThreadPool::trySubmit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_maxQueued > 0 && m_tasks.size() >= m_maxQueued) { return false; }
+    m_tasks.push_back(std::move(task));
+  }
+  m_taskCv.notify_one();
+  return true;
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idleCv.wait(lock, [&] { return m_tasks.empty() && m_numRunning == 0; });
+}
+
+size_t ThreadPool::numQueued() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_tasks.size();
+}
+
+void ThreadPool::workLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_taskCv.wait(lock, [&] { return !m_tasks.empty() || m_stopping; });
+    if (m_tasks.empty()) { break; }
+    std::function<void()> task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    ++m_numRunning;
+    lock.unlock();
+    m_roomCv.notify_one();
+    task();
+    lock.lock();
+    --m_numRunning;
+    if (m_tasks.empty() && m_numRunning == 0) { m_idleCv.notify_all(); }
+  }
+}
+
+void ThreadPool::parallelFor(const size_t n, const std::function<void(size_t)>& f) {
+  if (n == 0) { return; }
+  // Shared with helper tasks, which may only start running after all indices have been claimed (e.g. behind other
+  // queued tasks); they then return without touching f
+  struct State {
+    std::atomic<size_t> next, done;
+    std::mutex mutex;
+    std::condition_variable doneCv;
+  };
+  std::shared_ptr<State> state = std::make_shared<State>();
+  state->next = 0;
+  state->done = 0;
+  const std::function<void(size_t)>* pf = &f;
+  const auto work = [state, pf, n] () {
+    size_t numDone = 0;
+    for (size_t i = state->next++; i < n; i = state->next++) {
+      (*pf)(i);
+      ++numDone;
+    }
+    if (numDone > 0 && (state->done += numDone) == n) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->doneCv.notify_all();
+    }
+  };
+  const size_t numHelpers = std::min(n - 1, m_workers.size());
+  for (size_t h = 0; h < numHelpers; ++h) {
+    if (!trySubmit(work)) { break; }  // Queue full: the calling thread picks up the slack
+  }
+  work();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->doneCv.wait(lock, [&] { return state->done == n; });
+}
@@ -0,0 +1,55 @@
+#ifndef KINECTONETRACKER_THREADPOOL_H_
+#define KINECTONETRACKER_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fixed set of worker threads running queued tasks in FIFO order. The queue can be bounded, in which case
+//! submit() waits for room and trySubmit() fails instead, so that producers choose between backpressure and
+//! dropping work. Destruction finishes all queued tasks.
+class ThreadPool {
+ public:
+  //! Starts numThreads workers (0 = one per hardware thread). maxQueued bounds the number of tasks waiting to run
+  //! (0 = unbounded)
+  explicit ThreadPool(const size_t numThreads = 0, const size_t maxQueued = 0);
+  ~ThreadPool();
+
+  //! Queues task, waiting while the queue is full
+  void submit(std::function<void()> task);
+
+  //! Queues task unless the queue is full. Returns whether it was queued
+  bool trySubmit(std::function<void()> task);
+
+  //! Waits until all queued and running tasks have finished
+  void wait();
+
+  //! Runs f(i) for i in [0, n) on the workers and the calling thread, returning once all calls have finished.
+  //! Indices are handed out dynamically, so uneven work balances itself
+  void parallelFor(const size_t n, const std::function<void(size_t)>& f);
+
+  size_t numThreads() const { return m_workers.size(); }
+  //! Number of tasks waiting to run
+  size_t numQueued() const;
+
+ private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  void workLoop();
+
+  const size_t m_maxQueued;
+  std::vector<std::thread> m_workers;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_taskCv, m_roomCv, m_idleCv;
+  std::deque<std::function<void()>> m_tasks;
+  size_t m_numRunning;
+  bool m_stopping;
+};
+
+#endif  // KINECTONETRACKER_THREADPOOL_H_
@@ -0,0 +1,55 @@
+#include "./WaitStrategy.h"
+
+#include <algorithm>
+
+AdaptiveWait::AdaptiveWait(const WaitPolicy& policy)
+  : m_policy(policy)
+  , m_numParked(0)
+  , m_notifyTimeNs(0)
+  , m_waits(0)
+  , m_spins(0)
+  , m_yields(0)
+  , m_parks(0)
+  , m_wakeups(0)
+  , m_timeouts(0)
+  , m_wakeLatencySumNs(0)
+  , m_wakeLatencyMaxNs(0) { }
+
+void AdaptiveWait::notify() {
+  // Pairs with the seq_cst increment of m_numParked in wait(): either the waiter sees the new state
+  // when it re-checks under the lock, or we see it parked and signal it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_numParked.load(std::memory_order_relaxed) == 0) { return; }
+  m_notifyTimeNs.store(nowNs(), std::memory_order_relaxed);
+  { std::lock_guard<std::mutex> lock(m_mutex); }
+  m_cv.notify_one();
+}
+
+void AdaptiveWait::recordWakeup() {
+  const int64_t latency = std::max<int64_t>(0, nowNs() - m_notifyTimeNs.load(std::memory_order_relaxed));
+  bump(m_wakeups);
+  m_wakeLatencySumNs.store(m_wakeLatencySumNs.load(std::memory_order_relaxed) + latency,
+                           std::memory_order_relaxed);
+  if (static_cast<uint64_t>(latency) > m_wakeLatencyMaxNs.load(std::memory_order_relaxed)) {
+    m_wakeLatencyMaxNs.store(latency, std::memory_order_relaxed);
+  }
+}
+
+WaitStats AdaptiveWait::stats() const {
+  WaitStats s;
+  s.waits = m_waits.load(std::memory_order_relaxed);
+  s.spins = m_spins.load(std::memory_order_relaxed);
+  s.yields = m_yields.load(std::memory_order_relaxed);
+  s.parks = m_parks.load(std::memory_order_relaxed);
+  s.wakeups = m_wakeups.load(std::memory_order_relaxed);
+  s.timeouts = m_timeouts.load(std::memory_order_relaxed);
+  s.wakeLatencySumNs = m_wakeLatencySumNs.load(std::memory_order_relaxed);
+  s.wakeLatencyMaxNs = m_wakeLatencyMaxNs.load(std::memory_order_relaxed);
+  return s;
+}
+
+std::ostream& operator<<(std::ostream& os, const WaitStats& s) {  // NOLINT
+  return os << "waits=" << s.waits << " spun=" << s.spins << " yielded=" << s.yields << " parked=" << s.parks
+            << " woken=" << s.wakeups << " timeouts=" << s.timeouts
+            << " wakeLatency(mean/max us)=" << s.meanWakeLatencyMicros() << "/" << s.wakeLatencyMaxNs * 1.0E-3;
+}
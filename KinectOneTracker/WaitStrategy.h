@@ -0,0 +1,135 @@
+#ifndef KINECTONETRACKER_WAITSTRATEGY_H_
+#define KINECTONETRACKER_WAITSTRATEGY_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+//! How an AdaptiveWait backs off: busy-poll spinIterations times, then yield the core yieldIterations times,
+//! then park on a condition variable until notified. Parking re-checks the condition at least every
+//! parkTimeoutMicros so that a missed notification only costs latency.
+struct WaitPolicy {
+  unsigned spinIterations;
+  unsigned yieldIterations;
+  unsigned parkTimeoutMicros;
+
+  explicit WaitPolicy(const unsigned spins = 256, const unsigned yields = 16, const unsigned parkMicros = 5000)
+    : spinIterations(spins), yieldIterations(yields), parkTimeoutMicros(parkMicros) { }
+
+  //! Never parks, trading a core for minimum latency (the old busy-wait behavior)
+  static WaitPolicy spinning() { return WaitPolicy(~0u, 0, 0); }
+};
+
+//! Counters describing how waits were satisfied
+struct WaitStats {
+  uint64_t waits;             // Number of wait() calls that did not succeed immediately
+  uint64_t spins;             // Waits satisfied while spinning
+  uint64_t yields;            // Waits satisfied while yielding
+  uint64_t parks;             // Number of times the waiter parked
+  uint64_t wakeups;           // Parks ended by notify()
+  uint64_t timeouts;          // Waits that gave up at their deadline
+  uint64_t wakeLatencySumNs;  // Sum of notify() to wakeup latencies
+  uint64_t wakeLatencyMaxNs;  // Maximum notify() to wakeup latency
+
+  double meanWakeLatencyMicros() const { return wakeups ? wakeLatencySumNs * 1.0E-3 / wakeups : 0.0; }
+};
+
+std::ostream& operator<<(std::ostream& os, const WaitStats& s);  // NOLINT
+
+//! Spin, then yield, then park wait for a single waiting thread, woken by notify() from another thread.
+//! notify() only takes a lock when the waiter is actually parked, so it is cheap on the hot path.
+class AdaptiveWait {
+ public:
+  explicit AdaptiveWait(const WaitPolicy& policy = WaitPolicy());
+
+  const WaitPolicy& policy() const { return m_policy; }
+
+  //! Waits until ready() returns true, backing off according to the policy. Gives up after timeoutMicros
+  //! (0 = wait forever). Returns the last value of ready()
+  template <typename Pred>
+  bool wait(Pred ready, const uint64_t timeoutMicros = 0);
+
+  //! Wakes the waiter if it is parked. Call after making the awaited condition true
+  void notify();
+
+  //! Snapshot of counters (may be read from any thread)
+  WaitStats stats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+  void recordWakeup();
+  static void bump(std::atomic<uint64_t>& counter) {  // NOLINT
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  const WaitPolicy m_policy;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::atomic<int> m_numParked;
+  std::atomic<int64_t> m_notifyTimeNs;
+  // Written only by the waiting thread
+  std::atomic<uint64_t>
+    m_waits,
+    m_spins,
+    m_yields,
+    m_parks,
+    m_wakeups,
+    m_timeouts,
+    m_wakeLatencySumNs,
+    m_wakeLatencyMaxNs;
+};
+
+template <typename Pred>
+bool AdaptiveWait::wait(Pred ready, const uint64_t timeoutMicros) {
+  if (ready()) { return true; }
+  bump(m_waits);
+  const bool hasDeadline = timeoutMicros > 0;
+  const Clock::time_point deadline = Clock::now() + std::chrono::microseconds(timeoutMicros);
+
+  for (unsigned i = 0; i < m_policy.spinIterations; ++i) {
+    if (ready()) { bump(m_spins); return true; }
+    if (hasDeadline && (i & 63) == 63 && Clock::now() >= deadline) { bump(m_timeouts); return false; }
+  }
+  for (unsigned i = 0; i < m_policy.yieldIterations; ++i) {
+    std::this_thread::yield();
+    if (ready()) { bump(m_yields); return true; }
+    if (hasDeadline && Clock::now() >= deadline) { bump(m_timeouts); return false; }
+  }
+  if (m_policy.parkTimeoutMicros == 0) {  // Policy never parks: keep yielding
+    while (!ready()) {
+      if (hasDeadline && Clock::now() >= deadline) { bump(m_timeouts); return false; }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  while (true) {
+    Clock::time_point wakeBy = Clock::now() + std::chrono::microseconds(m_policy.parkTimeoutMicros);
+    if (hasDeadline && deadline < wakeBy) { wakeBy = deadline; }
+    bool isReady, notified = false;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_numParked.fetch_add(1, std::memory_order_seq_cst);
+      isReady = ready();
+      if (!isReady) {
+        bump(m_parks);
+        notified = (m_cv.wait_until(lock, wakeBy) == std::cv_status::no_timeout);
+      }
+      m_numParked.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (isReady) { return true; }
+    if (notified) { recordWakeup(); }
+    if (ready()) { return true; }
+    if (hasDeadline && Clock::now() >= deadline) { bump(m_timeouts); return false; }
+  }
+}
+
+#endif  // KINECTONETRACKER_WAITSTRATEGY_H_
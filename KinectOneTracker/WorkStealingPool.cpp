@@ -0,0 +1,105 @@
+#include "./WorkStealingPool.h"
+
+#include <algorithm>
+
+// Pool and deque of the calling thread, if it is a worker
+static thread_local const WorkStealingPool* t_pool = nullptr;
+static thread_local size_t t_queue = 0;
+
+WorkStealingPool::WorkStealingPool(const size_t numThreads)
+  : m_numQueued(0)
+  , m_numSteals(0)
+  , m_stopping(false) {
+  const size_t n = (numThreads > 0) ? numThreads : std::max(2u, std::thread::hardware_concurrency()) - 1;
+  for (size_t i = 0; i <= n; ++i) { m_queues.emplace_back(new Queue()); }
+  for (size_t i = 0; i < n; ++i) { m_workers.emplace_back(&WorkStealingPool::workLoop, this, i); }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stopping = true;
+  }
+  m_sleepCv.notify_all();
+  for (std::thread& t : m_workers) { t.join(); }
+}
+
+size_t WorkStealingPool::queueIndex() const {
+  return (t_pool == this) ? t_queue : m_queues.size() - 1;
+}
+
+void WorkStealingPool::push(Task task) {
+  Queue& q = *m_queues[queueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back(std::move(task));
+  }
+  ++m_numQueued;
+  // Taking the lock orders the count before the check of a thread about to sleep
+  { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+  m_sleepCv.notify_one();
+}
+
+bool WorkStealingPool::runOne(const size_t self) {
+  Task task;
+  bool found = false;
+  {
+    Queue& q = *m_queues[self];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+      found = true;
+    }
+  }
+  const size_t numQueues = m_queues.size();
+  for (size_t k = 1; k < numQueues && !found; ++k) {
+    const size_t victim = (self + k) % numQueues;
+    Queue& q = *m_queues[victim];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      found = true;
+      // Tasks queued from outside the pool are there for any worker to take
+      if (victim != numQueues - 1) { ++m_numSteals; }
+    }
+  }
+  if (!found) { return false; }
+  --m_numQueued;
+  task.f();
+  // The group may be destroyed as soon as its count reaches 0, so only the pool is touched after that
+  if (--task.group->m_numPending == 0) {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_sleepCv.notify_all();
+  }
+  return true;
+}
+
+void WorkStealingPool::workLoop(const size_t self) {
+  t_pool = this;
+  t_queue = self;
+  while (true) {
+    if (runOne(self)) { continue; }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_sleepCv.wait(lock, [&] { return m_numQueued > 0 || m_stopping; });
+    if (m_stopping && m_numQueued == 0) { break; }
+  }
+}
+
+void WorkStealingPool::TaskGroup::run(std::function<void()> task) {
+  ++m_numPending;
+  Task t;
+  t.f = std::move(task);
+  t.group = this;
+  m_pool.push(std::move(t));
+}
+
+void WorkStealingPool::TaskGroup::wait() {
+  const size_t self = m_pool.queueIndex();
+  while (m_numPending > 0) {
+    if (m_pool.runOne(self)) { continue; }
+    std::unique_lock<std::mutex> lock(m_pool.m_sleepMutex);
+    m_pool.m_sleepCv.wait(lock, [&] { return m_numPending == 0 || m_pool.m_numQueued > 0; });
+  }
+}
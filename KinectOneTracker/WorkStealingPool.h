@@ -0,0 +1,84 @@
+#ifndef KINECTONETRACKER_WORKSTEALINGPOOL_H_
+#define KINECTONETRACKER_WORKSTEALINGPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fork-join thread pool for nested parallelism, such as tasks per file that split into tasks per frame range. Each
+//! worker has its own deque of tasks: it runs its newest task first (depth first, so that a file is finished before
+//! the next one is started) and, when out of work, steals the oldest task of another worker (the largest remaining
+//! piece of work). Tasks are grouped in TaskGroups, and a thread waiting for a group runs queued tasks meanwhile
+//! instead of blocking, so that tasks can wait for subtasks without tying up workers or deadlocking.
+class WorkStealingPool {
+ public:
+  //! Starts numThreads workers (0 = one per hardware thread, less the calling thread, which helps while it waits)
+  explicit WorkStealingPool(const size_t numThreads = 0);
+  //! Finishes all queued tasks
+  ~WorkStealingPool();
+
+  //! Set of tasks that can be waited for together. Tasks may run further groups of their own
+  class TaskGroup {
+   public:
+    explicit TaskGroup(WorkStealingPool& pool) : m_pool(pool), m_numPending(0) { }  // NOLINT
+    //! Waits for all tasks
+    ~TaskGroup() { wait(); }
+
+    //! Queues task, on the calling worker's own deque if called from a task of the pool
+    void run(std::function<void()> task);
+    //! Runs queued tasks of the pool (of any group) until all tasks of this group have finished
+    void wait();
+
+   private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+    friend class WorkStealingPool;
+
+    WorkStealingPool& m_pool;
+    std::atomic<size_t> m_numPending;
+  };
+
+  size_t numThreads() const { return m_workers.size(); }
+  //! Number of tasks run by a thread other than the one that queued them
+  uint64_t numSteals() const { return m_numSteals; }
+
+ private:
+  WorkStealingPool(const WorkStealingPool&);
+  WorkStealingPool& operator=(const WorkStealingPool&);
+
+  struct Task {
+    std::function<void()> f;
+    TaskGroup* group;
+  };
+
+  // Deque of one worker, or (last) of the threads outside the pool
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void push(Task task);
+  //! Runs one queued task, own newest first and else stolen oldest first. Returns false if there was none
+  bool runOne(const size_t self);
+  void workLoop(const size_t self);
+  //! Index of the calling thread's deque
+  size_t queueIndex() const;
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::atomic<size_t> m_numQueued;
+  std::atomic<uint64_t> m_numSteals;
+  // Idle threads sleep until tasks are queued or a group they wait for completes
+  std::mutex m_sleepMutex;
+  std::condition_variable m_sleepCv;
+  bool m_stopping;
+  std::vector<std::thread> m_workers;
+};
+
+#endif  // KINECTONETRACKER_WORKSTEALINGPOOL_H_
@@ -0,0 +1,309 @@
+// Offline reprocessing of a directory of recordings: decodes each depth stream (<id>.depth.kdc), re-exports its point
+// clouds, regenerates the JSON header from the skeleton log (<id>.skel) and computes per-recording stats, written
+// to <id>.reprocess.json and printed as one CSV row per recording. Recordings run concurrently, and the frames of
+// each are split into ranges of framesPerTask frames, all on one WorkStealingPool, so that a few long recordings
+// are spread over all cores as well as many short ones.
+//
+// Point clouds are reprojected with the default depth intrinsics, as by a recorder without the sensor's ray table,
+// cropped to the region and step that the depth frames were recorded with (Recording::depthGeometry), and written
+// as in the recorder (see PointCloudExporter.h): chunked to <id>.pcs, one <id>.<frame index>.ply per frame, or not
+// at all.
+//
+// Usage: batch_reprocess inputDir [outputDir=inputDir] [pointClouds=pcs (ply, none)]
+//                        [numThreads=0 (all cores, at least 2 counting the calling thread)] [framesPerTask=16]
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "./Benchmark.h"
+#include "./DepthCodec.h"
+#include "./DepthReprojector.h"
+#include "./JsonWriter.h"
+#include "./PointCloudExporter.h"
+#include "./Recording.h"
+#include "./StreamStage.h"
+#include "./WorkStealingPool.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+namespace fs = std::filesystem;
+
+static const char* kSkeletonLogSuffix = ".skel";
+static const char* kDepthStreamSuffix = ".depth.kdc";
+// Size of sensor depth frames, which recorded depth frames are regions of (see Recording::depthGeometry)
+static const int kSensorDepthWidth = 512, kSensorDepthHeight = 424;
+
+enum PointCloudOutput { PointClouds_None, PointClouds_Ply, PointClouds_Pcs };
+
+// Totals of a range of depth frames, summed over the ranges of a recording
+struct DepthStats {
+  uint64_t numFrames, numCorrupt, numPoints, numDepthPixels, numBodyPixels;
+
+  DepthStats() : numFrames(0), numCorrupt(0), numPoints(0), numDepthPixels(0), numBodyPixels(0) { }
+  DepthStats& operator+=(const DepthStats& o) {
+    numFrames += o.numFrames;
+    numCorrupt += o.numCorrupt;
+    numPoints += o.numPoints;
+    numDepthPixels += o.numDepthPixels;
+    numBodyPixels += o.numBodyPixels;
+    return *this;
+  }
+};
+
+struct RecordingStats {
+  string name;
+  bool ok;
+  uint64_t numSkeletons, numColorFrames, numDepthFrames, numDroppedColor, numDroppedDepth;
+  DepthStats depth;
+  uint64_t numPixels;                   // Per depth frame
+  int64_t firstTime, lastTime, maxGap;  // Depth frame timestamps and largest interval between consecutive frames
+  double seconds;                       // Processing time
+
+  RecordingStats() : ok(true), numSkeletons(0), numColorFrames(0), numDepthFrames(0), numDroppedColor(0),
+    numDroppedDepth(0), numPixels(0), firstTime(0), lastTime(0), maxGap(0), seconds(0) { }
+};
+
+//! Names (file names without suffix) of the recordings in dir with a skeleton log or a depth stream, in order
+std::vector<string> findRecordings(const string& dir) {
+  std::set<string> names;
+  std::error_code ec;
+  for (const fs::directory_entry& e : fs::directory_iterator(dir, ec)) {
+    if (!e.is_regular_file(ec)) { continue; }
+    const string file = e.path().filename().string();
+    for (const string suffix : { kSkeletonLogSuffix, kDepthStreamSuffix }) {
+      if (file.size() > suffix.size() && file.compare(file.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        names.insert(file.substr(0, file.size() - suffix.size()));
+      }
+    }
+  }
+  if (ec) { cerr << "Could not list " << dir << ": " << ec.message() << endl; }
+  return std::vector<string>(names.begin(), names.end());
+}
+
+//! Decodes depth frames [first, last) of reader and, given an exporter, reprojects them with reprojector (sized as
+//! the frames) and writes their point clouds
+DepthStats processDepthRange(const DepthStreamReader& reader, const uint64_t first, const uint64_t last,
+                             const DepthReprojector* reprojector, PointCloudExporter* exporter) {
+  const size_t numPixels = static_cast<size_t>(reader.width()) * reader.height();
+  std::vector<UINT16> depth(numPixels);
+  std::vector<BYTE> bodyIndex(numPixels);
+  std::vector<float> points(exporter ? 3 * reprojector->maxPoints() : 0);
+  DepthStats stats;
+  for (uint64_t i = first; i < last; ++i) {
+    if (!reader.read(i, depth.data(), bodyIndex.data())) {
+      ++stats.numCorrupt;
+      continue;
+    }
+    ++stats.numFrames;
+    for (size_t p = 0; p < numPixels; ++p) {
+      stats.numDepthPixels += (depth[p] != 0);
+      stats.numBodyPixels += (bodyIndex[p] != 0xff);
+    }
+    if (exporter) {
+      const size_t n = reprojector->reproject(depth.data(), bodyIndex.data(), points.data());
+      exporter->write(reader.frameTime(i), i, points.data(), n);
+      stats.numPoints += n;
+    }
+  }
+  return stats;
+}
+
+//! Reprocesses recording name of inDir into outDir, splitting its depth frames into tasks of framesPerTask frames
+RecordingStats processRecording(WorkStealingPool& pool, const string& inDir, const string& outDir,  // NOLINT
+                                const string& name, const PointCloudOutput output, const uint64_t framesPerTask) {
+  Stopwatch sw;
+  RecordingStats stats;
+  stats.name = name;
+  const string in = (fs::path(inDir) / name).string();
+  const string out = (fs::path(outDir) / name).string();
+
+  // Metadata from the skeleton log if there is one, as it gives the geometry of the depth frames. The JSON header
+  // is written while the depth frames are processed
+  Recording rec;
+  rec.id = name;
+  const bool hasLog = fs::exists(in + kSkeletonLogSuffix);
+  bool jsonOk = !hasLog || rec.loadFromLog(in + kSkeletonLogSuffix);
+  WorkStealingPool::TaskGroup tasks(pool);
+  if (hasLog && jsonOk) {
+    tasks.run([&] () { jsonOk = rec.saveToJSON(out + ".json"); });
+  }
+
+  DepthStreamReader reader;
+  std::vector<DepthStats> ranges;
+  std::unique_ptr<DepthReprojector> reprojector;
+  std::unique_ptr<PointCloudExporter> exporter;
+  if (reader.open(in + kDepthStreamSuffix)) {
+    stats.numPixels = static_cast<uint64_t>(reader.width()) * reader.height();
+    const uint64_t numFrames = reader.numFrames();
+    if (numFrames > 0) {
+      stats.firstTime = reader.frameTime(0);
+      stats.lastTime = reader.frameTime(numFrames - 1);
+      for (uint64_t i = 1; i < numFrames; ++i) {
+        stats.maxGap = std::max(stats.maxGap, reader.frameTime(i) - reader.frameTime(i - 1));
+      }
+    }
+    // Frames are reprojected and written by the range tasks, so the exporter's own worker stays idle
+    if (output != PointClouds_None && numFrames > 0) {
+      // Sized as the stream's frames, with the rays of the pixels of sensor frames they were recorded from
+      reprojector.reset(new DepthReprojector(reader.width(), reader.height()));
+      const StreamGeometry& g = rec.depthGeometry;
+      const DepthStreamStage stage(streamStageOptions(g), 0, kSensorDepthWidth, kSensorDepthHeight);
+      const DepthReprojector sensor(kSensorDepthWidth, kSensorDepthHeight);
+      const bool matches = stage.geometry() == g && g.width == reader.width() && g.height == reader.height();
+      if (!matches || !reprojector->setRayTable(stage.cropRays(sensor.rayTable()))) {
+        cerr << in << kDepthStreamSuffix << ": frames of " << reader.width() << "x" << reader.height()
+             << " do not match the recorded depth region, not exporting point clouds" << endl;
+        stats.ok = false;
+        reprojector.reset();
+      }
+    }
+    if (reprojector) {
+      exporter.reset(new PointCloudExporter(*reprojector, 1, 1));
+      const PointCloudExporter::Mode mode =
+        (output == PointClouds_Pcs) ? PointCloudExporter::Mode_Chunked : PointCloudExporter::Mode_PerFrame;
+      if (!exporter->open(out, mode)) {
+        cerr << "Could not open point cloud output " << out << endl;
+        stats.ok = false;
+        exporter.reset();
+      }
+    }
+    ranges.resize(static_cast<size_t>((numFrames + framesPerTask - 1) / framesPerTask));
+    for (size_t r = 0; r < ranges.size(); ++r) {
+      tasks.run([&, r, numFrames] () {
+        const uint64_t first = r * framesPerTask;
+        const uint64_t last = std::min(first + framesPerTask, numFrames);
+        ranges[r] = processDepthRange(reader, first, last, reprojector.get(), exporter.get());
+      });
+    }
+  } else if (!hasLog) {
+    cerr << "Could not open " << in << kDepthStreamSuffix << endl;
+    stats.ok = false;
+  }
+  tasks.wait();
+
+  if (!jsonOk) {
+    cerr << "Could not regenerate " << out << ".json" << endl;
+    stats.ok = false;
+  }
+  for (const DepthStats& r : ranges) { stats.depth += r; }
+  if (exporter && !exporter->close()) {
+    cerr << "Error writing point clouds of " << out << endl;
+    stats.ok = false;
+  }
+  if (stats.depth.numCorrupt > 0) {
+    cerr << in << kDepthStreamSuffix << ": " << stats.depth.numCorrupt << " corrupt frames" << endl;
+  }
+  stats.numSkeletons = rec.numSkeletons();
+  stats.numColorFrames = rec.colorTimestamps.size();
+  stats.numDepthFrames = hasLog ? rec.depthTimestamps.size() : reader.numFrames();
+  stats.numDroppedColor = rec.droppedColorTimestamps.size();
+  stats.numDroppedDepth = rec.droppedDepthTimestamps.size();
+  stats.seconds = sw.seconds();
+  return stats;
+}
+
+bool writeStats(const RecordingStats& s, const string& file) {
+  std::ofstream ofs(file, std::ios::binary);
+  if (!ofs.is_open()) { return false; }
+  const double frames = static_cast<double>(std::max<uint64_t>(s.depth.numFrames, 1));
+  const double pixels = frames * static_cast<double>(std::max<uint64_t>(s.numPixels, 1));
+  JsonWriter w(ofs);
+  w.raw("{\n");
+  w.key("id").value(s.name).raw(",\n");
+  w.key("ok").raw(s.ok ? "true" : "false").raw(",\n");
+  w.key("numSkeletons").value(s.numSkeletons).raw(",\n");
+  w.key("numColorFrames").value(s.numColorFrames).raw(",\n");
+  w.key("numDepthFrames").value(s.numDepthFrames).raw(",\n");
+  w.key("numDroppedColorFrames").value(s.numDroppedColor).raw(",\n");
+  w.key("numDroppedDepthFrames").value(s.numDroppedDepth).raw(",\n");
+  w.key("numDecodedDepthFrames").value(s.depth.numFrames).raw(",\n");
+  w.key("numCorruptDepthFrames").value(s.depth.numCorrupt).raw(",\n");
+  w.key("firstDepthTime").value(s.firstTime).raw(",\n");
+  w.key("lastDepthTime").value(s.lastTime).raw(",\n");
+  w.key("maxDepthFrameGap").value(s.maxGap).raw(",\n");
+  w.key("meanPointsPerFrame").value(s.depth.numPoints / frames).raw(",\n");
+  w.key("meanDepthCoverage").value(s.depth.numDepthPixels / pixels).raw(",\n");
+  w.key("meanBodyCoverage").value(s.depth.numBodyPixels / pixels).raw(",\n");
+  w.key("seconds").value(s.seconds).raw("\n}\n");
+  w.flush();
+  return !ofs.fail();
+}
+
+int main(int argc, const char** argv) {
+  if (argc < 2) {
+    cerr << "Usage: batch_reprocess inputDir [outputDir=inputDir] [pointClouds=pcs (ply, none)] "
+         << "[numThreads=0 (all cores)] [framesPerTask=16]" << endl;
+    return 1;
+  }
+  const string inDir          = argv[1];
+  const string outDir         = (argc > 2) ? argv[2] : inDir;
+  const string pointClouds    = (argc > 3) ? argv[3] : "pcs";
+  const int    numThreads     = (argc > 4) ? atoi(argv[4]) : 0;
+  const int    framesPerTask  = (argc > 5) ? std::max(1, atoi(argv[5])) : 16;
+  PointCloudOutput output = PointClouds_Pcs;
+  if (pointClouds == "ply") {
+    output = PointClouds_Ply;
+  } else if (pointClouds == "none") {
+    output = PointClouds_None;
+  } else if (pointClouds != "pcs") {
+    cerr << "Unknown point cloud output " << pointClouds << " (pcs, ply or none)" << endl;
+    return 1;
+  }
+  std::error_code ec;
+  fs::create_directories(outDir, ec);
+
+  const std::vector<string> names = findRecordings(inDir);
+  if (names.empty()) {
+    cerr << "No recordings (" << kSkeletonLogSuffix << " or " << kDepthStreamSuffix << " files) in " << inDir << endl;
+    return 1;
+  }
+
+  // The calling thread works too while it waits, so one worker fewer than threads
+  WorkStealingPool pool(numThreads > 1 ? numThreads - 1 : numThreads);
+  std::vector<RecordingStats> stats(names.size());
+  std::mutex coutMutex;
+  Stopwatch sw;
+  {
+    WorkStealingPool::TaskGroup recordings(pool);
+    for (size_t i = 0; i < names.size(); ++i) {
+      recordings.run([&, i] () {
+        stats[i] = processRecording(pool, inDir, outDir, names[i], output, framesPerTask);
+        const string statsFile = (fs::path(outDir) / names[i]).string() + ".reprocess.json";
+        if (!writeStats(stats[i], statsFile)) {
+          cerr << "Could not write " << statsFile << endl;
+          stats[i].ok = false;
+        }
+        std::lock_guard<std::mutex> lock(coutMutex);
+        cout << "[" << names[i] << "] " << stats[i].depth.numFrames << " depth frames in " << stats[i].seconds
+             << " s" << endl;
+      });
+    }
+    recordings.wait();
+  }
+  const double seconds = sw.seconds();
+
+  cout << "recording,ok,skeletons,color_frames,depth_frames,decoded_frames,corrupt_frames,points_per_frame,seconds"
+       << endl;
+  uint64_t totalFrames = 0;
+  size_t numFailed = 0;
+  for (const RecordingStats& s : stats) {
+    const double frames = static_cast<double>(std::max<uint64_t>(s.depth.numFrames, 1));
+    cout << s.name << "," << s.ok << "," << s.numSkeletons << "," << s.numColorFrames << "," << s.numDepthFrames
+         << "," << s.depth.numFrames << "," << s.depth.numCorrupt << "," << s.depth.numPoints / frames << ","
+         << s.seconds << endl;
+    totalFrames += s.depth.numFrames;
+    if (!s.ok) { ++numFailed; }
+  }
+  cout << names.size() << " recordings, " << totalFrames << " depth frames in " << seconds << " s ("
+       << totalFrames / std::max(seconds, 1.0E-9) << " frames/s) on " << pool.numThreads() + 1 << " threads, "
+       << pool.numSteals() << " tasks stolen, " << numFailed << " failed" << endl;
+  return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// Benchmark of color frame conversion as done by KinectOneRecorder::consumeColor: full-resolution cv::cvtColor
+// followed by cv::resize, versus the fused half-resolution kernel (scalar, SIMD and row-parallel SIMD). Also times
+// the recorder's color stage (see StreamStage.h) copying and converting whole frames versus a centred region of
+// interest of a quarter of the frame.
+//
+// Usage: bench_color_convert
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "./Benchmark.h"
+#include "./ColorConvert.h"
+#include "./KinectOneListener.h"
+#include "./Simd.h"
+#include "./StreamStage.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+void report(const string& name, const double secs, const double baseline) {
+  cout << name << secs * 1.0E3 << " ms/frame (" << 1.0 / secs << " fps, " << baseline / secs << "x)" << endl;
+}
+
+int main() {
+  // Grab one synthetic color frame
+  struct Grabber : public KinectOneListener {
+    void onSkeleton(const Skeleton*) { }
+    void onColor(const INT64, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+      frame.create(SyntheticFrameSource::kColorHeight, SyntheticFrameSource::kColorWidth, CV_8UC2);
+      memcpy(frame.data, pColorBuffer, nColorBufferSize);
+    }
+    void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { }
+    cv::Mat frame;
+  } grabber;
+  SyntheticFrameSource source(0, 2, 1);
+  source.init();
+  source.update(KinectOneFrameSource::Stream_Color, &grabber);
+  const cv::Mat& yuy2 = grabber.frame;
+
+  cv::Mat bgrFull, bgrSmall(yuy2.rows / 2, yuy2.cols / 2, CV_8UC3), fused(bgrSmall.size(), CV_8UC3);
+  const double tOpenCV = timeIt([&] () {
+    cv::cvtColor(yuy2, bgrFull, cv::COLOR_YUV2BGR_YUY2);
+    cv::resize(bgrFull, bgrSmall, bgrSmall.size(), 0, 0, cv::INTER_LINEAR);
+  });
+  const double tScalar = timeIt([&] () {
+    yuy2ToBgrHalfRows(yuy2.data, yuy2.step, fused.data, fused.step, fused.cols, 0, fused.rows, false);
+  });
+  const double tSimd = timeIt([&] () { yuy2ToBgrHalf(yuy2, fused, false); });
+  const double tParallel = timeIt([&] () { yuy2ToBgrHalf(yuy2, fused, true); });
+
+  // Slot copy on the tracker thread plus conversion on the consumer thread, for whole frames and a region
+  StreamStageOptions roiOpts;
+  roiOpts.roi = cv::Rect(yuy2.cols / 4, yuy2.rows / 4, yuy2.cols / 2, yuy2.rows / 2);
+  ColorStreamStage wholeStage(StreamStageOptions(), 30, yuy2.cols, yuy2.rows);
+  ColorStreamStage roiStage(roiOpts, 30, yuy2.cols, yuy2.rows);
+  cv::Mat wholeSlot(yuy2.size(), CV_8UC2), roiSlot(roiStage.roi().size(), CV_8UC2), stageOut;
+  const double tStage = timeIt([&] () {
+    wholeStage.crop(yuy2.data, wholeSlot.data);
+    wholeStage.convert(wholeSlot, stageOut, false);
+  });
+  const double tStageRoi = timeIt([&] () {
+    roiStage.crop(yuy2.data, roiSlot.data);
+    roiStage.convert(roiSlot, stageOut, false);
+  });
+
+  // Rounding differs slightly between converting before and after averaging
+  cv::Mat diff;
+  cv::absdiff(bgrSmall, fused, diff);
+  double maxDiff;
+  cv::minMaxLoc(diff.reshape(1), nullptr, &maxDiff);
+
+  cout << "frame:             " << yuy2.cols << "x" << yuy2.rows << " YUY2 -> " << fused.cols << "x" << fused.rows
+       << " BGR (" << simdInstructionSet() << ", " << cv::getNumThreads() << " threads)" << endl;
+  report("cvtColor+resize:   ", tOpenCV, tOpenCV);
+  report("fused scalar:      ", tScalar, tOpenCV);
+  report("fused simd:        ", tSimd, tOpenCV);
+  report("fused parallel:    ", tParallel, tOpenCV);
+  report("stage whole frame: ", tStage, tOpenCV);
+  report("stage 1/4 region:  ", tStageRoi, tOpenCV);
+  cout << "max abs diff:      " << maxDiff << endl;
+  return 0;
+}
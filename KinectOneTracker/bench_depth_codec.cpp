@@ -0,0 +1,152 @@
+// Benchmark of depth + body index frame compression: the built-in DepthCodec (single-threaded and tiled over a
+// thread pool) against raw frames and Lagarith AVI through cv::VideoWriter, the previous recording path (skipped
+// when the codec is not installed). Synthetic frames get Gaussian depth noise and dropout pixels to resemble
+// sensor output.
+//
+// Usage: bench_depth_codec [noiseMm=2] [numThreads=hardware threads]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "./Benchmark.h"
+#include "./DepthCodec.h"
+#include "./DepthPacking.h"
+#include "./KinectOneListener.h"
+#include "./SyntheticFrameSource.h"
+#include "./ThreadPool.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+static const int
+  kWidth = SyntheticFrameSource::kDepthWidth,
+  kHeight = SyntheticFrameSource::kDepthHeight,
+  kPixels = kWidth * kHeight,
+  kRawFrameSize = kPixels * 3;
+
+void report(const string& name, const double secs, const double ratio) {
+  cout << name << secs * 1.0E3 << " ms/frame (" << kRawFrameSize / secs / 1.0E6 << " MB/s), ratio " << ratio << endl;
+}
+
+int main(int argc, const char** argv) {
+  const double noiseMm = (argc > 1) ? atof(argv[1]) : 2.0;
+  const size_t numThreads = (argc > 2) ? static_cast<size_t>(atoi(argv[2]))
+                                       : std::max(1u, std::thread::hardware_concurrency());
+
+  // Grab the synthetic depth frame variants and add sensor-like noise
+  struct Grabber : public KinectOneListener {
+    void onSkeleton(const Skeleton*) { }
+    void onColor(const INT64, const UINT, const RGBQUAD*) { }
+    void onDepthAndBodyIndex(const INT64, const UINT nDepth, const UINT16* pDepth, const UINT nBody,
+                             const BYTE* pBody) {
+      depth.push_back(std::vector<UINT16>(pDepth, pDepth + nDepth));
+      body.push_back(std::vector<BYTE>(pBody, pBody + nBody));
+    }
+    std::vector<std::vector<UINT16>> depth;
+    std::vector<std::vector<BYTE>> body;
+  } frames;
+  const int numFrames = 8;
+  SyntheticFrameSource source(0, 2, numFrames);
+  source.init();
+  for (int f = 0; f < numFrames; ++f) { source.update(KinectOneFrameSource::Stream_DepthAndBodyIndex, &frames); }
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.0f, static_cast<float>(noiseMm));
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  for (std::vector<UINT16>& d : frames.depth) {
+    for (UINT16& v : d) {
+      if (uniform(rng) < 0.01f) {
+        v = 0;  // Dropout
+      } else {
+        v = static_cast<UINT16>(std::max(0.0f, v + noise(rng) + 0.5f));
+      }
+    }
+  }
+  std::vector<cv::Mat> packed(numFrames);
+  for (int f = 0; f < numFrames; ++f) {
+    packed[f].create(kHeight, kWidth, CV_8UC3);
+    packDepthAndBodyIndex(frames.depth[f].data(), frames.body[f].data(), packed[f].data, kWidth, kHeight);
+  }
+
+  cout << "frames:            " << numFrames << " x " << kWidth << "x" << kHeight << " depth+body index, noise "
+       << noiseMm << " mm, " << numThreads << " threads" << endl;
+
+  // Raw copy of packed frames
+  int f = 0;
+  std::vector<uint8_t> copy(kRawFrameSize);
+  const double tRaw = timeIt([&] () {
+    memcpy(copy.data(), packed[f].data, kRawFrameSize);
+    f = (f + 1) % numFrames;
+  });
+  report("raw copy:          ", tRaw, 1.0);
+
+  // Lagarith AVI
+  const string aviFile = "bench_depth_codec.avi";
+  cv::VideoWriter avi;
+  avi.open(aviFile, cv::VideoWriter::fourcc('L', 'A', 'G', 'S'), 30.0, cv::Size(kWidth, kHeight));
+  if (avi.isOpened()) {
+    int numWritten = 0;
+    const double tLags = timeIt([&] () {
+      avi << packed[f];
+      f = (f + 1) % numFrames;
+      ++numWritten;
+    });
+    avi.release();
+    std::ifstream ifs(aviFile, std::ios::binary | std::ios::ate);
+    report("lagarith avi:      ", tLags, static_cast<double>(kRawFrameSize) * numWritten / ifs.tellg());
+  } else {
+    cout << "lagarith avi:      unavailable (LAGS codec not installed)" << endl;
+  }
+  std::remove(aviFile.c_str());
+
+  // Built-in codec
+  ThreadPool pool(numThreads > 1 ? numThreads - 1 : 1);
+  ThreadPool* pPool = (numThreads > 1) ? &pool : nullptr;
+  DepthFrameEncoder encoder(8);
+  std::vector<std::vector<uint8_t>> encoded(numFrames);
+  size_t encodedBytes = 0;
+  for (int i = 0; i < numFrames; ++i) {
+    encoder.encode(frames.depth[i].data(), frames.body[i].data(), kWidth, kHeight, encoded[i]);
+    encodedBytes += encoded[i].size();
+  }
+  const double ratio = static_cast<double>(kRawFrameSize) * numFrames / encodedBytes;
+  std::vector<uint8_t> out;
+  const double tEncode1 = timeIt([&] () {
+    encoder.encode(frames.depth[f].data(), frames.body[f].data(), kWidth, kHeight, out);
+    f = (f + 1) % numFrames;
+  });
+  const double tEncodeN = timeIt([&] () {
+    encoder.encode(frames.depth[f].data(), frames.body[f].data(), kWidth, kHeight, out, pPool);
+    f = (f + 1) % numFrames;
+  });
+  std::vector<UINT16> depth(kPixels);
+  std::vector<BYTE> body(kPixels);
+  const double tDecode1 = timeIt([&] () {
+    decodeDepthFrame(encoded[f].data(), encoded[f].size(), kWidth, kHeight, depth.data(), body.data());
+    f = (f + 1) % numFrames;
+  });
+  const double tDecodeN = timeIt([&] () {
+    decodeDepthFrame(encoded[f].data(), encoded[f].size(), kWidth, kHeight, depth.data(), body.data(), pPool);
+    f = (f + 1) % numFrames;
+  });
+  report("codec encode 1t:   ", tEncode1, ratio);
+  report("codec encode Nt:   ", tEncodeN, ratio);
+  report("codec decode 1t:   ", tDecode1, ratio);
+  report("codec decode Nt:   ", tDecodeN, ratio);
+
+  bool lossless = true;
+  for (int i = 0; i < numFrames; ++i) {
+    lossless &= decodeDepthFrame(encoded[i].data(), encoded[i].size(), kWidth, kHeight, depth.data(), body.data());
+    lossless &= (depth == frames.depth[i] && body == frames.body[i]);
+  }
+  cout << "lossless:          " << (lossless ? "yes" : "NO") << endl;
+  return lossless ? 0 : 1;
+}
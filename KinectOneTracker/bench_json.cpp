@@ -0,0 +1,66 @@
+// Benchmark of Recording::saveToJSON throughput on a synthetic recording.
+//
+// Usage: bench_json [numSkeletons=100000] [outFile=bench_json.json]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "./Benchmark.h"
+#include "./KinectOneListener.h"
+#include "./Recording.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+void rec2json(std::ostream& os, const Recording& rec, bool endlines);  // NOLINT
+
+// Collects skeletons into a Recording in memory
+struct SkeletonCollector : public KinectOneListener {
+  explicit SkeletonCollector(Recording& r) : rec(r) { }
+  void onSkeleton(const Skeleton* skel) { rec.skeletons.push_back(*skel); }
+  void onColor(const INT64, const UINT, const RGBQUAD*) { }
+  void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { }
+  Recording& rec;
+};
+
+int main(int argc, const char** argv) {
+  const size_t numSkeletons = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 100000;
+  const string outFile = (argc > 2) ? argv[2] : "bench_json.json";
+
+  // Generate recording with BODY_COUNT bodies per frame
+  Recording rec;
+  rec.id = "bench";
+  rec.camera = {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+  SyntheticFrameSource source(0, BODY_COUNT, 1);
+  source.init();
+  SkeletonCollector collector(rec);
+  rec.skeletons.reserve(numSkeletons + BODY_COUNT);
+  while (rec.skeletons.size() < numSkeletons) {
+    source.update(KinectOneFrameSource::Stream_Body, &collector);
+    rec.colorTimestamps.push_back(rec.skeletons.back().timestamp);
+    rec.depthTimestamps.push_back(rec.skeletons.back().timestamp);
+  }
+  rec.skeletons.resize(numSkeletons);
+
+  // Serialization only
+  NullStreamBuf nullBuf;
+  std::ostream nullStream(&nullBuf);
+  std::ostringstream sizing;
+  rec2json(sizing, rec, true);
+  const double bytes = static_cast<double>(sizing.str().size());
+  const double secsMem = timeIt([&] () { rec2json(nullStream, rec, true); }, 3, 1.0);
+
+  // Serialization to file
+  const double secsFile = timeIt([&] () { rec.saveToJSON(outFile); }, 3, 1.0);
+  remove(outFile.c_str());
+
+  cout << "skeletons:        " << numSkeletons << endl;
+  cout << "json bytes:       " << bytes << endl;
+  cout << "serialize:        " << secsMem * 1.0E3 << " ms (" << bytes / secsMem / 1.0E6 << " MB/s, "
+       << numSkeletons / secsMem << " skeletons/s)" << endl;
+  cout << "saveToJSON:       " << secsFile * 1.0E3 << " ms (" << bytes / secsFile / 1.0E6 << " MB/s)" << endl;
+  return 0;
+}
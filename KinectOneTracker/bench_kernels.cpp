@@ -0,0 +1,278 @@
+// Microbenchmark suite of the recorder's per-frame compute kernels on synthetic frames, for tracking regressions
+// without a sensor: color conversion (KinectOneRecorder::consumeColor), depth and body index packing
+// (onDepthAndBodyIndex and the depth consumer), reprojection to PLY (reprojectDepthFramePointsToPLY), color to depth
+// registration, the frame slot handoff between tracker and consumer threads, skeleton smoothing (SkeletonFilter) and
+// JSON serialization of a recording.
+// Prints one row per kernel with nanoseconds per frame, MB/s of input frame data and heap allocations per
+// iteration, as CSV or as one JSON object per line.
+//
+// Usage: bench_kernels [--json] [kernelFilter] [minSeconds=0.5]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "./Benchmark.h"
+#include "./ColorConvert.h"
+#include "./DepthColorRegistration.h"
+#include "./DepthPacking.h"
+#include "./DepthReprojector.h"
+#include "./FramePool.h"
+#include "./KinectOneListener.h"
+#include "./Recording.h"
+#include "./SkeletonFilter.h"
+#include "./SyntheticFrameSource.h"
+#include "./ThreadPool.h"
+
+using std::string;  using std::cout;  using std::endl;
+
+void rec2json(std::ostream& os, const Recording& rec, bool endlines);  // NOLINT
+
+// Heap allocations of all threads, counted by the replaced global operator new
+static std::atomic<uint64_t> g_numAllocations(0);
+
+// GCC mistakes the free() of the replaced operator delete, once inlined, for a mismatch with operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(size ? size : 1)) { return p; }
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& nt) noexcept { return operator new(size, nt); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static const int
+  kDepthWidth = SyntheticFrameSource::kDepthWidth,
+  kDepthHeight = SyntheticFrameSource::kDepthHeight,
+  kColorWidth = SyntheticFrameSource::kColorWidth,
+  kColorHeight = SyntheticFrameSource::kColorHeight;
+static const size_t kDepthPixels = static_cast<size_t>(kDepthWidth) * kDepthHeight;
+
+// One synthetic frame of each stream, and skeletons
+struct FrameGrabber : public KinectOneListener {
+  void onSkeleton(const Skeleton* skel) { skeletons.push_back(*skel); }
+  void onColor(const INT64, const UINT nColorBufferSize, const RGBQUAD* pColorBuffer) {
+    const BYTE* p = reinterpret_cast<const BYTE*>(pColorBuffer);
+    color.assign(p, p + nColorBufferSize);
+  }
+  void onDepthAndBodyIndex(const INT64, const UINT nDepth, const UINT16* pDepth, const UINT nBody,
+                           const BYTE* pBody) {
+    depth.assign(pDepth, pDepth + nDepth);
+    body.assign(pBody, pBody + nBody);
+  }
+  std::vector<BYTE> color;
+  std::vector<UINT16> depth;
+  std::vector<BYTE> body;
+  std::vector<Skeleton> skeletons;
+};
+
+struct KernelResult {
+  string name;
+  uint64_t iterations;
+  double nsPerFrame, mbPerSecond, allocsPerIteration;
+};
+
+class KernelSuite {
+ public:
+  KernelSuite(const string& filter, const double minSeconds) : m_filter(filter), m_minSeconds(minSeconds) { }
+
+  //! Times f, which processes framesPerIteration frames of bytesPerFrame input bytes each, unless name does not
+  //! match the filter. Allocations of the warm-up run are not counted
+  template <typename F>
+  void run(const string& name, const double bytesPerFrame, F f, const int framesPerIteration = 1) {
+    if (!m_filter.empty() && name.find(m_filter) == string::npos) { return; }
+    f();
+    const uint64_t allocs0 = g_numAllocations.load(std::memory_order_relaxed);
+    Stopwatch sw;
+    uint64_t iters = 0;
+    while (iters < 3 || sw.seconds() < m_minSeconds) {
+      f();
+      ++iters;
+    }
+    const double secs = sw.seconds();
+    const uint64_t allocs = g_numAllocations.load(std::memory_order_relaxed) - allocs0;
+    const double frames = static_cast<double>(iters) * framesPerIteration;
+    KernelResult r;
+    r.name = name;
+    r.iterations = iters;
+    r.nsPerFrame = secs * 1.0E9 / frames;
+    r.mbPerSecond = bytesPerFrame * frames / secs / 1.0E6;
+    r.allocsPerIteration = static_cast<double>(allocs) / iters;
+    m_results.push_back(r);
+  }
+
+  void print(std::ostream& os, const bool json) const {  // NOLINT
+    if (!json) { os << "kernel,iterations,ns_per_frame,mb_per_s,allocs_per_iter" << endl; }
+    for (const KernelResult& r : m_results) {
+      if (json) {
+        os << "{\"kernel\":\"" << r.name << "\",\"iterations\":" << r.iterations << ",\"nsPerFrame\":"
+           << r.nsPerFrame << ",\"mbPerSecond\":" << r.mbPerSecond << ",\"allocsPerIteration\":"
+           << r.allocsPerIteration << "}" << endl;
+      } else {
+        os << r.name << "," << r.iterations << "," << r.nsPerFrame << "," << r.mbPerSecond << ","
+           << r.allocsPerIteration << endl;
+      }
+    }
+  }
+
+ private:
+  const string m_filter;
+  const double m_minSeconds;
+  std::vector<KernelResult> m_results;
+};
+
+int main(int argc, const char** argv) {
+  int arg = 1;
+  const bool json = argc > arg && string(argv[arg]) == "--json";
+  if (json) { ++arg; }
+  const string filter = (argc > arg) ? argv[arg++] : "";
+  const double minSeconds = (argc > arg) ? atof(argv[arg++]) : 0.5;
+
+  FrameGrabber frame;
+  SyntheticFrameSource source(0, BODY_COUNT, 1);
+  source.init();
+  source.update(KinectOneFrameSource::Stream_Color, &frame);
+  source.update(KinectOneFrameSource::Stream_DepthAndBodyIndex, &frame);
+  const double colorBytes = static_cast<double>(frame.color.size());
+  const double depthBytes = static_cast<double>(kDepthPixels * (sizeof(UINT16) + sizeof(BYTE)));
+  KernelSuite suite(filter, minSeconds);
+
+  // Color consumer: YUY2 to half resolution BGR
+  const cv::Mat yuy2(kColorHeight, kColorWidth, CV_8UC2, frame.color.data());
+  cv::Mat bgrSmall(kColorHeight / 2, kColorWidth / 2, CV_8UC3);
+  suite.run("color_yuy2_to_bgr_half", colorBytes, [&] () { yuy2ToBgrHalf(yuy2, bgrSmall, false); });
+  suite.run("color_yuy2_to_bgr_half_parallel", colorBytes, [&] () { yuy2ToBgrHalf(yuy2, bgrSmall, true); });
+
+  // Depth and body index packing into a recorder slot, and unpacking by the depth consumer
+  std::vector<uint8_t> packed(3 * kDepthPixels);
+  std::vector<UINT16> depthOut(kDepthPixels);
+  std::vector<BYTE> bodyOut(kDepthPixels);
+  suite.run("depth_pack", depthBytes, [&] () {
+    packDepthAndBodyIndex(frame.depth.data(), frame.body.data(), packed.data(), kDepthWidth, kDepthHeight);
+  });
+  suite.run("depth_unpack", depthBytes, [&] () {
+    unpackDepthAndBodyIndex(packed.data(), depthOut.data(), bodyOut.data(), kDepthWidth, kDepthHeight);
+  });
+
+  // Point cloud of the background, in memory and as written by the recorder
+  DepthReprojector reprojector(kDepthWidth, kDepthHeight);
+  reprojector.setRayTable(source.getDepthPixelCoordsInCameraSpace());
+  std::vector<float> points(3 * reprojector.maxPoints());
+  size_t numPoints = 0;
+  suite.run("reproject", depthBytes, [&] () {
+    numPoints = reprojector.reproject(frame.depth.data(), frame.body.data(), points.data());
+  });
+  const string plyFile = "bench_kernels.ply";
+  PlyWriter ply;
+  suite.run("reproject_ply", depthBytes, [&] () {
+    numPoints = reprojector.reproject(frame.depth.data(), frame.body.data(), points.data());
+    ply.open(plyFile);
+    ply.append(points.data(), numPoints);
+    ply.close();
+  });
+  std::remove(plyFile.c_str());
+
+  // Color registered to depth with a fixed calibration, on the calling thread and split with one pool thread
+  DepthColorRegistration registration(kDepthWidth, kDepthHeight, kColorWidth, kColorHeight);
+  registration.setDefaultCalibration(source.getDepthPixelCoordsInCameraSpace());
+  std::vector<BYTE> registered(3 * kDepthPixels);
+  const double registrationBytes = kDepthPixels * sizeof(UINT16) + colorBytes;
+  suite.run("register_color", registrationBytes, [&] () {
+    registration.registerColor(frame.depth.data(), frame.color.data(), registered.data());
+  });
+  {
+    ThreadPool pool(1);
+    suite.run("register_color_pool", registrationBytes, [&] () {
+      registration.registerColor(frame.depth.data(), frame.color.data(), registered.data(), &pool);
+    });
+  }
+
+  // Slot handoff from the tracker thread to a consumer thread, as for recorded frames (indices only)
+  {
+    const int kHandoffFrames = 4096;
+    FramePool<int64_t, 32> pool;
+    std::atomic<bool> live(true);
+    std::thread consumer([&] () {
+      size_t slot;
+      while (pool.popWait(slot, live)) { pool.release(slot); }
+    });
+    int64_t n = 0;
+    suite.run("frame_pool_handoff", 0, [&] () {
+      for (int i = 0; i < kHandoffFrames; ++i) {
+        size_t slot;
+        if (!pool.acquire(slot)) { pool.acquireWait(slot); }
+        pool[slot] = n++;
+        pool.publish(slot);
+      }
+      while (pool.inFlight() > 0) { std::this_thread::yield(); }
+    }, kHandoffFrames);
+    live = false;
+    pool.wakeConsumer();
+    consumer.join();
+  }
+
+  // Skeleton smoothing, per body of a tick with BODY_COUNT bodies
+  {
+    frame.skeletons.clear();
+    source.update(KinectOneFrameSource::Stream_Body, &frame);
+    std::vector<Skeleton> bodies(frame.skeletons);
+    SkeletonFilter skeletonFilter;
+    suite.run("skeleton_filter", sizeof(Skeleton), [&] () {
+      for (Skeleton& s : bodies) {
+        s.timestamp += 333333;
+        skeletonFilter.filter(s);
+      }
+    }, static_cast<int>(bodies.size()));
+  }
+
+  // Recording header of a minute at 30 fps with BODY_COUNT bodies, per frame
+  {
+    const int kFrames = 1800;
+    Recording rec;
+    rec.id = "bench";
+    rec.camera = {{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+    frame.skeletons.clear();
+    for (int i = 0; i < kFrames; ++i) {
+      source.update(KinectOneFrameSource::Stream_Body, &frame);
+      rec.colorTimestamps.push_back(frame.skeletons.back().timestamp);
+      rec.depthTimestamps.push_back(frame.skeletons.back().timestamp);
+    }
+    rec.skeletons.swap(frame.skeletons);
+    std::ostringstream sizing;
+    rec2json(sizing, rec, true);
+    const double jsonBytesPerFrame = static_cast<double>(sizing.str().size()) / kFrames;
+    NullStreamBuf nullBuf;
+    std::ostream nullStream(&nullBuf);
+    suite.run("rec2json", jsonBytesPerFrame, [&] () { rec2json(nullStream, rec, true); }, kFrames);
+    const string jsonFile = "bench_kernels.json";
+    suite.run("save_to_json", jsonBytesPerFrame, [&] () { rec.saveToJSON(jsonFile); }, kFrames);
+    std::remove(jsonFile.c_str());
+  }
+
+  suite.print(cout, json);
+  return 0;
+}
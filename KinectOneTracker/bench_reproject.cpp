@@ -0,0 +1,164 @@
+// Benchmark of depth frame reprojection to a PLY point cloud: the previous per-call path of
+// KinectOneRecorder::reprojectDepthFramePointsToPLY (ray table rebuilt with a 4x4 matrix product per pixel, points
+// pushed one at a time, ASCII PLY with a flush per line) against DepthReprojector (cached rays, SIMD back-projection)
+// and the buffered binary PlyWriter.
+//
+// Usage: bench_reproject
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./Benchmark.h"
+#include "./DepthReprojector.h"
+#include "./KinectOneListener.h"
+#include "./Simd.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+static const int
+  kWidth = SyntheticFrameSource::kDepthWidth,
+  kHeight = SyntheticFrameSource::kDepthHeight;
+
+// Previous implementation, with the OpenCV matrix types spelled out
+struct Point3 { float x, y, z; };
+
+void legacyRays(std::vector<float>& rays) {  // NOLINT
+  const float inv[16] = {
+    1.f / 361.56f, 0.0f, 0.0f, -256.f / 361.56f,
+    0.0f, -1.f / 367.19f, 0.0f, 212.f / 367.19f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f };
+  rays.resize(4 * kWidth * kHeight);
+  for (int j = 0; j < kHeight; j++) {
+    for (int i = 0; i < kWidth; i++) {
+      const float v[4] = { static_cast<float>(i), static_cast<float>(j), 0.0f, 1.0f };
+      for (int r = 0; r < 4; ++r) {
+        rays[4 * (j * kWidth + i) + r] = inv[4 * r] * v[0] + inv[4 * r + 1] * v[1] + inv[4 * r + 2] * v[2] +
+                                         inv[4 * r + 3] * v[3];
+      }
+    }
+  }
+}
+
+void legacyReproject(const std::vector<float>& rays, const std::vector<UINT16>& depth,
+                     const std::vector<BYTE>& body, std::vector<Point3>& points) {  // NOLINT
+  const float ext[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+  points.clear();
+  points.reserve(50000);
+  for (int j = 0; j < kHeight; j++) {
+    for (int i = 0; i < kWidth; i++) {
+      const int idx = j * kWidth + (kWidth - 1 - i);  // Flipped left-right
+      if (body[idx] != 0xff) { continue; }
+      const float d = depth[idx] * 0.001f;
+      if (d == 0) { continue; }
+      const float* p = &rays[4 * (j * kWidth + i)];
+      const float v[4] = { d * p[0], d * p[1], d * p[3], 1.f };
+      float p2[4];
+      for (int r = 0; r < 4; ++r) {
+        p2[r] = ext[4 * r] * v[0] + ext[4 * r + 1] * v[1] + ext[4 * r + 2] * v[2] + ext[4 * r + 3] * v[3];
+      }
+      const Point3 q = { p2[0] / p2[3], p2[1] / p2[3], p2[2] / p2[3] };
+      points.push_back(q);
+    }
+  }
+}
+
+void legacyWritePLY(const std::vector<Point3>& points, const string& plyFile) {
+  std::ofstream os(plyFile);
+  os << "ply" << endl;
+  os << "format ascii 1.0" << endl;
+  os << "element vertex " << points.size() << endl;
+  os << "property float x" << endl;
+  os << "property float y" << endl;
+  os << "property float z" << endl;
+  os << "end_header" << endl;
+  for (const Point3& p : points) { os << p.x << " " << p.y << " " << p.z << endl; }
+}
+
+void report(const string& name, const double secs, const double baseline) {
+  cout << name << secs * 1.0E3 << " ms/frame (" << baseline / secs << "x)" << endl;
+}
+
+int main() {
+  // Grab one synthetic depth frame
+  struct Grabber : public KinectOneListener {
+    void onSkeleton(const Skeleton*) { }
+    void onColor(const INT64, const UINT, const RGBQUAD*) { }
+    void onDepthAndBodyIndex(const INT64, const UINT nDepth, const UINT16* pDepth, const UINT nBody,
+                             const BYTE* pBody) {
+      depth.assign(pDepth, pDepth + nDepth);
+      body.assign(pBody, pBody + nBody);
+    }
+    std::vector<UINT16> depth;
+    std::vector<BYTE> body;
+  } frame;
+  SyntheticFrameSource source(0, 2, 1);
+  source.init();
+  source.update(KinectOneFrameSource::Stream_DepthAndBodyIndex, &frame);
+  const string legacyFile = "bench_reproject_ascii.ply", plyFile = "bench_reproject_binary.ply";
+
+  std::vector<float> rays;
+  std::vector<Point3> legacyPoints;
+  const double tLegacyRays = timeIt([&] () { legacyRays(rays); });
+  const double tLegacyReproject = timeIt([&] () { legacyReproject(rays, frame.depth, frame.body, legacyPoints); });
+  const double tLegacyWrite = timeIt([&] () { legacyWritePLY(legacyPoints, legacyFile); });
+  const double tLegacy = tLegacyRays + tLegacyReproject + tLegacyWrite;
+
+  DepthReprojector reprojector(kWidth, kHeight);
+  std::vector<float> points(3 * reprojector.maxPoints());
+  size_t numPoints = 0;
+  const double tRays = timeIt([&] () {
+    reprojector.setIntrinsics(DepthReprojector::kDepthFx, DepthReprojector::kDepthFy, DepthReprojector::kDepthCx,
+                              DepthReprojector::kDepthCy, true);
+  });
+  const double tReproject = timeIt([&] () {
+    numPoints = reprojector.reproject(frame.depth.data(), frame.body.data(), points.data());
+  });
+  const double tWrite = timeIt([&] () {
+    PlyWriter ply;
+    ply.open(plyFile);
+    ply.append(points.data(), numPoints);
+    ply.close();
+  });
+
+  // Both paths must produce the same points, in reversed order within each row
+  bool same = legacyPoints.size() == numPoints;
+  for (int j = 0, k = 0; same && j < kHeight; ++j) {
+    int rowPoints = 0;
+    for (int i = 0; i < kWidth; ++i) {
+      const int idx = j * kWidth + i;
+      rowPoints += (frame.depth[idx] != 0 && frame.body[idx] == 0xff) ? 1 : 0;
+    }
+    for (int m = 0; m < rowPoints; ++m) {
+      const Point3& q = legacyPoints[k + rowPoints - 1 - m];
+      const float* p = &points[3 * (k + m)];
+      same &= std::abs(q.x - p[0]) < 1e-5f && std::abs(q.y - p[1]) < 1e-5f && std::abs(q.z - p[2]) < 1e-6f;
+    }
+    k += rowPoints;
+  }
+  std::ifstream legacyIfs(legacyFile, std::ios::binary | std::ios::ate), ifs(plyFile, std::ios::binary | std::ios::ate);
+  const double legacyMB = legacyIfs.tellg() / 1.0E6, binaryMB = ifs.tellg() / 1.0E6;
+  legacyIfs.close();
+  ifs.close();
+  std::remove(legacyFile.c_str());
+  std::remove(plyFile.c_str());
+
+  cout << "frame:             " << kWidth << "x" << kHeight << ", " << numPoints << " points ("
+       << simdInstructionSet() << ")" << endl;
+  report("legacy rays:       ", tLegacyRays, tLegacyRays);
+  report("legacy reproject:  ", tLegacyReproject, tLegacyReproject);
+  report("legacy ascii ply:  ", tLegacyWrite, tLegacyWrite);
+  report("cached rays build: ", tRays, tLegacyRays);
+  report("simd reproject:    ", tReproject, tLegacyReproject);
+  report("binary ply:        ", tWrite, tLegacyWrite);
+  report("legacy total:      ", tLegacy, tLegacy);
+  report("new total:         ", tReproject + tWrite, tLegacy);
+  cout << "file size:         " << legacyMB << " MB ascii, " << binaryMB << " MB binary" << endl;
+  cout << "same points:       " << (same ? "yes" : "NO") << endl;
+  return same ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Benchmark of the compact skeleton codec: bytes per skeleton against JSON and packSkeleton() records, encode and
+// decode throughput, and the largest quantization errors. Synthetic skeletons get Gaussian joint jitter, and leaf
+// joints get zero orientations as from the SDK, to resemble sensor output.
+//
+// Usage: bench_skeleton_codec [numSkeletons=100000] [numBodies=2] [noiseMm=2] [keyframeInterval=300]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./Benchmark.h"
+#include "./JsonWriter.h"
+#include "./KinectOneListener.h"
+#include "./SkeletonCodec.h"
+#include "./SkeletonLog.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+void skel2json(JsonWriter& w, const Skeleton& s);  // NOLINT
+
+int main(int argc, const char** argv) {
+  const size_t numSkeletons = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 100000;
+  const int numBodies = (argc > 2) ? std::min(std::max(atoi(argv[2]), 1), static_cast<int>(BODY_COUNT)) : 2;
+  const double noiseMm = (argc > 3) ? atof(argv[3]) : 2.0;
+  const int keyframeInterval = (argc > 4) ? atoi(argv[4]) : 300;
+
+  std::vector<Skeleton> skels;
+  skels.reserve(numSkeletons + numBodies);
+  SyntheticFrameSource source(0, numBodies, 1);
+  source.init();
+  struct Collector : public KinectOneListener {
+    explicit Collector(std::vector<Skeleton>& s) : skels(s) { }  // NOLINT
+    void onSkeleton(const Skeleton* skel) { skels.push_back(*skel); }
+    void onColor(const INT64, const UINT, const RGBQUAD*) { }
+    void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { }
+    std::vector<Skeleton>& skels;
+  } collector(skels);
+  while (skels.size() < numSkeletons) { source.update(KinectOneFrameSource::Stream_Body, &collector); }
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.0f, static_cast<float>(noiseMm * 1.0E-3));
+  std::normal_distribution<float> rotNoise(0.0f, 0.005f);
+  for (Skeleton& s : skels) {
+    for (int j = 0; j < Skeleton::JointType_Count; ++j) {
+      for (int c = 0; c < 3; ++c) { s.jointPositions[j][c] += noise(rng); }
+      std::array<float, 4>& q = s.jointOrientations[j];
+      const bool leaf = j == Skeleton::JointType_Head || j == Skeleton::JointType_FootLeft ||
+                        j == Skeleton::JointType_FootRight || j >= Skeleton::JointType_HandTipLeft;
+      if (leaf) {
+        q.fill(0.0f);
+        continue;
+      }
+      float norm2 = 0.0f;
+      for (int c = 0; c < 4; ++c) {
+        q[c] += rotNoise(rng);
+        norm2 += q[c] * q[c];
+      }
+      for (int c = 0; c < 4; ++c) { q[c] /= std::sqrt(norm2); }
+    }
+  }
+
+  // Reference sizes
+  NullStreamBuf nullBuf;
+  std::ostream nullStream(&nullBuf);
+  JsonWriter json(nullStream);
+  for (const Skeleton& s : skels) { skel2json(json, s); }
+  const double jsonBytes = static_cast<double>(json.bytesWritten()) / skels.size();
+  const double packedBytes = static_cast<double>(kSkeletonRecordSize);
+  std::vector<char> packed(skels.size() * kSkeletonRecordSize);
+  for (size_t i = 0; i < skels.size(); ++i) { packSkeleton(skels[i], &packed[i * kSkeletonRecordSize]); }
+  std::vector<Skeleton> unpacked(skels.size());
+  const double secsUnpack = timeIt([&] () {
+    for (size_t i = 0; i < skels.size(); ++i) { unpackSkeleton(&packed[i * kSkeletonRecordSize], unpacked[i]); }
+  });
+
+  std::vector<uint8_t> encoded;
+  encoded.reserve(skels.size() * 64);
+  const double secsEncode = timeIt([&] () { encodeSkeletons(skels, encoded, keyframeInterval); });
+  std::vector<Skeleton> decoded;
+  decoded.reserve(skels.size());
+  bool ok = true;
+  const double secsDecode = timeIt([&] () {
+    decoded.clear();
+    ok = decodeSkeletons(encoded.data(), encoded.size(), decoded) && ok;
+  });
+  const double codecBytes = static_cast<double>(encoded.size()) / skels.size();
+  SkeletonEncoder encoder(keyframeInterval);
+  std::vector<uint8_t> scratch;
+  for (const Skeleton& s : skels) { encoder.encode(s, scratch); }
+
+  // Errors, with quaternions compared up to sign
+  double maxPosition = 0.0, maxQuat = 0.0;
+  bool exact = ok && decoded.size() == skels.size();
+  for (size_t i = 0; exact && i < skels.size(); ++i) {
+    const Skeleton& a = skels[i];
+    const Skeleton& b = decoded[i];
+    exact = a.trackingId == b.trackingId && a.timestamp == b.timestamp && a.handLeftState == b.handLeftState &&
+            a.handRightState == b.handRightState && a.handLeftConfidence == b.handLeftConfidence &&
+            a.handRightConfidence == b.handRightConfidence && a.clippedEdges == b.clippedEdges &&
+            a.leanConfidence == b.leanConfidence && std::equal(a.activities, a.activities + Skeleton::Activity_Count,
+                                                               b.activities);
+    for (int j = 0; j < Skeleton::JointType_Count; ++j) {
+      exact = exact && a.jointConfidences[j] == b.jointConfidences[j];
+      for (int c = 0; c < 3; ++c) {
+        maxPosition = std::max(maxPosition, std::fabs(static_cast<double>(a.jointPositions[j][c]) -
+                                                      b.jointPositions[j][c]));
+      }
+      float dot = 0.0f;
+      for (int c = 0; c < 4; ++c) { dot += a.jointOrientations[j][c] * b.jointOrientations[j][c]; }
+      const float sign = (dot < 0) ? -1.0f : 1.0f;
+      for (int c = 0; c < 4; ++c) {
+        maxQuat = std::max(maxQuat, std::fabs(static_cast<double>(a.jointOrientations[j][c]) -
+                                              sign * b.jointOrientations[j][c]));
+      }
+    }
+  }
+
+  const size_t n = skels.size();
+  cout << "skeletons:         " << n << ", " << numBodies << " bodies, noise " << noiseMm << " mm, keyframes "
+       << encoder.numKeyframes() << endl;
+  cout << "json:              " << jsonBytes << " bytes/skel" << endl;
+  cout << "packSkeleton:      " << packedBytes << " bytes/skel, unpack " << secsUnpack / n * 1.0E9 << " ns/skel"
+       << endl;
+  cout << "codec:             " << codecBytes << " bytes/skel, ratio " << packedBytes / codecBytes << " vs packed, "
+       << jsonBytes / codecBytes << " vs json" << endl;
+  cout << "encode:            " << secsEncode / n * 1.0E9 << " ns/skel (" << n / secsEncode / 1.0E6 << " M skel/s)"
+       << endl;
+  cout << "decode:            " << secsDecode / n * 1.0E9 << " ns/skel (" << n / secsDecode / 1.0E6 << " M skel/s, "
+       << n * packedBytes / secsDecode / 1.0E6 << " MB/s of packed records)" << endl;
+  cout << "max error:         " << maxPosition * 1.0E3 << " mm position, " << maxQuat << " quaternion component"
+       << endl;
+  if (!exact) {
+    cerr << "Decoded skeletons do not match" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,137 @@
+// Benchmark of per-joint queries on the columnar SkeletonColumns store against equivalent loops over
+// Recording::skeletons (array of structs).
+//
+// Usage: bench_skeleton_columns [numSkeletons=1000000]
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "./Benchmark.h"
+#include "./Simd.h"
+#include "./SkeletonColumns.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+// Reference implementations over array of structs
+
+void aosSpeeds(const std::vector<Skeleton>& skels, const int joint, std::vector<float>& out) {  // NOLINT
+  out.resize(skels.size() - 1);
+  for (size_t i = 0; i + 1 < skels.size(); ++i) {
+    const std::array<float, 3>& p0 = skels[i].jointPositions[joint];
+    const std::array<float, 3>& p1 = skels[i + 1].jointPositions[joint];
+    const float dx = p1[0] - p0[0], dy = p1[1] - p0[1], dz = p1[2] - p0[2];
+    const int64_t dt = skels[i + 1].timestamp - skels[i].timestamp;
+    out[i] = (dt > 0) ? std::sqrt(dx * dx + dy * dy + dz * dz) * static_cast<float>(1.0E7 / dt) : 0.0f;
+  }
+}
+
+std::array<float, 3> aosCentroid(const std::vector<Skeleton>& skels, const int joint) {
+  double s[3] = { 0, 0, 0 };
+  for (const Skeleton& k : skels) {
+    for (int a = 0; a < 3; ++a) { s[a] += k.jointPositions[joint][a]; }
+  }
+  std::array<float, 3> mean;
+  for (int a = 0; a < 3; ++a) { mean[a] = static_cast<float>(s[a] / skels.size()); }
+  return mean;
+}
+
+JointExtents aosExtents(const std::vector<Skeleton>& skels, const int joint) {
+  JointExtents e;
+  e.min.fill(std::numeric_limits<float>::infinity());
+  e.max.fill(-std::numeric_limits<float>::infinity());
+  for (const Skeleton& k : skels) {
+    for (int a = 0; a < 3; ++a) {
+      e.min[a] = std::min(e.min[a], k.jointPositions[joint][a]);
+      e.max[a] = std::max(e.max[a], k.jointPositions[joint][a]);
+    }
+  }
+  return e;
+}
+
+size_t aosConfidentMean(const std::vector<Skeleton>& skels, const int joint, const float minConfidence,
+                        std::array<float, 3>& mean) {  // NOLINT
+  double s[3] = { 0, 0, 0 };
+  size_t n = 0;
+  for (const Skeleton& k : skels) {
+    if (k.jointConfidences[joint] < minConfidence) { continue; }
+    for (int a = 0; a < 3; ++a) { s[a] += k.jointPositions[joint][a]; }
+    ++n;
+  }
+  for (int a = 0; a < 3; ++a) { mean[a] = (n > 0) ? static_cast<float>(s[a] / n) : 0.0f; }
+  return n;
+}
+
+// Returns whether a and b agree to within relative tolerance
+bool close(const float a, const float b) {
+  return std::fabs(a - b) <= 1.0E-4f * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+}
+
+void report(const string& name, const double secsAoS, const double secsSoA, const size_t n, const bool match) {
+  cout << name << "aos " << secsAoS / n * 1.0E9 << " ns/skel, soa " << secsSoA / n * 1.0E9 << " ns/skel, speedup "
+       << secsAoS / secsSoA << "x" << (match ? "" : "  MISMATCH") << endl;
+}
+
+int main(int argc, const char** argv) {
+  const size_t numSkeletons = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 1000000;
+  const int joint = Skeleton::JointType_HandRight;
+
+  // Generate one body with varying confidences
+  std::vector<Skeleton> skels;
+  skels.reserve(numSkeletons);
+  SyntheticFrameSource source(0, 1, 1);
+  source.init();
+  struct Collector : public KinectOneListener {
+    explicit Collector(std::vector<Skeleton>& s) : skels(s) { }  // NOLINT
+    void onSkeleton(const Skeleton* skel) {
+      skels.push_back(*skel);
+      skels.back().jointConfidences[Skeleton::JointType_HandRight] = (skels.size() % 3 == 0) ? 0.5f : 1.0f;
+    }
+    void onColor(const INT64, const UINT, const RGBQUAD*) { }
+    void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { }
+    std::vector<Skeleton>& skels;
+  } collector(skels);
+  while (skels.size() < numSkeletons) { source.update(KinectOneFrameSource::Stream_Body, &collector); }
+
+  Stopwatch fillTimer;
+  SkeletonColumns cols;
+  cols.reserve(skels.size());
+  for (const Skeleton& s : skels) { cols.push_back(s); }
+  const double secsFill = fillTimer.seconds();
+
+  cout << "skeletons:         " << skels.size() << " (" << simdInstructionSet() << ")" << endl;
+  cout << "fill columns:      " << secsFill / skels.size() * 1.0E9 << " ns/skel" << endl;
+
+  std::vector<float> speedsAoS, speedsSoA;
+  const double tSpeedAoS = timeIt([&] () { aosSpeeds(skels, joint, speedsAoS); });
+  const double tSpeedSoA = timeIt([&] () { jointSpeeds(cols, joint, speedsSoA); });
+  bool match = speedsAoS.size() == speedsSoA.size();
+  for (size_t i = 0; match && i < speedsAoS.size(); ++i) { match = close(speedsAoS[i], speedsSoA[i]); }
+  report("speed:             ", tSpeedAoS, tSpeedSoA, skels.size(), match);
+
+  std::array<float, 3> cAoS, cSoA;
+  const double tCentroidAoS = timeIt([&] () { cAoS = aosCentroid(skels, joint); });
+  const double tCentroidSoA = timeIt([&] () { cSoA = jointCentroid(cols, joint); });
+  match = close(cAoS[0], cSoA[0]) && close(cAoS[1], cSoA[1]) && close(cAoS[2], cSoA[2]);
+  report("centroid:          ", tCentroidAoS, tCentroidSoA, skels.size(), match);
+
+  JointExtents eAoS, eSoA;
+  const double tExtentsAoS = timeIt([&] () { eAoS = aosExtents(skels, joint); });
+  const double tExtentsSoA = timeIt([&] () { eSoA = jointExtents(cols, joint); });
+  match = eAoS.min == eSoA.min && eAoS.max == eSoA.max;
+  report("extents:           ", tExtentsAoS, tExtentsSoA, skels.size(), match);
+
+  std::array<float, 3> mAoS, mSoA;
+  size_t nAoS = 0, nSoA = 0;
+  const double tMeanAoS = timeIt([&] () { nAoS = aosConfidentMean(skels, joint, 0.75f, mAoS); });
+  const double tMeanSoA = timeIt([&] () { nSoA = jointConfidentMean(cols, joint, 0.75f, mSoA); });
+  match = nAoS == nSoA && close(mAoS[0], mSoA[0]) && close(mAoS[1], mSoA[1]) && close(mAoS[2], mSoA[2]);
+  report("confident mean:    ", tMeanAoS, tMeanSoA, skels.size(), match);
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Load test for the recording pipeline: drives KinectOneRecorder from a SyntheticFrameSource
+// and reports sustained frame rates and process CPU usage. Runs without a sensor.
+//
+// Usage: loadtest [seconds=10] [sourceFps=30 (0 = as fast as possible)] [recordFps=30] [numBodies=2]
+//                 [asyncDispatch=0 (1 = recorder called from its own queue and thread, see AsyncDispatch.h)]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "./KinectOneTracker.h"
+#include "./KinectOneRecorder.h"
+#include "./SyntheticFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+//! Returns user+system CPU time consumed by this process in seconds
+double processCpuSeconds() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) { return 0; }
+  ULARGE_INTEGER k, u;
+  k.HighPart = kernel.dwHighDateTime;  k.LowPart = kernel.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;    u.LowPart = user.dwLowDateTime;
+  return (k.QuadPart + u.QuadPart) * 1.0E-7;
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0E-6;
+#endif
+}
+
+int main(int argc, const char** argv) {
+  // Parameters
+  const double seconds   = (argc > 1) ? atof(argv[1]) : 10.0;
+  const double sourceFps = (argc > 2) ? atof(argv[2]) : 30.0;
+  const double recordFps = (argc > 3) ? atof(argv[3]) : 30.0;
+  const int    numBodies = (argc > 4) ? atoi(argv[4]) : 2;
+  const bool   async     = (argc > 5) ? atoi(argv[5]) != 0 : false;
+
+  std::shared_ptr<SyntheticFrameSource> source = std::make_shared<SyntheticFrameSource>(sourceFps, numBodies);
+  KinectOneTracker tracker(source);
+  if (!tracker.init()) {
+    cerr << "Could not initialize synthetic frame source" << endl;
+    return 1;
+  }
+
+  const double cpuStart = processCpuSeconds();
+  const auto wallStart = std::chrono::steady_clock::now();
+  {
+    KinectOneRecorder kinectRec(false, recordFps, "loadtest");
+    tracker.setAsyncDispatch(async);
+    tracker.attachSkeletonListener(&kinectRec);
+    tracker.attachColorListener(&kinectRec);
+    tracker.attachDepthListener(&kinectRec);
+
+    std::thread trackerThread(&KinectOneTracker::run, std::ref(tracker));
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    tracker.quit();
+    trackerThread.join();
+    kinectRec.stop();
+
+    const double wallSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    const double cpuSecs = processCpuSeconds() - cpuStart;
+    const Recording& rec = kinectRec.getRecording();
+    cout << "Source frame sets:   " << tracker.getNumFrameSets()
+         << " (" << tracker.getNumFrameSets() / wallSecs << " fps)" << endl;
+    cout << "Recorded color:      " << rec.colorTimestamps.size()
+         << " (" << rec.colorTimestamps.size() / wallSecs << " fps)" << endl;
+    cout << "Recorded depth:      " << rec.depthTimestamps.size()
+         << " (" << rec.depthTimestamps.size() / wallSecs << " fps)" << endl;
+    cout << "Recorded skeletons:  " << rec.numSkeletons() << endl;
+    cout << "Wall time:           " << wallSecs << " s" << endl;
+    cout << "CPU time:            " << cpuSecs << " s (" << 100.0 * cpuSecs / wallSecs << "% of one core)" << endl;
+    kinectRec.printWaitStats(cout);
+    tracker.printDispatchStats(cout);
+  }
+
+  return 0;
+}
@@ -1,8 +1,19 @@
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "./Config.h"
+#include "./DepthColorRegistration.h"
+#include "./FrameSynchronizer.h"
 #include "./KinectOneTracker.h"
 #include "./KinectOneRecorder.h"
+#include "./SessionRecorder.h"
+#include "./SkeletonFilter.h"
+#include "./StreamStage.h"
+#include "./SyntheticFrameSource.h"
 
 using std::string;  using std::cout;  using std::cerr;  using std::endl;
 
@@ -11,25 +22,152 @@ string timeAsYMDHMS() {
   time_t rawtime;
   tm timeinfo;
   time(&rawtime);
+#ifdef _WIN32
   localtime_s(&timeinfo, &rawtime);
+#else
+  localtime_r(&rawtime, &timeinfo);
+#endif
   char timestr[80];
   strftime(timestr, 80, "%Y-%m-%d-%H-%M-%S", &timeinfo);
   return timestr;
 }
 
+//! Reads settings <prefix>.enabled, <prefix>.fps, <prefix>.roi (x,y,width,height) and <prefix>.size (widthxheight)
+//! of a recorded stream
+StreamStageOptions streamOptions(const Config& config, const string& prefix) {
+  StreamStageOptions opts;
+  opts.enabled = config.getBool(prefix + ".enabled", opts.enabled);
+  opts.fps = config.getDouble(prefix + ".fps", opts.fps);
+  const string roi = config.getString(prefix + ".roi", ""), size = config.getString(prefix + ".size", "");
+  if (!roi.empty() && !parseRoi(roi, opts.roi)) {
+    cerr << "Warning: ignoring " << prefix << ".roi = " << roi << " (expected x,y,width,height)" << endl;
+  }
+  if (!size.empty() && !parseSize(size, opts.outputSize)) {
+    cerr << "Warning: ignoring " << prefix << ".size = " << size << " (expected widthxheight)" << endl;
+  }
+  return opts;
+}
+
 int main(int argc, const char** argv) {
-  // Parameters
-  const string id_time     = "rec_" + timeAsYMDHMS();
-  const double fps         = 5.0;
-  const bool   showCapture = true;
+  // Parameters, from an optional config file of "key = value" lines overridden by key=value arguments
+  Config config;
+  const bool hasConfigFile = argc > 1 && string(argv[1]).find('=') == string::npos;
+  if ((hasConfigFile && !config.load(argv[1])) || !config.parseArgs(argc, argv, hasConfigFile ? 2 : 1)) {
+    cerr << "Usage: " << argv[0] << " [configFile] [key=value ...]" << endl;
+    return 1;
+  }
+  const string id_time     = config.getString("id", "rec_" + timeAsYMDHMS());
+  const double fps         = config.getDouble("fps", 5.0);
+  const bool   showCapture = config.getBool("showCapture", true);
+  bool         registerColor = config.getBool("registerColor", false);
+  const bool   asyncDispatch = config.getBool("asyncDispatch", false);
+  bool         synchronizeStreams = config.getBool("synchronizeStreams", false);
+  const bool   filterSkeletons = config.getBool("filterSkeletons", false);
+  const bool   skeletonStream = config.getBool("skeletonStream", false);
+  // Roll over to a new part after this long (0 = one part), or once a part takes this many bytes on disk (0 = no
+  // limit)
+  const double sessionMaxSeconds = config.getDouble("sessionMaxSeconds", 0);
+  const uint64_t sessionMaxBytes = static_cast<uint64_t>(std::max<int64_t>(0, config.getInt("sessionMaxBytes", 0)));
+  // Rate, region of interest and output size of each recorded stream, or whether it is recorded at all
+  const StreamStageOptions colorStage = streamOptions(config, "color");
+  const StreamStageOptions depthStage = streamOptions(config, "depth");
+  for (const string& key : config.unusedKeys()) {
+    cerr << "Warning: unknown setting " << key << endl;
+  }
+  // Matching streams and registering color both need the color and depth frames
+  if ((synchronizeStreams || registerColor) && (!colorStage.enabled || !depthStage.enabled)) {
+    cerr << "Warning: a stream is not recorded, so streams are not synchronized and color is not registered" << endl;
+    synchronizeStreams = registerColor = false;
+  }
 
-  // Initialize tracker and skeleton recorder
+  // Initialize tracker and skeleton recorder (no sensor SDK outside Windows, so fall back to synthetic frames)
+#ifdef _WIN32
   KinectOneTracker tracker;
+#else
+  KinectOneTracker tracker(std::make_shared<SyntheticFrameSource>());
+  cout << "Kinect SDK not available: recording synthetic frames." << endl;
+#endif
   tracker.init();
-  KinectOneRecorder kinectRec(showCapture, fps, id_time);
-  tracker.attachSkeletonListener(&kinectRec);
-  tracker.attachColorListener(&kinectRec);
-  tracker.attachDepthListener(&kinectRec);
+  tracker.setAsyncDispatch(asyncDispatch);
+  RecorderOptions opts;
+  opts.id = id_time;
+  opts.fps = fps;
+  opts.showCapture = showCapture;
+  opts.skeletonStream = skeletonStream;
+  opts.recordRegisteredColor = registerColor;
+  opts.color = colorStage;
+  opts.depth = depthStage;
+  // A session recorder records consecutive parts, each a recording of its own
+  const bool useSession = sessionMaxSeconds > 0 || sessionMaxBytes > 0;
+  RolloverOptions rollover;
+  rollover.maxPartSeconds = sessionMaxSeconds;
+  rollover.maxPartBytes = sessionMaxBytes;
+  std::unique_ptr<KinectOneRecorder> kinectRec;
+  std::unique_ptr<SessionRecorder> sessionRec;
+  KinectOneListener* recorder;
+  if (useSession) {
+    sessionRec.reset(new SessionRecorder(opts, rollover));
+    sessionRec->setDepthRayTable(tracker.getDepthPixelCoordsInCameraSpace());
+    recorder = sessionRec.get();
+  } else {
+    kinectRec.reset(new KinectOneRecorder(opts));
+    kinectRec->setDepthRayTable(tracker.getDepthPixelCoordsInCameraSpace());
+    recorder = kinectRec.get();
+  }
+
+  // The recorder and the stages feeding it are attached to the tracker through one router, so that with
+  // asynchronous dispatch they all run on the router's worker thread: the recorder's logs are appended from one
+  // thread whichever stages its frames come through
+  StreamRouter router;
+
+  // Optionally match the streams by timestamp, so that the recorder gets one bundle of frames per tick
+  FrameSynchronizer synchronizer;
+  KinectOneListener* skeletonSink = recorder;
+  if (synchronizeStreams) {
+    skeletonSink = &synchronizer;
+    router.attachColorListener(&synchronizer);
+    router.attachDepthListener(&synchronizer);
+  } else if (colorStage.enabled) {
+    router.attachColorListener(recorder);
+  }
+
+  // Optionally smooth joint positions and orientations before skeletons are matched or recorded
+  SkeletonFilterStage skeletonFilter;
+  if (filterSkeletons) {
+    skeletonFilter.attachListener(skeletonSink);
+    router.attachSkeletonListener(&skeletonFilter);
+  } else {
+    router.attachSkeletonListener(skeletonSink);
+  }
+
+  // Optionally pass depth frames through color registration (with the sensor's coordinate mapper, or else with
+  // the default calibration) on the way to the recorder
+  ColorRegistrationStage registration;
+  if (registerColor) {
+    registration.setMappingTracker(&tracker);
+#ifndef _WIN32
+    registration.registration().setDefaultCalibration(tracker.getDepthPixelCoordsInCameraSpace());
+#endif
+    registration.attachListener(recorder);
+    if (synchronizeStreams) {
+      synchronizer.attachListener(&registration);
+    } else {
+      router.attachColorListener(&registration);
+      router.attachDepthListener(&registration);
+    }
+  } else if (synchronizeStreams) {
+    synchronizer.attachListener(recorder);
+  } else if (depthStage.enabled) {
+    router.attachDepthListener(recorder);
+  }
+
+  // Skeletons share the router's queue with color and depth frames, so it never drops frames: when the recorder
+  // falls behind, the tracker thread waits for room instead of skeletons being evicted
+  tracker.setDispatchOptions(&router, DispatchOptions(16, Overflow_Block));
+  // Streams not recorded are not attached, so that the source does not acquire them at all
+  if (router.hasSkeletonListeners()) { tracker.attachSkeletonListener(&router); }
+  if (router.hasColorListeners()) { tracker.attachColorListener(&router); }
+  if (router.hasDepthListeners()) { tracker.attachDepthListener(&router); }
 
   // Spawn tracker thread
   std::thread trackerThread(&KinectOneTracker::run, std::ref(tracker));
@@ -40,12 +178,25 @@ int main(int argc, const char** argv) {
 
   tracker.quit();
   trackerThread.join();
-  kinectRec.stop();
+  if (synchronizeStreams) {
+    synchronizer.flush();
+    cout << "Synchronizer: " << synchronizer.stats() << endl;
+  }
+  if (useSession) {
+    // Each part has been saved as it was finalized
+    sessionRec->stop();
+    tracker.printDispatchStats(cout);
+    cout << "Session: " << sessionRec->parts().size() << " parts, index " << sessionRec->indexFile() << endl;
+  } else {
+    kinectRec->stop();
+    kinectRec->printWaitStats(cout);
+    tracker.printDispatchStats(cout);
 
-  // Dump recording to file and report
-  Recording& rec = kinectRec.getRecording();
-  const string recFile = rec.id + ".json";
-  rec.saveToJSON(recFile);
+    // Dump recording to file and report
+    Recording& rec = kinectRec->getRecording();
+    const string recFile = rec.id + ".json";
+    rec.saveToJSON(recFile);
+  }
 
   cout << "Exiting..." << endl;
 
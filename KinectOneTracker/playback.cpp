@@ -0,0 +1,91 @@
+// Replays a recording through KinectOneTracker from a PlaybackFrameSource, as if from the sensor, and reports the
+// achieved playback rate. Frames go to a listener that only counts them, or with reRecord=1 to a KinectOneRecorder
+// writing a new recording <recId>.replay, e.g. to re-encode a recording or to load test the recorder with real data.
+//
+// Usage: playback recId [speed=1 (0 = as fast as possible)] [reRecord=0] [recordFps=30] [depthDecodeThreads=2]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "./KinectOneRecorder.h"
+#include "./KinectOneTracker.h"
+#include "./PlaybackFrameSource.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+//! Listener counting the frames it is called with
+class CountingListener : public KinectOneListener {
+ public:
+  CountingListener() : numSkeletons(0), numColor(0), numDepth(0) { }
+  void onSkeleton(const Skeleton*) { ++numSkeletons; }
+  void onColor(const INT64, const UINT, const RGBQUAD*) { ++numColor; }
+  void onDepthAndBodyIndex(const INT64, const UINT, const UINT16*, const UINT, const BYTE*) { ++numDepth; }
+  std::atomic<uint64_t> numSkeletons, numColor, numDepth;
+};
+
+int main(int argc, const char** argv) {
+  if (argc < 2) {
+    cerr << "Usage: playback recId [speed=1 (0 = as fast as possible)] [reRecord=0] [recordFps=30] "
+         << "[depthDecodeThreads=2]" << endl;
+    return 1;
+  }
+  const string recId     = argv[1];
+  PlaybackOptions opts;
+  opts.speed             = (argc > 2) ? atof(argv[2]) : 1.0;
+  const bool reRecord    = (argc > 3) ? atoi(argv[3]) != 0 : false;
+  const double recordFps = (argc > 4) ? atof(argv[4]) : 30.0;
+  opts.depthDecodeThreads = (argc > 5) ? atoi(argv[5]) : 2;
+
+  std::shared_ptr<PlaybackFrameSource> source = std::make_shared<PlaybackFrameSource>(recId, opts);
+  KinectOneTracker tracker(source);
+  if (!tracker.init()) {
+    cerr << "Could not open recording " << recId << endl;
+    return 1;
+  }
+
+  CountingListener counter;
+  std::unique_ptr<KinectOneRecorder> kinectRec;
+  KinectOneListener* listener = &counter;
+  if (reRecord) {
+    RecorderOptions recOpts;
+    recOpts.id = recId + ".replay";
+    recOpts.fps = recordFps;
+    recOpts.showCapture = false;
+    kinectRec.reset(new KinectOneRecorder(recOpts));
+    kinectRec->setDepthRayTable(tracker.getDepthPixelCoordsInCameraSpace());
+    listener = kinectRec.get();
+  }
+  tracker.attachSkeletonListener(listener);
+  tracker.attachColorListener(listener);
+  tracker.attachDepthListener(listener);
+
+  cout << "Playing " << recId << " at ";
+  if (opts.speed > 0) {
+    cout << opts.speed << "x real time" << endl;
+  } else {
+    cout << "max speed" << endl;
+  }
+  std::thread trackerThread(&KinectOneTracker::run, std::ref(tracker));
+  while (!source->finished()) { std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+  tracker.quit();
+  trackerThread.join();
+
+  cout << "Playback: " << source->stats() << endl;
+  cout << "Tracker frame sets: " << tracker.getNumFrameSets() << endl;
+  if (kinectRec) {
+    kinectRec->stop();
+    Recording& rec = kinectRec->getRecording();
+    rec.saveToJSON(rec.id + ".json");
+    cout << "Re-recorded " << rec.colorTimestamps.size() << " color and " << rec.depthTimestamps.size()
+         << " depth frames and " << rec.numSkeletons() << " skeletons to " << rec.id << endl;
+  } else {
+    cout << "Received " << counter.numColor << " color and " << counter.numDepth << " depth frames and "
+         << counter.numSkeletons << " skeletons" << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+// Tests of depth and body index packing (see DepthPacking.h): pack and unpack must round-trip every 16-bit depth
+// value and every body index value exactly, in the byte layout of recorded depth frames, with and without mirroring,
+// for widths that are not a multiple of the SIMD block and for frames packed one row at a time (as the recorder's
+// depth stage packs regions of interest). The SIMD and scalar paths must produce identical output.
+//
+// Usage: test_depth_packing
+// Returns 0 if all checks pass
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./DepthPacking.h"
+
+using std::string;  using std::cout;  using std::cerr;  using std::endl;
+
+static int numFailures = 0;
+
+void check(const bool ok, const string& what) {
+  if (!ok) {
+    cerr << "FAILED: " << what << endl;
+    ++numFailures;
+  }
+}
+
+string describe(const string& name, const int width, const int height, const bool mirror, const bool simd) {
+  return name + " " + std::to_string(width) + "x" + std::to_string(height) + (mirror ? " mirrored" : "") +
+         (simd ? " simd" : " scalar");
+}
+
+//! Packs depth and bodyIndex with simd and checks the packed bytes against the layout (body index, depth low byte,
+//! depth high byte) and the unpacked images against the originals
+void checkRoundTrip(const std::vector<UINT16>& depth, const std::vector<BYTE>& bodyIndex, const int width,
+                    const int height, const bool mirror, const bool simd) {
+  const size_t n = static_cast<size_t>(width) * height;
+  std::vector<uint8_t> packed(3 * n);
+  packDepthAndBodyIndex(depth.data(), bodyIndex.data(), packed.data(), width, height, mirror, simd);
+
+  bool layoutOk = true;
+  for (int r = 0; r < height && layoutOk; ++r) {
+    for (int x = 0; x < width; ++x) {
+      const size_t src = static_cast<size_t>(r) * width + x;
+      const uint8_t* p = &packed[3 * (static_cast<size_t>(r) * width + (mirror ? width - 1 - x : x))];
+      if (p[0] != bodyIndex[src] || p[1] != (depth[src] & 0xff) || p[2] != (depth[src] >> 8)) {
+        layoutOk = false;
+        break;
+      }
+    }
+  }
+  check(layoutOk, describe("pack layout", width, height, mirror, simd));
+
+  std::vector<UINT16> depthOut(n);
+  std::vector<BYTE> bodyIndexOut(n);
+  unpackDepthAndBodyIndex(packed.data(), depthOut.data(), bodyIndexOut.data(), width, height, mirror, simd);
+  check(depthOut == depth && bodyIndexOut == bodyIndex, describe("round trip", width, height, mirror, simd));
+}
+
+//! Checks that SIMD and scalar paths give identical packed and unpacked output
+void checkPathsAgree(const std::vector<UINT16>& depth, const std::vector<BYTE>& bodyIndex, const int width,
+                     const int height, const bool mirror) {
+  const size_t n = static_cast<size_t>(width) * height;
+  std::vector<uint8_t> packedSimd(3 * n), packedScalar(3 * n);
+  packDepthAndBodyIndex(depth.data(), bodyIndex.data(), packedSimd.data(), width, height, mirror, true);
+  packDepthAndBodyIndex(depth.data(), bodyIndex.data(), packedScalar.data(), width, height, mirror, false);
+  check(packedSimd == packedScalar, describe("pack simd == scalar", width, height, mirror, true));
+
+  std::vector<UINT16> depthSimd(n), depthScalar(n);
+  std::vector<BYTE> bodyIndexSimd(n), bodyIndexScalar(n);
+  unpackDepthAndBodyIndex(packedSimd.data(), depthSimd.data(), bodyIndexSimd.data(), width, height, mirror, true);
+  unpackDepthAndBodyIndex(packedSimd.data(), depthScalar.data(), bodyIndexScalar.data(), width, height, mirror,
+                          false);
+  check(depthSimd == depthScalar && bodyIndexSimd == bodyIndexScalar,
+        describe("unpack simd == scalar", width, height, mirror, true));
+}
+
+//! Packs a width x height frame one row at a time into rows of a frame of frameWidth pixels starting at column x0,
+//! as DepthStreamStage::pack does for a region of interest, and checks it against packing the region as a whole
+void checkRowWise(const int frameWidth, const int height, const int x0, const int width) {
+  std::vector<UINT16> depth(static_cast<size_t>(frameWidth) * height);
+  std::vector<BYTE> bodyIndex(depth.size());
+  for (size_t i = 0; i < depth.size(); ++i) {
+    depth[i] = static_cast<UINT16>(i * 7919);
+    bodyIndex[i] = static_cast<BYTE>(i * 31);
+  }
+  std::vector<UINT16> regionDepth;
+  std::vector<BYTE> regionBodyIndex;
+  for (int r = 0; r < height; ++r) {
+    const size_t row = static_cast<size_t>(r) * frameWidth + x0;
+    regionDepth.insert(regionDepth.end(), depth.begin() + row, depth.begin() + row + width);
+    regionBodyIndex.insert(regionBodyIndex.end(), bodyIndex.begin() + row, bodyIndex.begin() + row + width);
+  }
+  std::vector<uint8_t> whole(3 * regionDepth.size());
+  packDepthAndBodyIndex(regionDepth.data(), regionBodyIndex.data(), whole.data(), width, height);
+
+  for (int simd = 0; simd < 2; ++simd) {
+    // Bytes past the region are guarded, so that a kernel writing past a row shows up as a mismatch
+    std::vector<uint8_t> rows(whole.size() + 64, 0xAB);
+    for (int r = 0; r < height; ++r) {
+      const size_t row = static_cast<size_t>(r) * frameWidth + x0;
+      packDepthAndBodyIndex(&depth[row], &bodyIndex[row], &rows[3 * r * width], width, 1, false, simd != 0);
+    }
+    bool guardOk = true;
+    for (size_t i = whole.size(); i < rows.size(); ++i) { guardOk = guardOk && rows[i] == 0xAB; }
+    rows.resize(whole.size());
+    check(rows == whole && guardOk, describe("row-wise pack at column " + std::to_string(x0) + " of " +
+                                             std::to_string(frameWidth), width, height, false, simd != 0));
+  }
+}
+
+int main() {
+  // Every 16-bit depth value once, with every body index value (including 255, no body) repeated across them
+  const int kAllWidth = 256, kAllHeight = 256;
+  std::vector<UINT16> allDepth(kAllWidth * kAllHeight);
+  std::vector<BYTE> allBodyIndex(allDepth.size());
+  for (size_t i = 0; i < allDepth.size(); ++i) {
+    allDepth[i] = static_cast<UINT16>(i);
+    allBodyIndex[i] = static_cast<BYTE>((i * 7) >> 3);
+  }
+  const std::vector<UINT16> tailDepth(allDepth.begin(), allDepth.begin() + 4095 * 16);
+  const std::vector<BYTE> tailBodyIndex(allBodyIndex.begin(), allBodyIndex.begin() + 4095 * 16);
+  for (int mirror = 0; mirror < 2; ++mirror) {
+    for (int simd = 0; simd < 2; ++simd) {
+      checkRoundTrip(allDepth, allBodyIndex, kAllWidth, kAllHeight, mirror != 0, simd != 0);
+      // The same values as a single row, and most of them as rows of a width that is not a multiple of the block
+      checkRoundTrip(allDepth, allBodyIndex, kAllWidth * kAllHeight, 1, mirror != 0, simd != 0);
+      checkRoundTrip(tailDepth, tailBodyIndex, 4095, 16, mirror != 0, simd != 0);
+    }
+    checkPathsAgree(allDepth, allBodyIndex, kAllWidth, kAllHeight, mirror != 0);
+  }
+
+  // Widths around the SIMD block of 16 pixels, so that each has a scalar tail of a different length
+  for (int width = 1; width <= 67; ++width) {
+    const int height = 3;
+    std::vector<UINT16> depth(width * height);
+    std::vector<BYTE> bodyIndex(depth.size());
+    for (size_t i = 0; i < depth.size(); ++i) {
+      depth[i] = static_cast<UINT16>(65535 - i * 257);
+      bodyIndex[i] = static_cast<BYTE>(255 - i);
+    }
+    for (int mirror = 0; mirror < 2; ++mirror) {
+      for (int simd = 0; simd < 2; ++simd) { checkRoundTrip(depth, bodyIndex, width, height, mirror != 0, simd != 0); }
+      checkPathsAgree(depth, bodyIndex, width, height, mirror != 0);
+    }
+  }
+
+  // Regions of a 512 pixel wide depth frame packed row by row, at aligned and unaligned columns
+  const int kRegionWidths[] = { 1, 15, 16, 17, 33, 255, 256, 512 };
+  for (const int width : kRegionWidths) {
+    checkRowWise(512, 5, 0, width);
+    if (width < 512) { checkRowWise(512, 5, 512 - width, width); }
+    if (width <= 500) { checkRowWise(512, 5, 7, width); }
+  }
+
+  if (numFailures > 0) {
+    cerr << numFailures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "All depth packing checks passed" << endl;
+  return 0;
+}